@@ -0,0 +1,159 @@
+/**
+ * @file binson_array_bench.cpp
+ *
+ * One large top level array of objects: walking it with binson_parser_next(),
+ * finding the element boundaries with binson_array_iter_spans(), and
+ * verifying and deserializing the elements on 1 to N threads.
+ *
+ * Usage: binson_array_bench [elements] [max threads]
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "binson_batch.hpp"
+
+/*======= Type Definitions ==================================================*/
+
+struct Event
+{
+    int64_t id;
+    std::string kind;
+    double latency;
+    bool ok;
+    std::vector<int64_t> tags;
+};
+BINSON_FIELDS(Event, id, kind, latency, ok, tags)
+
+/*======= Local variable declarations =======================================*/
+
+using namespace std;
+
+/*======= Local function implementations ====================================*/
+
+static double seconds(chrono::steady_clock::time_point start)
+{
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return (elapsed > 0.0) ? elapsed : 1e-9;
+}
+
+static vector<uint8_t> make_array(size_t count)
+{
+    static const char *kinds[] = { "click", "view", "purchase", "error" };
+    uint8_t empty;
+    vector<uint8_t> data;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        binson_writer w;
+        binson_writer_init(&w, pass ? data.data() : &empty, data.size());
+        binson_write_array_begin(&w);
+        for (size_t i = 0; i < count; i++)
+        {
+            Event e;
+            e.id = static_cast<int64_t>(i);
+            e.kind = kinds[i % 4];
+            e.latency = static_cast<double>(i % 1000) / 7.0;
+            e.ok = (i % 13) != 0;
+            e.tags.assign(i % 5, static_cast<int64_t>(i % 300));
+            binsonSerialize(e, &w);
+        }
+        binson_write_array_end(&w);
+        data.resize(binson_writer_get_counter(&w));
+    }
+
+    return data;
+}
+
+static void report(const char *name, size_t threads, size_t bytes, size_t count,
+                   double elapsed, double single)
+{
+    if (threads > 0)
+        printf("  %-28s %3zu threads %9.1f MB/s %7.2f M elements/s  speedup %.2f\n",
+               name, threads, bytes / elapsed / 1e6, count / elapsed / 1e6, single / elapsed);
+    else
+        printf("  %-40s %9.1f MB/s %7.2f M elements/s\n",
+               name, bytes / elapsed / 1e6, count / elapsed / 1e6);
+}
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    size_t count = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 1000000;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = (argc > 2) ? strtoul(argv[2], nullptr, 10)
+                                    : ((online > 0) ? static_cast<size_t>(online) : 1);
+    vector<uint8_t> data = make_array(count);
+    vector<bbuf> spans(count);
+    chrono::steady_clock::time_point start;
+    binson_message_iter iter;
+    binson_parser p;
+    size_t seen = 0;
+
+    if (max_threads == 0)
+        max_threads = 1;
+    printf("%zu elements, %zu bytes, %ld online processors\n", count, data.size(), online);
+
+    /* Baseline: the parser steps over every element in order. */
+    start = chrono::steady_clock::now();
+    binson_parser_init_array(&p, data.data(), data.size());
+    binson_parser_go_into_array(&p);
+    while (binson_parser_next(&p))
+        seen++;
+    report("binson_parser_next walk", 0, data.size(), seen, seconds(start), 0.0);
+
+    start = chrono::steady_clock::now();
+    binson_array_iter_init(&iter, data.data(), data.size());
+    seen = binson_array_iter_spans(&iter, spans.data(), spans.size());
+    report("binson_array_iter_spans", 0, data.size(), seen, seconds(start), 0.0);
+
+    /* Baseline: deserialize the elements one after the other. */
+    {
+        vector<Event> out(seen);
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < seen; i++)
+            binsonDeserialize(out[i], spans[i].bptr, spans[i].bsize);
+        report("sequential binsonDeserialize", 0, data.size(), seen, seconds(start), 0.0);
+    }
+
+    double single = 0.0;
+    for (size_t threads = 1; threads > 0; threads = (threads >= max_threads) ? 0 :
+         ((threads * 2 < max_threads) ? threads * 2 : max_threads))
+    {
+        binson_batch batch;
+        binson_batch_init(&batch);
+        batch.threads = threads;
+
+        start = chrono::steady_clock::now();
+        binson_batch_verify_array(&batch, data.data(), data.size(), nullptr, 0);
+        double elapsed = seconds(start);
+        if (threads == 1)
+            single = elapsed;
+        report("binson_batch_verify_array", batch.threads_used, data.size(),
+               batch.count, elapsed, single);
+    }
+
+    for (size_t threads = 1; threads > 0; threads = (threads >= max_threads) ? 0 :
+         ((threads * 2 < max_threads) ? threads * 2 : max_threads))
+    {
+        vector<Event> out;
+
+        start = chrono::steady_clock::now();
+        binson_err err = binsonDeserializeArray(out, data.data(), data.size(), threads);
+        double elapsed = seconds(start);
+        if (threads == 1)
+            single = elapsed;
+        report((err == BINSON_ERROR_NONE) ? "binsonDeserializeArray<Event>" : "FAILED",
+               threads, data.size(), out.size(), elapsed, single);
+    }
+
+    return 0;
+}
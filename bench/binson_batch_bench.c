@@ -0,0 +1,183 @@
+/**
+ * @file binson_batch_bench.c
+ *
+ * binson_batch_verify() scaling from one thread to all online processors,
+ * plain and with a callback reading one field of each message. Every 64th
+ * message is large, so the shares of the threads are uneven and have to
+ * be balanced by stealing.
+ *
+ * Usage: binson_batch_bench [messages] [max threads]
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "binson_batch.h"
+#include "binson_writer.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define LARGE_EVERY     (64U)
+#define LARGE_FIELDS    (200U)
+
+/*======= Local function prototypes =========================================*/
+
+static size_t build_message(uint8_t *buffer, size_t size, size_t n);
+static binson_err read_sequence(void *context, size_t n, binson_parser *parser);
+static double run(binson_batch *batch, const bbuf *messages, size_t count,
+                  binson_err *results);
+static size_t next_threads(size_t threads, size_t max_threads);
+static double now(void);
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    size_t count = (argc > 1) ? strtoul(argv[1], NULL, 10) : 200000;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = (argc > 2) ? strtoul(argv[2], NULL, 10)
+                                    : ((online > 0) ? (size_t) online : 1);
+    bbuf *messages = malloc(count * sizeof(bbuf));
+    binson_err *results = malloc(count * sizeof(binson_err));
+    size_t capacity = count * 200 + (count / LARGE_EVERY + 1) * LARGE_FIELDS * 32;
+    uint8_t *data = malloc(capacity);
+    size_t total = 0;
+    int pass;
+    size_t i;
+
+    if ((NULL == messages) || (NULL == results) || (NULL == data) ||
+        (0 == count) || (0 == max_threads)) {
+        printf("Could not set up %zu messages\n", count);
+        free(messages);
+        free(results);
+        free(data);
+        return 1;
+    }
+
+    for (i = 0; i < count; i++) {
+        messages[i].bptr = &data[total];
+        messages[i].bsize = build_message(&data[total], capacity - total, i);
+        total += messages[i].bsize;
+    }
+
+    printf("%zu messages, %zu bytes, %ld online processors\n", count, total, online);
+
+    for (pass = 0; pass < 2; pass++) {
+        double single = 0.0;
+        size_t threads;
+
+        printf("%s\n", pass ? "verify + read field" : "verify");
+        for (threads = 1; threads > 0; threads = next_threads(threads, max_threads)) {
+            binson_batch batch;
+            double elapsed;
+
+            binson_batch_init(&batch);
+            batch.threads = threads;
+            if (pass) {
+                batch.callback = read_sequence;
+            }
+
+            elapsed = run(&batch, messages, count, results);
+            if (1 == threads) {
+                single = elapsed;
+            }
+            printf("  %3zu threads (%3zu used) %10.1f MB/s %8.2f M msg/s  speedup %.2f%s\n",
+                   threads, batch.threads_used,
+                   (double) total / elapsed / 1e6, (double) count / elapsed / 1e6,
+                   single / elapsed, (batch.failed > 0) ? "  FAILED" : "");
+        }
+    }
+
+    free(messages);
+    free(results);
+    free(data);
+
+    return 0;
+}
+
+/*======= Local function implementations ====================================*/
+
+/* Best of three runs, in wall clock seconds. */
+static double run(binson_batch *batch, const bbuf *messages, size_t count,
+                  binson_err *results)
+{
+    double best = 0.0;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        double start = now();
+        double elapsed;
+
+        binson_batch_verify(batch, messages, count, results);
+        elapsed = now() - start;
+        if ((0 == i) || (elapsed < best)) {
+            best = elapsed;
+        }
+    }
+
+    return (best > 0.0) ? best : 1e-9;
+}
+
+static size_t build_message(uint8_t *buffer, size_t size, size_t n)
+{
+    binson_writer w;
+    size_t fields = (n % LARGE_EVERY == 0) ? LARGE_FIELDS : 4;
+    size_t i;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "a");
+    binson_write_array_begin(&w);
+    for (i = 0; i < fields; i++) {
+        binson_write_integer(&w, (int64_t) (n * 7 + i));
+        binson_write_string(&w, "sensor-reading");
+    }
+    binson_write_array_end(&w);
+    binson_write_name(&w, "b");
+    binson_write_double(&w, (double) n / 3.0);
+    binson_write_name(&w, "sequence");
+    binson_write_integer(&w, (int64_t) n);
+    binson_write_object_end(&w);
+
+    return binson_writer_get_counter(&w);
+}
+
+static binson_err read_sequence(void *context, size_t n, binson_parser *parser)
+{
+    (void) context;
+
+    if (!binson_parser_go_into_object(parser) ||
+        !binson_parser_field(parser, "sequence") ||
+        (binson_parser_get_integer(parser) != (int64_t) n)) {
+        return BINSON_ERROR_FORMAT;
+    }
+
+    return BINSON_ERROR_NONE;
+}
+
+/* Powers of two and then max_threads itself, 0 after that. */
+static size_t next_threads(size_t threads, size_t max_threads)
+{
+    if (threads >= max_threads) {
+        return 0;
+    }
+
+    return (threads * 2 < max_threads) ? threads * 2 : max_threads;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
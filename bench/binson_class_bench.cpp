@@ -0,0 +1,134 @@
+/**
+ * @file binson_class_bench.cpp
+ *
+ * Compares the throwing and the non-throwing Binson deserialization on
+ * malformed and on valid input.
+ *
+ * Usage: binson_class_bench [iterations]
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <chrono>
+#include <vector>
+
+#include "binson.hpp"
+
+/*======= Local Macro Definitions ===========================================*/
+/*======= Local function prototypes =========================================*/
+/*======= Local variable declarations =======================================*/
+
+using namespace std;
+
+static uint32_t lcg_state = 12345;
+
+/*======= Local function implementations ====================================*/
+
+static uint32_t lcg(void)
+{
+    lcg_state = lcg_state * 1103515245U + 12345U;
+    return lcg_state >> 8;
+}
+
+static vector<uint8_t> valid_message(void)
+{
+    Binson b;
+    vector<BinsonValue> array;
+
+    for (int i = 0; i < 16; i++)
+    {
+        array.push_back(Binson().put("id", i).put("name", "element"));
+    }
+
+    b.put("array", array);
+    b.put("bytes", vector<uint8_t>(64, 0xAB));
+    b.put("count", 123456789);
+    b.put("nested", Binson().put("a", 1.5).put("b", true).put("c", "text"));
+    b.put("value", -42);
+
+    return b.serialize();
+}
+
+/* Mutated copies of a valid message that the parser rejects. */
+static vector<vector<uint8_t>> malformed_messages(const vector<uint8_t> &valid, size_t count)
+{
+    vector<vector<uint8_t>> corpus;
+    Binson b;
+
+    while (corpus.size() < count)
+    {
+        vector<uint8_t> bad = valid;
+        if (lcg() & 1U)
+            bad.resize(1 + lcg() % (bad.size() - 1));
+        else
+            bad[lcg() % bad.size()] = static_cast<uint8_t>(lcg());
+        if (b.tryDeserialize(bad) != BINSON_ERROR_NONE)
+            corpus.push_back(bad);
+    }
+
+    return corpus;
+}
+
+template <typename F>
+static void run(const char *name, const vector<vector<uint8_t>> &corpus, size_t iterations, F f)
+{
+    size_t failures = 0;
+    auto start = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; i++)
+    {
+        for (auto &msg : corpus)
+        {
+            failures += f(msg) ? 0 : 1;
+        }
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    double messages = static_cast<double>(iterations * corpus.size());
+    printf("%-28s %12.0f msg/s (%zu rejected)\n", name, messages / elapsed.count(), failures);
+}
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    size_t iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : 200;
+    vector<uint8_t> valid = valid_message();
+    vector<vector<uint8_t>> bad = malformed_messages(valid, 1000);
+    vector<vector<uint8_t>> good(1000, valid);
+
+    printf("Message size %zu bytes, %zu messages x %zu iterations\n",
+           valid.size(), bad.size(), iterations);
+
+    run("malformed deserialize()", bad, iterations, [](const vector<uint8_t> &msg) {
+        try {
+            Binson b;
+            b.deserialize(msg);
+            return true;
+        } catch (const std::runtime_error &e) {
+            return false;
+        }
+    });
+
+    run("malformed tryDeserialize()", bad, iterations, [](const vector<uint8_t> &msg) {
+        Binson b;
+        return b.tryDeserialize(msg) == BINSON_ERROR_NONE;
+    });
+
+    run("valid deserialize()", good, iterations, [](const vector<uint8_t> &msg) {
+        Binson b;
+        b.deserialize(msg);
+        return true;
+    });
+
+    run("valid tryDeserialize()", good, iterations, [](const vector<uint8_t> &msg) {
+        Binson b;
+        return b.tryDeserialize(msg) == BINSON_ERROR_NONE;
+    });
+
+    return 0;
+}
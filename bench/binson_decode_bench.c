@@ -0,0 +1,182 @@
+/**
+ * @file binson_decode_bench.c
+ *
+ * Integer and double decode/encode throughput on an integer heavy and a
+ * double heavy corpus. Built twice: binson_decode_bench uses the little
+ * endian memcpy fast paths where the host allows it, and
+ * binson_decode_bench_portable compiles the parser and the writer with
+ * BINSON_PORTABLE_ENDIAN to measure the byte by byte loops.
+ *
+ * Usage: binson_decode_bench [iterations]
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "binson_light.h"
+
+#ifdef BINSON_LITTLE_ENDIAN
+#define BENCH_BUILD "little endian fast path"
+#else
+#define BENCH_BUILD "portable"
+#endif
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define ELEMENTS    (4096U)
+
+/*======= Local function prototypes =========================================*/
+
+static size_t encode_ints(uint8_t *buffer, size_t size);
+static size_t encode_doubles(uint8_t *buffer, size_t size);
+static size_t decode_ints(uint8_t *buffer, size_t size);
+static size_t decode_doubles(uint8_t *buffer, size_t size);
+static void run(const char *name,
+                size_t (*f)(uint8_t *, size_t),
+                uint8_t *buffer,
+                size_t size,
+                size_t iterations);
+
+/*======= Local variable declarations =======================================*/
+
+static int64_t ints[ELEMENTS];
+static double doubles[ELEMENTS];
+static uint8_t int_corpus[ELEMENTS * 9 + 16];
+static uint8_t double_corpus[ELEMENTS * 9 + 16];
+static volatile double sink;
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    size_t iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000;
+    size_t int_size;
+    size_t double_size;
+    uint32_t i;
+
+    for (i = 0; i < ELEMENTS; i++) {
+        /* Widths cycle through 1, 2, 4 and 8 bytes. */
+        static const int64_t scale[4] = { 1, 300, 100000, INT64_C(10000000000) };
+        ints[i] = (int64_t) (i % 97) * scale[i % 4] * ((i & 1U) ? -1 : 1);
+        doubles[i] = i * 1.25 - 1000.0;
+    }
+
+    int_size = encode_ints(int_corpus, sizeof(int_corpus));
+    double_size = encode_doubles(double_corpus, sizeof(double_corpus));
+    if ((int_size == 0) || (double_size == 0)) {
+        printf("Could not build corpus\n");
+        return 1;
+    }
+
+    printf("%s: %u values per corpus, %zu iterations\n",
+           BENCH_BUILD, ELEMENTS, iterations);
+
+    run("decode integers", decode_ints, int_corpus, int_size, iterations);
+    run("decode doubles", decode_doubles, double_corpus, double_size, iterations);
+    run("encode integers", encode_ints, int_corpus, sizeof(int_corpus), iterations);
+    run("encode doubles", encode_doubles, double_corpus, sizeof(double_corpus), iterations);
+
+    return 0;
+}
+
+/*======= Local function implementations ====================================*/
+
+/* { "v": [ ... ] } */
+static size_t encode_ints(uint8_t *buffer, size_t size)
+{
+    binson_writer w;
+    uint32_t i;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "v");
+    binson_write_array_begin(&w);
+    for (i = 0; i < ELEMENTS; i++) {
+        binson_write_integer(&w, ints[i]);
+    }
+    binson_write_array_end(&w);
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+static size_t encode_doubles(uint8_t *buffer, size_t size)
+{
+    binson_writer w;
+    uint32_t i;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "v");
+    binson_write_array_begin(&w);
+    for (i = 0; i < ELEMENTS; i++) {
+        binson_write_double(&w, doubles[i]);
+    }
+    binson_write_array_end(&w);
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+static size_t decode_ints(uint8_t *buffer, size_t size)
+{
+    binson_parser p;
+    int64_t sum = 0;
+
+    binson_parser_init(&p, buffer, size);
+    binson_parser_go_into_object(&p);
+    binson_parser_field(&p, "v");
+    binson_parser_go_into_array(&p);
+    while (binson_parser_next(&p)) {
+        sum += binson_parser_get_integer(&p);
+    }
+    sink = (double) sum;
+
+    return size;
+}
+
+static size_t decode_doubles(uint8_t *buffer, size_t size)
+{
+    binson_parser p;
+    double sum = 0.0;
+
+    binson_parser_init(&p, buffer, size);
+    binson_parser_go_into_object(&p);
+    binson_parser_field(&p, "v");
+    binson_parser_go_into_array(&p);
+    while (binson_parser_next(&p)) {
+        sum += binson_parser_get_double(&p);
+    }
+    sink = sum;
+
+    return size;
+}
+
+static void run(const char *name,
+                size_t (*f)(uint8_t *, size_t),
+                uint8_t *buffer,
+                size_t size,
+                size_t iterations)
+{
+    size_t bytes = 0;
+    size_t i;
+    clock_t start = clock();
+
+    for (i = 0; i < iterations; i++) {
+        bytes += f(buffer, size);
+    }
+
+    double elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+    if (elapsed <= 0.0) {
+        elapsed = 1e-9;
+    }
+
+    printf("%-24s %10.1f MB/s %12.0f values/s\n",
+           name,
+           (double) bytes / elapsed / 1e6,
+           (double) (iterations * ELEMENTS) / elapsed);
+}
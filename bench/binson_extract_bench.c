@@ -0,0 +1,216 @@
+/**
+ * @file binson_extract_bench.c
+ *
+ * Value extraction throughput of the parser. Built twice: linked against
+ * the split binson_parser/binson_writer libraries, and as
+ * binson_extract_bench_amalgamated with the whole library compiled into
+ * this translation unit from binson_light_amalgamated.h. Each binary runs
+ * the extraction loop with the out-of-line and with the inline accessors,
+ * and with the bulk array readers.
+ *
+ * Usage: binson_extract_bench [iterations]
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef BINSON_BENCH_AMALGAMATED
+#define BINSON_LIGHT_IMPLEMENTATION
+#include "binson_light_amalgamated.h"
+#define BENCH_BUILD "amalgamated"
+#else
+#include "binson_light.h"
+#define BENCH_BUILD "split libraries"
+#endif
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define ELEMENTS    (256U)
+
+/*======= Local function prototypes =========================================*/
+
+static size_t build_message(uint8_t *buffer, size_t size);
+static double extract(const uint8_t *buffer, size_t size);
+static double extract_inline(const uint8_t *buffer, size_t size);
+static double extract_bulk(const uint8_t *buffer, size_t size);
+static void run(const char *name,
+                double (*f)(const uint8_t *, size_t),
+                const uint8_t *buffer,
+                size_t size,
+                size_t iterations);
+
+/*======= Local variable declarations =======================================*/
+
+static uint8_t message[16 * ELEMENTS + 64];
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    size_t iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000;
+    size_t size = build_message(message, sizeof(message));
+
+    if (size == 0) {
+        printf("Could not build message\n");
+        return 1;
+    }
+
+    printf("%s: message size %zu bytes, 3 x %u values, %zu iterations\n",
+           BENCH_BUILD, size, ELEMENTS, iterations);
+
+    run("out-of-line accessors", extract, message, size, iterations);
+    run("inline accessors", extract_inline, message, size, iterations);
+    run("bulk array readers", extract_bulk, message, size, iterations);
+
+    return 0;
+}
+
+/*======= Local function implementations ====================================*/
+
+/* { "doubles": [...], "flags": [...], "ints": [...] } */
+static size_t build_message(uint8_t *buffer, size_t size)
+{
+    binson_writer w;
+    uint32_t i;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+
+    binson_write_name(&w, "doubles");
+    binson_write_array_begin(&w);
+    for (i = 0; i < ELEMENTS; i++) {
+        binson_write_double(&w, i * 0.5);
+    }
+    binson_write_array_end(&w);
+
+    binson_write_name(&w, "flags");
+    binson_write_array_begin(&w);
+    for (i = 0; i < ELEMENTS; i++) {
+        binson_write_boolean(&w, (i & 1U) != 0);
+    }
+    binson_write_array_end(&w);
+
+    binson_write_name(&w, "ints");
+    binson_write_array_begin(&w);
+    for (i = 0; i < ELEMENTS; i++) {
+        /* Mix of 1, 2 and 4 byte integers. */
+        binson_write_integer(&w, (int64_t) i * (int64_t) i * ((i & 1U) ? -1 : 1));
+    }
+    binson_write_array_end(&w);
+
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+/*
+ * The same loop is instantiated for both accessor flavours so the only
+ * difference between the two runs is how the accessors are called.
+ */
+#define EXTRACT_BODY(get_double, get_boolean, get_integer)          \
+    binson_parser p;                                                \
+    double sum = 0.0;                                               \
+                                                                    \
+    binson_parser_init(&p, buffer, size);                           \
+    binson_parser_go_into_object(&p);                               \
+                                                                    \
+    binson_parser_field(&p, "doubles");                             \
+    binson_parser_go_into_array(&p);                                \
+    while (binson_parser_next(&p)) {                                \
+        sum += get_double(&p);                                      \
+    }                                                               \
+    binson_parser_leave_array(&p);                                  \
+                                                                    \
+    binson_parser_field(&p, "flags");                               \
+    binson_parser_go_into_array(&p);                                \
+    while (binson_parser_next(&p)) {                                \
+        sum += get_boolean(&p) ? 1.0 : 0.0;                         \
+    }                                                               \
+    binson_parser_leave_array(&p);                                  \
+                                                                    \
+    binson_parser_field(&p, "ints");                                \
+    binson_parser_go_into_array(&p);                                \
+    while (binson_parser_next(&p)) {                                \
+        sum += (double) get_integer(&p);                            \
+    }                                                               \
+    binson_parser_leave_array(&p);                                  \
+                                                                    \
+    return sum;
+
+static double extract(const uint8_t *buffer, size_t size)
+{
+    EXTRACT_BODY(binson_parser_get_double,
+                 binson_parser_get_boolean,
+                 binson_parser_get_integer)
+}
+
+static double extract_inline(const uint8_t *buffer, size_t size)
+{
+    EXTRACT_BODY(binson_parser_get_double_inline,
+                 binson_parser_get_boolean_inline,
+                 binson_parser_get_integer_inline)
+}
+
+static double extract_bulk(const uint8_t *buffer, size_t size)
+{
+    binson_parser p;
+    double doubles[ELEMENTS];
+    bool flags[ELEMENTS];
+    int64_t ints[ELEMENTS];
+    double sum = 0.0;
+    size_t n;
+    size_t i;
+
+    binson_parser_init(&p, buffer, size);
+    binson_parser_go_into_object(&p);
+
+    binson_parser_field(&p, "doubles");
+    binson_parser_read_double_array(&p, doubles, ELEMENTS, &n);
+    for (i = 0; i < n; i++) {
+        sum += doubles[i];
+    }
+
+    binson_parser_field(&p, "flags");
+    binson_parser_read_bool_array(&p, flags, ELEMENTS, &n);
+    for (i = 0; i < n; i++) {
+        sum += flags[i] ? 1.0 : 0.0;
+    }
+
+    binson_parser_field(&p, "ints");
+    binson_parser_read_int64_array(&p, ints, ELEMENTS, &n);
+    for (i = 0; i < n; i++) {
+        sum += (double) ints[i];
+    }
+
+    return sum;
+}
+
+static void run(const char *name,
+                double (*f)(const uint8_t *, size_t),
+                const uint8_t *buffer,
+                size_t size,
+                size_t iterations)
+{
+    double check = 0.0;
+    size_t i;
+    clock_t start = clock();
+
+    for (i = 0; i < iterations; i++) {
+        check += f(buffer, size);
+    }
+
+    double elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+    if (elapsed <= 0.0) {
+        elapsed = 1e-9;
+    }
+
+    printf("%-24s %10.1f MB/s %12.0f values/s (check %.0f)\n",
+           name,
+           (double) (iterations * size) / elapsed / 1e6,
+           (double) (iterations * 3 * ELEMENTS) / elapsed,
+           check);
+}
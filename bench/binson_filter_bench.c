@@ -0,0 +1,320 @@
+/**
+ * @file binson_filter_bench.c
+ *
+ * Filtering a memory mapped record file: parsing every record and looking
+ * the fields up with the parser, against binson_filter on the raw records,
+ * sequentially and with binson_filter_scan_file() on 1 to N threads. The
+ * file is written without and with field name dictionaries.
+ *
+ * Usage: binson_filter_bench [records] [max threads] [file]
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "binson_filter.h"
+#include "binson_parser.h"
+#include "binson_writer.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define QUERIES     (3U)
+
+/*======= Local function prototypes =========================================*/
+
+static size_t build_event(uint8_t *buffer, size_t size, uint64_t n);
+static bool write_file(const char *path, size_t records, bool dictionary);
+static void build_query(binson_filter *filter, size_t query);
+static bool parse_query(binson_parser *p, size_t query);
+static uint64_t parse_all(const binson_record_file *file, size_t query);
+static uint64_t match_all(const binson_record_file *file, const binson_filter *filter);
+static size_t next_threads(size_t threads, size_t max_threads);
+static double now(void);
+
+/*======= Local variable declarations =======================================*/
+
+static const char *query_names[QUERIES] = {
+    "device.id == 7",
+    "kind ^= \"pur\", latency in [10, 20]",
+    "ok == false, tag exists"
+};
+
+static uint8_t block[BINSON_RECORD_BLOCK_DEFAULT];
+static uint8_t decoded[1024];
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    size_t records = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = (argc > 2) ? strtoul(argv[2], NULL, 10)
+                                    : ((online > 0) ? (size_t) online : 1);
+    const char *path = (argc > 3) ? argv[3] : "binson_filter_bench.rec";
+    int dictionary;
+
+    if ((0 == records) || (0 == max_threads)) {
+        printf("Nothing to do\n");
+        return 1;
+    }
+
+    for (dictionary = 0; dictionary < 2; dictionary++) {
+        binson_record_file f;
+        size_t q;
+
+        if (!write_file(path, records, dictionary != 0) || !binson_record_open(&f, path)) {
+            printf("Could not write and map %s\n", path);
+            remove(path);
+            return 1;
+        }
+        printf("%zu records, %zu bytes %s, %ld online processors\n", records, f.size,
+               dictionary ? "with dictionaries" : "plain", online);
+
+        for (q = 0; q < QUERIES; q++) {
+            binson_filter filter;
+            double single = 0.0;
+            double start;
+            double parsed;
+            double elapsed;
+            uint64_t expected;
+            uint64_t matched;
+            size_t threads;
+
+            build_query(&filter, q);
+            printf("  %s\n", query_names[q]);
+
+            start = now();
+            expected = parse_all(&f, q);
+            parsed = now() - start;
+            printf("    %-30s %8.1f MB/s %7.2f M records/s %9llu matches\n",
+                   "parse + parser lookups", (double) f.size / parsed / 1e6,
+                   (double) records / parsed / 1e6, (unsigned long long) expected);
+
+            start = now();
+            matched = match_all(&f, &filter);
+            elapsed = now() - start;
+            printf("    %-30s %8.1f MB/s %7.2f M records/s %9llu matches  x%.1f%s\n",
+                   "binson_filter_match_record", (double) f.size / elapsed / 1e6,
+                   (double) records / elapsed / 1e6, (unsigned long long) matched,
+                   parsed / elapsed, (matched != expected) ? "  WRONG" : "");
+
+            for (threads = 1; threads > 0; threads = next_threads(threads, max_threads)) {
+                binson_filter_scan scan;
+
+                binson_filter_scan_init(&scan);
+                scan.threads = threads;
+                start = now();
+                binson_filter_scan_file(&scan, &filter, &f);
+                elapsed = now() - start;
+                if (1 == threads) {
+                    single = elapsed;
+                }
+                printf("    scan %3zu threads (%3zu used)    %8.1f MB/s %7.2f M records/s "
+                       "%9llu matches  speedup %.2f%s\n",
+                       threads, scan.threads_used, (double) f.size / elapsed / 1e6,
+                       (double) records / elapsed / 1e6, (unsigned long long) scan.matched,
+                       single / elapsed, (scan.matched != expected) ? "  WRONG" : "");
+            }
+        }
+
+        binson_record_close(&f);
+    }
+
+    remove(path);
+
+    return 0;
+}
+
+/*======= Local function implementations ====================================*/
+
+/* Telemetry event n, about 150 bytes. */
+static size_t build_event(uint8_t *buffer, size_t size, uint64_t n)
+{
+    static const char *kinds[] = { "click", "view", "purchase", "error" };
+    static const char *vendors[] = { "acme", "globex", "initech" };
+    binson_writer w;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "device");
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "firmware");
+    binson_write_string(&w, "4.2.1-release");
+    binson_write_name(&w, "id");
+    binson_write_integer(&w, (int64_t) (n % 1000));
+    binson_write_name(&w, "vendor");
+    binson_write_string(&w, vendors[n % 3]);
+    binson_write_object_end(&w);
+    binson_write_name(&w, "kind");
+    binson_write_string(&w, kinds[(n / 3) % 4]);
+    binson_write_name(&w, "latency");
+    binson_write_double(&w, (double) (n % 997) / 10.0);
+    binson_write_name(&w, "ok");
+    binson_write_boolean(&w, n % 13 != 0);
+    binson_write_name(&w, "sequence");
+    binson_write_integer(&w, (int64_t) n);
+    if (n % 10 == 0) {
+        binson_write_name(&w, "tag");
+        binson_write_string(&w, "sampled");
+    }
+    binson_write_name(&w, "timestamp");
+    binson_write_integer(&w, (int64_t) (1700000000000ULL + n * 250));
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+static bool write_file(const char *path, size_t records, bool dictionary)
+{
+    binson_record_writer w;
+    uint8_t event[256];
+    FILE *out = fopen(path, "wb");
+    bool ok;
+    size_t i;
+
+    if (NULL == out) {
+        return false;
+    }
+
+    ok = binson_record_writer_init(&w, binson_record_file_sink, out, block, sizeof(block)) &&
+        (!dictionary || binson_record_writer_set_dictionary(&w));
+    for (i = 0; ok && (i < records); i++) {
+        ok = binson_record_write(&w, event, build_event(event, sizeof(event), i));
+    }
+    ok = binson_record_writer_finish(&w) && ok;
+
+    return (fclose(out) == 0) && ok;
+}
+
+static void build_query(binson_filter *filter, size_t query)
+{
+    binson_filter_init(filter);
+    switch (query) {
+        case 0:
+            binson_filter_equal_integer(filter, "device.id", 7);
+            break;
+        case 1:
+            binson_filter_prefix_string(filter, "kind", "pur");
+            binson_filter_range_double(filter, "latency", 10.0, 20.0);
+            break;
+        default:
+            binson_filter_equal_boolean(filter, "ok", false);
+            binson_filter_exists(filter, "tag");
+            break;
+    }
+}
+
+/* The same queries with the parser, on a verified record. */
+static bool parse_query(binson_parser *p, size_t query)
+{
+    bbuf *s;
+    double d;
+
+    if (!binson_parser_go_into_object(p)) {
+        return false;
+    }
+
+    switch (query) {
+        case 0:
+            return binson_parser_field(p, "device") &&
+                (binson_parser_get_type(p) == BINSON_TYPE_OBJECT) &&
+                binson_parser_go_into_object(p) &&
+                binson_parser_field(p, "id") &&
+                (binson_parser_get_type(p) == BINSON_TYPE_INTEGER) &&
+                (binson_parser_get_integer(p) == 7);
+        case 1:
+            if (!binson_parser_field(p, "kind") ||
+                (binson_parser_get_type(p) != BINSON_TYPE_STRING)) {
+                return false;
+            }
+            s = binson_parser_get_string_bbuf(p);
+            if ((s->bsize < 3) || (memcmp(s->bptr, "pur", 3) != 0) ||
+                !binson_parser_field(p, "latency") ||
+                (binson_parser_get_type(p) != BINSON_TYPE_DOUBLE)) {
+                return false;
+            }
+            d = binson_parser_get_double(p);
+            return (d >= 10.0) && (d <= 20.0);
+        default:
+            return binson_parser_field(p, "ok") &&
+                (binson_parser_get_type(p) == BINSON_TYPE_BOOLEAN) &&
+                !binson_parser_get_boolean(p) &&
+                binson_parser_field(p, "tag");
+    }
+}
+
+/* Decodes and verifies every record, then runs the query with the parser. */
+static uint64_t parse_all(const binson_record_file *file, size_t query)
+{
+    uint64_t matched = 0;
+    size_t i;
+
+    for (i = 0; i < file->block_count; i++) {
+        binson_record_block b;
+        bbuf record;
+
+        if (binson_record_block_open(file, i, &b) != BINSON_ERROR_NONE) {
+            continue;
+        }
+        while (binson_record_block_next(&b, &record)) {
+            binson_parser p;
+            bbuf message;
+
+            if ((binson_record_decode(&b, &record, decoded, sizeof(decoded), &message) ==
+                 BINSON_ERROR_NONE) &&
+                binson_parser_init_object(&p, message.bptr, message.bsize) &&
+                binson_parser_verify(&p) &&
+                parse_query(&p, query)) {
+                matched++;
+            }
+        }
+    }
+
+    return matched;
+}
+
+static uint64_t match_all(const binson_record_file *file, const binson_filter *filter)
+{
+    uint64_t matched = 0;
+    size_t i;
+
+    for (i = 0; i < file->block_count; i++) {
+        binson_record_block b;
+        bbuf record;
+
+        if (binson_record_block_open(file, i, &b) != BINSON_ERROR_NONE) {
+            continue;
+        }
+        while (binson_record_block_next(&b, &record)) {
+            matched += binson_filter_match_record(filter, &b, &record) ? 1 : 0;
+        }
+    }
+
+    return matched;
+}
+
+static size_t next_threads(size_t threads, size_t max_threads)
+{
+    if (threads >= max_threads) {
+        return 0;
+    }
+
+    return (threads * 2 < max_threads) ? threads * 2 : max_threads;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
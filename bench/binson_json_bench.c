@@ -0,0 +1,126 @@
+/**
+ * @file binson_json_bench.c
+ *
+ * JSON to binson transcoding and binson to JSON emitting throughput on a
+ * batch of partner style records with unsorted keys.
+ *
+ * Usage: binson_json_bench [iterations]
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "binson_json.h"
+#include "binson_cpu.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define RECORDS     (2000U)
+
+/*======= Local function prototypes =========================================*/
+
+static size_t build_json(char *buffer, size_t size);
+static bool count_sink(void *context, const char *data, size_t size);
+
+/*======= Local variable declarations =======================================*/
+
+static char json[RECORDS * 400];
+static uint8_t output[RECORDS * 400];
+static uint8_t scratch[BINSON_JSON_SCRATCH_SIZE];
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    size_t iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : 200;
+    size_t json_size = build_json(json, sizeof(json));
+    size_t output_size = 0;
+    size_t emitted = 0;
+    binson_writer w;
+    binson_parser p;
+    clock_t start;
+    double elapsed;
+    size_t i;
+
+    if (json_size == 0) {
+        printf("Could not build document\n");
+        return 1;
+    }
+
+    printf("document %zu bytes JSON, %u records, %zu iterations, avx2 %s\n",
+           json_size, RECORDS, iterations, binson_cpu_has_avx2() ? "yes" : "no");
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        binson_writer_init(&w, output, sizeof(output));
+        if (!binson_json_transcode(&w, json, json_size, scratch, sizeof(scratch))) {
+            printf("Transcoding failed: %d\n", (int) w.error_flags);
+            return 1;
+        }
+        output_size = binson_writer_get_counter(&w);
+    }
+    elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+    elapsed = (elapsed > 0.0) ? elapsed : 1e-9;
+    printf("%-24s %10.1f MB/s JSON in, %zu bytes binson out\n",
+           "json -> binson",
+           (double) (iterations * json_size) / elapsed / 1e6,
+           output_size);
+
+    binson_parser_init_array(&p, output, output_size);
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        emitted = 0;
+        binson_json_emit(&p, 0, count_sink, &emitted);
+    }
+    elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+    elapsed = (elapsed > 0.0) ? elapsed : 1e-9;
+    printf("%-24s %10.1f MB/s JSON out\n",
+           "binson -> json",
+           (double) (iterations * emitted) / elapsed / 1e6);
+
+    return 0;
+}
+
+/*======= Local function implementations ====================================*/
+
+/* [ { "user": ..., "id": ..., ... }, ... ] with keys in no particular order. */
+static size_t build_json(char *buffer, size_t size)
+{
+    size_t used = 0;
+    uint32_t i;
+
+    used += (size_t) snprintf(&buffer[used], size - used, "[\n");
+    for (i = 0; i < RECORDS; i++) {
+        int n = snprintf(&buffer[used], size - used,
+            "  {\"user\": \"partner-%u\", \"id\": %u, \"score\": %u.%02u, "
+            "\"active\": %s, \"tags\": [\"alpha\", \"beta\", \"gamma\"], "
+            "\"comment\": \"line one\\nline \\\"two\\\" r\\u00e4ksm\\u00f6rg\\u00e5s\", "
+            "\"location\": {\"lon\": %d.%04u, \"lat\": %d.%04u}, "
+            "\"created\": %u%06u, \"counts\": [%u, %u, %u, %u]}%s\n",
+            i % 97, i * 7919U, i % 1000, i % 100,
+            (i & 1U) ? "true" : "false",
+            (int) (i % 360) - 180, i % 10000, (int) (i % 180) - 90, (i * 7U) % 10000,
+            1600000U + i, i * 13U % 1000000U,
+            i, i * 2U, i * 3U, i * 5U,
+            (i + 1 < RECORDS) ? "," : "");
+        if ((n < 0) || ((size_t) n >= size - used)) {
+            return 0;
+        }
+        used += (size_t) n;
+    }
+    used += (size_t) snprintf(&buffer[used], size - used, "]\n");
+
+    return (used < size) ? used : 0;
+}
+
+static bool count_sink(void *context, const char *data, size_t size)
+{
+    (void) data;
+    *(size_t *) context += size;
+    return true;
+}
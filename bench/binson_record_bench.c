@@ -0,0 +1,186 @@
+/**
+ * @file binson_record_bench.c
+ *
+ * Record file throughput: writing, scanning all blocks with checksum
+ * validation, and random access to single records.
+ *
+ * Usage: binson_record_bench [records]
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "binson_record.h"
+#include "binson_cpu.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define LOOKUPS     (1000000U)
+
+/*======= Type Definitions ==================================================*/
+
+typedef struct memory_sink_s {
+    uint8_t     *data;
+    size_t      size;
+    size_t      capacity;
+} memory_sink;
+
+/*======= Local function prototypes =========================================*/
+
+static bool memory_write(void *context, const uint8_t *data, size_t size);
+static size_t build_event(uint8_t *buffer, size_t size, uint64_t n);
+static double seconds(clock_t start);
+
+/*======= Local variable declarations =======================================*/
+
+static uint8_t block[BINSON_RECORD_BLOCK_DEFAULT];
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    size_t records = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    memory_sink sink = { NULL, 0, 0 };
+    binson_record_writer w;
+    binson_record_file f;
+    uint8_t event[256];
+    uint64_t checksum = 0;
+    uint64_t seed = 1;
+    size_t payload = 0;
+    size_t scanned = 0;
+    clock_t start;
+    double elapsed;
+    size_t i;
+
+    if ((0 == records) ||
+        !binson_record_writer_init(&w, memory_write, &sink, block, sizeof(block))) {
+        printf("Could not start writer\n");
+        return 1;
+    }
+
+    printf("%zu records, sse4.2 %s\n", records, binson_cpu_has_sse42() ? "yes" : "no");
+
+    start = clock();
+    for (i = 0; i < records; i++) {
+        size_t size = build_event(event, sizeof(event), i);
+
+        payload += size;
+        if (!binson_record_write(&w, event, size)) {
+            break;
+        }
+    }
+    if (!binson_record_writer_finish(&w)) {
+        printf("Writing failed: %d\n", (int) w.error_flags);
+        free(sink.data);
+        return 1;
+    }
+    elapsed = seconds(start);
+    printf("%-24s %10.1f MB/s, %zu bytes file for %zu bytes of records\n",
+           "write (with events)", (double) payload / elapsed / 1e6, sink.size, payload);
+
+    if (!binson_record_open_buffer(&f, sink.data, sink.size)) {
+        printf("Open failed: %d\n", (int) f.error_flags);
+        free(sink.data);
+        return 1;
+    }
+
+    start = clock();
+    for (i = 0; i < f.block_count; i++) {
+        binson_record_block b;
+        bbuf record;
+
+        if (binson_record_block_open(&f, i, &b) != BINSON_ERROR_NONE) {
+            printf("Block %zu is damaged\n", i);
+            break;
+        }
+        while (binson_record_block_next(&b, &record)) {
+            checksum += record.bsize;
+            scanned++;
+        }
+    }
+    elapsed = seconds(start);
+    printf("%-24s %10.1f MB/s, %zu records in %zu blocks\n",
+           "scan with crc32c", (double) sink.size / elapsed / 1e6, scanned, f.block_count);
+
+    start = clock();
+    for (i = 0; i < LOOKUPS; i++) {
+        bbuf record;
+
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        if (binson_record_get(&f, (seed >> 33) % f.record_count, &record)) {
+            checksum += record.bptr[record.bsize - 1];
+        }
+    }
+    elapsed = seconds(start);
+    printf("%-24s %10.1f M lookups/s (checksum %llu)\n",
+           "random get", (double) LOOKUPS / elapsed / 1e6, (unsigned long long) checksum);
+
+    binson_record_close(&f);
+    free(sink.data);
+
+    return 0;
+}
+
+/*======= Local function implementations ====================================*/
+
+static bool memory_write(void *context, const uint8_t *data, size_t size)
+{
+    memory_sink *sink = (memory_sink *) context;
+
+    if (size > sink->capacity - sink->size) {
+        size_t capacity = (sink->capacity > 0) ? sink->capacity : 1024 * 1024;
+        uint8_t *grown;
+
+        while (size > capacity - sink->size) {
+            capacity *= 2;
+        }
+        grown = realloc(sink->data, capacity);
+        if (NULL == grown) {
+            return false;
+        }
+        sink->data = grown;
+        sink->capacity = capacity;
+    }
+
+    memcpy(&sink->data[sink->size], data, size);
+    sink->size += size;
+
+    return true;
+}
+
+/* A telemetry style event of roughly 100 bytes. */
+static size_t build_event(uint8_t *buffer, size_t size, uint64_t n)
+{
+    static const char *kinds[] = { "click", "view", "purchase", "error" };
+    binson_writer w;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "device");
+    binson_write_integer(&w, (int64_t) (n % 5000));
+    binson_write_name(&w, "kind");
+    binson_write_string(&w, kinds[n % 4]);
+    binson_write_name(&w, "latency");
+    binson_write_double(&w, (double) (n % 1000) / 7.0);
+    binson_write_name(&w, "ok");
+    binson_write_boolean(&w, (n % 13) != 0);
+    binson_write_name(&w, "session");
+    binson_write_string(&w, "5f0c1a2b-7d3e-4c8f");
+    binson_write_name(&w, "time");
+    binson_write_integer(&w, (int64_t) (1600000000000ULL + n * 17));
+    binson_write_object_end(&w);
+
+    return binson_writer_get_counter(&w);
+}
+
+static double seconds(clock_t start)
+{
+    double elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    return (elapsed > 0.0) ? elapsed : 1e-9;
+}
@@ -0,0 +1,384 @@
+/**
+ * @file binson_record_dict_bench.c
+ *
+ * Field name dictionaries in record files: file size without and with
+ * dictionaries, and the throughput of reading every record back as binson
+ * (decode plus binson_parser_verify()).
+ *
+ * Two data sets are used: synthetic telemetry records and the messages of a
+ * corpus directory such as utest/test_data/valid_objects, repeated until
+ * the set is a few megabytes.
+ *
+ * Usage: binson_record_dict_bench [records] [corpus directory]
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "binson_record.h"
+#include "binson_parser.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#ifndef BINSON_TEST_DATA
+#define BINSON_TEST_DATA "utest/test_data"
+#endif
+
+#define CORPUS_TARGET   (4U * 1024U * 1024U)
+#define READ_TARGET     (64U * 1024U * 1024U)
+#define MESSAGE_MAX     (64U * 1024U)
+
+/*======= Type Definitions ==================================================*/
+
+typedef struct memory_sink_s {
+    uint8_t     *data;
+    size_t      size;
+    size_t      capacity;
+} memory_sink;
+
+/* Messages back to back, ends[i] is where message i ends. */
+typedef struct message_set_s {
+    memory_sink bytes;
+    size_t      *ends;
+    size_t      count;
+    size_t      capacity;
+} message_set;
+
+/*======= Local function prototypes =========================================*/
+
+static bool memory_reserve(memory_sink *sink, size_t size);
+static bool memory_write(void *context, const uint8_t *data, size_t size);
+static bool add_message(message_set *set, const uint8_t *message, size_t size);
+static bool build_telemetry(message_set *set, size_t records);
+static bool load_corpus(message_set *set, const char *path);
+static void run(const char *name, const message_set *set);
+static bool write_file(const message_set *set, bool dictionary, memory_sink *file);
+static double read_all(const memory_sink *file);
+static double seconds(clock_t start);
+
+/*======= Local variable declarations =======================================*/
+
+static uint8_t block[BINSON_RECORD_BLOCK_DEFAULT];
+static uint8_t decoded[MESSAGE_MAX];
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    size_t records = (argc > 1) ? strtoul(argv[1], NULL, 10) : 200000;
+    const char *path = (argc > 2) ? argv[2] : BINSON_TEST_DATA "/valid_objects";
+    message_set telemetry;
+    message_set corpus;
+
+    memset(&telemetry, 0, sizeof(telemetry));
+    memset(&corpus, 0, sizeof(corpus));
+
+    if ((records > 0) && build_telemetry(&telemetry, records)) {
+        run("telemetry", &telemetry);
+    }
+    else {
+        printf("Could not build telemetry records\n");
+    }
+
+    if (load_corpus(&corpus, path)) {
+        run(path, &corpus);
+    }
+    else {
+        printf("No messages in %s\n", path);
+    }
+
+    free(telemetry.bytes.data);
+    free(telemetry.ends);
+    free(corpus.bytes.data);
+    free(corpus.ends);
+
+    return 0;
+}
+
+/*======= Local function implementations ====================================*/
+
+static void run(const char *name, const message_set *set)
+{
+    memory_sink plain = { NULL, 0, 0 };
+    memory_sink packed = { NULL, 0, 0 };
+
+    printf("%s: %zu records, %zu bytes\n", name, set->count, set->bytes.size);
+
+    if (write_file(set, false, &plain) && write_file(set, true, &packed)) {
+        double rate;
+
+        printf("  %-22s %10zu bytes\n", "plain file", plain.size);
+        printf("  %-22s %10zu bytes, %.1f %% of plain, ratio %.2f\n",
+               "dictionary file", packed.size,
+               100.0 * (double) packed.size / (double) plain.size,
+               (double) plain.size / (double) packed.size);
+
+        rate = read_all(&plain);
+        printf("  %-22s %10.1f MB/s of binson\n", "read + verify plain", rate / 1e6);
+        rate = read_all(&packed);
+        printf("  %-22s %10.1f MB/s of binson\n", "read + verify dict", rate / 1e6);
+    }
+    else {
+        printf("  Writing failed\n");
+    }
+
+    free(plain.data);
+    free(packed.data);
+}
+
+static bool write_file(const message_set *set, bool dictionary, memory_sink *file)
+{
+    binson_record_writer w;
+    size_t start = 0;
+    size_t i;
+    bool ok;
+
+    if (!binson_record_writer_init(&w, memory_write, file, block, sizeof(block))) {
+        return false;
+    }
+
+    ok = !dictionary || binson_record_writer_set_dictionary(&w);
+    for (i = 0; ok && (i < set->count); i++) {
+        ok = binson_record_write(&w, &set->bytes.data[start], set->ends[i] - start);
+        start = set->ends[i];
+    }
+
+    return binson_record_writer_finish(&w) && ok;
+}
+
+/*
+ * Reads all records of the file repeatedly, about READ_TARGET bytes in
+ * total, and returns the rate in binson bytes per second.
+ */
+static double read_all(const memory_sink *file)
+{
+    binson_record_file f;
+    size_t total = 0;
+    clock_t start;
+
+    if (!binson_record_open_buffer(&f, file->data, file->size)) {
+        return 0.0;
+    }
+
+    start = clock();
+    do {
+        size_t pass = 0;
+        size_t i;
+
+        for (i = 0; i < f.block_count; i++) {
+            binson_record_block b;
+            bbuf record;
+
+            if (binson_record_block_open(&f, i, &b) != BINSON_ERROR_NONE) {
+                printf("  Block %zu is damaged\n", i);
+                binson_record_close(&f);
+                return 0.0;
+            }
+            while (binson_record_block_next(&b, &record)) {
+                binson_parser p;
+                bbuf message;
+                bool ok;
+
+                if (binson_record_decode(&b, &record, decoded, sizeof(decoded), &message)
+                    != BINSON_ERROR_NONE) {
+                    printf("  Record does not decode\n");
+                    binson_record_close(&f);
+                    return 0.0;
+                }
+                ok = (message.bptr[0] == BINSON_DEF_OBJECT_BEGIN)
+                    ? binson_parser_init_object(&p, message.bptr, message.bsize)
+                    : binson_parser_init_array(&p, message.bptr, message.bsize);
+                if (!ok || !binson_parser_verify(&p)) {
+                    printf("  Record does not verify\n");
+                    binson_record_close(&f);
+                    return 0.0;
+                }
+                pass += message.bsize;
+            }
+        }
+        total += pass;
+    } while ((total < READ_TARGET) && (total > 0));
+
+    binson_record_close(&f);
+
+    return (double) total / seconds(start);
+}
+
+/* Makes room for size more bytes. */
+static bool memory_reserve(memory_sink *sink, size_t size)
+{
+    if (size > sink->capacity - sink->size) {
+        size_t capacity = (sink->capacity > 0) ? sink->capacity : 1024 * 1024;
+        uint8_t *grown;
+
+        while (size > capacity - sink->size) {
+            capacity *= 2;
+        }
+        grown = realloc(sink->data, capacity);
+        if (NULL == grown) {
+            return false;
+        }
+        sink->data = grown;
+        sink->capacity = capacity;
+    }
+
+    return true;
+}
+
+static bool memory_write(void *context, const uint8_t *data, size_t size)
+{
+    memory_sink *sink = (memory_sink *) context;
+
+    if (!memory_reserve(sink, size)) {
+        return false;
+    }
+
+    memcpy(&sink->data[sink->size], data, size);
+    sink->size += size;
+
+    return true;
+}
+
+static bool add_message(message_set *set, const uint8_t *message, size_t size)
+{
+    if (set->count == set->capacity) {
+        size_t capacity = (set->capacity > 0) ? set->capacity * 2 : 1024;
+        size_t *grown = realloc(set->ends, capacity * sizeof(size_t));
+
+        if (NULL == grown) {
+            return false;
+        }
+        set->ends = grown;
+        set->capacity = capacity;
+    }
+
+    if (!memory_write(&set->bytes, message, size)) {
+        return false;
+    }
+    set->ends[set->count++] = set->bytes.size;
+
+    return true;
+}
+
+/* Device telemetry: a few nested objects and a short measurement array. */
+static bool build_telemetry(message_set *set, size_t records)
+{
+    static const char *sensors[] = { "temperature", "humidity", "pressure", "voltage" };
+    static const char *units[] = { "celsius", "percent", "hectopascal", "volt" };
+    uint8_t message[1024];
+    size_t n;
+
+    for (n = 0; n < records; n++) {
+        binson_writer w;
+        size_t i;
+
+        binson_writer_init(&w, message, sizeof(message));
+        binson_write_object_begin(&w);
+        binson_write_name(&w, "device_id");
+        binson_write_integer(&w, (int64_t) (n % 5000));
+        binson_write_name(&w, "firmware_version");
+        binson_write_string(&w, (n % 7) ? "2.4.1" : "2.5.0-rc1");
+        binson_write_name(&w, "location");
+        binson_write_object_begin(&w);
+        binson_write_name(&w, "latitude");
+        binson_write_double(&w, 59.3 + (double) (n % 100) / 1000.0);
+        binson_write_name(&w, "longitude");
+        binson_write_double(&w, 18.0 + (double) (n % 77) / 1000.0);
+        binson_write_object_end(&w);
+        binson_write_name(&w, "measurements");
+        binson_write_array_begin(&w);
+        for (i = 0; i < 1 + n % 4; i++) {
+            binson_write_object_begin(&w);
+            binson_write_name(&w, "sensor");
+            binson_write_string(&w, sensors[i]);
+            binson_write_name(&w, "unit");
+            binson_write_string(&w, units[i]);
+            binson_write_name(&w, "value");
+            binson_write_integer(&w, (int64_t) ((n * 31 + i) % 4000));
+            binson_write_object_end(&w);
+        }
+        binson_write_array_end(&w);
+        binson_write_name(&w, "sequence_number");
+        binson_write_integer(&w, (int64_t) n);
+        binson_write_name(&w, "timestamp_ms");
+        binson_write_integer(&w, (int64_t) (1600000000000ULL + n * 250));
+        binson_write_object_end(&w);
+
+        if ((w.error_flags != BINSON_ERROR_NONE) ||
+            !add_message(set, message, binson_writer_get_counter(&w))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Every file of the directory that holds exactly one binson object or
+ * array, repeated until the set reaches CORPUS_TARGET bytes.
+ */
+static bool load_corpus(message_set *set, const char *path)
+{
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    size_t files;
+
+    if (NULL == dir) {
+        return false;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        char name[4096];
+        FILE *f;
+        size_t size;
+
+        if ('.' == entry->d_name[0]) {
+            continue;
+        }
+        snprintf(name, sizeof(name), "%s/%s", path, entry->d_name);
+        f = fopen(name, "rb");
+        if (NULL == f) {
+            continue;
+        }
+        size = fread(decoded, 1, sizeof(decoded), f);
+        fclose(f);
+
+        if ((size < sizeof(decoded)) && (binson_message_size(decoded, size) == size) &&
+            !add_message(set, decoded, size)) {
+            break;
+        }
+    }
+    closedir(dir);
+
+    files = set->count;
+    while ((files > 0) && (set->bytes.size < CORPUS_TARGET)) {
+        size_t start = 0;
+        size_t i;
+
+        /* The copies are taken from the set itself, so it must not move. */
+        if (!memory_reserve(&set->bytes, set->ends[files - 1])) {
+            return false;
+        }
+        for (i = 0; i < files; i++) {
+            if (!add_message(set, &set->bytes.data[start], set->ends[i] - start)) {
+                return false;
+            }
+            start = set->ends[i];
+        }
+    }
+
+    return set->count > 0;
+}
+
+static double seconds(clock_t start)
+{
+    double elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    return (elapsed > 0.0) ? elapsed : 1e-9;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file binson_verify_bench.c
+ *
+ * binson_parser_verify() throughput on a string heavy object, without and
+ * with BINSON_PARSER_OPTION_VALIDATE_UTF8.
+ *
+ * Usage: binson_verify_bench [iterations]
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "binson_light.h"
+#include "binson_cpu.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define FIELDS      (64U)
+
+/*======= Local function prototypes =========================================*/
+
+static size_t build_message(uint8_t *buffer, size_t size);
+static void run(const char *name, uint8_t options, size_t size, size_t iterations);
+
+/*======= Local variable declarations =======================================*/
+
+static uint8_t message[FIELDS * 600];
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    size_t iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000;
+    size_t size = build_message(message, sizeof(message));
+
+    if (size == 0) {
+        printf("Could not build message\n");
+        return 1;
+    }
+
+    printf("message size %zu bytes, %u strings, %zu iterations, avx2 %s\n",
+           size, FIELDS, iterations, binson_cpu_has_avx2() ? "yes" : "no");
+
+    run("verify", 0, size, iterations);
+    run("verify + utf-8", BINSON_PARSER_OPTION_VALIDATE_UTF8, size, iterations);
+
+    return 0;
+}
+
+/*======= Local function implementations ====================================*/
+
+/* Fields "f00".."f63" holding ASCII and multibyte text of varying length. */
+static size_t build_message(uint8_t *buffer, size_t size)
+{
+    static const char *words[] = {
+        "binson ", "r\xC3\xA4ksm\xC3\xB6rg\xC3\xA5s ", "\xE2\x82\xAC ",
+        "\xF0\x9F\x98\x80 ", "message ", "\xCE\xB1\xCE\xB2\xCE\xB3 "
+    };
+    char text[512];
+    char name[4];
+    binson_writer w;
+    uint32_t i;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+
+    for (i = 0; i < FIELDS; i++) {
+        size_t len = 0;
+        uint32_t j;
+
+        for (j = 0; j < 8 + 4 * (i % 16); j++) {
+            const char *word = words[(i + j) % (sizeof(words) / sizeof(words[0]))];
+            memcpy(&text[len], word, strlen(word));
+            len += strlen(word);
+        }
+
+        name[0] = 'f';
+        name[1] = (char) ('0' + i / 10);
+        name[2] = (char) ('0' + i % 10);
+        name[3] = '\0';
+        binson_write_name(&w, name);
+        binson_write_string_with_len(&w, text, len);
+    }
+
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+static void run(const char *name, uint8_t options, size_t size, size_t iterations)
+{
+    binson_parser p;
+    size_t ok = 0;
+    size_t i;
+    clock_t start = clock();
+
+    for (i = 0; i < iterations; i++) {
+        binson_parser_init(&p, message, size);
+        p.options = options;
+        ok += binson_parser_verify(&p) ? 1 : 0;
+    }
+
+    double elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+    if (elapsed <= 0.0) {
+        elapsed = 1e-9;
+    }
+
+    printf("%-24s %10.1f MB/s (%zu of %zu valid)\n",
+           name,
+           (double) (iterations * size) / elapsed / 1e6,
+           ok,
+           iterations);
+}
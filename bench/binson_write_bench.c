@@ -0,0 +1,129 @@
+/**
+ * @file binson_write_bench.c
+ *
+ * Array encoding throughput of the writer: one binson_write_integer() or
+ * binson_write_double() call per element against the bulk array writers.
+ *
+ * Usage: binson_write_bench [iterations]
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "binson_light.h"
+#include "binson_cpu.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define ELEMENTS    (1024U)
+
+/*======= Local function prototypes =========================================*/
+
+static size_t write_single(uint8_t *buffer, size_t size);
+static size_t write_bulk(uint8_t *buffer, size_t size);
+static void run(const char *name,
+                size_t (*f)(uint8_t *, size_t),
+                size_t iterations);
+
+/*======= Local variable declarations =======================================*/
+
+static int64_t ints[ELEMENTS];
+static double doubles[ELEMENTS];
+static uint8_t message[ELEMENTS * 18 + 64];
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    size_t iterations = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000;
+    uint32_t i;
+
+    for (i = 0; i < ELEMENTS; i++) {
+        /* Mix of 1, 2, 4 and 8 byte integers. */
+        ints[i] = (int64_t) i * (int64_t) i * ((i & 1U) ? -1 : 1);
+        if ((i % 16U) == 0) {
+            ints[i] *= INT64_C(1) << 32;
+        }
+        doubles[i] = i * 0.5;
+    }
+
+    printf("2 x %u values, %zu iterations, avx2 %s\n",
+           ELEMENTS, iterations, binson_cpu_has_avx2() ? "yes" : "no");
+
+    run("per element writes", write_single, iterations);
+    run("bulk array writers", write_bulk, iterations);
+
+    return 0;
+}
+
+/*======= Local function implementations ====================================*/
+
+/* { "doubles": [...], "ints": [...] } */
+static size_t write_single(uint8_t *buffer, size_t size)
+{
+    binson_writer w;
+    uint32_t i;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+
+    binson_write_name(&w, "doubles");
+    binson_write_array_begin(&w);
+    for (i = 0; i < ELEMENTS; i++) {
+        binson_write_double(&w, doubles[i]);
+    }
+    binson_write_array_end(&w);
+
+    binson_write_name(&w, "ints");
+    binson_write_array_begin(&w);
+    for (i = 0; i < ELEMENTS; i++) {
+        binson_write_integer(&w, ints[i]);
+    }
+    binson_write_array_end(&w);
+
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+static size_t write_bulk(uint8_t *buffer, size_t size)
+{
+    binson_writer w;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "doubles");
+    binson_write_double_array(&w, doubles, ELEMENTS);
+    binson_write_name(&w, "ints");
+    binson_write_int64_array(&w, ints, ELEMENTS);
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+static void run(const char *name,
+                size_t (*f)(uint8_t *, size_t),
+                size_t iterations)
+{
+    size_t bytes = 0;
+    size_t i;
+    clock_t start = clock();
+
+    for (i = 0; i < iterations; i++) {
+        bytes += f(message, sizeof(message));
+    }
+
+    double elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+    if (elapsed <= 0.0) {
+        elapsed = 1e-9;
+    }
+
+    printf("%-24s %10.1f MB/s %12.0f values/s\n",
+           name,
+           (double) bytes / elapsed / 1e6,
+           (double) (iterations * 2 * ELEMENTS) / elapsed);
+}
@@ -3,20 +3,109 @@
 #include <binson_light.h>
 
 #include <string.h>
+#include <atomic>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
 
 using namespace std;
 
-void ifRuntimeError(bool x, const char *msg)
+namespace {
+
+/*
+ * Process wide table of interned field names. Symbols are never freed so
+ * names can refer to them without reference counting.
+ */
+class NameTable
+{
+public:
+    static NameTable &instance()
+    {
+        /* Intentionally leaked, names may outlive static destruction. */
+        static NameTable *table = new NameTable();
+        return *table;
+    }
+
+    const string *lookup(size_t hash, const uint8_t *data, size_t size)
+    {
+        lock_guard<mutex> lock(m_lock);
+
+        auto range = m_symbols.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if ((it->second.size() == size) &&
+                (memcmp(it->second.data(), data, size) == 0))
+                return &it->second;
+        }
+
+        if (m_symbols.size() >= maxNames)
+            return nullptr;
+
+        auto it = m_symbols.emplace(hash, string(reinterpret_cast<const char*>(data), size));
+        return &it->second;
+    }
+
+    atomic<bool> enabled;
+    atomic<size_t> maxNames;
+
+private:
+    NameTable() : enabled(false), maxNames(0) { }
+
+    mutex m_lock;
+    /* Node based, references stay valid on rehash. */
+    unordered_multimap<size_t, string> m_symbols;
+};
+
+struct NameCacheEntry
 {
-    if (!(x))
-        throw std::runtime_error(msg);
+    size_t hash;
+    const string *symbol;
+};
+
+/* Taken once per buffer-backed value that is read with getString()/getBin(). */
+mutex materializeLock;
+
+/* Per thread cache in front of the name table to keep the lock off hits. */
+thread_local NameCacheEntry nameCache[256];
+
+size_t nameHash(const uint8_t *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return static_cast<size_t>(hash);
 }
 
-void CheckParserState(binson_parser *p)
+}
+
+BinsonName BinsonName::intern(const uint8_t *data, size_t size)
 {
-    if (p->error_flags != BINSON_ERROR_NONE)
-        throw std::runtime_error("Parse error");
+    size_t hash = nameHash(data, size);
+    NameCacheEntry &entry = nameCache[hash % 256];
+
+    if ((entry.symbol != nullptr) &&
+        (entry.hash == hash) &&
+        (entry.symbol->size() == size) &&
+        (memcmp(entry.symbol->data(), data, size) == 0))
+        return BinsonName(entry.symbol);
+
+    const string *symbol = NameTable::instance().lookup(hash, data, size);
+    if (symbol == nullptr)
+        return BinsonName(string(reinterpret_cast<const char*>(data), size));
+
+    entry.hash = hash;
+    entry.symbol = symbol;
+    return BinsonName(symbol);
+}
+
+BinsonName BinsonName::intern(const std::string &name)
+{
+    return intern(reinterpret_cast<const uint8_t*>(name.data()), name.size());
 }
 
 const std::array<std::string, 8> BinsonValue::typeToString
@@ -33,240 +122,552 @@ const std::array<std::string, 8> BinsonValue::typeToString
     }
 };
 
+void Binson::setNameInterning(bool enable, size_t max_names)
+{
+    NameTable &table = NameTable::instance();
+    table.maxNames = max_names;
+    table.enabled = enable;
+}
+
+BinsonValue & Binson::item(const std::string &key)
+{
+    BinsonName ref = BinsonName::ref(key);
+    auto it = m_items.lower_bound(ref);
+
+    if ((it != m_items.end()) && (it->first == ref))
+        return it->second;
+
+    if (NameTable::instance().enabled)
+        return m_items.emplace_hint(it, BinsonName::intern(key), BinsonValue())->second;
+
+    return m_items.emplace_hint(it, BinsonName(key), BinsonValue())->second;
+}
+
 Binson & Binson::put(const std::string &key, const BinsonValue &v)
 {
-    m_items[key] = move(v);
+    invalidate();
+    item(key) = v;
     return *this;
 }
 
 Binson & Binson::put(const std::string &key, Binson o)
 {
-    m_items[key] = BinsonValue(move(o));
+    invalidate();
+    item(key) = BinsonValue(move(o));
     return *this;
 }
 
 Binson & Binson::put(const string &key, const uint8_t *data, size_t size)
 {
+    invalidate();
     vector<uint8_t> v(data, data + size);
-    m_items[key] = BinsonValue(v);
+    item(key) = BinsonValue(move(v));
     return *this;
 }
 
 const BinsonValue &Binson::get(const string &key) const
 {
-    if (!hasKey(key))
+    const BinsonValue *value = tryGet(key);
+    if (value == nullptr)
         throw std::out_of_range("Key '" + key + "' does not exist");
-    else
-        return m_items.at(key);
+    return *value;
+}
+
+const BinsonValue &Binson::get(const BinsonName &key) const
+{
+    const BinsonValue *value = tryGet(key);
+    if (value == nullptr)
+        throw std::out_of_range("Key '" + key.str() + "' does not exist");
+    return *value;
+}
+
+const BinsonValue *Binson::tryGet(const std::string &key) const
+{
+    return tryGet(BinsonName::ref(key));
+}
+
+const BinsonValue *Binson::tryGet(const BinsonName &key) const
+{
+    auto it = m_items.find(key);
+    return (it != m_items.end()) ? &it->second : nullptr;
 }
 
 bool Binson::hasKey(const string &key) const
 {
-    return m_items.find(key) != m_items.end();
+    return tryGet(key) != nullptr;
 }
 
 void Binson::clear()
 {
+    invalidate();
     m_items.clear();
 }
 
-void Binson::seralizeItem(binson_writer *w, const BinsonValue &val) const
+void Binson::invalidate()
 {
+    m_encodedOwner.reset();
+    m_encoded = bbuf();
+}
+
+size_t Binson::serializedSize() const
+{
+    size_t size = encodedSize();
+    return (size == unencodable) ? 0 : size;
+}
+
+std::vector<uint8_t> Binson::serialize() const
+{
+    vector<uint8_t> data;
+    size_t size = serializedSize();
+
+    if (size > 0)
+    {
+        data.resize(size);
+        encodeTo(data.data());
+    }
+
+    return data;
+}
+
+void Binson::serialize(std::string &out) const
+{
+    size_t size = serializedSize();
+
+    out.clear();
+    if (size > 0)
+    {
+        out.resize(size);
+        encodeTo(reinterpret_cast<uint8_t*>(&out[0]));
+    }
+}
+
+size_t Binson::serialize(uint8_t *buffer, size_t size) const
+{
+    size_t required = serializedSize();
+
+    if ((buffer != nullptr) && (required > 0) && (required <= size))
+        encodeTo(buffer);
+
+    return required;
+}
+
+void Binson::serialize(binson_writer *w) const
+{
+    if (w == nullptr)
+        return;
+
+    size_t size = serializedSize();
+    if (size == 0)
+    {
+        w->error_flags = BINSON_ERROR_FORMAT;
+        return;
+    }
+
+    /* Same accounting as the C writer, the counter grows even on error. */
+    size_t c = w->buffer_used + size;
+    if ((c > w->buffer_size) || (c < w->buffer_used))
+        w->error_flags = BINSON_ERROR_RANGE;
+    if (w->buffer == nullptr)
+        w->error_flags = BINSON_ERROR_NULL;
+
+    if (w->error_flags == BINSON_ERROR_NONE)
+        encodeTo(&w->buffer[w->buffer_used]);
+
+    w->buffer_used += size;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> Binson::serializeCached()
+{
+    auto data = make_shared<vector<uint8_t>>(serialize());
+
+    if (!data->empty())
+        attachEncoded(data, data->data());
+
+    return data;
+}
+
+/* Computed on every call, only cached encoded bytes make it O(1). */
+size_t Binson::encodedSize() const
+{
+    size_t size = 2;
+
+    if (m_encodedOwner)
+        return m_encoded.bsize;
+
+    for (auto &item: m_items)
+    {
+        size = addSize(size, bufferSize(item.first.size()));
+        size = addSize(size, valueSize(item.second));
+    }
+
+    return size;
+}
+
+size_t Binson::valueSize(const BinsonValue &val)
+{
+    size_t size = 0;
+
     switch(val.myType())
     {
     case BinsonValue::Types::noneType:
         break;
     case BinsonValue::Types::boolType:
-        binson_write_boolean(w, val.getBool());
+        size = 1;
         break;
     case BinsonValue::Types::intType:
-        binson_write_integer(w, val.getInt());
+        size = 1 + binson_encode_detail::integerWidth(val.m_val.i);
         break;
     case BinsonValue::Types::doubleType:
-        binson_write_double(w, val.getDouble());
+        size = 1 + sizeof(double);
         break;
     case BinsonValue::Types::stringType:
-        binson_write_string_with_len(w,
-                                     val.getString().data(),
-                                     val.getString().size());
+        size = bufferSize(val.getStringRef().bsize);
         break;
     case BinsonValue::Types::binaryType:
-        binson_write_bytes(w, val.getBin().data(), val.getBin().size());
+        size = bufferSize(val.getBinRef().bsize);
         break;
     case BinsonValue::Types::objectType:
-        binson_write_object_begin(w);
-        val.getObject().seralizeItems(w);
-        binson_write_object_end(w);
+        size = val.m_val.o.encodedSize();
         break;
     case BinsonValue::Types::arrayType:
-        binson_write_array_begin(w);
-        for (auto &arrayValue : val.getArray())
+        size = 2;
+        for (auto &arrayValue : val.m_val.a)
         {
-            seralizeItem(w, arrayValue);
+            size = addSize(size, valueSize(arrayValue));
         }
-        binson_write_array_end(w);
         break;
     default:
         throw runtime_error("Unknown binson type");
     }
+
+    return size;
 }
 
-void Binson::seralizeItems(binson_writer *w) const
+size_t Binson::bufferSize(size_t size)
 {
+    if (size > INT32_MAX)
+        return unencodable;
+
+    return binson_encode_detail::lengthHeaderSize(size) + size;
+}
+
+size_t Binson::addSize(size_t a, size_t b)
+{
+    if ((a == unencodable) || (b == unencodable) || (a + b < a))
+        return unencodable;
+
+    return a + b;
+}
+
+/*
+ * Points the cache of this object and of its nested objects to their bytes
+ * in the encoded object at at. Returns the encoded size.
+ */
+size_t Binson::attachEncoded(const std::shared_ptr<const void> &owner, const uint8_t *at)
+{
+    size_t pos = 1;
+
     for (auto &item: m_items)
     {
-        binson_write_name_with_len(w, item.first.c_str(), item.first.size());
-        seralizeItem(w, item.second);
+        pos += bufferSize(item.first.size());
+        pos += attachValue(owner, item.second, at + pos);
     }
+    pos++;
+
+    m_encoded.bptr = at;
+    m_encoded.bsize = pos;
+    m_encodedOwner = owner;
+    return pos;
 }
 
-std::vector<uint8_t> Binson::serialize() const
+size_t Binson::attachValue(const std::shared_ptr<const void> &owner,
+                           BinsonValue &val,
+                           const uint8_t *at)
 {
-    vector<uint8_t> data;
-    data.resize(1000);
-    binson_writer w;
-    binson_writer_init(&w, data.data(), data.size());
-    serialize(&w);
-    if (w.error_flags == BINSON_ERROR_RANGE)
+    size_t pos = 1;
+
+    switch(val.myType())
     {
-        data.resize(binson_writer_get_counter(&w));
-        binson_writer_init(&w, data.data(), data.size());
-        serialize(&w);
+    case BinsonValue::Types::objectType:
+        return val.m_val.o.attachEncoded(owner, at);
+    case BinsonValue::Types::arrayType:
+        for (auto &arrayValue : val.m_val.a)
+        {
+            pos += attachValue(owner, arrayValue, at + pos);
+        }
+        return pos + 1;
+    default:
+        return valueSize(val);
     }
+}
 
-    if (w.error_flags == BINSON_ERROR_NONE)
-        data.resize(binson_writer_get_counter(&w));
-    else
-        data.clear();
+static binson_err parserError(binson_parser *p)
+{
+    return (p->error_flags != BINSON_ERROR_NONE) ? p->error_flags : BINSON_ERROR_STATE;
+}
 
-    return data;
+/*
+ * Appends the elements of a scalar array with a bulk reader. done is false
+ * when the array turned out to be mixed; the parser is then inside the
+ * array, in front of the first element of another type.
+ */
+template <typename T>
+static binson_err readScalars(binson_parser *p,
+                              bool (*read)(binson_parser *, T *, size_t, size_t *),
+                              vector<BinsonValue> &array,
+                              bool &done)
+{
+    T chunk[64];
+    size_t n;
+
+    for (;;)
+    {
+        done = read(p, chunk, sizeof(chunk) / sizeof(chunk[0]), &n);
+        for (size_t i = 0; i < n; i++)
+            array.emplace_back(chunk[i]);
+        if (done)
+            return BINSON_ERROR_NONE;
+        if (p->error_flags == BINSON_ERROR_WRONG_TYPE)
+        {
+            p->error_flags = BINSON_ERROR_NONE;
+            return BINSON_ERROR_NONE;
+        }
+        if (p->error_flags != BINSON_ERROR_NONE)
+            return p->error_flags;
+    }
 }
 
-void Binson::serialize(binson_writer *w) const
+/* Enters an array, decoding leading integers, doubles or booleans in bulk. */
+static binson_err enterArray(binson_parser *p, vector<BinsonValue> &array, bool &done)
 {
-    binson_write_object_begin(w);
-    seralizeItems(w);
-    binson_write_object_end(w);
+    uint8_t first = (p->buffer_used + 1 < p->buffer_size) ? p->buffer[p->buffer_used + 1] : 0;
+
+    done = false;
+    switch (first)
+    {
+    case BINSON_DEF_INT8:
+    case BINSON_DEF_INT16:
+    case BINSON_DEF_INT32:
+    case BINSON_DEF_INT64:
+        return readScalars<int64_t>(p, binson_parser_read_int64_array, array, done);
+    case BINSON_DEF_DOUBLE:
+        return readScalars<double>(p, binson_parser_read_double_array, array, done);
+    case BINSON_DEF_TRUE:
+    case BINSON_DEF_FALSE:
+        return readScalars<bool>(p, binson_parser_read_bool_array, array, done);
+    default:
+        return binson_parser_go_into_array(p) ? BINSON_ERROR_NONE : parserError(p);
+    }
 }
 
-BinsonValue Binson::deseralizeItem(binson_parser *p)
+static void throwOnError(binson_err err)
 {
-    uint8_t t = binson_parser_get_type(p);
-    CheckParserState(p);
+    if (err != BINSON_ERROR_NONE)
+        throw std::runtime_error("Parse error");
+}
 
-    switch(t)
+binson_err Binson::deseralizeItem(binson_parser *p,
+                                  const std::shared_ptr<const void> &owner,
+                                  BinsonValue &value)
+{
+    switch(binson_parser_get_type(p))
     {
     case BINSON_ID_BOOLEAN:
-    {
-        bool val = binson_parser_get_boolean(p);
-        CheckParserState(p);
-        return BinsonValue(val);
-    }
+        value = BinsonValue(binson_parser_get_boolean(p));
         break;
     case BINSON_ID_INTEGER:
-    {
-        int64_t val = binson_parser_get_integer(p);
-        CheckParserState(p);
-        return BinsonValue(val);
-    }
+        value = BinsonValue(binson_parser_get_integer(p));
         break;
     case BINSON_ID_DOUBLE:
-    {
-        double val = binson_parser_get_double(p);
-        CheckParserState(p);
-        return BinsonValue(val);
-    }
+        value = BinsonValue(binson_parser_get_double(p));
         break;
     case BINSON_ID_STRING:
     {
-        bbuf *buf;
-        buf = binson_parser_get_string_bbuf(p);
-        CheckParserState(p);
-        if (buf)
-            return BinsonValue(string(reinterpret_cast<const char*>(buf->bptr), buf->bsize));
+        bbuf *buf = binson_parser_get_string_bbuf(p);
+        if (owner)
+            value = BinsonValue(BinsonValue::Types::stringType, *buf, owner);
         else
-            throw runtime_error("Parse error, missing string");
+            value = BinsonValue(string(reinterpret_cast<const char*>(buf->bptr), buf->bsize));
     }
         break;
     case BINSON_ID_BYTES:
     {
-        bbuf *buf;
-        buf = binson_parser_get_bytes_bbuf(p);
-        CheckParserState(p);
-        if (buf)
-            return BinsonValue(vector<uint8_t>(buf->bptr, buf->bptr + buf->bsize));
+        bbuf *buf = binson_parser_get_bytes_bbuf(p);
+        if (owner)
+            value = BinsonValue(BinsonValue::Types::binaryType, *buf, owner);
         else
-            throw runtime_error("Parse error, missing data");
+            value = BinsonValue(vector<uint8_t>(buf->bptr, buf->bptr + buf->bsize));
     }
         break;
     case BINSON_ID_OBJECT:
     {
-        ifRuntimeError(binson_parser_go_into_object(p), "Parse error");
+        const uint8_t *start = &p->buffer[p->buffer_used];
+        if (!binson_parser_go_into_object(p))
+            return parserError(p);
         Binson b;
-        b.deseralizeItems(p);
-        ifRuntimeError(binson_parser_leave_object(p), "Parse error");
-        return BinsonValue(b);
+        binson_err err = b.deseralizeItems(p, owner);
+        if (err != BINSON_ERROR_NONE)
+            return err;
+        if (!binson_parser_leave_object(p))
+            return parserError(p);
+        if (owner)
+        {
+            /* Verified input is canonical, reuse it as encoded form. */
+            b.m_encoded.bptr = start;
+            b.m_encoded.bsize = &p->buffer[p->buffer_used] - start;
+            b.m_encodedOwner = owner;
+        }
+        value = BinsonValue(move(b));
     }
         break;
     case BINSON_ID_ARRAY:
     {
-        ifRuntimeError(binson_parser_go_into_array(p), "Parse error");
         vector<BinsonValue> array;
-        while(binson_parser_next(p))
+        bool done;
+        binson_err err = enterArray(p, array, done);
+        if (err != BINSON_ERROR_NONE)
+            return err;
+        while(!done && binson_parser_next(p))
         {
-            array.push_back(deseralizeItem(p));
+            array.emplace_back();
+            err = deseralizeItem(p, owner, array.back());
+            if (err != BINSON_ERROR_NONE)
+                return err;
         }
-        ifRuntimeError(binson_parser_leave_array(p), "Parse error");
-        return array;
+        if (!done && !binson_parser_leave_array(p))
+            return parserError(p);
+        value = BinsonValue(move(array));
     }
         break;
     default:
-        throw runtime_error("Unknown type");
+        return parserError(p);
     }
-    return BinsonValue();
+
+    return BINSON_ERROR_NONE;
 }
 
-void Binson::deseralizeItems(binson_parser *p)
+binson_err Binson::deseralizeItems(binson_parser *p,
+                                   const std::shared_ptr<const void> &owner)
 {
+    bool intern = NameTable::instance().enabled;
+
     while(binson_parser_next(p))
     {
-        bbuf *buf;
-        buf = binson_parser_get_name(p);
-        CheckParserState(p);
-        ifRuntimeError(buf != nullptr, "Parse error");
-        string name(reinterpret_cast<const char*>(buf->bptr), buf->bsize);
-        put(name, deseralizeItem(p));
+        bbuf *buf = binson_parser_get_name(p);
+        /* Fields arrive sorted, so each one is appended at the end. */
+        auto it = m_items.emplace_hint(m_items.end(),
+            intern ? BinsonName::intern(buf->bptr, buf->bsize)
+                   : BinsonName(string(reinterpret_cast<const char*>(buf->bptr), buf->bsize)),
+            BinsonValue());
+        binson_err err = deseralizeItem(p, owner, it->second);
+        if (err != BINSON_ERROR_NONE)
+            return err;
     }
-    CheckParserState(p);
+
+    return p->error_flags;
 }
 
-void Binson::deserialize(const std::vector<uint8_t> &data)
+binson_err Binson::deseralizeObject(binson_parser *p,
+                                    const std::shared_ptr<const void> &owner)
 {
-    binson_parser p;
+    binson_err err;
+
     clear();
 
-    binson_parser_init(&p, const_cast<uint8_t*>(data.data()), data.size());
-    binson_parser_go_into_object(&p);
-    deseralizeItems(&p);
-    binson_parser_leave_object(&p);
+    if (!binson_parser_go_into_object(p))
+    {
+        err = parserError(p);
+    }
+    else
+    {
+        err = deseralizeItems(p, owner);
+        if ((err == BINSON_ERROR_NONE) && !binson_parser_leave_object(p))
+            err = parserError(p);
+    }
+
+    if (err != BINSON_ERROR_NONE)
+        clear();
+
+    return err;
+}
+
+void Binson::deserialize(const std::vector<uint8_t> &data)
+{
+    throwOnError(tryDeserialize(data));
 }
 
 void Binson::deserialize(const uint8_t *data, size_t size)
 {
-    binson_parser p;
+    throwOnError(tryDeserialize(data, size));
+}
+
+void Binson::deserialize(binson_parser *p)
+{
+    throwOnError(tryDeserialize(p));
+}
+
+void Binson::deserialize(const std::shared_ptr<const std::vector<uint8_t>> &data)
+{
+    throwOnError(tryDeserialize(data));
+}
+
+void Binson::deserialize(const uint8_t *data,
+                         size_t size,
+                         const std::shared_ptr<const void> &owner)
+{
+    throwOnError(tryDeserialize(data, size, owner));
+}
+
+binson_err Binson::tryDeserialize(const std::vector<uint8_t> &data)
+{
+    return tryDeserialize(data.data(), data.size(), nullptr);
+}
+
+binson_err Binson::tryDeserialize(const uint8_t *data, size_t size)
+{
+    return tryDeserialize(data, size, nullptr);
+}
+
+binson_err Binson::tryDeserialize(binson_parser *p)
+{
     clear();
+    if (!binson_parser_reset(p))
+        return (p != nullptr) ? parserError(p) : BINSON_ERROR_NULL;
+    return deseralizeObject(p, nullptr);
+}
 
-    ifRuntimeError(binson_parser_init(&p, const_cast<uint8_t*>(data), size), "Parser init error");
-    deserialize(&p);
+binson_err Binson::tryDeserialize(const std::shared_ptr<const std::vector<uint8_t>> &data)
+{
+    if (data == nullptr)
+    {
+        clear();
+        return BINSON_ERROR_NULL;
+    }
+    return tryDeserialize(data->data(), data->size(), data);
 }
 
-void Binson::deserialize(binson_parser *p)
+binson_err Binson::tryDeserialize(const uint8_t *data,
+                                  size_t size,
+                                  const std::shared_ptr<const void> &owner)
 {
+    binson_parser p;
+
     clear();
-    ifRuntimeError(binson_parser_reset(p), "Parser reset error");
-    ifRuntimeError(binson_parser_go_into_object(p), "Parse error");
-    deseralizeItems(p);
-    ifRuntimeError(binson_parser_leave_object(p), "Parse error");
+    if (data == nullptr)
+        return BINSON_ERROR_NULL;
+    p.error_flags = BINSON_ERROR_NONE;
+    if (!binson_parser_init(&p, data, size))
+        return parserError(&p);
+
+    binson_err err = deseralizeObject(&p, owner);
+    if ((err == BINSON_ERROR_NONE) && owner)
+    {
+        m_encoded.bptr = data;
+        m_encoded.bsize = size;
+        m_encodedOwner = owner;
+    }
+
+    return err;
 }
 
 string Binson::toStr() const
@@ -277,18 +678,17 @@ string Binson::toStr() const
     vector<uint8_t> stream = serialize();
     if (stream.empty())
         return string();
-    int trys = 5;
-    bool result = false;
-    size_t size = 0;
-    do
+    if (!binson_parser_init(&p, stream.data(), stream.size()))
+        return string();
+
+    size_t size = str.size();
+    bool result = binson_parser_to_string(&p, &str[0], &size, true);
+    if (!result && size > str.size())
     {
-        if (!binson_parser_init(&p, stream.data(), stream.size()))
-            break;
-        size = str.size();
-        result = binson_parser_to_string(&p, (char*)str.data(), &size, true);
-        if (!result)
-            str.resize(size * 2);
-    } while(!result && trys-- > 0 && p.error_flags == 0);
+        /* The failed call reported the exact size needed. */
+        str.resize(size);
+        result = binson_parser_to_string(&p, &str[0], &size, true);
+    }
 
     if (!result)
         str.clear();
@@ -302,6 +702,14 @@ BinsonValue::BinsonValue()
 
 }
 
+BinsonValue::BinsonValue(Types t, const bbuf &ref, const std::shared_ptr<const void> &owner)
+{
+    m_val.setType(t);
+    m_val.ref = ref;
+    m_val.owner = owner;
+    m_val.materialized = false;
+}
+
 BinsonValue::BinsonValue(bool val)
 {
     m_val.b = val;
@@ -436,6 +844,142 @@ BinsonValue BinsonValue::operator=(std::vector<BinsonValue> &&val)
     return *this;
 }
 
+BinsonValue::InternalValue::InternalValue(const InternalValue &other)
+    : materialized(false)
+{
+    *this = other;
+}
+
+BinsonValue::InternalValue::InternalValue(InternalValue &&other)
+    : materialized(false)
+{
+    *this = move(other);
+}
+
+BinsonValue::InternalValue &
+BinsonValue::InternalValue::operator=(const InternalValue &other)
+{
+    if (this == &other)
+        return *this;
+
+    b = other.b;
+    i = other.i;
+    d = other.d;
+    str = other.owner ? string() : other.str;
+    bin = other.owner ? vector<uint8_t>() : other.bin;
+    o = other.o;
+    a = other.a;
+    tinfo = other.tinfo;
+    ref = other.ref;
+    owner = other.owner;
+    materialized = false;
+    return *this;
+}
+
+BinsonValue::InternalValue &
+BinsonValue::InternalValue::operator=(InternalValue &&other)
+{
+    b = other.b;
+    i = other.i;
+    d = other.d;
+    str = move(other.str);
+    bin = move(other.bin);
+    o = move(other.o);
+    a = move(other.a);
+    tinfo = other.tinfo;
+    ref = other.ref;
+    owner = move(other.owner);
+    materialized = other.materialized.load();
+    return *this;
+}
+
+/*
+ * Copies a buffer-backed string or bytes value into str or bin. Double
+ * checked, so only the first read of each value takes the lock.
+ */
+void BinsonValue::materialize() const
+{
+    if (!m_val.owner || m_val.materialized.load(memory_order_acquire))
+        return;
+
+    lock_guard<mutex> lock(materializeLock);
+    if (m_val.materialized.load(memory_order_relaxed))
+        return;
+
+    if (m_val.tinfo == Types::stringType)
+        m_val.str.assign(reinterpret_cast<const char*>(m_val.ref.bptr), m_val.ref.bsize);
+    else
+        m_val.bin.assign(m_val.ref.bptr, m_val.ref.bptr + m_val.ref.bsize);
+    m_val.materialized.store(true, memory_order_release);
+}
+
+void BinsonValue::throwTypeError(Types expected) const
+{
+    throw std::runtime_error("Wrong type req(" +
+                             typeToString[(int)expected] + ") actual(" +
+                             typeToString[(int)m_val.myType()] + ")");
+}
+
+bool BinsonValue::tryGetBool(bool &value) const
+{
+    if (myType() != Types::boolType)
+        return false;
+    value = m_val.b;
+    return true;
+}
+
+bool BinsonValue::tryGetInt(int64_t &value) const
+{
+    if (myType() != Types::intType)
+        return false;
+    value = m_val.i;
+    return true;
+}
+
+bool BinsonValue::tryGetDouble(double &value) const
+{
+    if (myType() != Types::doubleType)
+        return false;
+    value = m_val.d;
+    return true;
+}
+
+bool BinsonValue::tryGetStringRef(bbuf &value) const
+{
+    if (myType() != Types::stringType)
+        return false;
+    value = getStringRef();
+    return true;
+}
+
+bool BinsonValue::tryGetBinRef(bbuf &value) const
+{
+    if (myType() != Types::binaryType)
+        return false;
+    value = getBinRef();
+    return true;
+}
+
+const std::string *BinsonValue::tryGetString() const
+{
+    return (myType() == Types::stringType) ? &getString() : nullptr;
+}
+
+const std::vector<uint8_t> *BinsonValue::tryGetBin() const
+{
+    return (myType() == Types::binaryType) ? &getBin() : nullptr;
+}
+
+const Binson *BinsonValue::tryGetObject() const
+{
+    return (myType() == Types::objectType) ? &m_val.o : nullptr;
+}
+
+const std::vector<BinsonValue> *BinsonValue::tryGetArray() const
+{
+    return (myType() == Types::arrayType) ? &m_val.a : nullptr;
+}
+
 bool BinsonValue::getBool() const
 {
     checkType(Types::boolType);
@@ -457,15 +1001,39 @@ double BinsonValue::getDouble() const
 const string & BinsonValue::getString() const
 {
     checkType(Types::stringType);
+    materialize();
     return m_val.str;
 }
 
 const std::vector<uint8_t> & BinsonValue::getBin() const
 {
     checkType(Types::binaryType);
+    materialize();
     return m_val.bin;
 }
 
+bbuf BinsonValue::getStringRef() const
+{
+    checkType(Types::stringType);
+    if (m_val.owner)
+        return m_val.ref;
+    bbuf ref;
+    ref.bptr = reinterpret_cast<const uint8_t*>(m_val.str.data());
+    ref.bsize = m_val.str.size();
+    return ref;
+}
+
+bbuf BinsonValue::getBinRef() const
+{
+    checkType(Types::binaryType);
+    if (m_val.owner)
+        return m_val.ref;
+    bbuf ref;
+    ref.bptr = m_val.bin.data();
+    ref.bsize = m_val.bin.size();
+    return ref;
+}
+
 const Binson & BinsonValue::getObject() const
 {
     checkType(Types::objectType);
@@ -4,13 +4,78 @@
 #include <map>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
 #include <stdint.h>
+#include <string.h>
 
 #include <binson_light.h>
+#include <binson_encode.hpp>
 
 class BinsonValue;
 
+/*
+ * Field name of a Binson object. A name either holds its own string, as a
+ * plain std::string key would, or points to a symbol in the process wide
+ * name table, see Binson::setNameInterning(). Interned names are stored
+ * once, are not reference counted and equal names compare equal by
+ * pointer.
+ */
+class BinsonName
+{
+public:
+    explicit BinsonName(const std::string &name) : m_name(name), m_symbol(nullptr) { }
+    explicit BinsonName(std::string &&name) : m_name(std::move(name)), m_symbol(nullptr) { }
+
+    /*
+     * Returns the interned symbol for a name, or an owned copy when the
+     * name table is full.
+     */
+    static BinsonName intern(const uint8_t *data, size_t size);
+    static BinsonName intern(const std::string &name);
+
+    /* Non-owning name, only valid as long as name (used for lookups). */
+    static BinsonName ref(const std::string &name) { return BinsonName(&name); }
+
+    const std::string & str() const { return (m_symbol != nullptr) ? *m_symbol : m_name; }
+    operator const std::string & () const { return str(); }
+    const char * c_str() const { return str().c_str(); }
+    const char * data() const { return str().data(); }
+    size_t size() const { return str().size(); }
+
+    bool operator<(const BinsonName &other) const
+    {
+        return !isSameSymbol(other) && (str() < other.str());
+    }
+    bool operator==(const BinsonName &other) const
+    {
+        return isSameSymbol(other) || (str() == other.str());
+    }
+    bool operator!=(const BinsonName &other) const { return !(*this == other); }
+
+    /* True if both names refer to the same interned string. */
+    bool isSameSymbol(const BinsonName &other) const
+    {
+        return (m_symbol != nullptr) && (m_symbol == other.m_symbol);
+    }
+
+private:
+    explicit BinsonName(const std::string *name) : m_symbol(name) { }
+
+    std::string m_name;
+    const std::string *m_symbol;    /* nullptr if the name is in m_name. */
+};
+
+inline bool operator==(const BinsonName &a, const std::string &b) { return a.str() == b; }
+inline bool operator!=(const BinsonName &a, const std::string &b) { return a.str() != b; }
+inline bool operator==(const BinsonName &a, const char *b) { return a.str() == b; }
+inline bool operator!=(const BinsonName &a, const char *b) { return a.str() != b; }
+
 class Binson
 {
 public:
@@ -19,25 +84,152 @@ public:
     Binson& put(const std::string &key, Binson o);
     Binson& put(const std::string &key, const uint8_t *data, size_t size);
     const BinsonValue & get(const std::string &key) const;
+    const BinsonValue & get(const BinsonName &key) const;
+    const BinsonValue * tryGet(const std::string &key) const;  /* nullptr if missing */
+    const BinsonValue * tryGet(const BinsonName &key) const;
     bool hasKey(const std::string &key) const;
 
+    /*
+     * Process wide field name interning, off by default. When enabled,
+     * field names of deserialized objects and names given to put() are
+     * stored once in a shared, thread-safe name table. At most max_names
+     * names are interned, later names are copied as usual so untrusted
+     * input can't grow the table without bound.
+     */
+    static void setNameInterning(bool enable, size_t max_names = 4096);
+
     void clear();
+
+    /*
+     * The exact encoded size is computed up front and the object is then
+     * written in one pass. Objects with cached encoded bytes, see
+     * serializeCached(), are written with a single copy of those bytes.
+     * The const serialization functions only read the caches, so they may
+     * run concurrently on the same object.
+     */
+    size_t serializedSize() const;  /* 0 if the object can't be encoded */
     std::vector<uint8_t> serialize() const;
+    void serialize(std::string &out) const;
+    /* Writes only if the buffer is large enough, returns the required size. */
+    size_t serialize(uint8_t *buffer, size_t size) const;
     void serialize(binson_writer *w) const;
+    template <typename OutputIt> OutputIt serializeTo(OutputIt out) const;
+    /*
+     * Serializes and caches the encoded bytes of this object and of every
+     * nested object as references into the returned buffer, which the
+     * object shares ownership of. Unmodified objects are then serialized
+     * with plain copies. Objects deserialized from a shared buffer are
+     * cached the same way. Empty if the object can't be encoded.
+     */
+    std::shared_ptr<const std::vector<uint8_t>> serializeCached();
     void deserialize(const std::vector<uint8_t> &data);
     void deserialize(const uint8_t *data, size_t size);
     void deserialize(binson_parser *p);
+
+    /*
+     * Buffer-backed deserialization. The Binson shares ownership of the
+     * input buffer and string and bytes values are kept as references into
+     * it instead of being copied. Use getStringRef()/getBinRef() to read
+     * them without copying.
+     */
+    void deserialize(const std::shared_ptr<const std::vector<uint8_t>> &data);
+    void deserialize(const uint8_t *data,
+                     size_t size,
+                     const std::shared_ptr<const void> &owner);
+
+    /*
+     * Non-throwing variants of deserialize(). The error code from the
+     * parser is returned and the object is left empty on error. Nothing
+     * is thrown or allocated once an error has been detected.
+     */
+    binson_err tryDeserialize(const std::vector<uint8_t> &data);
+    binson_err tryDeserialize(const uint8_t *data, size_t size);
+    binson_err tryDeserialize(binson_parser *p);
+    binson_err tryDeserialize(const std::shared_ptr<const std::vector<uint8_t>> &data);
+    binson_err tryDeserialize(const uint8_t *data,
+                              size_t size,
+                              const std::shared_ptr<const void> &owner);
     std::string toStr() const;
-    std::map<std::string, BinsonValue>::const_iterator begin(){ return m_items.begin(); }
-    std::map<std::string, BinsonValue>::const_iterator end(){ return m_items.end(); }
+
+    /*
+     * Iterates the fields in name order. Elements are pairs of references,
+     * first is the name as a std::string and second the value, so iterate
+     * with auto or const auto &. name() gives the BinsonName itself.
+     */
+    class const_iterator
+    {
+    public:
+        typedef std::pair<const std::string &, const BinsonValue &> value_type;
+        typedef value_type reference;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::input_iterator_tag iterator_category;
+
+        struct pointer
+        {
+            value_type item;
+            const value_type * operator->() const { return &item; }
+        };
+
+        const_iterator() { }
+        explicit const_iterator(std::map<BinsonName, BinsonValue>::const_iterator it) : m_it(it) { }
+
+        reference operator*() const;
+        pointer operator->() const;
+        const BinsonName & name() const;
+
+        const_iterator & operator++();
+        const_iterator operator++(int);
+        const_iterator & operator--();
+        const_iterator operator--(int);
+
+        bool operator==(const const_iterator &other) const;
+        bool operator!=(const const_iterator &other) const;
+
+    private:
+        std::map<BinsonName, BinsonValue>::const_iterator m_it;
+    };
+
+    const_iterator begin() const { return const_iterator(m_items.begin()); }
+    const_iterator end() const { return const_iterator(m_items.end()); }
 
 private:
-    void seralizeItem(binson_writer *w, const BinsonValue &val) const;
-    void seralizeItems(binson_writer *w) const;
-    BinsonValue deseralizeItem(binson_parser *p);
-    void deseralizeItems(binson_parser *p);
+    static const size_t unencodable = SIZE_MAX;
+
+    size_t encodedSize() const;
+    static size_t valueSize(const BinsonValue &val);
+    static size_t bufferSize(size_t size);
+    static size_t addSize(size_t a, size_t b);
+    template <typename OutputIt> OutputIt encodeTo(OutputIt out) const;
+    template <typename OutputIt>
+    static OutputIt encodeValue(OutputIt out, const BinsonValue &val);
+    template <typename OutputIt>
+    static OutputIt encodeNumber(OutputIt out, uint8_t token,
+                                 uint64_t value, size_t width);
+    template <typename OutputIt>
+    static OutputIt encodeBuffer(OutputIt out, uint8_t token, const bbuf &data);
+    binson_err deseralizeItem(binson_parser *p,
+                              const std::shared_ptr<const void> &owner,
+                              BinsonValue &value);
+    binson_err deseralizeItems(binson_parser *p,
+                               const std::shared_ptr<const void> &owner);
+    binson_err deseralizeObject(binson_parser *p,
+                                const std::shared_ptr<const void> &owner);
+    size_t attachEncoded(const std::shared_ptr<const void> &owner, const uint8_t *at);
+    static size_t attachValue(const std::shared_ptr<const void> &owner,
+                              BinsonValue &val,
+                              const uint8_t *at);
+    void invalidate();
 
-    std::map<std::string, BinsonValue> m_items;
+    BinsonValue & item(const std::string &key);
+
+    std::map<BinsonName, BinsonValue> m_items;
+
+    /*
+     * Encoded bytes of this object. Only valid while m_encodedOwner is set,
+     * which only non-const functions do.
+     */
+    bbuf m_encoded = bbuf();
+    std::shared_ptr<const void> m_encodedOwner;
 };
 
 
@@ -85,12 +277,34 @@ public:
     bool getBool() const;
     int64_t getInt() const;
     double getDouble() const;
+    /*
+     * For buffer-backed values the first call copies the value out of the
+     * buffer, once, also when several threads read the same value.
+     * getStringRef()/getBinRef() never copy.
+     */
     const std::string & getString() const;
     const std::vector<uint8_t> & getBin() const;
+    bbuf getStringRef() const;
+    bbuf getBinRef() const;
     const Binson & getObject() const;
     const std::vector<BinsonValue> & getArray() const;
 
+    /* Non-throwing getters, false or nullptr on type mismatch. */
+    bool tryGetBool(bool &value) const;
+    bool tryGetInt(int64_t &value) const;
+    bool tryGetDouble(double &value) const;
+    bool tryGetStringRef(bbuf &value) const;
+    bool tryGetBinRef(bbuf &value) const;
+    const std::string * tryGetString() const;
+    const std::vector<uint8_t> * tryGetBin() const;
+    const Binson * tryGetObject() const;
+    const std::vector<BinsonValue> * tryGetArray() const;
+
 private:
+    friend class Binson;
+
+    /* String or bytes value referencing a buffer owned by owner. */
+    BinsonValue(Types t, const bbuf &ref, const std::shared_ptr<const void> &owner);
 
     static const std::array<std::string, 8> typeToString;
 
@@ -100,29 +314,189 @@ private:
         bool b;
         int64_t i;
         double d;
-        std::string str;
-        std::vector<uint8_t> bin;
+        /*
+         * For buffer-backed values str and bin are only filled in on the
+         * first call to getString()/getBin(), see materialize(). They are
+         * not copied with the value since another thread may be filling
+         * them in.
+         */
+        mutable std::string str;
+        mutable std::vector<uint8_t> bin;
         Binson o;
         std::vector<BinsonValue> a;
         Types tinfo;
+        bbuf ref;
+        std::shared_ptr<const void> owner;
+        mutable std::atomic<bool> materialized;
     public:
-        InternalValue():b(false), tinfo(Types::noneType){ }
+        InternalValue():b(false), tinfo(Types::noneType), ref(), materialized(false){ }
+        InternalValue(const InternalValue &other);
+        InternalValue(InternalValue &&other);
+        InternalValue & operator=(const InternalValue &other);
+        InternalValue & operator=(InternalValue &&other);
 
-        void setType(Types t){ tinfo = t; }
+        void setType(Types t){ tinfo = t; owner.reset(); }
 
         Types myType() const { return tinfo; }
     } m_val;
 
+    void materialize() const;
+
     void checkType(Types expected) const
     {
         if (myType() != expected)
-        {
-            throw std::runtime_error("Wrong type req(" +
-                                     typeToString[(int)expected] + ") actual(" +
-                                     typeToString[(int)m_val.myType()] + ")");
+            throwTypeError(expected);
+    }
 
+    [[noreturn]] void throwTypeError(Types expected) const;
+};
+
+inline Binson::const_iterator::reference Binson::const_iterator::operator*() const
+{
+    return value_type(m_it->first.str(), m_it->second);
+}
+
+inline Binson::const_iterator::pointer Binson::const_iterator::operator->() const
+{
+    return pointer{**this};
+}
+
+inline const BinsonName & Binson::const_iterator::name() const
+{
+    return m_it->first;
+}
+
+inline Binson::const_iterator & Binson::const_iterator::operator++()
+{
+    ++m_it;
+    return *this;
+}
+
+inline Binson::const_iterator Binson::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++m_it;
+    return old;
+}
+
+inline Binson::const_iterator & Binson::const_iterator::operator--()
+{
+    --m_it;
+    return *this;
+}
+
+inline Binson::const_iterator Binson::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --m_it;
+    return old;
+}
+
+inline bool Binson::const_iterator::operator==(const const_iterator &other) const
+{
+    return m_it == other.m_it;
+}
+
+inline bool Binson::const_iterator::operator!=(const const_iterator &other) const
+{
+    return m_it != other.m_it;
+}
+
+template <typename OutputIt>
+OutputIt Binson::serializeTo(OutputIt out) const
+{
+    if (serializedSize() == 0)
+        return out;
+
+    return encodeTo(out);
+}
+
+template <typename OutputIt>
+OutputIt Binson::encodeTo(OutputIt out) const
+{
+    if (m_encodedOwner)
+        return std::copy(m_encoded.bptr, m_encoded.bptr + m_encoded.bsize, out);
+
+    *out++ = static_cast<uint8_t>(BINSON_DEF_OBJECT_BEGIN);
+    for (auto &item: m_items)
+    {
+        bbuf name;
+        name.bptr = reinterpret_cast<const uint8_t*>(item.first.data());
+        name.bsize = item.first.size();
+        out = encodeBuffer(out, BINSON_DEF_STRINGLEN_INT8, name);
+        out = encodeValue(out, item.second);
+    }
+    *out++ = static_cast<uint8_t>(BINSON_DEF_OBJECT_END);
+
+    return out;
+}
+
+template <typename OutputIt>
+OutputIt Binson::encodeValue(OutputIt out, const BinsonValue &val)
+{
+    uint64_t bits;
+
+    switch(val.myType())
+    {
+    case BinsonValue::Types::boolType:
+        *out++ = static_cast<uint8_t>(val.m_val.b ? BINSON_DEF_TRUE : BINSON_DEF_FALSE);
+        break;
+    case BinsonValue::Types::intType:
+    {
+        size_t width = binson_encode_detail::integerWidth(val.m_val.i);
+        out = encodeNumber(out, binson_encode_detail::sizedToken(BINSON_DEF_INT8, width),
+                           static_cast<uint64_t>(val.m_val.i), width);
+    }
+        break;
+    case BinsonValue::Types::doubleType:
+        memcpy(&bits, &val.m_val.d, sizeof(bits));
+        out = encodeNumber(out, BINSON_DEF_DOUBLE, bits, sizeof(bits));
+        break;
+    case BinsonValue::Types::stringType:
+        out = encodeBuffer(out, BINSON_DEF_STRINGLEN_INT8, val.getStringRef());
+        break;
+    case BinsonValue::Types::binaryType:
+        out = encodeBuffer(out, BINSON_DEF_BYTESLEN_INT8, val.getBinRef());
+        break;
+    case BinsonValue::Types::objectType:
+        out = val.m_val.o.encodeTo(out);
+        break;
+    case BinsonValue::Types::arrayType:
+        *out++ = static_cast<uint8_t>(BINSON_DEF_ARRAY_BEGIN);
+        for (auto &arrayValue : val.m_val.a)
+        {
+            out = encodeValue(out, arrayValue);
         }
+        *out++ = static_cast<uint8_t>(BINSON_DEF_ARRAY_END);
+        break;
+    default:
+        break;
     }
-};
+
+    return out;
+}
+
+/* Writes token followed by width little endian bytes of value. */
+template <typename OutputIt>
+OutputIt Binson::encodeNumber(OutputIt out, uint8_t token,
+                              uint64_t value, size_t width)
+{
+    *out++ = token;
+    for (size_t i = 0; i < width; i++)
+    {
+        *out++ = static_cast<uint8_t>(value & 0xFFU);
+        value >>= 8U;
+    }
+
+    return out;
+}
+
+template <typename OutputIt>
+OutputIt Binson::encodeBuffer(OutputIt out, uint8_t token, const bbuf &data)
+{
+    size_t width = binson_encode_detail::integerWidth(static_cast<int64_t>(data.bsize));
+    out = encodeNumber(out, binson_encode_detail::sizedToken(token, width), data.bsize, width);
+    return std::copy(data.bptr, data.bptr + data.bsize, out);
+}
 
 #endif // BINSON_HPP
@@ -0,0 +1,404 @@
+/**
+ * @file binson_batch.c
+ *
+ * Verification of many independent messages on several threads.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "binson_batch.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+/* Element spans binson_batch_verify_array() first allocates room for. */
+#define BINSON_BATCH_SPANS_INITIAL  (4096U)
+
+/*======= Type Definitions ==================================================*/
+
+/* Messages [begin, end) not yet taken from one thread's share. */
+typedef struct _batch_range_s {
+    pthread_mutex_t     lock;
+    size_t              begin;
+    size_t              end;
+} _batch_range;
+
+typedef struct _batch_job_s {
+    const binson_batch  *batch;
+    const bbuf          *messages;
+    binson_err          *results;
+    _batch_range        *ranges;
+    size_t              workers;
+    size_t              chunk;
+} _batch_job;
+
+typedef struct _batch_worker_s {
+    _batch_job          *job;
+    size_t              id;
+    size_t              passed;
+    size_t              failed;
+    pthread_t           thread;
+    bool                started;
+} _batch_worker;
+
+/*======= Local function prototypes =========================================*/
+
+static void *_worker_main(void *context);
+static void _work(_batch_worker *worker);
+static bool _take(_batch_range *range, size_t chunk, size_t *begin, size_t *end);
+static bool _steal(_batch_job *job, size_t self, size_t *begin, size_t *end);
+static binson_err _verify(const binson_batch *batch, const bbuf *message, size_t n);
+
+/*======= Global function implementations ===================================*/
+
+bool binson_batch_init(binson_batch *batch)
+{
+    if (NULL == batch) {
+        return false;
+    }
+
+    memset(batch, 0, sizeof(binson_batch));
+    batch->error_flags = BINSON_ERROR_NONE;
+
+    return true;
+}
+
+bool binson_batch_verify(binson_batch *batch,
+                         const bbuf *messages,
+                         size_t count,
+                         binson_err *results)
+{
+    _batch_job job;
+    _batch_worker *workers;
+    size_t initiated;
+    size_t i;
+
+    if (NULL == batch) {
+        return false;
+    }
+
+    batch->count = count;
+    batch->passed = 0;
+    batch->failed = 0;
+    batch->threads_used = 0;
+
+    if ((NULL == messages) && (count > 0)) {
+        batch->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+
+    job.batch = batch;
+    job.messages = messages;
+    job.results = results;
+    job.chunk = (batch->chunk > 0) ? batch->chunk : BINSON_BATCH_CHUNK_DEFAULT;
+    job.workers = binson_batch_thread_count(batch->threads, BINSON_BATCH_MAX_THREADS,
+                                            count / job.chunk + ((count % job.chunk) ? 1 : 0));
+
+    workers = calloc(job.workers, sizeof(_batch_worker));
+    job.ranges = calloc(job.workers, sizeof(_batch_range));
+    if ((NULL == workers) || (NULL == job.ranges)) {
+        free(workers);
+        free(job.ranges);
+        batch->error_flags = BINSON_ERROR_RANGE;
+        return false;
+    }
+
+    /* Contiguous shares, the first count % workers one message larger. */
+    for (initiated = 0; initiated < job.workers; initiated++) {
+        _batch_range *range = &job.ranges[initiated];
+        size_t share = count / job.workers;
+        size_t extra = count % job.workers;
+
+        if (pthread_mutex_init(&range->lock, NULL) != 0) {
+            break;
+        }
+        range->begin = initiated * share + ((initiated < extra) ? initiated : extra);
+        range->end = range->begin + share + ((initiated < extra) ? 1 : 0);
+
+        workers[initiated].job = &job;
+        workers[initiated].id = initiated;
+    }
+
+    if (initiated < job.workers) {
+        for (i = 0; i < initiated; i++) {
+            pthread_mutex_destroy(&job.ranges[i].lock);
+        }
+        free(workers);
+        free(job.ranges);
+        batch->error_flags = BINSON_ERROR_RANGE;
+        return false;
+    }
+
+    /*
+     * The calling thread is worker 0. The share of a worker that cannot be
+     * started is stolen by the others.
+     */
+    batch->threads_used = 1;
+    for (i = 1; i < job.workers; i++) {
+        workers[i].started =
+            (pthread_create(&workers[i].thread, NULL, _worker_main, &workers[i]) == 0);
+        batch->threads_used += workers[i].started ? 1 : 0;
+    }
+
+    _work(&workers[0]);
+
+    /* Running workers may still look at any range, so join them all first. */
+    for (i = 0; i < job.workers; i++) {
+        if (workers[i].started) {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+    for (i = 0; i < job.workers; i++) {
+        batch->passed += workers[i].passed;
+        batch->failed += workers[i].failed;
+        pthread_mutex_destroy(&job.ranges[i].lock);
+    }
+
+    free(workers);
+    free(job.ranges);
+    batch->error_flags = BINSON_ERROR_NONE;
+
+    return true;
+}
+
+bool binson_batch_verify_array(binson_batch *batch,
+                               const uint8_t *array,
+                               size_t size,
+                               binson_err *results,
+                               size_t results_size)
+{
+    binson_message_iter iter;
+    bbuf *spans = NULL;
+    size_t capacity = 0;
+    size_t count = 0;
+    bool ok;
+
+    if (NULL == batch) {
+        return false;
+    }
+
+    batch->count = 0;
+    batch->passed = 0;
+    batch->failed = 0;
+    batch->threads_used = 0;
+
+    if (NULL == array) {
+        batch->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+    if (!binson_array_iter_init(&iter, array, size)) {
+        batch->error_flags = iter.error_flags;
+        return false;
+    }
+
+    for (;;) {
+        if (count == capacity) {
+            size_t grown_capacity = (capacity > 0) ? capacity * 2 : BINSON_BATCH_SPANS_INITIAL;
+            bbuf *grown = realloc(spans, grown_capacity * sizeof(bbuf));
+
+            if (NULL == grown) {
+                free(spans);
+                batch->error_flags = BINSON_ERROR_RANGE;
+                return false;
+            }
+            spans = grown;
+            capacity = grown_capacity;
+        }
+
+        count += binson_array_iter_spans(&iter, &spans[count], capacity - count);
+        if (count < capacity) {
+            break;
+        }
+    }
+
+    batch->count = count;
+    if (BINSON_ERROR_NONE != iter.error_flags) {
+        batch->error_flags = iter.error_flags;
+        ok = false;
+    }
+    else if ((NULL != results) && (count > results_size)) {
+        batch->error_flags = BINSON_ERROR_RANGE;
+        ok = false;
+    }
+    else {
+        ok = binson_batch_verify(batch, spans, count, results);
+    }
+
+    free(spans);
+
+    return ok;
+}
+
+size_t binson_batch_thread_count(size_t threads, size_t max, size_t units)
+{
+    if (0 == threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+        threads = (online > 0) ? (size_t) online : 1;
+    }
+    if (threads > max) {
+        threads = max;
+    }
+    if (threads > units) {
+        threads = units;
+    }
+
+    return (threads > 0) ? threads : 1;
+}
+
+/*======= Local function implementations ====================================*/
+
+static void *_worker_main(void *context)
+{
+    _work((_batch_worker *) context);
+    return NULL;
+}
+
+static void _work(_batch_worker *worker)
+{
+    _batch_job *job = worker->job;
+    _batch_range *own = &job->ranges[worker->id];
+    size_t begin;
+    size_t end;
+
+    for (;;) {
+        size_t i;
+
+        if (!_take(own, job->chunk, &begin, &end)) {
+            if (!_steal(job, worker->id, &begin, &end)) {
+                break;
+            }
+
+            /* Publish the stolen messages so that they can be stolen again. */
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            continue;
+        }
+
+        for (i = begin; i < end; i++) {
+            binson_err result = _verify(job->batch, &job->messages[i], i);
+
+            if (NULL != job->results) {
+                job->results[i] = result;
+            }
+            if (BINSON_ERROR_NONE == result) {
+                worker->passed++;
+            }
+            else {
+                worker->failed++;
+            }
+        }
+    }
+}
+
+/* Takes up to chunk messages from the front of range. */
+static bool _take(_batch_range *range, size_t chunk, size_t *begin, size_t *end)
+{
+    bool taken = false;
+
+    pthread_mutex_lock(&range->lock);
+    if (range->begin < range->end) {
+        size_t left = range->end - range->begin;
+
+        *begin = range->begin;
+        *end = range->begin + ((left < chunk) ? left : chunk);
+        range->begin = *end;
+        taken = true;
+    }
+    pthread_mutex_unlock(&range->lock);
+
+    return taken;
+}
+
+/*
+ * Takes the back half of the largest range of the other workers. Fails
+ * when all of them are empty. The messages a thief is about to publish in
+ * its own range are not visible to others, so a worker may stop while
+ * work is left; that work is still done by the thief.
+ */
+static bool _steal(_batch_job *job, size_t self, size_t *begin, size_t *end)
+{
+    for (;;) {
+        size_t victim = job->workers;
+        size_t most = 0;
+        size_t left;
+        size_t i;
+
+        for (i = 0; i < job->workers; i++) {
+            _batch_range *range = &job->ranges[i];
+
+            if (i == self) {
+                continue;
+            }
+            pthread_mutex_lock(&range->lock);
+            left = range->end - range->begin;
+            pthread_mutex_unlock(&range->lock);
+
+            if (left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+
+        if (victim == job->workers) {
+            return false;
+        }
+
+        pthread_mutex_lock(&job->ranges[victim].lock);
+        left = job->ranges[victim].end - job->ranges[victim].begin;
+        if (left > 0) {
+            size_t half = left - left / 2;
+
+            *end = job->ranges[victim].end;
+            *begin = *end - half;
+            job->ranges[victim].end = *begin;
+        }
+        pthread_mutex_unlock(&job->ranges[victim].lock);
+
+        if (left > 0) {
+            return true;
+        }
+    }
+}
+
+static binson_err _verify(const binson_batch *batch, const bbuf *message, size_t n)
+{
+    binson_parser parser;
+    bool ok;
+
+    /* The init functions return false for a NULL buffer without a code. */
+    parser.error_flags = BINSON_ERROR_NULL;
+
+    if ((NULL != message->bptr) && (message->bsize > 0) &&
+        (BINSON_DEF_ARRAY_BEGIN == message->bptr[0])) {
+        ok = binson_parser_init_array(&parser, message->bptr, message->bsize);
+    }
+    else {
+        ok = binson_parser_init_object(&parser, message->bptr, message->bsize);
+    }
+    if (!ok) {
+        return parser.error_flags;
+    }
+
+    parser.options = batch->parser_options;
+
+    /* binson_parser_verify() resets the parser, also its error flags. */
+    if (!binson_parser_verify(&parser)) {
+        return BINSON_ERROR_FORMAT;
+    }
+
+    if (NULL != batch->callback) {
+        return batch->callback(batch->callback_context, n, &parser);
+    }
+
+    return BINSON_ERROR_NONE;
+}
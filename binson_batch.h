@@ -0,0 +1,146 @@
+#ifndef _BINSON_BATCH_H_
+#define _BINSON_BATCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file binson_batch.h
+ *
+ * Verification of many independent messages on several threads.
+ *
+ * The messages are split into one contiguous range per thread. A thread
+ * takes chunks from the front of its own range and, when that is empty,
+ * steals the back half of the largest range left, so uneven message sizes
+ * do not leave threads idle. The result of message i is always written to
+ * results[i] and depends only on the message, so the output is the same
+ * for any number of threads.
+ *
+ * binson_batch_verify_array() does the same for the elements of one large
+ * top level array, see binson_batch.hpp for deserializing them.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include "binson_defines.h"
+#include "binson_parser.h"
+
+/*======= Public macro definitions ==========================================*/
+
+/* Most threads binson_batch_verify() starts. */
+#define BINSON_BATCH_MAX_THREADS    (256U)
+
+/* Messages a thread takes at a time when batch->chunk is 0. */
+#define BINSON_BATCH_CHUNK_DEFAULT  (64U)
+
+/*======= Type Definitions and declarations =================================*/
+
+/**
+ * Called for each message that passed verification, with a parser
+ * initiated on it. Runs on the worker threads: calls for different
+ * messages may run at the same time and in any order.
+ *
+ * @param context   batch->callback_context.
+ * @param n         Index of the message.
+ * @param parser    Parser at the start of message n.
+ *
+ * @return The result for message n, BINSON_ERROR_NONE to accept it.
+ */
+typedef binson_err (*binson_batch_callback)(void *context, size_t n, binson_parser *parser);
+
+typedef struct binson_batch_s {
+    size_t                  threads;        /* 0: one per online processor. */
+    size_t                  chunk;          /* 0: BINSON_BATCH_CHUNK_DEFAULT. */
+    uint8_t                 parser_options; /* E.g. BINSON_PARSER_OPTION_VALIDATE_UTF8. */
+    binson_batch_callback   callback;       /* Optional. */
+    void                    *callback_context;
+    size_t                  count;          /* Messages or array elements. */
+    size_t                  passed;         /* Messages with result BINSON_ERROR_NONE. */
+    size_t                  failed;
+    size_t                  threads_used;
+    binson_err              error_flags;
+} binson_batch;
+
+/*======= Public function declarations ======================================*/
+
+/**
+ * @brief Initiates a batch with default settings and no callback.
+ */
+bool binson_batch_init(binson_batch *batch);
+
+/**
+ * @brief Verifies messages with binson_parser_verify() on several threads.
+ *
+ * A message is a binson object or array. Its result is BINSON_ERROR_NONE
+ * if it verifies and the callback, if any, accepts it. Otherwise it is the
+ * error of binson_parser_init_object() or binson_parser_init_array(),
+ * BINSON_ERROR_FORMAT if verification failed, or the error returned by the
+ * callback.
+ *
+ * Falls back to fewer threads, down to only the calling one, if threads
+ * cannot be started. batch->count, batch->passed, batch->failed and
+ * batch->threads_used are set when the call returns.
+ *
+ * @param batch     Settings, see binson_batch_init().
+ * @param messages  Messages, each bptr and bsize.
+ * @param count     Number of messages.
+ * @param results   count results, or NULL if only the totals are needed.
+ *
+ * @return true     All messages were processed, see batch->failed.
+ * @return false    Invalid arguments (BINSON_ERROR_NULL) or no memory for
+ *                  the thread state (BINSON_ERROR_RANGE), see
+ *                  batch->error_flags.
+ */
+bool binson_batch_verify(binson_batch *batch,
+                         const bbuf *messages,
+                         size_t count,
+                         binson_err *results);
+
+/**
+ * @brief Verifies the elements of one top level array on several threads.
+ *
+ * The elements are found with binson_array_iter_spans() on the calling
+ * thread and then passed to binson_batch_verify(), so each object or array
+ * element is verified and handed to the callback as a message of its own.
+ * Elements of other types get BINSON_ERROR_FORMAT. The callback gets the
+ * element index as n.
+ *
+ * @param batch         Settings, see binson_batch_init().
+ * @param array         Serialized array.
+ * @param size          Size of array.
+ * @param results       One result per element, or NULL.
+ * @param results_size  Number of entries in results.
+ *
+ * @return true     All elements were processed, batch->count of them.
+ * @return false    array is not a well formed sequence of elements
+ *                  (BINSON_ERROR_FORMAT), NULL (BINSON_ERROR_NULL), or
+ *                  memory is short (BINSON_ERROR_RANGE). BINSON_ERROR_RANGE
+ *                  is also returned, before any element is verified, when
+ *                  results has fewer than batch->count entries.
+ */
+bool binson_batch_verify_array(binson_batch *batch,
+                               const uint8_t *array,
+                               size_t size,
+                               binson_err *results,
+                               size_t results_size);
+
+/**
+ * @brief Gets the number of worker threads to start for a parallel job.
+ *
+ * Shared by the multi threaded functions of the library.
+ *
+ * @param threads   Requested threads, 0 for one per online processor.
+ * @param max       Most threads the caller supports.
+ * @param units     Pieces of work that can run in parallel.
+ *
+ * @return threads, but no more than max and units, and at least 1.
+ */
+size_t binson_batch_thread_count(size_t threads, size_t max, size_t units);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BINSON_BATCH_H_ */
@@ -0,0 +1,121 @@
+#ifndef BINSON_BATCH_HPP
+#define BINSON_BATCH_HPP
+
+/**
+ * @file binson_batch.hpp
+ *
+ * Deserialization of the elements of one large top level array on several
+ * threads.
+ *
+ *   std::vector<Point> points;
+ *   binson_err err = binsonDeserializeArray(points, data, size);
+ *
+ * The element type is Binson or a struct reflected with BINSON_FIELDS.
+ * The element boundaries are found first with binson_array_iter_spans().
+ * binson_batch_verify() then verifies each element and deserializes it
+ * into out[i] on whichever thread takes element i. out is therefore in
+ * array order for any number of threads.
+ */
+
+#include <new>
+#include <vector>
+#include <stdint.h>
+
+#include <binson.hpp>
+#include <binson_struct.hpp>
+#include <binson_batch.h>
+
+namespace binson_batch_detail
+{
+
+inline binson_err deserializeElement(Binson &object, binson_parser *p)
+{
+    return object.tryDeserialize(p);
+}
+
+template <typename T>
+binson_err deserializeElement(T &object, binson_parser *p)
+{
+    return binsonDeserialize(object, p);
+}
+
+/* Runs on the worker threads, each call writes only out[n]. */
+template <typename T>
+binson_err deserializeCallback(void *context, size_t n, binson_parser *p)
+{
+    std::vector<T> &out = *static_cast<std::vector<T> *>(context);
+
+    try
+    {
+        return deserializeElement(out[n], p);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return BINSON_ERROR_RANGE;
+    }
+}
+
+} /* namespace binson_batch_detail */
+
+/*
+ * Deserializes every element of the array in data into out, which gets one
+ * entry per element. Returns BINSON_ERROR_NONE, the error of the first
+ * failing element in array order, or the scan error if data is not a well
+ * formed array. The entries of failed elements are left empty. results, if
+ * given, gets the result of every element.
+ *
+ * threads and chunk are as in binson_batch, 0 for the defaults.
+ */
+template <typename T>
+binson_err binsonDeserializeArray(std::vector<T> &out,
+                                  const uint8_t *data,
+                                  size_t size,
+                                  size_t threads = 0,
+                                  std::vector<binson_err> *results = nullptr,
+                                  size_t chunk = 0)
+{
+    binson_message_iter iter;
+    std::vector<bbuf> spans;
+    std::vector<binson_err> local;
+    std::vector<binson_err> &res = (results != nullptr) ? *results : local;
+    binson_batch batch;
+    size_t count = 0;
+
+    out.clear();
+    res.clear();
+    if (data == nullptr)
+        return BINSON_ERROR_NULL;
+    if (!binson_array_iter_init(&iter, data, size))
+        return iter.error_flags;
+
+    do
+    {
+        spans.resize((count == 0) ? 4096 : count * 2);
+        count += binson_array_iter_spans(&iter, &spans[count], spans.size() - count);
+    } while (count == spans.size());
+    spans.resize(count);
+
+    if (iter.error_flags != BINSON_ERROR_NONE)
+        return iter.error_flags;
+
+    out.resize(count);
+    res.assign(count, BINSON_ERROR_NONE);
+
+    binson_batch_init(&batch);
+    batch.threads = threads;
+    batch.chunk = chunk;
+    batch.callback = binson_batch_detail::deserializeCallback<T>;
+    batch.callback_context = &out;
+
+    if (!binson_batch_verify(&batch, spans.data(), count, res.data()))
+        return batch.error_flags;
+
+    for (binson_err err : res)
+    {
+        if (err != BINSON_ERROR_NONE)
+            return err;
+    }
+    return BINSON_ERROR_NONE;
+}
+
+#endif /* BINSON_BATCH_HPP */
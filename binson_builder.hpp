@@ -0,0 +1,309 @@
+#ifndef BINSON_BUILDER_HPP
+#define BINSON_BUILDER_HPP
+
+/**
+ * @file binson_builder.hpp
+ *
+ * Header-only streaming builder writing directly into a binson_writer.
+ *
+ * Nothing is allocated: object and array scopes write their begin token
+ * when created and their end token when destroyed (or closed). Errors and
+ * the required size are tracked in the writer exactly as the
+ * binson_write_* functions do, so binson_writer_get_counter() reports the
+ * size needed when the buffer was too small.
+ *
+ *   binson_writer w;
+ *   binson_writer_init(&w, buf, sizeof(buf));
+ *   BinsonBuilder b(&w);
+ *   {
+ *       BinsonBuilder::Object root = b.object();
+ *       root.field("a", 1).field("b", "text");
+ *       BinsonBuilder::Array list = root.array("c");
+ *       list.value(1).value(2.5);
+ *   }
+ *
+ * As with the writer, fields must be added in binson (sorted) order.
+ */
+
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include <binson_light.h>
+#include <binson_encode.hpp>
+
+/*
+ * Field name with its string header encoded at compile time when
+ * constructed from a string literal. Only pass string literals to the
+ * array constructor, other character arrays must use (name, length) or
+ * std::string since the array size is taken as the name length.
+ */
+class BinsonFieldName
+{
+public:
+    template <size_t N>
+    constexpr BinsonFieldName(const char (&name)[N])
+        : BinsonFieldName(name, N - 1) { }
+
+    constexpr BinsonFieldName(const char *name, size_t length)
+        : m_name(name),
+          m_length(length),
+          m_header{ binson_encode_detail::sizedToken(
+                        BINSON_DEF_STRINGLEN_INT8,
+                        binson_encode_detail::integerWidth(static_cast<int64_t>(length))),
+                    binson_encode_detail::numberByte(length, 0),
+                    binson_encode_detail::numberByte(length, 1),
+                    binson_encode_detail::numberByte(length, 2),
+                    binson_encode_detail::numberByte(length, 3) },
+          m_headerSize(binson_encode_detail::lengthHeaderSize(length)) { }
+
+    BinsonFieldName(const std::string &name)
+        : BinsonFieldName(name.data(), name.size()) { }
+
+    constexpr const char *data() const { return m_name; }
+    constexpr size_t size() const { return m_length; }
+    constexpr const uint8_t *header() const { return m_header; }
+    constexpr size_t headerSize() const { return m_headerSize; }
+
+private:
+    const char *m_name;
+    size_t m_length;
+    uint8_t m_header[5];
+    size_t m_headerSize;
+};
+
+class BinsonBuilder
+{
+public:
+    class Array;
+
+    /* Object scope, writes OBJECT_END when destroyed or closed. */
+    class Object
+    {
+    public:
+        Object(Object &&other) : m_writer(other.m_writer) { other.m_writer = nullptr; }
+        ~Object() { close(); }
+
+        template <typename T>
+        Object & field(const BinsonFieldName &name, const T &value)
+        {
+            writeName(m_writer, name);
+            writeValue(m_writer, value);
+            return *this;
+        }
+        Object & field(const BinsonFieldName &name, const uint8_t *data, size_t size)
+        {
+            writeName(m_writer, name);
+            writeBuffer(m_writer, BINSON_DEF_BYTESLEN_INT8, data, size);
+            return *this;
+        }
+        Object object(const BinsonFieldName &name)
+        {
+            writeName(m_writer, name);
+            return Object(m_writer);
+        }
+        inline Array array(const BinsonFieldName &name);
+
+        void close()
+        {
+            if (m_writer != nullptr)
+                writeToken(m_writer, BINSON_DEF_OBJECT_END);
+            m_writer = nullptr;
+        }
+
+    private:
+        friend class BinsonBuilder;
+        friend class Array;
+
+        explicit Object(binson_writer *writer) : m_writer(writer)
+        {
+            writeToken(m_writer, BINSON_DEF_OBJECT_BEGIN);
+        }
+        Object(const Object &) = delete;
+        Object & operator=(const Object &) = delete;
+
+        binson_writer *m_writer;
+    };
+
+    /* Array scope, writes ARRAY_END when destroyed or closed. */
+    class Array
+    {
+    public:
+        Array(Array &&other) : m_writer(other.m_writer) { other.m_writer = nullptr; }
+        ~Array() { close(); }
+
+        template <typename T>
+        Array & value(const T &value)
+        {
+            writeValue(m_writer, value);
+            return *this;
+        }
+        Array & value(const uint8_t *data, size_t size)
+        {
+            writeBuffer(m_writer, BINSON_DEF_BYTESLEN_INT8, data, size);
+            return *this;
+        }
+        Object object() { return Object(m_writer); }
+        Array array() { return Array(m_writer); }
+
+        void close()
+        {
+            if (m_writer != nullptr)
+                writeToken(m_writer, BINSON_DEF_ARRAY_END);
+            m_writer = nullptr;
+        }
+
+    private:
+        friend class Object;
+
+        explicit Array(binson_writer *writer) : m_writer(writer)
+        {
+            writeToken(m_writer, BINSON_DEF_ARRAY_BEGIN);
+        }
+        Array(const Array &) = delete;
+        Array & operator=(const Array &) = delete;
+
+        binson_writer *m_writer;
+    };
+
+    explicit BinsonBuilder(binson_writer *writer) : m_writer(writer) { }
+
+    /* Begins the top level object. */
+    Object object() { return Object(m_writer); }
+
+    binson_err error() const { return m_writer->error_flags; }
+    bool ok() const { return m_writer->error_flags == BINSON_ERROR_NONE; }
+    /* Bytes written, or required if the buffer was too small. */
+    size_t size() const { return m_writer->buffer_used; }
+
+private:
+    /*
+     * Reserves size bytes in the writer. Returns where to write them, or
+     * nullptr if the writer is in error, in which case only the counter is
+     * advanced (same accounting as binson_write_raw()).
+     */
+    static uint8_t *claim(binson_writer *w, size_t size)
+    {
+        size_t end = w->buffer_used + size;
+
+        if ((end > w->buffer_size) || (end < w->buffer_used))
+            w->error_flags = BINSON_ERROR_RANGE;
+        if (w->buffer == nullptr)
+            w->error_flags = BINSON_ERROR_NULL;
+
+        uint8_t *out = (w->error_flags == BINSON_ERROR_NONE) ? &w->buffer[w->buffer_used] : nullptr;
+        w->buffer_used += size;
+        return out;
+    }
+
+    static void encodeNumber(uint8_t *out, uint64_t value, size_t width)
+    {
+        for (size_t i = 0; i < width; i++)
+            out[i] = binson_encode_detail::numberByte(value, i);
+    }
+
+    static void writeToken(binson_writer *w, uint8_t token)
+    {
+        uint8_t *out = claim(w, 1);
+        if (out != nullptr)
+            *out = token;
+    }
+
+    static void writeName(binson_writer *w, const BinsonFieldName &name)
+    {
+        if (name.size() > INT32_MAX)
+        {
+            w->error_flags = BINSON_ERROR_FORMAT;
+            return;
+        }
+
+        uint8_t *out = claim(w, name.headerSize() + name.size());
+        if (out != nullptr)
+        {
+            memcpy(out, name.header(), name.headerSize());
+            memcpy(out + name.headerSize(), name.data(), name.size());
+        }
+    }
+
+    static void writeBuffer(binson_writer *w, uint8_t token, const void *data, size_t size)
+    {
+        if (size > INT32_MAX)
+        {
+            w->error_flags = BINSON_ERROR_FORMAT;
+            return;
+        }
+
+        size_t width = binson_encode_detail::integerWidth(static_cast<int64_t>(size));
+        uint8_t *out = claim(w, 1 + width + size);
+        if (out != nullptr)
+        {
+            out[0] = binson_encode_detail::sizedToken(token, width);
+            encodeNumber(out + 1, size, width);
+            if (size > 0)
+                memcpy(out + 1 + width, data, size);
+        }
+    }
+
+    static void writeValue(binson_writer *w, bool value)
+    {
+        writeToken(w, value ? BINSON_DEF_TRUE : BINSON_DEF_FALSE);
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value>::type
+    writeValue(binson_writer *w, T value)
+    {
+        int64_t i = static_cast<int64_t>(value);
+        size_t width = binson_encode_detail::integerWidth(i);
+        uint8_t *out = claim(w, 1 + width);
+        if (out != nullptr)
+        {
+            out[0] = binson_encode_detail::sizedToken(BINSON_DEF_INT8, width);
+            encodeNumber(out + 1, static_cast<uint64_t>(i), width);
+        }
+    }
+
+    static void writeValue(binson_writer *w, double value)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint8_t *out = claim(w, 1 + sizeof(bits));
+        if (out != nullptr)
+        {
+            out[0] = BINSON_DEF_DOUBLE;
+            encodeNumber(out + 1, bits, sizeof(bits));
+        }
+    }
+
+    static void writeValue(binson_writer *w, float value)
+    {
+        writeValue(w, static_cast<double>(value));
+    }
+
+    static void writeValue(binson_writer *w, const char *value)
+    {
+        writeBuffer(w, BINSON_DEF_STRINGLEN_INT8, value, strlen(value));
+    }
+
+    static void writeValue(binson_writer *w, const std::string &value)
+    {
+        writeBuffer(w, BINSON_DEF_STRINGLEN_INT8, value.data(), value.size());
+    }
+
+    static void writeValue(binson_writer *w, const std::vector<uint8_t> &value)
+    {
+        writeBuffer(w, BINSON_DEF_BYTESLEN_INT8, value.data(), value.size());
+    }
+
+    binson_writer *m_writer;
+};
+
+inline BinsonBuilder::Array BinsonBuilder::Object::array(const BinsonFieldName &name)
+{
+    writeName(m_writer, name);
+    return Array(m_writer);
+}
+
+#endif /* BINSON_BUILDER_HPP */
@@ -0,0 +1,70 @@
+#ifndef _BINSON_CPU_H_
+#define _BINSON_CPU_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file binson_cpu.h
+ *
+ * Runtime CPU feature detection for the optional vectorized code paths.
+ *
+ * BINSON_CPU_X86_DISPATCH is defined when the compiler can build functions
+ * for a wider instruction set than the rest of the translation unit (GCC
+ * and Clang on x86) and BINSON_NO_SIMD is not defined. Such functions are
+ * only called after the matching binson_cpu_has_*() check returned true,
+ * so the library itself can still be built for the baseline target.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdbool.h>
+
+/*======= Public macro definitions ==========================================*/
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__)) && \
+    !defined(BINSON_NO_SIMD)
+#define BINSON_CPU_X86_DISPATCH
+#endif
+
+/*======= Public function declarations ======================================*/
+
+/**
+ * @brief Check if the running CPU supports AVX2.
+ *
+ * @return true if AVX2 instructions can be used, false otherwise or when
+ *         runtime dispatch is not available in this build.
+ */
+static inline bool binson_cpu_has_avx2(void)
+{
+#ifdef BINSON_CPU_X86_DISPATCH
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Check if the running CPU supports SSE4.2, which includes the
+ *        CRC32C instructions.
+ *
+ * @return true if SSE4.2 instructions can be used, false otherwise or when
+ *         runtime dispatch is not available in this build.
+ */
+static inline bool binson_cpu_has_sse42(void)
+{
+#ifdef BINSON_CPU_X86_DISPATCH
+    return __builtin_cpu_supports("sse4.2") != 0;
+#else
+    return false;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BINSON_CPU_H_ */
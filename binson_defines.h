@@ -47,6 +47,20 @@ extern "C" {
 
 #define BINSON_OBJECT_MINIMUM_SIZE  (2U)
 
+/*
+ * BINSON_LITTLE_ENDIAN is defined on little endian hosts, where integers
+ * and doubles are loaded and stored with memcpy instead of byte by byte.
+ * Define BINSON_PORTABLE_ENDIAN to always use the portable byte loops.
+ */
+#if !defined(BINSON_PORTABLE_ENDIAN) && !defined(BINSON_LITTLE_ENDIAN)
+#if (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)) || \
+    defined(__x86_64__) || defined(__i386__) || \
+    defined(_M_X64) || defined(_M_IX86) || \
+    defined(__AARCH64EL__) || defined(__ARMEL__)
+#define BINSON_LITTLE_ENDIAN
+#endif
+#endif
+
 #define BINSON_DEF_OBJECT_BEGIN     (0x40U)
 #define BINSON_DEF_OBJECT_END       (0x41U)
 #define BINSON_DEF_ARRAY_BEGIN      (0x42U)
@@ -0,0 +1,50 @@
+#ifndef BINSON_ENCODE_HPP
+#define BINSON_ENCODE_HPP
+
+/**
+ * @file binson_encode.hpp
+ *
+ * Internal helpers shared by the C++ encoders (binson.hpp and
+ * binson_builder.hpp): integer widths, sized tokens and string or bytes
+ * length headers. constexpr so field names can be encoded at compile time.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <binson_light.h>
+
+namespace binson_encode_detail
+{
+
+/* Bytes needed to store value as a binson integer or length. */
+constexpr size_t integerWidth(int64_t value)
+{
+    return ((value >= INT8_MIN) && (value <= INT8_MAX)) ? sizeof(int8_t) :
+           ((value >= INT16_MIN) && (value <= INT16_MAX)) ? sizeof(int16_t) :
+           ((value >= INT32_MIN) && (value <= INT32_MAX)) ? sizeof(int32_t) :
+           sizeof(int64_t);
+}
+
+/* INT8, STRINGLEN_INT8 or BYTESLEN_INT8 token adjusted for width. */
+constexpr uint8_t sizedToken(uint8_t token, size_t width)
+{
+    return static_cast<uint8_t>(token + ((width == 1) ? 0 : (width == 2) ? 1 :
+                                         (width == 4) ? 2 : 3));
+}
+
+/* Byte index of a little endian number. */
+constexpr uint8_t numberByte(uint64_t value, size_t index)
+{
+    return static_cast<uint8_t>(value >> (8 * index));
+}
+
+/* Size of the token and length in front of a string or bytes value. */
+constexpr size_t lengthHeaderSize(size_t length)
+{
+    return 1 + integerWidth(static_cast<int64_t>(length));
+}
+
+} /* namespace binson_encode_detail */
+
+#endif /* BINSON_ENCODE_HPP */
@@ -0,0 +1,699 @@
+/**
+ * @file binson_filter.c
+ *
+ * Predicates evaluated on the raw bytes of binson objects, and parallel
+ * filtering of record files with them.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binson_filter.h"
+#include "binson_batch.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+/*======= Type Definitions ==================================================*/
+
+/* Object being tested, and the dictionary of its block if it has one. */
+typedef struct _filter_object_s {
+    const uint8_t       *data;
+    size_t              size;
+    const uint8_t       *ends;
+    const uint8_t       *names;
+    uint32_t            entries;
+} _filter_object;
+
+typedef struct _filter_job_s {
+    const binson_filter_scan    *scan;
+    const binson_filter         *filter;
+    const binson_record_file    *file;
+    pthread_mutex_t             lock;
+    size_t                      next_block;
+} _filter_job;
+
+typedef struct _filter_worker_s {
+    _filter_job         *job;
+    uint64_t            scanned;
+    uint64_t            matched;
+    size_t              damaged;
+    pthread_t           thread;
+    bool                started;
+} _filter_worker;
+
+/*======= Local function prototypes =========================================*/
+
+static binson_filter_predicate *_add(binson_filter *filter,
+                                     const char *path,
+                                     binson_filter_op op,
+                                     binson_type type,
+                                     const uint8_t *value,
+                                     size_t value_size);
+static bool _match(const binson_filter *filter, const _filter_object *object);
+static const uint8_t *_find(const binson_filter *filter,
+                            const binson_filter_predicate *predicate,
+                            const _filter_object *object,
+                            size_t *size);
+static bool _test(const binson_filter *filter,
+                  const binson_filter_predicate *predicate,
+                  const uint8_t *value,
+                  size_t size);
+static size_t _name(const _filter_object *object, const uint8_t *data, size_t size, bbuf *name);
+static size_t _content(const uint8_t *data, size_t size, bbuf *content);
+static size_t _value_size(const _filter_object *object, const uint8_t *data, size_t size);
+static int _cmp_name(const bbuf *a, const bbuf *b);
+static uint64_t _load_le(const uint8_t *data, size_t size);
+static void *_worker_main(void *context);
+static void _work(_filter_worker *worker);
+
+/*======= Global function implementations ===================================*/
+
+bool binson_filter_init(binson_filter *filter)
+{
+    if (NULL == filter) {
+        return false;
+    }
+
+    memset(filter, 0, sizeof(binson_filter));
+    filter->error_flags = BINSON_ERROR_NONE;
+
+    return true;
+}
+
+bool binson_filter_exists(binson_filter *filter, const char *path)
+{
+    return NULL != _add(filter, path, BINSON_FILTER_EXISTS, BINSON_TYPE_NONE, NULL, 0);
+}
+
+bool binson_filter_equal_integer(binson_filter *filter, const char *path, int64_t value)
+{
+    binson_filter_predicate *predicate =
+        _add(filter, path, BINSON_FILTER_EQUAL, BINSON_TYPE_INTEGER, NULL, 0);
+
+    if (NULL == predicate) {
+        return false;
+    }
+    predicate->integer_min = value;
+    predicate->integer_max = value;
+
+    return true;
+}
+
+bool binson_filter_equal_boolean(binson_filter *filter, const char *path, bool value)
+{
+    binson_filter_predicate *predicate =
+        _add(filter, path, BINSON_FILTER_EQUAL, BINSON_TYPE_BOOLEAN, NULL, 0);
+
+    if (NULL == predicate) {
+        return false;
+    }
+    predicate->integer_min = value ? 1 : 0;
+
+    return true;
+}
+
+bool binson_filter_equal_string(binson_filter *filter, const char *path, const char *value)
+{
+    if ((NULL == value) && (NULL != filter)) {
+        filter->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+
+    return NULL != _add(filter, path, BINSON_FILTER_EQUAL, BINSON_TYPE_STRING,
+                        (const uint8_t *) value, (NULL != value) ? strlen(value) : 0);
+}
+
+bool binson_filter_equal_bytes(binson_filter *filter,
+                               const char *path,
+                               const uint8_t *value,
+                               size_t size)
+{
+    return NULL != _add(filter, path, BINSON_FILTER_EQUAL, BINSON_TYPE_BYTES, value, size);
+}
+
+bool binson_filter_range_integer(binson_filter *filter,
+                                 const char *path,
+                                 int64_t min,
+                                 int64_t max)
+{
+    binson_filter_predicate *predicate =
+        _add(filter, path, BINSON_FILTER_RANGE, BINSON_TYPE_INTEGER, NULL, 0);
+
+    if (NULL == predicate) {
+        return false;
+    }
+    predicate->integer_min = min;
+    predicate->integer_max = max;
+
+    return true;
+}
+
+bool binson_filter_range_double(binson_filter *filter,
+                                const char *path,
+                                double min,
+                                double max)
+{
+    binson_filter_predicate *predicate =
+        _add(filter, path, BINSON_FILTER_RANGE, BINSON_TYPE_DOUBLE, NULL, 0);
+
+    if (NULL == predicate) {
+        return false;
+    }
+    predicate->double_min = min;
+    predicate->double_max = max;
+
+    return true;
+}
+
+bool binson_filter_prefix_string(binson_filter *filter, const char *path, const char *prefix)
+{
+    if ((NULL == prefix) && (NULL != filter)) {
+        filter->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+
+    return NULL != _add(filter, path, BINSON_FILTER_PREFIX, BINSON_TYPE_STRING,
+                        (const uint8_t *) prefix, (NULL != prefix) ? strlen(prefix) : 0);
+}
+
+bool binson_filter_prefix_bytes(binson_filter *filter,
+                                const char *path,
+                                const uint8_t *prefix,
+                                size_t size)
+{
+    return NULL != _add(filter, path, BINSON_FILTER_PREFIX, BINSON_TYPE_BYTES, prefix, size);
+}
+
+bool binson_filter_match(const binson_filter *filter, const uint8_t *data, size_t size)
+{
+    _filter_object object;
+
+    memset(&object, 0, sizeof(object));
+    object.data = data;
+    object.size = size;
+
+    return _match(filter, &object);
+}
+
+bool binson_filter_match_record(const binson_filter *filter,
+                                const binson_record_block *block,
+                                const bbuf *record)
+{
+    _filter_object object;
+
+    if ((NULL == block) || (NULL == record)) {
+        return false;
+    }
+
+    memset(&object, 0, sizeof(object));
+    object.data = record->bptr;
+    object.size = record->bsize;
+
+    /* The dictionary was checked by binson_record_block_open(). */
+    if (NULL != block->dictionary) {
+        object.entries = (uint32_t) _load_le(block->dictionary, 2);
+        object.ends = &block->dictionary[2];
+        object.names = &object.ends[2 * object.entries];
+    }
+
+    return _match(filter, &object);
+}
+
+bool binson_filter_scan_init(binson_filter_scan *scan)
+{
+    if (NULL == scan) {
+        return false;
+    }
+
+    memset(scan, 0, sizeof(binson_filter_scan));
+    scan->error_flags = BINSON_ERROR_NONE;
+
+    return true;
+}
+
+bool binson_filter_scan_file(binson_filter_scan *scan,
+                             const binson_filter *filter,
+                             const binson_record_file *file)
+{
+    _filter_job job;
+    _filter_worker *workers;
+    size_t count;
+    size_t i;
+
+    if (NULL == scan) {
+        return false;
+    }
+
+    scan->scanned = 0;
+    scan->matched = 0;
+    scan->damaged = 0;
+    scan->threads_used = 0;
+
+    if ((NULL == filter) || (NULL == file)) {
+        scan->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+
+    job.scan = scan;
+    job.filter = filter;
+    job.file = file;
+    job.next_block = 0;
+    count = binson_batch_thread_count(scan->threads, BINSON_FILTER_MAX_THREADS,
+                                      file->block_count);
+
+    workers = calloc(count, sizeof(_filter_worker));
+    if ((NULL == workers) || (pthread_mutex_init(&job.lock, NULL) != 0)) {
+        free(workers);
+        scan->error_flags = BINSON_ERROR_RANGE;
+        return false;
+    }
+
+    /* The calling thread is worker 0, the others share its blocks if they start. */
+    scan->threads_used = 1;
+    for (i = 0; i < count; i++) {
+        workers[i].job = &job;
+    }
+    for (i = 1; i < count; i++) {
+        workers[i].started =
+            (pthread_create(&workers[i].thread, NULL, _worker_main, &workers[i]) == 0);
+        scan->threads_used += workers[i].started ? 1 : 0;
+    }
+
+    _work(&workers[0]);
+
+    for (i = 0; i < count; i++) {
+        if (workers[i].started) {
+            pthread_join(workers[i].thread, NULL);
+        }
+        scan->scanned += workers[i].scanned;
+        scan->matched += workers[i].matched;
+        scan->damaged += workers[i].damaged;
+    }
+
+    pthread_mutex_destroy(&job.lock);
+    free(workers);
+    scan->error_flags = (scan->damaged > 0) ? BINSON_ERROR_FORMAT : BINSON_ERROR_NONE;
+
+    return BINSON_ERROR_NONE == scan->error_flags;
+}
+
+/*======= Local function implementations ====================================*/
+
+/*
+ * Appends a predicate with the names of path and value in the pool. The
+ * filter is left as it was if anything does not fit.
+ */
+static binson_filter_predicate *_add(binson_filter *filter,
+                                     const char *path,
+                                     binson_filter_op op,
+                                     binson_type type,
+                                     const uint8_t *value,
+                                     size_t value_size)
+{
+    binson_filter_predicate *predicate;
+    size_t used;
+    size_t start;
+    size_t i;
+
+    if (NULL == filter) {
+        return NULL;
+    }
+    if ((NULL == path) || ((NULL == value) && (value_size > 0))) {
+        filter->error_flags = BINSON_ERROR_NULL;
+        return NULL;
+    }
+    if (filter->count >= BINSON_FILTER_MAX_PREDICATES) {
+        filter->error_flags = BINSON_ERROR_RANGE;
+        return NULL;
+    }
+
+    predicate = &filter->predicates[filter->count];
+    memset(predicate, 0, sizeof(binson_filter_predicate));
+    used = filter->pool_used;
+    start = 0;
+
+    /* Names go into the pool without the separators. */
+    for (i = 0; ; i++) {
+        if (('.' != path[i]) && ('\0' != path[i])) {
+            continue;
+        }
+        if (i == start) {
+            filter->error_flags = BINSON_ERROR_FORMAT;
+            return NULL;
+        }
+        if (predicate->depth >= BINSON_FILTER_MAX_DEPTH) {
+            filter->error_flags = BINSON_ERROR_MAX_DEPTH;
+            return NULL;
+        }
+        if (BINSON_FILTER_POOL_SIZE - used < i - start) {
+            filter->error_flags = BINSON_ERROR_RANGE;
+            return NULL;
+        }
+        predicate->path[predicate->depth++] = (uint16_t) used;
+        memcpy(&filter->pool[used], &path[start], i - start);
+        used += i - start;
+        start = i + 1;
+
+        if ('\0' == path[i]) {
+            break;
+        }
+    }
+    predicate->path[predicate->depth] = (uint16_t) used;
+
+    if (BINSON_FILTER_POOL_SIZE - used < value_size) {
+        filter->error_flags = BINSON_ERROR_RANGE;
+        return NULL;
+    }
+    if (value_size > 0) {
+        memcpy(&filter->pool[used], value, value_size);
+    }
+    predicate->value = (uint16_t) used;
+    predicate->value_size = (uint16_t) value_size;
+    predicate->op = (uint8_t) op;
+    predicate->type = (uint8_t) type;
+
+    filter->pool_used = used + value_size;
+    filter->count++;
+
+    return predicate;
+}
+
+static bool _match(const binson_filter *filter, const _filter_object *object)
+{
+    size_t i;
+
+    if ((NULL == filter) || (NULL == object->data) || (object->size < 2) ||
+        (BINSON_DEF_OBJECT_BEGIN != object->data[0])) {
+        return false;
+    }
+
+    for (i = 0; i < filter->count; i++) {
+        const binson_filter_predicate *predicate = &filter->predicates[i];
+        size_t size;
+        const uint8_t *value = _find(filter, predicate, object, &size);
+
+        if ((NULL == value) || !_test(filter, predicate, value, size)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Finds the value at the path of predicate. Returns it with the bytes left
+ * in the object from there in size, or NULL if it is missing.
+ */
+static const uint8_t *_find(const binson_filter *filter,
+                            const binson_filter_predicate *predicate,
+                            const _filter_object *object,
+                            size_t *size)
+{
+    const uint8_t *data = object->data;
+    size_t left = object->size;
+    uint8_t k;
+
+    for (k = 0; k < predicate->depth; k++) {
+        bbuf target;
+        size_t pos = 1;
+
+        if ((left < 2) || (BINSON_DEF_OBJECT_BEGIN != data[0])) {
+            return NULL;
+        }
+        target.bptr = &filter->pool[predicate->path[k]];
+        target.bsize = predicate->path[k + 1] - predicate->path[k];
+
+        for (;;) {
+            bbuf name;
+            size_t n;
+            int r;
+
+            if ((pos >= left) || (BINSON_DEF_OBJECT_END == data[pos])) {
+                return NULL;
+            }
+            n = _name(object, &data[pos], left - pos, &name);
+            if ((0 == n) || (left - pos <= n)) {
+                return NULL;
+            }
+            pos += n;
+
+            /* Fields are sorted, so the name cannot come after a larger one. */
+            r = _cmp_name(&name, &target);
+            if (r > 0) {
+                return NULL;
+            }
+            if (0 == r) {
+                break;
+            }
+
+            n = _value_size(object, &data[pos], left - pos);
+            if (0 == n) {
+                return NULL;
+            }
+            pos += n;
+        }
+
+        /* The value is the rest of the object, nested objects end on their own. */
+        data = &data[pos];
+        left -= pos;
+    }
+
+    *size = left;
+    return data;
+}
+
+static bool _test(const binson_filter *filter,
+                  const binson_filter_predicate *predicate,
+                  const uint8_t *value,
+                  size_t size)
+{
+    size_t n;
+
+    if (BINSON_FILTER_EXISTS == predicate->op) {
+        return 0 != binson_token_size(value, size);
+    }
+
+    switch (predicate->type) {
+        case BINSON_TYPE_BOOLEAN:
+            return value[0] == (predicate->integer_min ? BINSON_DEF_TRUE : BINSON_DEF_FALSE);
+
+        case BINSON_TYPE_INTEGER:
+        {
+            uint64_t bits;
+            int64_t integer;
+
+            if ((value[0] < BINSON_DEF_INT8) || (value[0] > BINSON_DEF_INT64)) {
+                return false;
+            }
+            n = binson_token_size(value, size);
+            if (0 == n) {
+                return false;
+            }
+            /* Sign extend from the width of the token. */
+            bits = _load_le(&value[1], n - 1);
+            if ((n - 1 < 8) && (value[n - 1] & 0x80U)) {
+                bits |= ~(uint64_t) 0 << (8 * (n - 1));
+            }
+            integer = (int64_t) bits;
+            return (integer >= predicate->integer_min) && (integer <= predicate->integer_max);
+        }
+
+        case BINSON_TYPE_DOUBLE:
+        {
+            uint64_t bits;
+            double d;
+
+            if ((BINSON_DEF_DOUBLE != value[0]) || (0 == binson_token_size(value, size))) {
+                return false;
+            }
+            bits = _load_le(&value[1], sizeof(bits));
+            memcpy(&d, &bits, sizeof(d));
+            return (d >= predicate->double_min) && (d <= predicate->double_max);
+        }
+
+        case BINSON_TYPE_STRING:
+        case BINSON_TYPE_BYTES:
+        {
+            uint8_t first = (BINSON_TYPE_STRING == predicate->type) ?
+                BINSON_DEF_STRINGLEN_INT8 : BINSON_DEF_BYTESLEN_INT8;
+            const uint8_t *expected = &filter->pool[predicate->value];
+            bbuf content;
+
+            if ((value[0] < first) || (value[0] > first + 2) ||
+                (0 == _content(value, size, &content))) {
+                return false;
+            }
+            if (BINSON_FILTER_EQUAL == predicate->op) {
+                return (content.bsize == predicate->value_size) &&
+                    (memcmp(content.bptr, expected, content.bsize) == 0);
+            }
+            return (content.bsize >= predicate->value_size) &&
+                (memcmp(content.bptr, expected, predicate->value_size) == 0);
+        }
+
+        default:
+            return false;
+    }
+}
+
+/*
+ * Name at data[0]: a string token, or a dictionary reference. Returns the
+ * size of the name in data, 0 if there is none.
+ */
+static size_t _name(const _filter_object *object, const uint8_t *data, size_t size, bbuf *name)
+{
+    if (BINSON_RECORD_NAME_REF == data[0]) {
+        uint32_t entry;
+        uint32_t start;
+        uint32_t end;
+
+        if ((NULL == object->names) || (size < 2) || (data[1] >= object->entries)) {
+            return 0;
+        }
+        entry = data[1];
+        start = (entry > 0) ? (uint32_t) _load_le(&object->ends[2 * (entry - 1)], 2) : 0;
+        end = (uint32_t) _load_le(&object->ends[2 * entry], 2);
+        return (0 != _content(&object->names[start], end - start, name)) ? 2 : 0;
+    }
+
+    if ((data[0] < BINSON_DEF_STRINGLEN_INT8) || (data[0] > BINSON_DEF_STRINGLEN_INT32)) {
+        return 0;
+    }
+
+    return _content(data, size, name);
+}
+
+/* Content of the string or bytes token at data[0], returns the token size. */
+static size_t _content(const uint8_t *data, size_t size, bbuf *content)
+{
+    size_t n = binson_token_size(data, size);
+    size_t width = (size_t) 1 << (data[0] & 0x03U);
+
+    if (n <= width) {
+        return 0;
+    }
+    content->bptr = &data[1 + width];
+    content->bsize = n - 1 - width;
+
+    return n;
+}
+
+/* Size of the value at data[0], containers and their names included. */
+static size_t _value_size(const _filter_object *object, const uint8_t *data, size_t size)
+{
+    size_t depth = 0;
+    size_t pos = 0;
+
+    do {
+        size_t n;
+
+        if (pos >= size) {
+            return 0;
+        }
+
+        switch (data[pos]) {
+            case BINSON_DEF_OBJECT_BEGIN:
+            case BINSON_DEF_ARRAY_BEGIN:
+                depth++;
+                n = 1;
+                break;
+            case BINSON_DEF_OBJECT_END:
+            case BINSON_DEF_ARRAY_END:
+                if (0 == depth) {
+                    return 0;
+                }
+                depth--;
+                n = 1;
+                break;
+            case BINSON_RECORD_NAME_REF:
+                n = ((NULL != object->names) && (size - pos >= 2)) ? 2 : 0;
+                break;
+            default:
+                n = binson_token_size(&data[pos], size - pos);
+                break;
+        }
+
+        if (0 == n) {
+            return 0;
+        }
+        pos += n;
+    } while (depth > 0);
+
+    return pos;
+}
+
+/* Same order as the parser: bytewise, then the shorter name first. */
+static int _cmp_name(const bbuf *a, const bbuf *b)
+{
+    int r = memcmp(a->bptr, b->bptr, MIN(a->bsize, b->bsize));
+
+    if (0 != r) {
+        return r;
+    }
+    return (a->bsize < b->bsize) ? -1 : (a->bsize > b->bsize) ? 1 : 0;
+}
+
+static uint64_t _load_le(const uint8_t *data, size_t size)
+{
+    uint64_t value = 0;
+    size_t i;
+
+    for (i = size; i > 0; i--) {
+        value = (value << 8) | data[i - 1];
+    }
+
+    return value;
+}
+
+static void *_worker_main(void *context)
+{
+    _work((_filter_worker *) context);
+    return NULL;
+}
+
+/* Blocks are large, so taking them one at a time under a lock is cheap. */
+static void _work(_filter_worker *worker)
+{
+    _filter_job *job = worker->job;
+    binson_filter_callback callback = job->scan->callback;
+
+    for (;;) {
+        binson_record_block block;
+        bbuf record;
+        size_t n;
+
+        pthread_mutex_lock(&job->lock);
+        n = job->next_block;
+        if (n < job->file->block_count) {
+            job->next_block++;
+        }
+        pthread_mutex_unlock(&job->lock);
+
+        if (n >= job->file->block_count) {
+            break;
+        }
+        if (BINSON_ERROR_NONE != binson_record_block_open(job->file, n, &block)) {
+            worker->damaged++;
+            continue;
+        }
+
+        while (binson_record_block_next(&block, &record)) {
+            worker->scanned++;
+            if (binson_filter_match_record(job->filter, &block, &record)) {
+                worker->matched++;
+                if (NULL != callback) {
+                    callback(job->scan->callback_context,
+                             block.first_record + block.next - 1, &block, &record);
+                }
+            }
+        }
+    }
+}
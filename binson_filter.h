@@ -0,0 +1,232 @@
+#ifndef _BINSON_FILTER_H_
+#define _BINSON_FILTER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file binson_filter.h
+ *
+ * Predicates evaluated on the raw bytes of binson objects, and parallel
+ * filtering of record files with them.
+ *
+ * A filter is a list of predicates that must all hold: a field exists, is
+ * equal to a value, lies in a range or starts with a prefix. A field is
+ * given by its path from the top level object, names separated by '.':
+ * "device.id" is field "id" of the object in field "device".
+ *
+ * Nothing is parsed or copied to evaluate a filter. Each path is stored as
+ * its names, and the object is walked token by token, reading only type
+ * bytes and lengths to step over values. Since binson objects keep their
+ * fields sorted by name, the search for a name stops at the first larger
+ * one. Records of blocks with a field name dictionary are read as they are
+ * stored, references are looked up in the block dictionary.
+ *
+ * Values are compared by type: an integer predicate only matches integer
+ * fields, a double predicate only double fields. Objects that are not
+ * well formed do not match.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include "binson_defines.h"
+#include "binson_record.h"
+
+/*======= Public macro definitions ==========================================*/
+
+/* Most predicates in one filter. */
+#define BINSON_FILTER_MAX_PREDICATES    (16U)
+
+/* Most names in one path. */
+#define BINSON_FILTER_MAX_DEPTH         (8U)
+
+/* Room for the names and string values of all predicates of a filter. */
+#define BINSON_FILTER_POOL_SIZE         (1024U)
+
+/* Most threads binson_filter_scan_file() starts. */
+#define BINSON_FILTER_MAX_THREADS       (256U)
+
+/*======= Type Definitions and declarations =================================*/
+
+typedef enum {
+    BINSON_FILTER_EXISTS,
+    BINSON_FILTER_EQUAL,
+    BINSON_FILTER_RANGE,        /* min <= value <= max */
+    BINSON_FILTER_PREFIX
+} binson_filter_op;
+
+typedef struct binson_filter_predicate_s {
+    uint8_t             op;             /* binson_filter_op */
+    uint8_t             type;           /* binson_type of the value, BINSON_TYPE_NONE for EXISTS. */
+    uint8_t             depth;          /* Names in the path. */
+    uint16_t            path[BINSON_FILTER_MAX_DEPTH + 1];  /* Name k is pool[path[k]] up to pool[path[k + 1]]. */
+    uint16_t            value;          /* String or bytes value at pool[value]. */
+    uint16_t            value_size;
+    int64_t             integer_min;    /* Also the boolean value for BINSON_TYPE_BOOLEAN. */
+    int64_t             integer_max;
+    double              double_min;
+    double              double_max;
+} binson_filter_predicate;
+
+typedef struct binson_filter_s {
+    binson_filter_predicate predicates[BINSON_FILTER_MAX_PREDICATES];
+    size_t              count;
+    uint8_t             pool[BINSON_FILTER_POOL_SIZE];
+    size_t              pool_used;
+    binson_err          error_flags;
+} binson_filter;
+
+/**
+ * Called for each matching record. Runs on the worker threads: calls for
+ * different records may run at the same time and in any order.
+ *
+ * @param context   scan->callback_context.
+ * @param n         Record number in the file.
+ * @param block     Block of the record, for binson_record_decode().
+ * @param record    The record as stored.
+ */
+typedef void (*binson_filter_callback)(void *context,
+                                       uint64_t n,
+                                       const binson_record_block *block,
+                                       const bbuf *record);
+
+typedef struct binson_filter_scan_s {
+    size_t                  threads;        /* 0: one per online processor. */
+    binson_filter_callback  callback;       /* Optional. */
+    void                    *callback_context;
+    uint64_t                scanned;        /* Records looked at. */
+    uint64_t                matched;
+    size_t                  damaged;        /* Blocks that failed to open. */
+    size_t                  threads_used;
+    binson_err              error_flags;
+} binson_filter_scan;
+
+/*======= Public function declarations ======================================*/
+
+/**
+ * @brief Initiates an empty filter, which matches every object.
+ */
+bool binson_filter_init(binson_filter *filter);
+
+/**
+ * @brief Adds a predicate: the field at path exists, of any type.
+ *
+ * All binson_filter_* functions adding a predicate return false and set
+ * filter->error_flags to BINSON_ERROR_NULL for NULL arguments,
+ * BINSON_ERROR_FORMAT for an empty name in path, BINSON_ERROR_MAX_DEPTH
+ * for more than BINSON_FILTER_MAX_DEPTH names, or BINSON_ERROR_RANGE when
+ * the filter is full.
+ */
+bool binson_filter_exists(binson_filter *filter, const char *path);
+
+/**
+ * @brief Adds a predicate: the field at path is this integer.
+ */
+bool binson_filter_equal_integer(binson_filter *filter, const char *path, int64_t value);
+
+/**
+ * @brief Adds a predicate: the field at path is this boolean.
+ */
+bool binson_filter_equal_boolean(binson_filter *filter, const char *path, bool value);
+
+/**
+ * @brief Adds a predicate: the field at path is this string.
+ */
+bool binson_filter_equal_string(binson_filter *filter, const char *path, const char *value);
+
+/**
+ * @brief Adds a predicate: the field at path holds these bytes.
+ */
+bool binson_filter_equal_bytes(binson_filter *filter,
+                               const char *path,
+                               const uint8_t *value,
+                               size_t size);
+
+/**
+ * @brief Adds a predicate: the field at path is an integer in [min, max].
+ */
+bool binson_filter_range_integer(binson_filter *filter,
+                                 const char *path,
+                                 int64_t min,
+                                 int64_t max);
+
+/**
+ * @brief Adds a predicate: the field at path is a double in [min, max].
+ *
+ * min == max tests for equality. NaN is in no range.
+ */
+bool binson_filter_range_double(binson_filter *filter,
+                                const char *path,
+                                double min,
+                                double max);
+
+/**
+ * @brief Adds a predicate: the field at path is a string starting with
+ *        prefix.
+ */
+bool binson_filter_prefix_string(binson_filter *filter, const char *path, const char *prefix);
+
+/**
+ * @brief Adds a predicate: the field at path is a bytes value starting
+ *        with prefix.
+ */
+bool binson_filter_prefix_bytes(binson_filter *filter,
+                                const char *path,
+                                const uint8_t *prefix,
+                                size_t size);
+
+/**
+ * @brief Tests an object against a filter.
+ *
+ * @param filter    Filter with its predicates.
+ * @param data      Serialized binson object.
+ * @param size      Size of data.
+ *
+ * @return true     data is an object that satisfies every predicate.
+ * @return false    A predicate failed, or data is not a well formed object
+ *                  where the predicates looked.
+ */
+bool binson_filter_match(const binson_filter *filter, const uint8_t *data, size_t size);
+
+/**
+ * @brief Tests a record as returned by binson_record_block_next().
+ *
+ * Like binson_filter_match(), but field name references are resolved in
+ * the dictionary of block, without decoding the record.
+ */
+bool binson_filter_match_record(const binson_filter *filter,
+                                const binson_record_block *block,
+                                const bbuf *record);
+
+/**
+ * @brief Initiates a scan with default settings and no callback.
+ */
+bool binson_filter_scan_init(binson_filter_scan *scan);
+
+/**
+ * @brief Runs a filter over every record of a file on several threads.
+ *
+ * The threads take one block at a time, open it with
+ * binson_record_block_open() and test each of its records with
+ * binson_filter_match_record(). Damaged blocks are counted in
+ * scan->damaged and skipped, the other blocks are still scanned.
+ *
+ * @param scan      Scan settings, counters are updated.
+ * @param filter    Filter to apply.
+ * @param file      Open record file, not modified.
+ *
+ * @return true     Every block was scanned.
+ * @return false    Invalid arguments or out of memory, or damaged blocks
+ *                  (BINSON_ERROR_FORMAT), see scan->error_flags.
+ */
+bool binson_filter_scan_file(binson_filter_scan *scan,
+                             const binson_filter *filter,
+                             const binson_record_file *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BINSON_FILTER_H_ */
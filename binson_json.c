@@ -0,0 +1,1376 @@
+/**
+ * @file binson_json.c
+ *
+ * Conversion between binson and JSON text.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <unistd.h>
+#define BINSON_JSON_HAVE_FD
+#define BINSON_JSON_HAVE_USELOCALE
+#endif
+
+#include <locale.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binson_json.h"
+#include "binson_cpu.h"
+
+#ifdef BINSON_CPU_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define BINSON_JSON_INDENT          (2U)
+
+/* Significant digits that still fit a uint64_t mantissa. */
+#define BINSON_JSON_MAX_DIGITS      (19U)
+
+/* Exponent magnitude beyond which only strtod() gets the value right. */
+#define BINSON_JSON_MAX_EXPONENT    (100000)
+
+/* Objects with more keys than this are sorted with qsort(). */
+#define BINSON_JSON_INSERTION_SORT  (16U)
+
+#define BINSON_JSON_MEMBER_ALIGN    offsetof(binson_json_member_align, member)
+
+/*======= Type Definitions ==================================================*/
+
+typedef struct binson_json_out_s {
+    binson_json_sink    sink;
+    void                *context;
+    uint8_t             flags;
+    bool                failed;
+    size_t              used;
+    char                buffer[BINSON_JSON_BUFFER_SIZE];
+} binson_json_out;
+
+/* Reader state of binson_json_transcode(). */
+typedef struct binson_json_in_s {
+    const uint8_t       *data;
+    size_t              size;
+    size_t              pos;
+    binson_writer       *writer;
+    uint8_t             *scratch;
+    size_t              low;        /* Unescaped strings grow up from here */
+    size_t              high;       /* Key tables grow down from here */
+    binson_err          error;
+    bool                avx2;
+} binson_json_in;
+
+/* Object key and the offset of its value in the JSON text. */
+typedef struct binson_json_member_s {
+    const uint8_t       *name;
+    size_t              name_size;
+    size_t              value;
+} binson_json_member;
+
+typedef struct binson_json_member_align_s {
+    char                c;
+    binson_json_member  member;
+} binson_json_member_align;
+
+/*======= Local function prototypes =========================================*/
+
+static void _out_init(binson_json_out *out,
+                      uint8_t flags,
+                      binson_json_sink sink,
+                      void *context);
+static bool _emit_block(binson_json_out *out,
+                        binson_parser *parser,
+                        bool is_object,
+                        size_t level);
+static bool _emit_value(binson_json_out *out, binson_parser *parser, size_t level);
+static void _put(binson_json_out *out, const char *data, size_t size);
+static void _put_newline(binson_json_out *out, size_t level);
+static void _put_string(binson_json_out *out, const bbuf *value);
+static void _put_hex(binson_json_out *out, const bbuf *value);
+static void _put_base64(binson_json_out *out, const bbuf *value);
+static bool _flush(binson_json_out *out);
+static bool _transcode_value(binson_json_in *in, size_t depth);
+static bool _transcode_object(binson_json_in *in, size_t depth);
+static bool _transcode_array(binson_json_in *in, size_t depth);
+static bool _read_string(binson_json_in *in, const uint8_t **value, size_t *size);
+static size_t _read_escape_u(binson_json_in *in, size_t *pos, uint8_t *out);
+static bool _read_hex4(const binson_json_in *in, size_t pos, uint32_t *value);
+static bool _read_number(binson_json_in *in, bool write);
+static bool _read_literal(binson_json_in *in, const char *literal, size_t size);
+static double _strtod_c(char *text);
+static bool _skip_value(binson_json_in *in);
+static bool _skip_string(binson_json_in *in);
+static bool _skip_block(binson_json_in *in);
+static void _skip_space(binson_json_in *in);
+static size_t _scan_string(const binson_json_in *in, size_t pos);
+static size_t _scan_block(const binson_json_in *in, size_t pos);
+#ifdef BINSON_CPU_X86_DISPATCH
+static size_t _scan_string_avx2(const uint8_t *data, size_t pos, size_t size);
+static size_t _scan_block_avx2(const uint8_t *data, size_t pos, size_t size);
+#endif
+static bool _sort_members(binson_json_member *members, size_t count);
+static int _cmp_member(const void *a, const void *b);
+static bool _is_digit(uint8_t c);
+static bool _fail(binson_json_in *in, binson_err error);
+
+/*======= Local variable declarations =======================================*/
+
+/*
+ * Escape character for each byte of a string, 0 when the byte is copied as
+ * is. Control characters without a short escape use \u00XX.
+ */
+static const char _escape[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+static const char _hex_digits[17] = "0123456789abcdef";
+
+static const char _base64_digits[65] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const char _spaces[64] =
+    "                                                               ";
+
+/* Powers of ten that are exact doubles. */
+static const double _pow10[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*======= Global function implementations ===================================*/
+
+bool binson_json_emit(binson_parser *parser,
+                      uint8_t flags,
+                      binson_json_sink sink,
+                      void *context)
+{
+    binson_json_out out;
+    bool is_object;
+    bool ret;
+
+    if ((NULL == parser) || (NULL == sink)) {
+        return false;
+    }
+
+    if (!binson_parser_reset(parser)) {
+        return false;
+    }
+
+    _out_init(&out, flags, sink, context);
+
+    is_object = (BINSON_DEF_OBJECT_BEGIN == parser->buffer[0]);
+    ret = is_object ? binson_parser_go_into_object(parser) :
+                      binson_parser_go_into_array(parser);
+    ret = ret && _emit_block(&out, parser, is_object, 0);
+
+    if (ret && (out.flags & BINSON_JSON_PRETTY)) {
+        _put(&out, "\n", 1);
+    }
+
+    return _flush(&out) && ret;
+}
+
+bool binson_json_emit_value(binson_parser *parser,
+                            uint8_t flags,
+                            binson_json_sink sink,
+                            void *context)
+{
+    binson_json_out out;
+    bool ret;
+
+    if ((NULL == parser) || (NULL == sink)) {
+        return false;
+    }
+
+    _out_init(&out, flags, sink, context);
+
+    ret = _emit_value(&out, parser, 0);
+
+    if (ret && (out.flags & BINSON_JSON_PRETTY)) {
+        _put(&out, "\n", 1);
+    }
+
+    return _flush(&out) && ret;
+}
+
+bool binson_json_transcode(binson_writer *writer,
+                           const char *json,
+                           size_t size,
+                           void *scratch,
+                           size_t scratch_size)
+{
+    uint8_t stack_scratch[BINSON_JSON_SCRATCH_SIZE];
+    binson_json_in in;
+    size_t misalign;
+
+    if ((NULL == writer) || (NULL == json)) {
+        return false;
+    }
+
+    if (NULL == scratch) {
+        scratch = stack_scratch;
+        scratch_size = sizeof(stack_scratch);
+    }
+
+    in.data = (const uint8_t *) json;
+    in.size = size;
+    in.pos = 0;
+    in.writer = writer;
+    in.scratch = (uint8_t *) scratch;
+    in.low = 0;
+    misalign = (uintptr_t) &in.scratch[scratch_size] % BINSON_JSON_MEMBER_ALIGN;
+    in.high = (scratch_size >= misalign) ? scratch_size - misalign : 0;
+    in.error = BINSON_ERROR_NONE;
+    in.avx2 = binson_cpu_has_avx2();
+
+    _skip_space(&in);
+    if ((in.pos < in.size) &&
+        (('{' == in.data[in.pos]) || ('[' == in.data[in.pos]))) {
+        if (_transcode_value(&in, 0)) {
+            _skip_space(&in);
+            if (in.pos != in.size) {
+                _fail(&in, BINSON_ERROR_FORMAT);
+            }
+        }
+    }
+    else {
+        _fail(&in, BINSON_ERROR_FORMAT);
+    }
+
+    if (BINSON_ERROR_NONE != in.error) {
+        writer->error_flags = in.error;
+        return false;
+    }
+
+    return BINSON_ERROR_NONE == writer->error_flags;
+}
+
+bool binson_json_file_sink(void *context, const char *data, size_t size)
+{
+    FILE *stream = (FILE *) context;
+
+    if (NULL == stream) {
+        return false;
+    }
+
+    return fwrite(data, 1, size, stream) == size;
+}
+
+bool binson_json_fd_sink(void *context, const char *data, size_t size)
+{
+#ifdef BINSON_JSON_HAVE_FD
+    const int *fd = (const int *) context;
+
+    if (NULL == fd) {
+        return false;
+    }
+
+    while (size > 0) {
+        ssize_t written = write(*fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= (size_t) written;
+    }
+
+    return true;
+#else
+    (void) context;
+    (void) data;
+    (void) size;
+    return false;
+#endif
+}
+
+bool binson_json_buffer_sink(void *context, const char *data, size_t size)
+{
+    binson_json_buffer *buffer = (binson_json_buffer *) context;
+
+    if (NULL == buffer) {
+        return false;
+    }
+
+    if (size > buffer->capacity - buffer->size) {
+        size_t capacity = (buffer->capacity > 0) ? buffer->capacity : 256;
+        char *data_new;
+
+        while (size > capacity - buffer->size) {
+            if (capacity > SIZE_MAX / 2) {
+                return false;
+            }
+            capacity *= 2;
+        }
+
+        data_new = realloc(buffer->data, capacity);
+        if (NULL == data_new) {
+            return false;
+        }
+        buffer->data = data_new;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(&buffer->data[buffer->size], data, size);
+    buffer->size += size;
+
+    return true;
+}
+
+void binson_json_buffer_free(binson_json_buffer *buffer)
+{
+    if (NULL == buffer) {
+        return;
+    }
+
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+/*======= Local function implementations ====================================*/
+
+static void _out_init(binson_json_out *out,
+                      uint8_t flags,
+                      binson_json_sink sink,
+                      void *context)
+{
+    out->sink = sink;
+    out->context = context;
+    out->flags = flags;
+    out->failed = false;
+    out->used = 0;
+}
+
+/* Called after entering the block, leaves it again. */
+static bool _emit_block(binson_json_out *out,
+                        binson_parser *parser,
+                        bool is_object,
+                        size_t level)
+{
+    bool first = true;
+
+    _put(out, is_object ? "{" : "[", 1);
+
+    while (binson_parser_next(parser)) {
+        if (!first) {
+            _put(out, ",", 1);
+        }
+        first = false;
+        _put_newline(out, level + 1);
+
+        if (is_object) {
+            _put_string(out, binson_parser_get_name(parser));
+            if (out->flags & BINSON_JSON_PRETTY) {
+                _put(out, ": ", 2);
+            }
+            else {
+                _put(out, ":", 1);
+            }
+        }
+
+        if (!_emit_value(out, parser, level + 1)) {
+            return false;
+        }
+
+        if (out->failed) {
+            return false;
+        }
+    }
+
+    if (BINSON_ERROR_NONE != parser->error_flags) {
+        return false;
+    }
+
+    if (!first) {
+        _put_newline(out, level);
+    }
+    _put(out, is_object ? "}" : "]", 1);
+
+    return is_object ? binson_parser_leave_object(parser) :
+                       binson_parser_leave_array(parser);
+}
+
+static bool _emit_value(binson_json_out *out, binson_parser *parser, size_t level)
+{
+    char number[BINSON_FORMAT_DOUBLE_SIZE];
+    double d;
+
+    switch (binson_parser_get_type(parser)) {
+        case BINSON_TYPE_OBJECT:
+            return binson_parser_go_into_object(parser) &&
+                   _emit_block(out, parser, true, level);
+        case BINSON_TYPE_ARRAY:
+            return binson_parser_go_into_array(parser) &&
+                   _emit_block(out, parser, false, level);
+        case BINSON_TYPE_BOOLEAN:
+            if (binson_parser_get_boolean(parser)) {
+                _put(out, "true", 4);
+            }
+            else {
+                _put(out, "false", 5);
+            }
+            break;
+        case BINSON_TYPE_INTEGER:
+            _put(out, number, binson_format_integer(number, binson_parser_get_integer(parser)));
+            break;
+        case BINSON_TYPE_DOUBLE:
+            /* JSON has no NaN or infinity. */
+            d = binson_parser_get_double(parser);
+            if (isfinite(d)) {
+                _put(out, number, binson_format_double(number, d));
+            }
+            else {
+                _put(out, "null", 4);
+            }
+            break;
+        case BINSON_TYPE_STRING:
+            _put_string(out, binson_parser_get_string_bbuf(parser));
+            break;
+        case BINSON_TYPE_BYTES:
+            if (out->flags & BINSON_JSON_BYTES_BASE64) {
+                _put_base64(out, binson_parser_get_bytes_bbuf(parser));
+            }
+            else {
+                _put_hex(out, binson_parser_get_bytes_bbuf(parser));
+            }
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+static void _put(binson_json_out *out, const char *data, size_t size)
+{
+    if (out->failed) {
+        return;
+    }
+
+    if (size > sizeof(out->buffer) - out->used) {
+        if (!_flush(out)) {
+            return;
+        }
+        if (size > sizeof(out->buffer)) {
+            out->failed = !out->sink(out->context, data, size);
+            return;
+        }
+    }
+
+    memcpy(&out->buffer[out->used], data, size);
+    out->used += size;
+}
+
+static void _put_newline(binson_json_out *out, size_t level)
+{
+    size_t indent = level * BINSON_JSON_INDENT;
+
+    if (!(out->flags & BINSON_JSON_PRETTY)) {
+        return;
+    }
+
+    _put(out, "\n", 1);
+    while (indent > 0) {
+        size_t n = (indent < sizeof(_spaces) - 1) ? indent : sizeof(_spaces) - 1;
+        _put(out, _spaces, n);
+        indent -= n;
+    }
+}
+
+static void _put_string(binson_json_out *out, const bbuf *value)
+{
+    size_t start = 0;
+    size_t i;
+
+    if (NULL == value) {
+        _put(out, "null", 4);
+        return;
+    }
+
+    _put(out, "\"", 1);
+
+    for (i = 0; i < value->bsize; i++) {
+        uint8_t c = value->bptr[i];
+        char escape[6] = { '\\', 0, '0', '0', 0, 0 };
+
+        if (0 == _escape[c]) {
+            continue;
+        }
+
+        /* Copy the run of plain bytes before the escape in one go. */
+        _put(out, (const char *) &value->bptr[start], i - start);
+        start = i + 1;
+
+        escape[1] = _escape[c];
+        if ('u' == escape[1]) {
+            escape[4] = _hex_digits[c >> 4];
+            escape[5] = _hex_digits[c & 0x0FU];
+            _put(out, escape, 6);
+        }
+        else {
+            _put(out, escape, 2);
+        }
+    }
+
+    _put(out, (const char *) &value->bptr[start], value->bsize - start);
+    _put(out, "\"", 1);
+}
+
+static void _put_hex(binson_json_out *out, const bbuf *value)
+{
+    char chunk[128];
+    size_t i = 0;
+
+    _put(out, "\"0x", 3);
+    while (i < value->bsize) {
+        size_t n = 0;
+        while ((i < value->bsize) && (n < sizeof(chunk))) {
+            chunk[n++] = _hex_digits[value->bptr[i] >> 4];
+            chunk[n++] = _hex_digits[value->bptr[i] & 0x0FU];
+            i++;
+        }
+        _put(out, chunk, n);
+    }
+    _put(out, "\"", 1);
+}
+
+static void _put_base64(binson_json_out *out, const bbuf *value)
+{
+    char chunk[128];
+    size_t i = 0;
+
+    _put(out, "\"", 1);
+    while (i < value->bsize) {
+        size_t n = 0;
+        while ((i < value->bsize) && (n < sizeof(chunk))) {
+            size_t left = value->bsize - i;
+            uint32_t group = (uint32_t) value->bptr[i] << 16;
+
+            group |= (left > 1) ? (uint32_t) value->bptr[i + 1] << 8 : 0;
+            group |= (left > 2) ? (uint32_t) value->bptr[i + 2] : 0;
+
+            chunk[n++] = _base64_digits[(group >> 18) & 0x3FU];
+            chunk[n++] = _base64_digits[(group >> 12) & 0x3FU];
+            chunk[n++] = (left > 1) ? _base64_digits[(group >> 6) & 0x3FU] : '=';
+            chunk[n++] = (left > 2) ? _base64_digits[group & 0x3FU] : '=';
+            i += (left > 2) ? 3 : left;
+        }
+        _put(out, chunk, n);
+    }
+    _put(out, "\"", 1);
+}
+
+static bool _flush(binson_json_out *out)
+{
+    if (!out->failed && (out->used > 0)) {
+        out->failed = !out->sink(out->context, out->buffer, out->used);
+    }
+    out->used = 0;
+
+    return !out->failed;
+}
+
+static bool _transcode_value(binson_json_in *in, size_t depth)
+{
+    const uint8_t *value;
+    size_t size;
+    size_t low = in->low;
+
+    if (in->pos >= in->size) {
+        return _fail(in, BINSON_ERROR_FORMAT);
+    }
+
+    switch (in->data[in->pos]) {
+        case '{':
+            return _transcode_object(in, depth + 1);
+        case '[':
+            return _transcode_array(in, depth + 1);
+        case '"':
+            if (!_read_string(in, &value, &size)) {
+                return false;
+            }
+            binson_write_string_with_len(in->writer, (const char *) value, size);
+            /* Drop the unescaped copy, if any. */
+            in->low = low;
+            return true;
+        case 't':
+            if (!_read_literal(in, "true", 4)) {
+                return false;
+            }
+            binson_write_boolean(in->writer, true);
+            return true;
+        case 'f':
+            if (!_read_literal(in, "false", 5)) {
+                return false;
+            }
+            binson_write_boolean(in->writer, false);
+            return true;
+        default:
+            /* Also rejects null, which binson cannot represent. */
+            return _read_number(in, true);
+    }
+}
+
+/*
+ * First pass collects the keys and the offsets of their values, skipping
+ * the values themselves. Second pass writes the values in key order.
+ */
+static bool _transcode_object(binson_json_in *in, size_t depth)
+{
+    binson_json_member *members;
+    size_t low = in->low;
+    size_t high = in->high;
+    size_t count;
+    size_t end;
+    size_t i;
+
+    if (depth > BINSON_PARSER_MAX_DEPTH) {
+        return _fail(in, BINSON_ERROR_MAX_DEPTH);
+    }
+
+    in->pos++;
+    _skip_space(in);
+    if ((in->pos < in->size) && ('}' == in->data[in->pos])) {
+        in->pos++;
+        binson_write_object_begin(in->writer);
+        binson_write_object_end(in->writer);
+        return true;
+    }
+
+    for (;;) {
+        binson_json_member *member;
+        const uint8_t *name;
+        size_t name_size;
+
+        _skip_space(in);
+        if ((in->pos >= in->size) || ('"' != in->data[in->pos])) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+
+        if (!_read_string(in, &name, &name_size)) {
+            return false;
+        }
+
+        if ((in->high - in->low) < sizeof(binson_json_member)) {
+            return _fail(in, BINSON_ERROR_RANGE);
+        }
+        in->high -= sizeof(binson_json_member);
+        member = (binson_json_member *) &in->scratch[in->high];
+        member->name = name;
+        member->name_size = name_size;
+
+        _skip_space(in);
+        if ((in->pos >= in->size) || (':' != in->data[in->pos])) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+        in->pos++;
+        _skip_space(in);
+
+        member->value = in->pos;
+        if (!_skip_value(in)) {
+            return false;
+        }
+
+        _skip_space(in);
+        if (in->pos >= in->size) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+        if ('}' == in->data[in->pos++]) {
+            break;
+        }
+        if (',' != in->data[in->pos - 1]) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+    }
+
+    end = in->pos;
+    members = (binson_json_member *) &in->scratch[in->high];
+    count = (high - in->high) / sizeof(binson_json_member);
+
+    if (!_sort_members(members, count)) {
+        return _fail(in, BINSON_ERROR_FORMAT);
+    }
+
+    binson_write_object_begin(in->writer);
+    for (i = 0; i < count; i++) {
+        binson_write_name_with_len(in->writer,
+                                   (const char *) members[i].name,
+                                   members[i].name_size);
+        in->pos = members[i].value;
+        if (!_transcode_value(in, depth)) {
+            return false;
+        }
+    }
+    binson_write_object_end(in->writer);
+
+    in->pos = end;
+    in->low = low;
+    in->high = high;
+
+    return true;
+}
+
+static bool _transcode_array(binson_json_in *in, size_t depth)
+{
+    if (depth > BINSON_PARSER_MAX_DEPTH) {
+        return _fail(in, BINSON_ERROR_MAX_DEPTH);
+    }
+
+    in->pos++;
+    binson_write_array_begin(in->writer);
+
+    _skip_space(in);
+    if ((in->pos < in->size) && (']' == in->data[in->pos])) {
+        in->pos++;
+        binson_write_array_end(in->writer);
+        return true;
+    }
+
+    for (;;) {
+        _skip_space(in);
+        if (!_transcode_value(in, depth)) {
+            return false;
+        }
+
+        _skip_space(in);
+        if (in->pos >= in->size) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+        if (']' == in->data[in->pos++]) {
+            break;
+        }
+        if (',' != in->data[in->pos - 1]) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+    }
+
+    binson_write_array_end(in->writer);
+
+    return true;
+}
+
+/*
+ * Reads the string starting at in->pos. A string without escapes is
+ * returned in place, otherwise it is unescaped to the low end of the
+ * scratch area, which the caller releases by restoring in->low.
+ */
+static bool _read_string(binson_json_in *in, const uint8_t **value, size_t *size)
+{
+    size_t start = in->pos + 1;
+    size_t pos = _scan_string(in, start);
+    size_t available = in->high - in->low;
+    uint8_t *out = &in->scratch[in->low];
+    size_t used = 0;
+
+    if ((pos < in->size) && ('"' == in->data[pos])) {
+        *value = &in->data[start];
+        *size = pos - start;
+        in->pos = pos + 1;
+        return true;
+    }
+
+    for (;;) {
+        size_t run = pos - start;
+        uint8_t c;
+
+        if (pos >= in->size) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+
+        if (run > available - used) {
+            return _fail(in, BINSON_ERROR_RANGE);
+        }
+        memcpy(&out[used], &in->data[start], run);
+        used += run;
+
+        c = in->data[pos++];
+        if ('"' == c) {
+            break;
+        }
+
+        /* Unescaped control characters are not allowed in JSON strings. */
+        if (('\\' != c) || (pos >= in->size)) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+
+        /* Room for the longest UTF-8 sequence an escape produces. */
+        if ((available - used) < 4) {
+            return _fail(in, BINSON_ERROR_RANGE);
+        }
+
+        c = in->data[pos++];
+        switch (c) {
+            case '"':
+            case '\\':
+            case '/':
+                out[used++] = c;
+                break;
+            case 'b':
+                out[used++] = '\b';
+                break;
+            case 'f':
+                out[used++] = '\f';
+                break;
+            case 'n':
+                out[used++] = '\n';
+                break;
+            case 'r':
+                out[used++] = '\r';
+                break;
+            case 't':
+                out[used++] = '\t';
+                break;
+            case 'u':
+                run = _read_escape_u(in, &pos, &out[used]);
+                if (0 == run) {
+                    return _fail(in, BINSON_ERROR_FORMAT);
+                }
+                used += run;
+                break;
+            default:
+                return _fail(in, BINSON_ERROR_FORMAT);
+        }
+
+        start = pos;
+        pos = _scan_string(in, pos);
+    }
+
+    *value = out;
+    *size = used;
+    in->low += used;
+    in->pos = pos;
+
+    return true;
+}
+
+/*
+ * Decodes the hex digits of a \u escape at *pos to UTF-8, together with the
+ * \u escape of the low half that must follow a high surrogate. Returns the
+ * number of bytes written, 0 on malformed input.
+ */
+static size_t _read_escape_u(binson_json_in *in, size_t *pos, uint8_t *out)
+{
+    uint32_t code;
+    uint32_t low;
+
+    if (!_read_hex4(in, *pos, &code)) {
+        return 0;
+    }
+    *pos += 4;
+
+    if ((code >= 0xDC00U) && (code <= 0xDFFFU)) {
+        return 0;
+    }
+
+    if ((code >= 0xD800U) && (code <= 0xDBFFU)) {
+        if (((in->size - *pos) < 6) ||
+            ('\\' != in->data[*pos]) ||
+            ('u' != in->data[*pos + 1]) ||
+            !_read_hex4(in, *pos + 2, &low) ||
+            (low < 0xDC00U) || (low > 0xDFFFU)) {
+            return 0;
+        }
+        *pos += 6;
+        code = 0x10000U + ((code - 0xD800U) << 10) + (low - 0xDC00U);
+    }
+
+    if (code < 0x80U) {
+        out[0] = (uint8_t) code;
+        return 1;
+    }
+
+    if (code < 0x800U) {
+        out[0] = (uint8_t) (0xC0U | (code >> 6));
+        out[1] = (uint8_t) (0x80U | (code & 0x3FU));
+        return 2;
+    }
+
+    if (code < 0x10000U) {
+        out[0] = (uint8_t) (0xE0U | (code >> 12));
+        out[1] = (uint8_t) (0x80U | ((code >> 6) & 0x3FU));
+        out[2] = (uint8_t) (0x80U | (code & 0x3FU));
+        return 3;
+    }
+
+    out[0] = (uint8_t) (0xF0U | (code >> 18));
+    out[1] = (uint8_t) (0x80U | ((code >> 12) & 0x3FU));
+    out[2] = (uint8_t) (0x80U | ((code >> 6) & 0x3FU));
+    out[3] = (uint8_t) (0x80U | (code & 0x3FU));
+    return 4;
+}
+
+static bool _read_hex4(const binson_json_in *in, size_t pos, uint32_t *value)
+{
+    size_t i;
+
+    if ((in->size - pos) < 4) {
+        return false;
+    }
+
+    *value = 0;
+    for (i = 0; i < 4; i++) {
+        uint8_t c = in->data[pos + i];
+
+        if ((c >= '0') && (c <= '9')) {
+            c = (uint8_t) (c - '0');
+        }
+        else if (((c | 0x20U) >= 'a') && ((c | 0x20U) <= 'f')) {
+            c = (uint8_t) ((c | 0x20U) - 'a' + 10);
+        }
+        else {
+            return false;
+        }
+        *value = (*value << 4) | c;
+    }
+
+    return true;
+}
+
+/*
+ * Validates the number at in->pos against the JSON grammar and, if write
+ * is set, writes it as an integer when it has no fraction or exponent and
+ * fits in 64 bits, else as a double. Doubles whose mantissa and power of
+ * ten are both exact take the fast path (Clinger), the rest go through
+ * _strtod_c() on a NUL terminated copy in the scratch area.
+ */
+static bool _read_number(binson_json_in *in, bool write)
+{
+    const uint8_t *data = in->data;
+    size_t size = in->size;
+    size_t pos = in->pos;
+    uint64_t mantissa = 0;
+    uint32_t digits = 0;
+    int64_t exponent = 0;
+    bool negative = false;
+    bool integer = true;
+    bool truncated = false;
+    double value;
+
+    if ((pos < size) && ('-' == data[pos])) {
+        negative = true;
+        pos++;
+    }
+
+    if ((pos >= size) || !_is_digit(data[pos])) {
+        return _fail(in, BINSON_ERROR_FORMAT);
+    }
+
+    if ('0' == data[pos]) {
+        pos++;
+    }
+    else {
+        while ((pos < size) && _is_digit(data[pos])) {
+            if (digits < BINSON_JSON_MAX_DIGITS) {
+                mantissa = mantissa * 10 + (uint64_t) (data[pos] - '0');
+                digits++;
+            }
+            else {
+                truncated = true;
+            }
+            pos++;
+        }
+    }
+
+    if ((pos < size) && ('.' == data[pos])) {
+        integer = false;
+        pos++;
+        if ((pos >= size) || !_is_digit(data[pos])) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+        while ((pos < size) && _is_digit(data[pos])) {
+            if (digits < BINSON_JSON_MAX_DIGITS) {
+                mantissa = mantissa * 10 + (uint64_t) (data[pos] - '0');
+                /* Leading zeros of the fraction are not significant. */
+                digits += (0 != mantissa) ? 1 : 0;
+                exponent--;
+            }
+            else {
+                truncated = true;
+            }
+            pos++;
+        }
+    }
+
+    if ((pos < size) && ('e' == (data[pos] | 0x20U))) {
+        int64_t e = 0;
+        bool e_negative = false;
+
+        integer = false;
+        pos++;
+        if ((pos < size) && (('+' == data[pos]) || ('-' == data[pos]))) {
+            e_negative = ('-' == data[pos]);
+            pos++;
+        }
+        if ((pos >= size) || !_is_digit(data[pos])) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+        while ((pos < size) && _is_digit(data[pos])) {
+            if (e < BINSON_JSON_MAX_EXPONENT) {
+                e = e * 10 + (data[pos] - '0');
+            }
+            pos++;
+        }
+        exponent += e_negative ? -e : e;
+    }
+
+    if (!write) {
+        in->pos = pos;
+        return true;
+    }
+
+    if (integer && !truncated) {
+        if (!negative && (mantissa <= (uint64_t) INT64_MAX)) {
+            binson_write_integer(in->writer, (int64_t) mantissa);
+            in->pos = pos;
+            return true;
+        }
+        if (negative && (mantissa <= (uint64_t) INT64_MAX + 1)) {
+            binson_write_integer(in->writer, (mantissa > (uint64_t) INT64_MAX) ?
+                                             INT64_MIN : -(int64_t) mantissa);
+            in->pos = pos;
+            return true;
+        }
+    }
+
+    if (!truncated &&
+        (mantissa <= (UINT64_C(1) << 53)) &&
+        (exponent >= -22) && (exponent <= 22)) {
+        value = (double) mantissa;
+        value = (exponent < 0) ? value / _pow10[-exponent] : value * _pow10[exponent];
+        value = negative ? -value : value;
+    }
+    else {
+        size_t length = pos - in->pos;
+        char *copy = (char *) &in->scratch[in->low];
+
+        if ((in->high - in->low) <= length) {
+            return _fail(in, BINSON_ERROR_RANGE);
+        }
+        memcpy(copy, &data[in->pos], length);
+        copy[length] = '\0';
+        value = _strtod_c(copy);
+    }
+
+    binson_write_double(in->writer, value);
+    in->pos = pos;
+
+    return true;
+}
+
+/*
+ * strtod() in the "C" locale, whatever the application set with
+ * setlocale(). Without uselocale() the '.' of the JSON number is replaced
+ * by the decimal point of the current locale instead.
+ */
+static double _strtod_c(char *text)
+{
+    const char *point;
+    char *dot;
+
+#ifdef BINSON_JSON_HAVE_USELOCALE
+    locale_t c_locale = newlocale(LC_ALL_MASK, "C", (locale_t) 0);
+
+    if ((locale_t) 0 != c_locale) {
+        locale_t previous = uselocale(c_locale);
+        double value = strtod(text, NULL);
+
+        uselocale(previous);
+        freelocale(c_locale);
+        return value;
+    }
+#endif
+
+    point = localeconv()->decimal_point;
+    dot = strchr(text, '.');
+    if ((NULL != dot) && (NULL != point) && ('\0' != point[0]) && ('\0' == point[1])) {
+        *dot = point[0];
+    }
+
+    return strtod(text, NULL);
+}
+
+static bool _read_literal(binson_json_in *in, const char *literal, size_t size)
+{
+    if (((in->size - in->pos) < size) ||
+        (0 != memcmp(&in->data[in->pos], literal, size))) {
+        return _fail(in, BINSON_ERROR_FORMAT);
+    }
+
+    in->pos += size;
+
+    return true;
+}
+
+/* Finds the end of the value at in->pos without writing it. */
+static bool _skip_value(binson_json_in *in)
+{
+    if (in->pos >= in->size) {
+        return _fail(in, BINSON_ERROR_FORMAT);
+    }
+
+    switch (in->data[in->pos]) {
+        case '"':
+            return _skip_string(in);
+        case '{':
+        case '[':
+            return _skip_block(in);
+        case 't':
+            return _read_literal(in, "true", 4);
+        case 'f':
+            return _read_literal(in, "false", 5);
+        case 'n':
+            return _read_literal(in, "null", 4);
+        default:
+            return _read_number(in, false);
+    }
+}
+
+static bool _skip_string(binson_json_in *in)
+{
+    size_t pos = in->pos + 1;
+
+    for (;;) {
+        pos = _scan_string(in, pos);
+        if (pos >= in->size) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+        if ('"' == in->data[pos]) {
+            in->pos = pos + 1;
+            return true;
+        }
+        /* Control characters are reported when the value is written. */
+        pos += ('\\' == in->data[pos]) ? 2 : 1;
+        if (pos > in->size) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+    }
+}
+
+/*
+ * Skips an object or array by counting brackets outside of strings. The
+ * contents are checked when the block is written, so a mismatched bracket
+ * only has to keep the count from going wrong.
+ */
+static bool _skip_block(binson_json_in *in)
+{
+    size_t depth = 0;
+    size_t pos = in->pos;
+
+    for (;;) {
+        uint8_t c;
+
+        pos = _scan_block(in, pos);
+        if (pos >= in->size) {
+            return _fail(in, BINSON_ERROR_FORMAT);
+        }
+
+        c = in->data[pos];
+        if ('"' == c) {
+            in->pos = pos;
+            if (!_skip_string(in)) {
+                return false;
+            }
+            pos = in->pos;
+            continue;
+        }
+
+        pos++;
+        /* '[' | 0x20 is '{' and ']' | 0x20 is '}'. */
+        if ('{' == (c | 0x20U)) {
+            depth++;
+        }
+        else if (0 == --depth) {
+            in->pos = pos;
+            return true;
+        }
+    }
+}
+
+static void _skip_space(binson_json_in *in)
+{
+    while ((in->pos < in->size) &&
+           ((' ' == in->data[in->pos]) || ('\n' == in->data[in->pos]) ||
+            ('\r' == in->data[in->pos]) || ('\t' == in->data[in->pos]))) {
+        in->pos++;
+    }
+}
+
+/* Position of the next quote, backslash or control character from pos. */
+static size_t _scan_string(const binson_json_in *in, size_t pos)
+{
+#ifdef BINSON_CPU_X86_DISPATCH
+    if (in->avx2) {
+        pos = _scan_string_avx2(in->data, pos, in->size);
+    }
+#endif
+
+    while ((pos < in->size) &&
+           ('"' != in->data[pos]) &&
+           ('\\' != in->data[pos]) &&
+           (in->data[pos] >= 0x20U)) {
+        pos++;
+    }
+
+    return pos;
+}
+
+/* Position of the next quote or bracket from pos. */
+static size_t _scan_block(const binson_json_in *in, size_t pos)
+{
+#ifdef BINSON_CPU_X86_DISPATCH
+    if (in->avx2) {
+        pos = _scan_block_avx2(in->data, pos, in->size);
+    }
+#endif
+
+    while ((pos < in->size) &&
+           ('"' != in->data[pos]) &&
+           ('{' != (in->data[pos] | 0x20U)) &&
+           ('}' != (in->data[pos] | 0x20U))) {
+        pos++;
+    }
+
+    return pos;
+}
+
+#ifdef BINSON_CPU_X86_DISPATCH
+
+/* Both scanners stop with fewer than 32 bytes left for the scalar loop. */
+__attribute__((target("avx2")))
+static size_t _scan_string_avx2(const uint8_t *data, size_t pos, size_t size)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1F);
+
+    while ((size - pos) >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) &data[pos]);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                      _mm256_cmpeq_epi8(v, backslash));
+        uint32_t mask;
+
+        /* max(v, 0x1F) == 0x1F for the unsigned bytes below 0x20. */
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(_mm256_max_epu8(v, control),
+                                                     control));
+        mask = (uint32_t) _mm256_movemask_epi8(hit);
+        if (0 != mask) {
+            return pos + (size_t) __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+
+    return pos;
+}
+
+__attribute__((target("avx2")))
+static size_t _scan_block_avx2(const uint8_t *data, size_t pos, size_t size)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+
+    while ((size - pos) >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) &data[pos]);
+        __m256i folded = _mm256_or_si256(v, case_bit);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(folded, open),
+                                      _mm256_cmpeq_epi8(folded, close));
+        uint32_t mask;
+
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, quote));
+        mask = (uint32_t) _mm256_movemask_epi8(hit);
+        if (0 != mask) {
+            return pos + (size_t) __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+
+    return pos;
+}
+
+#endif
+
+/*
+ * Sorts an object's key table into binson field order and checks for
+ * duplicates. The table grows downwards, so it holds the keys in reverse
+ * input order; reversing it first keeps insertion sort linear for input
+ * that is already sorted.
+ */
+static bool _sort_members(binson_json_member *members, size_t count)
+{
+    binson_json_member tmp;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < count / 2; i++) {
+        tmp = members[i];
+        members[i] = members[count - 1 - i];
+        members[count - 1 - i] = tmp;
+    }
+
+    if (count > BINSON_JSON_INSERTION_SORT) {
+        qsort(members, count, sizeof(binson_json_member), _cmp_member);
+    }
+    else {
+        for (i = 1; i < count; i++) {
+            tmp = members[i];
+            for (j = i; (j > 0) && (_cmp_member(&members[j - 1], &tmp) > 0); j--) {
+                members[j] = members[j - 1];
+            }
+            members[j] = tmp;
+        }
+    }
+
+    for (i = 1; i < count; i++) {
+        if (0 == _cmp_member(&members[i - 1], &members[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Same order as the parser: bytewise, a prefix sorts first. */
+static int _cmp_member(const void *a, const void *b)
+{
+    const binson_json_member *x = (const binson_json_member *) a;
+    const binson_json_member *y = (const binson_json_member *) b;
+    size_t size = (x->name_size < y->name_size) ? x->name_size : y->name_size;
+    int r = memcmp(x->name, y->name, size);
+
+    if (0 != r) {
+        return r;
+    }
+
+    return (x->name_size > y->name_size) - (x->name_size < y->name_size);
+}
+
+static bool _is_digit(uint8_t c)
+{
+    return (c >= '0') && (c <= '9');
+}
+
+static bool _fail(binson_json_in *in, binson_err error)
+{
+    if (BINSON_ERROR_NONE == in->error) {
+        in->error = error;
+    }
+
+    return false;
+}
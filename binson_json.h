@@ -0,0 +1,171 @@
+#ifndef _BINSON_JSON_H_
+#define _BINSON_JSON_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file binson_json.h
+ *
+ * Conversion between binson and JSON text.
+ *
+ * binson_json_emit() walks a parser once and writes the JSON text through a
+ * sink callback in chunks of BINSON_JSON_BUFFER_SIZE bytes, so documents of
+ * any size are written with constant memory. Sinks for FILE streams, file
+ * descriptors and a growable heap buffer are provided.
+ *
+ * Output is written while parsing, so an object that turns out to be
+ * invalid half way leaves partial output behind. Call binson_parser_verify()
+ * first when that matters.
+ *
+ * binson_json_transcode() goes the other way and writes a JSON document
+ * straight through a binson_writer, without building a tree in between.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+
+#include "binson_parser.h"
+#include "binson_writer.h"
+
+/*======= Public macro definitions ==========================================*/
+
+/* Size of the internal output buffer, on the stack of binson_json_emit(). */
+#define BINSON_JSON_BUFFER_SIZE     (1024U)
+
+/* Indented output with one field or element per line. */
+#define BINSON_JSON_PRETTY          (0x01U)
+
+/* Bytes as base64 strings instead of "0x" prefixed lower case hex. */
+#define BINSON_JSON_BYTES_BASE64    (0x02U)
+
+/* Scratch area binson_json_transcode() uses on its stack when none is given. */
+#define BINSON_JSON_SCRATCH_SIZE    (4096U)
+
+/*======= Type Definitions and declarations =================================*/
+
+/**
+ * Sink callback. Receives size bytes of output and returns false to abort
+ * the emitter.
+ */
+typedef bool (*binson_json_sink)(void *context, const char *data, size_t size);
+
+/* Growable heap buffer, zero initialize before first use. */
+typedef struct binson_json_buffer_s {
+    char    *data;
+    size_t  size;
+    size_t  capacity;
+} binson_json_buffer;
+
+/*======= Public function declarations ======================================*/
+
+/**
+ * @brief Writes the object or array a parser was initiated on as JSON.
+ *
+ * Strings are escaped as required by JSON; their bytes are otherwise
+ * passed through unchanged. Doubles use the shortest text that reads back
+ * as the same value, NaN and infinities are written as null.
+ *
+ * @param parser    Parser initiated with binson_parser_init() or
+ *                  binson_parser_init_array(). It is reset first.
+ * @param flags     BINSON_JSON_PRETTY and/or BINSON_JSON_BYTES_BASE64.
+ * @param sink      Output callback.
+ * @param context   Passed to sink.
+ *
+ * @return true     The whole document was written.
+ * @return false    Parse error, see parser->error_flags, or the sink failed.
+ */
+bool binson_json_emit(binson_parser *parser,
+                      uint8_t flags,
+                      binson_json_sink sink,
+                      void *context);
+
+/**
+ * @brief Writes the value a parser is positioned on as JSON.
+ *
+ * Like binson_json_emit() but for the current value only, for example
+ * after binson_parser_field(). Objects and arrays are written with their
+ * contents and the parser continues after them.
+ *
+ * @param parser    Parser positioned on a value.
+ * @param flags     BINSON_JSON_PRETTY and/or BINSON_JSON_BYTES_BASE64.
+ * @param sink      Output callback.
+ * @param context   Passed to sink.
+ *
+ * @return true     The value was written.
+ * @return false    Parse error, see parser->error_flags, or the sink failed.
+ */
+bool binson_json_emit_value(binson_parser *parser,
+                            uint8_t flags,
+                            binson_json_sink sink,
+                            void *context);
+
+/**
+ * @brief Converts a JSON document to binson.
+ *
+ * The top level value must be an object or an array. Integers that fit in
+ * 64 bits become binson integers, all other numbers become doubles. Strings
+ * are unescaped, including UTF-16 surrogate pairs, and otherwise copied
+ * byte for byte. JSON null has no binson counterpart and is rejected, as
+ * are duplicate object keys and nesting deeper than
+ * BINSON_PARSER_MAX_DEPTH.
+ *
+ * Binson requires the fields of an object in sorted order, so each object
+ * is read twice: once to collect and sort its keys, once to write the
+ * values in key order. The key table lives in the scratch area, which
+ * needs room for three words per key of every object on the current
+ * nesting path plus the unescaped copies of keys and strings that contain
+ * escape sequences.
+ *
+ * As with the other write functions, a writer buffer that is too small
+ * sets BINSON_ERROR_RANGE but keeps counting, so the required size can be
+ * read with binson_writer_get_counter() afterwards.
+ *
+ * @param writer        Writer to append the converted document to.
+ * @param json          JSON text, need not be NUL terminated.
+ * @param size          Size of the JSON text.
+ * @param scratch       Scratch area, or NULL to use BINSON_JSON_SCRATCH_SIZE
+ *                      bytes of stack.
+ * @param scratch_size  Size of the scratch area.
+ *
+ * @return true     The document was converted.
+ * @return false    writer->error_flags is BINSON_ERROR_FORMAT for invalid
+ *                  or unsupported JSON, BINSON_ERROR_MAX_DEPTH for too deep
+ *                  nesting, or BINSON_ERROR_RANGE when the scratch area or
+ *                  the writer buffer was too small.
+ */
+bool binson_json_transcode(binson_writer *writer,
+                           const char *json,
+                           size_t size,
+                           void *scratch,
+                           size_t scratch_size);
+
+/**
+ * @brief Sink writing to a FILE stream. context is the FILE pointer.
+ */
+bool binson_json_file_sink(void *context, const char *data, size_t size);
+
+/**
+ * @brief Sink writing to a file descriptor. context points to the int fd.
+ */
+bool binson_json_fd_sink(void *context, const char *data, size_t size);
+
+/**
+ * @brief Sink appending to a binson_json_buffer. context points to the
+ *        buffer, which grows as needed. The data is not NUL terminated.
+ */
+bool binson_json_buffer_sink(void *context, const char *data, size_t size);
+
+/**
+ * @brief Releases the memory of a binson_json_buffer and zeroes it.
+ */
+void binson_json_buffer_free(binson_json_buffer *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BINSON_JSON_H_ */
@@ -11,6 +11,16 @@
 #include <string.h>
 
 #include "binson_parser.h"
+#include "binson_cpu.h"
+
+#if defined(__SSE2__) && !defined(BINSON_NO_SIMD)
+#include <emmintrin.h>
+#define BINSON_PARSER_SSE2
+#endif
+
+#ifdef BINSON_CPU_X86_DISPATCH
+#include <immintrin.h>
+#endif
 
 /*======= Local Macro Definitions ===========================================*/
 /*======= Type Definitions ==================================================*/
@@ -48,6 +58,9 @@
 #define BINSON_ADVANCE_LEAVE_ARRAY          (0x10U)
 #define BINSON_ADVANCE_VALUE                (0x20U)
 
+/* Strings shorter than this are validated by the scalar UTF-8 loop. */
+#define BINSON_UTF8_SIMD_MIN                (32U)
+
 #ifndef MIN
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #endif
@@ -61,7 +74,11 @@
 /*======= Local variable declarations =======================================*/
 
 static bool _parse_integer(bbuf *length_data, int64_t *value, bool check_boundaries);
+static int64_t _load_int(const uint8_t *data, size_t size);
+static double _load_double(const uint8_t *data);
+static size_t _token_size(const uint8_t *data, size_t size);
 static int _cmp_name(bbuf *a, bbuf *b);
+static bool _ends_match(const uint8_t *value, size_t size);
 #define _advance(p, s) _advance_parsing(p, s, NULL)
 static bool _advance_parsing(binson_parser *parser, uint8_t scan_flags, bbuf *scan_name);
 static bool _consume(binson_parser *parser,
@@ -71,6 +88,23 @@ static bool _consume(binson_parser *parser,
 static bool _check_boundary(size_t a,
                             size_t b,
                             size_t max);
+static binson_type _token_type(uint8_t token);
+static bool _read_array(binson_parser *parser,
+                        binson_type type,
+                        void *out,
+                        size_t max,
+                        size_t *n);
+#ifdef BINSON_PARSER_SSE2
+static size_t _read_int8_run(const uint8_t *data,
+                             size_t available,
+                             int64_t *out,
+                             size_t max);
+#endif
+static bool _utf8_valid(const uint8_t *data, size_t size);
+static bool _utf8_valid_scalar(const uint8_t *data, size_t size);
+#ifdef BINSON_CPU_X86_DISPATCH
+static bool _utf8_valid_avx2(const uint8_t *data, size_t size);
+#endif
 
 /*======= Global function implementations ===================================*/
 
@@ -166,6 +200,7 @@ bool binson_parser_reset(binson_parser *parser)
     bool ret;
     binson_cb cb        = parser->cb;
     void *cb_context    = parser->cb_context;
+    uint8_t options     = parser->options;
 
     if (parser->type == BINSON_TYPE_OBJECT)
     {
@@ -178,6 +213,7 @@ bool binson_parser_reset(binson_parser *parser)
 
     parser->cb = cb;
     parser->cb_context = cb_context;
+    parser->options = options;
 
     return ret;
 
@@ -200,6 +236,205 @@ bool binson_parser_verify(binson_parser *parser)
     return ret;
 }
 
+size_t binson_message_size(const uint8_t *buffer, size_t buffer_size)
+{
+    if ((NULL == buffer) ||
+        (buffer_size < BINSON_OBJECT_MINIMUM_SIZE) ||
+        ((BINSON_DEF_OBJECT_BEGIN != buffer[0]) &&
+         (BINSON_DEF_ARRAY_BEGIN != buffer[0]))) {
+        return 0;
+    }
+
+    return binson_value_size(buffer, buffer_size);
+}
+
+size_t binson_value_size(const uint8_t *buffer, size_t buffer_size)
+{
+    size_t depth = 0;
+    size_t pos = 0;
+
+    if ((NULL == buffer) || (0 == buffer_size)) {
+        return 0;
+    }
+
+    do {
+        size_t n;
+
+        switch (buffer[pos]) {
+            case BINSON_DEF_OBJECT_BEGIN:
+            case BINSON_DEF_ARRAY_BEGIN:
+                depth++;
+                n = 1;
+                break;
+            case BINSON_DEF_OBJECT_END:
+            case BINSON_DEF_ARRAY_END:
+                if (0 == depth) {
+                    return 0;
+                }
+                depth--;
+                n = 1;
+                break;
+            default:
+                n = _token_size(&buffer[pos], buffer_size - pos);
+                if (0 == n) {
+                    return 0;
+                }
+                break;
+        }
+
+        pos += n;
+    } while ((depth > 0) && (pos < buffer_size));
+
+    return (0 == depth) ? pos : 0;
+}
+
+size_t binson_token_size(const uint8_t *buffer, size_t buffer_size)
+{
+    if ((NULL == buffer) || (0 == buffer_size)) {
+        return 0;
+    }
+
+    return _token_size(buffer, buffer_size);
+}
+
+bool binson_message_iter_init(binson_message_iter *iter,
+                              const uint8_t *buffer,
+                              size_t buffer_size)
+{
+    if ((NULL == iter) || (NULL == buffer)) {
+        return false;
+    }
+
+    iter->buffer        = buffer;
+    iter->buffer_size   = buffer_size;
+    iter->offset        = 0;
+    iter->index         = 0;
+    iter->error_flags   = BINSON_ERROR_NONE;
+    iter->options       = 0;
+    iter->cb            = NULL;
+    iter->cb_context    = NULL;
+
+    return true;
+}
+
+bool binson_message_iter_next(binson_message_iter *iter, binson_parser *parser)
+{
+    bbuf span;
+
+    if (NULL == parser) {
+        return false;
+    }
+
+    if (binson_message_iter_spans(iter, &span, 1) != 1) {
+        return false;
+    }
+
+    /* The span begins and ends with matching tokens, so init succeeds. */
+    if (BINSON_DEF_OBJECT_BEGIN == span.bptr[0]) {
+        binson_parser_init_object(parser, span.bptr, span.bsize);
+    }
+    else {
+        binson_parser_init_array(parser, span.bptr, span.bsize);
+    }
+
+    parser->cb = iter->cb;
+    parser->cb_context = iter->cb_context;
+    parser->options = iter->options;
+
+    return true;
+}
+
+size_t binson_message_iter_spans(binson_message_iter *iter, bbuf *spans, size_t max)
+{
+    size_t n = 0;
+
+    if ((NULL == iter) || (NULL == spans) || (BINSON_ERROR_NONE != iter->error_flags)) {
+        return 0;
+    }
+
+    while ((n < max) && (iter->offset < iter->buffer_size)) {
+        const uint8_t *message = &iter->buffer[iter->offset];
+        size_t size = binson_message_size(message, iter->buffer_size - iter->offset);
+
+        if (0 == size) {
+            iter->error_flags = BINSON_ERROR_FORMAT;
+            break;
+        }
+
+        /* Init of a parser requires the matching end token. */
+        if (!_ends_match(message, size)) {
+            iter->error_flags = BINSON_ERROR_FORMAT;
+            break;
+        }
+
+        spans[n].bptr = message;
+        spans[n].bsize = size;
+        iter->offset += size;
+        iter->index++;
+        n++;
+    }
+
+    return n;
+}
+
+bool binson_array_iter_init(binson_message_iter *iter,
+                            const uint8_t *buffer,
+                            size_t buffer_size)
+{
+    if ((NULL == iter) || (NULL == buffer)) {
+        return false;
+    }
+
+    iter->buffer        = buffer;
+    iter->buffer_size   = 0;
+    iter->offset        = 0;
+    iter->index         = 0;
+    iter->error_flags   = BINSON_ERROR_FORMAT;
+    iter->options       = 0;
+    iter->cb            = NULL;
+    iter->cb_context    = NULL;
+
+    if ((buffer_size < BINSON_OBJECT_MINIMUM_SIZE) ||
+        (BINSON_DEF_ARRAY_BEGIN != buffer[0]) ||
+        (BINSON_DEF_ARRAY_END != buffer[buffer_size - 1])) {
+        return false;
+    }
+
+    /* Iterate over the contents between the begin and end tokens. */
+    iter->buffer        = &buffer[1];
+    iter->buffer_size   = buffer_size - 2;
+    iter->error_flags   = BINSON_ERROR_NONE;
+
+    return true;
+}
+
+size_t binson_array_iter_spans(binson_message_iter *iter, bbuf *spans, size_t max)
+{
+    size_t n = 0;
+
+    if ((NULL == iter) || (NULL == spans) || (BINSON_ERROR_NONE != iter->error_flags)) {
+        return 0;
+    }
+
+    while ((n < max) && (iter->offset < iter->buffer_size)) {
+        const uint8_t *element = &iter->buffer[iter->offset];
+        size_t size = binson_value_size(element, iter->buffer_size - iter->offset);
+
+        if ((0 == size) || !_ends_match(element, size)) {
+            iter->error_flags = BINSON_ERROR_FORMAT;
+            break;
+        }
+
+        spans[n].bptr = element;
+        spans[n].bsize = size;
+        iter->offset += size;
+        iter->index++;
+        n++;
+    }
+
+    return n;
+}
+
 size_t binson_parser_get_depth(binson_parser *parser)
 {
     return (NULL != parser) ? parser->depth : 0;
@@ -234,13 +469,7 @@ bool binson_parser_next_ensure(binson_parser *parser, binson_type field_type)
 
 binson_type binson_parser_get_type(binson_parser *parser)
 {
-    if ((NULL != parser) &&
-        (BINSON_ERROR_NONE == parser->error_flags) &&
-        (NULL != parser->current_state)) {
-        return parser->current_state->current_type;
-    }
-
-    return BINSON_TYPE_NONE;
+    return binson_parser_get_type_inline(parser);
 }
 
 bool binson_parser_field_with_length(binson_parser *parser, const char *field_name, size_t length)
@@ -348,23 +577,12 @@ bool binson_parser_leave_array(binson_parser *parser)
 
 bbuf *binson_parser_get_name(binson_parser *parser)
 {
-    if ((NULL != parser) &&
-        (BINSON_ERROR_NONE == parser->error_flags) &&
-        (NULL != parser->current_state)) {
-        return &parser->current_state->current_name;
-    }
-    return NULL;
+    return binson_parser_get_name_inline(parser);
 }
 
 bbuf *binson_parser_get_string_bbuf(binson_parser *parser)
 {
-    if ((NULL != parser) &&
-        (BINSON_ERROR_NONE == parser->error_flags) &&
-        (NULL != parser->current_state) &&
-        (BINSON_TYPE_STRING == parser->current_state->current_type)) {
-        return &parser->current_state->current_value.string_value;
-    }
-    return NULL;
+    return binson_parser_get_string_bbuf_inline(parser);
 }
 
 bool binson_parser_get_raw(binson_parser *parser, bbuf *raw)
@@ -406,50 +624,46 @@ bool binson_parser_get_raw(binson_parser *parser, bbuf *raw)
 
 int64_t binson_parser_get_integer(binson_parser *parser)
 {
-    if ((NULL != parser) &&
-        (BINSON_ERROR_NONE == parser->error_flags) &&
-        (NULL != parser->current_state) &&
-        (BINSON_TYPE_INTEGER == parser->current_state->current_type)) {
-        return parser->current_state->current_value.integer_value;
-    }
-
-    return 0;
+    return binson_parser_get_integer_inline(parser);
 }
 
 bool binson_parser_get_boolean(binson_parser *parser)
 {
-    if ((NULL != parser) &&
-        (BINSON_ERROR_NONE == parser->error_flags) &&
-        (NULL != parser->current_state) &&
-        (BINSON_TYPE_BOOLEAN == parser->current_state->current_type)) {
-        return parser->current_state->current_value.bool_value;
-    }
-
-    return false;
+    return binson_parser_get_boolean_inline(parser);
 }
 
 double binson_parser_get_double(binson_parser *parser)
 {
-    if ((NULL != parser) &&
-        (BINSON_ERROR_NONE == parser->error_flags) &&
-        (NULL != parser->current_state) &&
-        (BINSON_TYPE_DOUBLE == parser->current_state->current_type)) {
-        return parser->current_state->current_value.double_value;
-    }
+    return binson_parser_get_double_inline(parser);
+}
 
+bbuf *binson_parser_get_bytes_bbuf(binson_parser *parser)
+{
+    return binson_parser_get_bytes_bbuf_inline(parser);
+}
 
-    return 0.0f;
+bool binson_parser_read_int64_array(binson_parser *parser,
+                                    int64_t *out,
+                                    size_t max,
+                                    size_t *n)
+{
+    return _read_array(parser, BINSON_TYPE_INTEGER, out, max, n);
 }
 
-bbuf *binson_parser_get_bytes_bbuf(binson_parser *parser)
+bool binson_parser_read_double_array(binson_parser *parser,
+                                     double *out,
+                                     size_t max,
+                                     size_t *n)
 {
-    if ((NULL != parser) &&
-        (BINSON_ERROR_NONE == parser->error_flags) &&
-        (NULL != parser->current_state) &&
-        (BINSON_TYPE_BYTES == parser->current_state->current_type)) {
-        return &parser->current_state->current_value.bytes_value;
-    }
-    return NULL;
+    return _read_array(parser, BINSON_TYPE_DOUBLE, out, max, n);
+}
+
+bool binson_parser_read_bool_array(binson_parser *parser,
+                                   bool *out,
+                                   size_t max,
+                                   size_t *n)
+{
+    return _read_array(parser, BINSON_TYPE_BOOLEAN, out, max, n);
 }
 
 bool binson_parser_string_equals(binson_parser *parser, const char *pstr)
@@ -467,96 +681,434 @@ bool binson_parser_string_equals(binson_parser *parser, const char *pstr)
     return _cmp_name(&parser->current_state->current_value.string_value, &cmp) == 0;
 }
 
-static void _binson_print_cb(binson_parser *parser, uint16_t next_state, void *context)
+/*
+ * Text formatting shared by binson_parser_print() and
+ * binson_parser_to_string(). Output goes to a buffer; with a stream set the
+ * buffer is flushed to it when full, otherwise output past the end of the
+ * buffer is only counted so the required size can be reported.
+ */
+struct _to_string_ctx {
+    char *buffer;
+    size_t buffer_size;
+    size_t buffer_used;
+    FILE *stream;
+    uint8_t pstate;
+    bool nice;
+    bool buffer_full;
+};
+
+static void _text_put(struct _to_string_ctx *ctx, const char *data, size_t length)
 {
+    if (NULL != ctx->stream) {
+        if (!_check_boundary(ctx->buffer_used, length, ctx->buffer_size)) {
+            fwrite(ctx->buffer, 1, ctx->buffer_used, ctx->stream);
+            ctx->buffer_used = 0;
+        }
+        if (length > ctx->buffer_size) {
+            fwrite(data, 1, length, ctx->stream);
+            return;
+        }
+    }
+    else if (ctx->buffer_full ||
+             !_check_boundary(ctx->buffer_used, length, ctx->buffer_size)) {
+        ctx->buffer_full = true;
+        ctx->buffer_used = _check_boundary(ctx->buffer_used, length, SIZE_MAX) ?
+                           ctx->buffer_used + length : SIZE_MAX;
+        return;
+    }
 
-    binson_state *state = parser->current_state;
-    uint8_t *pstate = (uint8_t *) context;
+    memcpy(&ctx->buffer[ctx->buffer_used], data, length);
+    ctx->buffer_used += length;
+}
 
-    if (next_state != BINSON_STATE_PARSED_ARRAY_END && *pstate == 0x05) {
-        printf(",");
+/* Two digit lookup, "00" to "99". */
+static const char _digits[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char _hex_digits[17] = "0123456789abcdef";
+
+size_t binson_format_integer(char *out, int64_t value)
+{
+    char tmp[20];
+    size_t pos = sizeof(tmp);
+    uint64_t u = (value < 0) ? (0U - (uint64_t) value) : (uint64_t) value;
+
+    while (u >= 100U) {
+        size_t d = (size_t) (u % 100U) * 2U;
+        u /= 100U;
+        tmp[--pos] = _digits[d + 1];
+        tmp[--pos] = _digits[d];
     }
 
-    if (*pstate == 0x04) {
-        *pstate = 0x05;
+    if (u >= 10U) {
+        tmp[--pos] = _digits[u * 2U + 1];
+        tmp[--pos] = _digits[u * 2U];
+    }
+    else {
+        tmp[--pos] = (char) ('0' + u);
     }
 
-    switch (next_state)
-    {
-        case BINSON_STATE_PARSED_OBJECT_BEGIN:
-            *pstate = 0x01;
-            printf("{");
-            break;
-        case BINSON_STATE_PARSED_OBJECT_END:
-            if (state->array_depth > 0) {
-                *pstate = 0x05;
-            }
-            printf("}");
-            break;
-        case BINSON_STATE_PARSED_ARRAY_BEGIN:
-            *pstate = 0x04;
-            printf("[");
-            break;
-        case BINSON_STATE_PARSED_ARRAY_END:
-            if (state->array_depth == 0) {
-                *pstate = 0x02;
-            }
-            printf("]");
-            break;
-        case BINSON_STATE_PARSED_FIELD_NAME:
-            if (*pstate == 0x02) {
-                printf(",");
-            }
-            *pstate = 0x02;
-            printf("\"%*.*s\":", 0, (int) state->current_name.bsize, (const char* ) parser->current_state->current_name.bptr);
-            break;
-        case BINSON_STATE_PARSED_STRING:
-            printf("\"%*.*s\"", 0, (int) state->current_value.string_value.bsize, (const char* ) state->current_value.string_value.bptr);
-            break;
-        case BINSON_STATE_PARSED_BOOLEAN:
-            printf("%s", (state->current_value.bool_value) ? "true" : "false");
-            break;
-        case BINSON_STATE_PARSED_DOUBLE:
-            printf("%lf", state->current_value.double_value);
-            break;
-        case BINSON_STATE_PARSED_INTEGER:
-            printf("%" PRId64 "", state->current_value.integer_value);
-            break;
-        case BINSON_STATE_PARSED_BYTES:
-            printf("\"0x");
-            size_t i;
-            for (i = 0; i < state->current_value.bytes_value.bsize; i++) {
-                printf("%02x", state->current_value.bytes_value.bptr[i]);
-            }
-            printf("\"");
-            break;
-            
+    if (value < 0) {
+        tmp[--pos] = '-';
     }
 
+    memcpy(out, &tmp[pos], sizeof(tmp) - pos);
+    return sizeof(tmp) - pos;
 }
 
-bool binson_parser_print(binson_parser *parser)
+/*
+ * Shortest round trip formatting of doubles with Grisu2 (Florian Loitsch,
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers").
+ * The digits always read back as the same double and are the shortest
+ * such digits for almost all values. Only integer arithmetic, so the
+ * output does not depend on the locale.
+ */
+typedef struct {
+    uint64_t f;
+    int e;
+} _diy_fp;
+
+typedef struct {
+    uint64_t f;
+    int16_t e;
+    int16_t k;
+} _cached_power;
+
+/* 10^k normalized to 64 bits, rounded, for k = -300, -292, ..., 324. */
+static const _cached_power _cached_powers[79] = {
+    { 0xAB70FE17C79AC6CAULL, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+    { 0xBE5691EF416BD60CULL, -1007, -284 },
+    { 0x8DD01FAD907FFC3CULL,  -980, -276 },
+    { 0xD3515C2831559A83ULL,  -954, -268 },
+    { 0x9D71AC8FADA6C9B5ULL,  -927, -260 },
+    { 0xEA9C227723EE8BCBULL,  -901, -252 },
+    { 0xAECC49914078536DULL,  -874, -244 },
+    { 0x823C12795DB6CE57ULL,  -847, -236 },
+    { 0xC21094364DFB5637ULL,  -821, -228 },
+    { 0x9096EA6F3848984FULL,  -794, -220 },
+    { 0xD77485CB25823AC7ULL,  -768, -212 },
+    { 0xA086CFCD97BF97F4ULL,  -741, -204 },
+    { 0xEF340A98172AACE5ULL,  -715, -196 },
+    { 0xB23867FB2A35B28EULL,  -688, -188 },
+    { 0x84C8D4DFD2C63F3BULL,  -661, -180 },
+    { 0xC5DD44271AD3CDBAULL,  -635, -172 },
+    { 0x936B9FCEBB25C996ULL,  -608, -164 },
+    { 0xDBAC6C247D62A584ULL,  -582, -156 },
+    { 0xA3AB66580D5FDAF6ULL,  -555, -148 },
+    { 0xF3E2F893DEC3F126ULL,  -529, -140 },
+    { 0xB5B5ADA8AAFF80B8ULL,  -502, -132 },
+    { 0x87625F056C7C4A8BULL,  -475, -124 },
+    { 0xC9BCFF6034C13053ULL,  -449, -116 },
+    { 0x964E858C91BA2655ULL,  -422, -108 },
+    { 0xDFF9772470297EBDULL,  -396, -100 },
+    { 0xA6DFBD9FB8E5B88FULL,  -369,  -92 },
+    { 0xF8A95FCF88747D94ULL,  -343,  -84 },
+    { 0xB94470938FA89BCFULL,  -316,  -76 },
+    { 0x8A08F0F8BF0F156BULL,  -289,  -68 },
+    { 0xCDB02555653131B6ULL,  -263,  -60 },
+    { 0x993FE2C6D07B7FACULL,  -236,  -52 },
+    { 0xE45C10C42A2B3B06ULL,  -210,  -44 },
+    { 0xAA242499697392D3ULL,  -183,  -36 },
+    { 0xFD87B5F28300CA0EULL,  -157,  -28 },
+    { 0xBCE5086492111AEBULL,  -130,  -20 },
+    { 0x8CBCCC096F5088CCULL,  -103,  -12 },
+    { 0xD1B71758E219652CULL,   -77,   -4 },
+    { 0x9C40000000000000ULL,   -50,    4 },
+    { 0xE8D4A51000000000ULL,   -24,   12 },
+    { 0xAD78EBC5AC620000ULL,     3,   20 },
+    { 0x813F3978F8940984ULL,    30,   28 },
+    { 0xC097CE7BC90715B3ULL,    56,   36 },
+    { 0x8F7E32CE7BEA5C70ULL,    83,   44 },
+    { 0xD5D238A4ABE98068ULL,   109,   52 },
+    { 0x9F4F2726179A2245ULL,   136,   60 },
+    { 0xED63A231D4C4FB27ULL,   162,   68 },
+    { 0xB0DE65388CC8ADA8ULL,   189,   76 },
+    { 0x83C7088E1AAB65DBULL,   216,   84 },
+    { 0xC45D1DF942711D9AULL,   242,   92 },
+    { 0x924D692CA61BE758ULL,   269,  100 },
+    { 0xDA01EE641A708DEAULL,   295,  108 },
+    { 0xA26DA3999AEF774AULL,   322,  116 },
+    { 0xF209787BB47D6B85ULL,   348,  124 },
+    { 0xB454E4A179DD1877ULL,   375,  132 },
+    { 0x865B86925B9BC5C2ULL,   402,  140 },
+    { 0xC83553C5C8965D3DULL,   428,  148 },
+    { 0x952AB45CFA97A0B3ULL,   455,  156 },
+    { 0xDE469FBD99A05FE3ULL,   481,  164 },
+    { 0xA59BC234DB398C25ULL,   508,  172 },
+    { 0xF6C69A72A3989F5CULL,   534,  180 },
+    { 0xB7DCBF5354E9BECEULL,   561,  188 },
+    { 0x88FCF317F22241E2ULL,   588,  196 },
+    { 0xCC20CE9BD35C78A5ULL,   614,  204 },
+    { 0x98165AF37B2153DFULL,   641,  212 },
+    { 0xE2A0B5DC971F303AULL,   667,  220 },
+    { 0xA8D9D1535CE3B396ULL,   694,  228 },
+    { 0xFB9B7CD9A4A7443CULL,   720,  236 },
+    { 0xBB764C4CA7A44410ULL,   747,  244 },
+    { 0x8BAB8EEFB6409C1AULL,   774,  252 },
+    { 0xD01FEF10A657842CULL,   800,  260 },
+    { 0x9B10A4E5E9913129ULL,   827,  268 },
+    { 0xE7109BFBA19C0C9DULL,   853,  276 },
+    { 0xAC2820D9623BF429ULL,   880,  284 },
+    { 0x80444B5E7AA7CF85ULL,   907,  292 },
+    { 0xBF21E44003ACDD2DULL,   933,  300 },
+    { 0x8E679C2F5E44FF8FULL,   960,  308 },
+    { 0xD433179D9C8CB841ULL,   986,  316 },
+    { 0x9E19DB92B4E31BA9ULL,  1013,  324 },
+};
+
+#define GRISU_ALPHA         (-60)
+#define GRISU_MIN_DEC_EXP   (-300)
+#define GRISU_DEC_STEP      (8)
+
+static _diy_fp _diy_fp_mul(_diy_fp x, _diy_fp y)
 {
-    if (NULL == parser) {
-        return false;
+    uint64_t x_lo = x.f & 0xFFFFFFFFU;
+    uint64_t x_hi = x.f >> 32;
+    uint64_t y_lo = y.f & 0xFFFFFFFFU;
+    uint64_t y_hi = y.f >> 32;
+    uint64_t lo_lo = x_lo * y_lo;
+    uint64_t lo_hi = x_lo * y_hi;
+    uint64_t hi_lo = x_hi * y_lo;
+    uint64_t mid = (lo_lo >> 32) + (lo_hi & 0xFFFFFFFFU) + (hi_lo & 0xFFFFFFFFU) +
+                   (1ULL << 31);
+    _diy_fp r;
+
+    r.f = x_hi * y_hi + (lo_hi >> 32) + (hi_lo >> 32) + (mid >> 32);
+    r.e = x.e + y.e + 64;
+    return r;
+}
+
+static _diy_fp _diy_fp_normalize(_diy_fp x)
+{
+    while (0U == (x.f >> 63)) {
+        x.f <<= 1;
+        x.e--;
     }
-    uint8_t pstate = 0x00;
-    parser->cb_context = &pstate;
-    parser->cb = _binson_print_cb;
-    bool ret = binson_parser_verify(parser);
-    parser->cb = NULL;
-    parser->cb_context = NULL;
-    return ret;
+    return x;
 }
 
-struct _to_string_ctx {
-    char *buffer;
-    size_t buffer_size;
-    size_t buffer_used;
-    uint8_t pstate;
-    bool nice;
-    bool buffer_full;
-};
+/* Number of decimal digits of n, with pow10 set to 10^(digits - 1). */
+static int _decimal_digits(uint32_t n, uint32_t *pow10)
+{
+    int digits = 1;
+
+    *pow10 = 1;
+    while ((digits < 10) && (n / 10U >= *pow10)) {
+        *pow10 *= 10U;
+        digits++;
+    }
+    return digits;
+}
+
+/* Moves the last digit towards w while that stays inside the interval. */
+static void _grisu_round(char *digits, int length, uint64_t dist, uint64_t delta,
+                         uint64_t rest, uint64_t ten_k)
+{
+    while ((rest < dist) && (delta - rest >= ten_k) &&
+           ((rest + ten_k < dist) || (dist - rest > rest + ten_k - dist))) {
+        digits[length - 1]--;
+        rest += ten_k;
+    }
+}
+
+/*
+ * Writes the digits of positive finite value, value = digits * 10^exponent.
+ * Returns the number of digits, at most 17.
+ */
+static int _grisu2(char *digits, int *exponent, double value)
+{
+    uint64_t bits;
+    uint64_t fraction;
+    int biased;
+    _diy_fp v, m_minus, m_plus, c, w, lo, hi, one;
+    const _cached_power *cached;
+    uint64_t delta, dist, rest, p2;
+    uint32_t p1, pow10;
+    int length = 0;
+    int k, n;
+
+    memcpy(&bits, &value, sizeof(bits));
+    fraction = bits & ((1ULL << 52) - 1U);
+    biased = (int) (bits >> 52);
+    v.f = (0 == biased) ? fraction : fraction + (1ULL << 52);
+    v.e = (0 == biased) ? 1 - 1075 : biased - 1075;
+
+    /* Boundaries halfway to the neighbours, the lower one is closer at powers of two. */
+    m_plus.f = 2U * v.f + 1U;
+    m_plus.e = v.e - 1;
+    m_plus = _diy_fp_normalize(m_plus);
+    if ((0U == fraction) && (biased > 1)) {
+        m_minus.f = 4U * v.f - 1U;
+        m_minus.e = v.e - 2;
+    }
+    else {
+        m_minus.f = 2U * v.f - 1U;
+        m_minus.e = v.e - 1;
+    }
+    m_minus.f <<= m_minus.e - m_plus.e;
+    m_minus.e = m_plus.e;
+    v = _diy_fp_normalize(v);
+
+    /* Scale by a cached 10^-k so the product's exponent is in [-60, -32]. */
+    n = GRISU_ALPHA - m_plus.e - 1;
+    k = (n * 78913) / (1 << 18) + ((n > 0) ? 1 : 0);
+    cached = &_cached_powers[(-GRISU_MIN_DEC_EXP + k + (GRISU_DEC_STEP - 1)) / GRISU_DEC_STEP];
+    c.f = cached->f;
+    c.e = cached->e;
+    w = _diy_fp_mul(v, c);
+    lo = _diy_fp_mul(m_minus, c);
+    hi = _diy_fp_mul(m_plus, c);
+    lo.f++;
+    hi.f--;
+    *exponent = -cached->k;
+
+    /* Digits of hi, stopping as soon as the rest is inside [lo, hi]. */
+    delta = hi.f - lo.f;
+    dist = hi.f - w.f;
+    one.f = 1ULL << -hi.e;
+    one.e = hi.e;
+    p1 = (uint32_t) (hi.f >> -one.e);
+    p2 = hi.f & (one.f - 1U);
+
+    n = _decimal_digits(p1, &pow10);
+    while (n > 0) {
+        digits[length++] = (char) ('0' + p1 / pow10);
+        p1 %= pow10;
+        n--;
+        rest = ((uint64_t) p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *exponent += n;
+            _grisu_round(digits, length, dist, delta, rest, (uint64_t) pow10 << -one.e);
+            return length;
+        }
+        pow10 /= 10U;
+    }
+
+    for (;;) {
+        p2 *= 10U;
+        digits[length++] = (char) ('0' + (p2 >> -one.e));
+        p2 &= one.f - 1U;
+        delta *= 10U;
+        dist *= 10U;
+        (*exponent)--;
+        if (p2 <= delta) {
+            break;
+        }
+    }
+    _grisu_round(digits, length, dist, delta, p2, one.f);
+    return length;
+}
+
+size_t binson_format_double(char *out, double value)
+{
+    char digits[20];
+    size_t length = 0;
+    int count, exponent, point, i;
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    if (value != value) {
+        memcpy(out, "nan", 4);
+        return 3;
+    }
+    if (0U != (bits >> 63)) {
+        out[length++] = '-';
+        value = -value;
+    }
+    if (0x7FFU == ((bits >> 52) & 0x7FFU)) {
+        memcpy(&out[length], "inf", 4);
+        return length + 3;
+    }
+    if (value == 0.0) {
+        memcpy(&out[length], "0.0", 4);
+        return length + 3;
+    }
+
+    count = _grisu2(digits, &exponent, value);
+    point = count + exponent;   /* Digits before the decimal point. */
+
+    /* Same choice of notation as printf("%g") with at least 15 digits. */
+    if ((point < -3) || (point > ((count > 15) ? count : 15))) {
+        exponent = point - 1;
+        out[length++] = digits[0];
+        if (count > 1) {
+            out[length++] = '.';
+            memcpy(&out[length], &digits[1], (size_t) count - 1U);
+            length += (size_t) count - 1U;
+        }
+        out[length++] = 'e';
+        out[length++] = (exponent < 0) ? '-' : '+';
+        exponent = (exponent < 0) ? -exponent : exponent;
+        if (exponent >= 100) {
+            out[length++] = (char) ('0' + exponent / 100);
+            exponent %= 100;
+        }
+        out[length++] = _digits[exponent * 2];
+        out[length++] = _digits[exponent * 2 + 1];
+    }
+    else if (point <= 0) {
+        out[length++] = '0';
+        out[length++] = '.';
+        for (i = point; i < 0; i++) {
+            out[length++] = '0';
+        }
+        memcpy(&out[length], digits, (size_t) count);
+        length += (size_t) count;
+    }
+    else if (point >= count) {
+        memcpy(&out[length], digits, (size_t) count);
+        length += (size_t) count;
+        for (i = count; i < point; i++) {
+            out[length++] = '0';
+        }
+        out[length++] = '.';
+        out[length++] = '0';
+    }
+    else {
+        memcpy(&out[length], digits, (size_t) point);
+        length += (size_t) point;
+        out[length++] = '.';
+        memcpy(&out[length], &digits[point], (size_t) (count - point));
+        length += (size_t) (count - point);
+    }
+
+    out[length] = '\0';
+    return length;
+}
+
+static void _text_put_quoted(struct _to_string_ctx *ctx, const bbuf *data)
+{
+    /* Printed as with %.*s, which stops at an embedded NUL. */
+    const void *nul = memchr(data->bptr, '\0', data->bsize);
+    size_t length = (NULL != nul) ? (size_t) ((const uint8_t *) nul - data->bptr) : data->bsize;
+
+    _text_put(ctx, "\"", 1);
+    _text_put(ctx, (const char *) data->bptr, length);
+    _text_put(ctx, "\"", 1);
+}
+
+static void _text_put_hex(struct _to_string_ctx *ctx, const bbuf *data)
+{
+    char chunk[128];
+    size_t i = 0;
+
+    _text_put(ctx, "\"0x", 3);
+    while (i < data->bsize) {
+        size_t n = 0;
+        while ((i < data->bsize) && (n < sizeof(chunk))) {
+            chunk[n++] = _hex_digits[data->bptr[i] >> 4];
+            chunk[n++] = _hex_digits[data->bptr[i] & 0x0FU];
+            i++;
+        }
+        _text_put(ctx, chunk, n);
+    }
+    _text_put(ctx, "\"", 1);
+}
 
 static void _binson_to_string_cb(binson_parser *parser, uint16_t next_state, void *context)
 {
@@ -564,23 +1116,10 @@ static void _binson_to_string_cb(binson_parser *parser, uint16_t next_state, voi
     binson_state *state = parser->current_state;
     struct _to_string_ctx *ctx = (struct _to_string_ctx *) context;
     uint8_t *pstate = &ctx->pstate;
-    char *pbuf = &ctx->buffer[ctx->buffer_used];
-
-    if (ctx->buffer_full || ctx->buffer_used >= ctx->buffer_size) {
-        return;
-    }
-
-    size_t available = ctx->buffer_size - ctx->buffer_used;
-    size_t ret = 0;
+    char number[BINSON_FORMAT_DOUBLE_SIZE];
 
     if (next_state != BINSON_STATE_PARSED_ARRAY_END && *pstate == 0x05) {
-        ret = snprintf(pbuf, available, ",");
-        if (!_check_boundary(ctx->buffer_used, ret, ctx->buffer_size)) {
-            ctx->buffer_full = true;
-            return;
-        }
-        ctx->buffer_used += ret;
-        pbuf = &ctx->buffer[ctx->buffer_used];
+        _text_put(ctx, ",", 1);
     }
 
     if (*pstate == 0x04) {
@@ -591,80 +1130,79 @@ static void _binson_to_string_cb(binson_parser *parser, uint16_t next_state, voi
     {
         case BINSON_STATE_PARSED_OBJECT_BEGIN:
             *pstate = 0x01;
-            ret = snprintf(pbuf, available, "{");
+            _text_put(ctx, "{", 1);
             break;
         case BINSON_STATE_PARSED_OBJECT_END:
             if (state->array_depth > 0) {
                 *pstate = 0x05;
             }
-            ret = snprintf(pbuf, available, "}");
+            _text_put(ctx, "}", 1);
             break;
         case BINSON_STATE_PARSED_ARRAY_BEGIN:
             *pstate = 0x04;
-            ret = snprintf(pbuf, available, "[");
+            _text_put(ctx, "[", 1);
             break;
         case BINSON_STATE_PARSED_ARRAY_END:
             if (state->array_depth == 0) {
                 *pstate = 0x02;
             }
-            ret = snprintf(pbuf, available, "]");
+            _text_put(ctx, "]", 1);
             break;
         case BINSON_STATE_PARSED_FIELD_NAME:
             if (*pstate == 0x02) {
-                ret = snprintf(pbuf, available, ",");
-                if (!_check_boundary(ctx->buffer_used, ret, ctx->buffer_size)) {
-                    ctx->buffer_full = true;
-                    return;
-                }
-                ctx->buffer_used += ret;
-                pbuf = &ctx->buffer[ctx->buffer_used];
+                _text_put(ctx, ",", 1);
             }
             *pstate = 0x02;
-            ret = snprintf(pbuf, available, "\"%*.*s\":", 0, (int) state->current_name.bsize, (const char* ) parser->current_state->current_name.bptr);
+            _text_put_quoted(ctx, &state->current_name);
+            _text_put(ctx, ":", 1);
             break;
         case BINSON_STATE_PARSED_STRING:
-            ret = snprintf(pbuf, available, "\"%*.*s\"", 0, (int) state->current_value.string_value.bsize, (const char* ) state->current_value.string_value.bptr);
+            _text_put_quoted(ctx, &state->current_value.string_value);
             break;
         case BINSON_STATE_PARSED_BOOLEAN:
-            ret = snprintf(pbuf, available, "%s", (state->current_value.bool_value) ? "true" : "false");
+            if (state->current_value.bool_value) {
+                _text_put(ctx, "true", 4);
+            }
+            else {
+                _text_put(ctx, "false", 5);
+            }
             break;
         case BINSON_STATE_PARSED_DOUBLE:
-            ret = snprintf(pbuf, available, "%lf", state->current_value.double_value);
+            _text_put(ctx, number, binson_format_double(number, state->current_value.double_value));
             break;
         case BINSON_STATE_PARSED_INTEGER:
-            ret = snprintf(pbuf, available, "%" PRId64 "", state->current_value.integer_value);
+            _text_put(ctx, number, binson_format_integer(number, state->current_value.integer_value));
             break;
         case BINSON_STATE_PARSED_BYTES:
-            ret = snprintf(pbuf, available, "\"0x");
-            if (!_check_boundary(ctx->buffer_used, ret, ctx->buffer_size)) {
-                ctx->buffer_full = true;
-                return;
-            }
-            ctx->buffer_used += ret;
-            pbuf = &ctx->buffer[ctx->buffer_used];
-            if ((state->current_value.bytes_value.bsize > (SIZE_MAX/2)) &&
-                !_check_boundary(ctx->buffer_used, (state->current_value.bytes_value.bsize*2) + 1, ctx->buffer_size)) {
-                ctx->buffer_full = true;
-                return;
-            }
-            ret = 0;
-            size_t i;
-            for (i = 0; i < state->current_value.bytes_value.bsize; i++) {
-                ret += snprintf(&pbuf[ret], available, "%02x", state->current_value.bytes_value.bptr[i]);
-            }
-            ret += snprintf(&pbuf[ret], available, "\"");
+            _text_put_hex(ctx, &state->current_value.bytes_value);
             break;
-            
     }
 
+}
 
-    if (!_check_boundary(ctx->buffer_used, ret, ctx->buffer_size)) {
-        ctx->buffer_full = true;
-        return;
+bool binson_parser_print(binson_parser *parser)
+{
+    if (NULL == parser) {
+        return false;
     }
 
-    ctx->buffer_used += ret;
+    char buffer[256];
+    struct _to_string_ctx ctx;
+    ctx.buffer = buffer;
+    ctx.buffer_size = sizeof(buffer);
+    ctx.buffer_used = 0;
+    ctx.stream = stdout;
+    ctx.pstate = 0;
+    ctx.nice = false;
+    ctx.buffer_full = false;
 
+    parser->cb_context = &ctx;
+    parser->cb = _binson_to_string_cb;
+    bool ret = binson_parser_verify(parser);
+    parser->cb = NULL;
+    parser->cb_context = NULL;
+    fwrite(buffer, 1, ctx.buffer_used, stdout);
+    return ret;
 }
 
 bool binson_parser_to_string(binson_parser *parser,
@@ -680,6 +1218,7 @@ bool binson_parser_to_string(binson_parser *parser,
     ctx.buffer = pbuf;
     ctx.buffer_size = *buf_size;
     ctx.buffer_used = 0;
+    ctx.stream = NULL;
     ctx.pstate = 0;
     ctx.nice = nice;
     ctx.buffer_full = false;
@@ -690,9 +1229,16 @@ bool binson_parser_to_string(binson_parser *parser,
     parser->cb = NULL;
     parser->cb_context = NULL;
     if (ret && !ctx.buffer_full) {
+        if (ctx.buffer_used < ctx.buffer_size) {
+            pbuf[ctx.buffer_used] = '\0';
+        }
         *buf_size = ctx.buffer_used;
         return true;
     }
+    if (ret) {
+        /* Too small, report the size needed. */
+        *buf_size = ctx.buffer_used;
+    }
     return false;
 }
 
@@ -702,16 +1248,7 @@ bool binson_parser_to_string(binson_parser *parser,
 
 static bool _parse_integer(bbuf *length_data, int64_t *value, bool check_boundaries)
 {
-    /* prefill with ones or zeroes depending of sign presence */
-    uint64_t ui64 = (length_data->bptr[length_data->bsize - 1] & 0x80) ? ~0ULL : 0;
-    size_t i;
-
-    for (i = length_data->bsize; i > 0; i--) {
-        ui64 <<= 8;
-        ui64 |= length_data->bptr[i-1];
-    }
-
-    *value = (int64_t) ui64;
+    *value = _load_int(length_data->bptr, length_data->bsize);
 
     if (!check_boundaries) {
         if (length_data->bsize != 8) {
@@ -739,6 +1276,106 @@ static bool _parse_integer(bbuf *length_data, int64_t *value, bool check_boundar
     return false;
 }
 
+/* Sign extending load of a 1, 2, 4 or 8 byte little endian integer. */
+static int64_t _load_int(const uint8_t *data, size_t size)
+{
+#ifdef BINSON_LITTLE_ENDIAN
+    int8_t i8;
+    int16_t i16;
+    int32_t i32;
+    int64_t i64;
+
+    switch (size) {
+        case 1:
+            memcpy(&i8, data, sizeof(i8));
+            return i8;
+        case 2:
+            memcpy(&i16, data, sizeof(i16));
+            return i16;
+        case 4:
+            memcpy(&i32, data, sizeof(i32));
+            return i32;
+        case 8:
+            memcpy(&i64, data, sizeof(i64));
+            return i64;
+        default:
+            break;
+    }
+#endif
+
+    /* prefill with ones or zeroes depending of sign presence */
+    uint64_t ui64 = (data[size - 1] & 0x80) ? ~0ULL : 0;
+    size_t i;
+
+    for (i = size; i > 0; i--) {
+        ui64 <<= 8;
+        ui64 |= data[i-1];
+    }
+
+    return (int64_t) ui64;
+}
+
+static double _load_double(const uint8_t *data)
+{
+    double value;
+#ifdef BINSON_LITTLE_ENDIAN
+    memcpy(&value, data, sizeof(value));
+#else
+    int64_t bits = _load_int(data, sizeof(bits));
+    memcpy(&value, &bits, sizeof(value));
+#endif
+    return value;
+}
+
+/* Size of the token at data[0], size > 0. 0 if unknown or incomplete. */
+static inline size_t _token_size(const uint8_t *data, size_t size)
+{
+    size_t value_size;
+
+    switch (data[0]) {
+        case BINSON_DEF_OBJECT_BEGIN:
+        case BINSON_DEF_OBJECT_END:
+        case BINSON_DEF_ARRAY_BEGIN:
+        case BINSON_DEF_ARRAY_END:
+        case BINSON_DEF_TRUE:
+        case BINSON_DEF_FALSE:
+            return 1;
+        case BINSON_DEF_DOUBLE:
+            value_size = sizeof(double);
+            break;
+        case BINSON_DEF_INT8:
+        case BINSON_DEF_INT16:
+        case BINSON_DEF_INT32:
+        case BINSON_DEF_INT64:
+            value_size = (size_t) 1 << (data[0] - BINSON_DEF_INT8);
+            break;
+        case BINSON_DEF_STRINGLEN_INT8:
+        case BINSON_DEF_STRINGLEN_INT16:
+        case BINSON_DEF_STRINGLEN_INT32:
+        case BINSON_DEF_BYTESLEN_INT8:
+        case BINSON_DEF_BYTESLEN_INT16:
+        case BINSON_DEF_BYTESLEN_INT32:
+        {
+            size_t width = (size_t) 1 << (data[0] & 0x03U);
+            int64_t length;
+
+            if ((size - 1) < width) {
+                return 0;
+            }
+            length = _load_int(&data[1], width);
+            if ((length < 0) || ((uint64_t) length > (size - 1 - width))) {
+                return 0;
+            }
+            value_size = width + (size_t) length;
+            break;
+        }
+        default:
+            return 0;
+    }
+
+    return ((size - 1) >= value_size) ? 1 + value_size : 0;
+}
+
 static int _cmp_name(bbuf *a, bbuf *b)
 {
     int r = memcmp(a->bptr,
@@ -748,6 +1385,19 @@ static int _cmp_name(bbuf *a, bbuf *b)
     return (r == 0) ? (int) (a->bsize - b->bsize) : r;
 }
 
+/* An object or array of size bytes closes with its own end token. */
+static bool _ends_match(const uint8_t *value, size_t size)
+{
+    switch (value[0]) {
+        case BINSON_DEF_OBJECT_BEGIN:
+            return BINSON_DEF_OBJECT_END == value[size - 1];
+        case BINSON_DEF_ARRAY_BEGIN:
+            return BINSON_DEF_ARRAY_END == value[size - 1];
+        default:
+            return true;
+    }
+}
+
 static uint16_t _process_one(binson_parser *parser, bbuf *consumed, size_t *bytes_consumed)
 {
     size_t to_consume = 1;
@@ -837,6 +1487,11 @@ static uint16_t _process_one(binson_parser *parser, bbuf *consumed, size_t *byte
 
             if (type < BINSON_DEF_BYTESLEN_INT8) {
                 /* A string is expected. */
+                if (CHECKBITMASK(parser->options, BINSON_PARSER_OPTION_VALIDATE_UTF8) &&
+                    !_utf8_valid(consumed->bptr, consumed->bsize)) {
+                    parser->error_flags = BINSON_ERROR_FORMAT;
+                    break;
+                }
                 next_state = BINSON_STATE_PARSED_STRING;
             }
 
@@ -1142,10 +1797,11 @@ static bool _advance_parsing(binson_parser *parser, uint8_t scan_flags, bbuf *sc
                 state->current_type = BINSON_TYPE_INTEGER;
                 break;
             case BINSON_STATE_PARSED_DOUBLE:
-                if (!_parse_integer(&consumed, (int64_t *) &state->current_value.double_value, false)) {
+                if (consumed.bsize != sizeof(double)) {
                     parser->error_flags = BINSON_ERROR_FORMAT;
                     break;
                 }
+                state->current_value.double_value = _load_double(consumed.bptr);
                 state->current_type = BINSON_TYPE_DOUBLE;
                 break;
             case BINSON_STATE_PARSED_BOOLEAN:
@@ -1218,3 +1874,472 @@ static bool _check_boundary(size_t a,
 
     return true;
 }
+
+static binson_type _token_type(uint8_t token)
+{
+    switch (token) {
+        case BINSON_DEF_OBJECT_BEGIN:
+            return BINSON_TYPE_OBJECT;
+        case BINSON_DEF_ARRAY_BEGIN:
+            return BINSON_TYPE_ARRAY;
+        case BINSON_DEF_TRUE:
+        case BINSON_DEF_FALSE:
+            return BINSON_TYPE_BOOLEAN;
+        case BINSON_DEF_DOUBLE:
+            return BINSON_TYPE_DOUBLE;
+        case BINSON_DEF_INT8:
+        case BINSON_DEF_INT16:
+        case BINSON_DEF_INT32:
+        case BINSON_DEF_INT64:
+            return BINSON_TYPE_INTEGER;
+        case BINSON_DEF_STRINGLEN_INT8:
+        case BINSON_DEF_STRINGLEN_INT16:
+        case BINSON_DEF_STRINGLEN_INT32:
+            return BINSON_TYPE_STRING;
+        case BINSON_DEF_BYTESLEN_INT8:
+        case BINSON_DEF_BYTESLEN_INT16:
+        case BINSON_DEF_BYTESLEN_INT32:
+            return BINSON_TYPE_BYTES;
+        default:
+            return BINSON_TYPE_NONE;
+    }
+}
+
+/*
+ * Decodes scalar array elements straight from the buffer, without going
+ * through _advance_parsing() per element. The checks are the same as in
+ * _process_one(). With a callback installed each element is parsed with
+ * binson_parser_next() instead, so the callback sees every element.
+ */
+static bool _read_array(binson_parser *parser,
+                        binson_type type,
+                        void *out,
+                        size_t max,
+                        size_t *n)
+{
+    if (NULL == parser) {
+        return false;
+    }
+
+    if ((NULL == n) || ((NULL == out) && (max > 0))) {
+        parser->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+
+    *n = 0;
+
+    if ((BINSON_ERROR_NONE != parser->error_flags) || (NULL == parser->current_state)) {
+        return false;
+    }
+
+    /* Positioned on the array value, or at the start of an array parser: enter it. */
+    if (!CHECKBITMASK(parser->current_state->flags, BINSON_STATE_IN_ARRAY)) {
+        if (((BINSON_TYPE_ARRAY != binson_parser_get_type(parser)) && (parser->buffer_used > 0)) ||
+            (parser->buffer_used >= parser->buffer_size) ||
+            (BINSON_DEF_ARRAY_BEGIN != parser->buffer[parser->buffer_used])) {
+            parser->error_flags = BINSON_ERROR_WRONG_TYPE;
+            return false;
+        }
+        if (!binson_parser_go_into_array(parser)) {
+            return false;
+        }
+    }
+
+    binson_state *state = parser->current_state;
+    const uint8_t *buffer = parser->buffer;
+    size_t pos = parser->buffer_used;
+    size_t count = 0;
+    bool end = false;
+    bbuf consumed;
+    int64_t value;
+
+    while (BINSON_ERROR_NONE == parser->error_flags) {
+
+        if (pos >= parser->buffer_size) {
+            parser->error_flags = BINSON_ERROR_RANGE;
+            break;
+        }
+
+        uint8_t token = buffer[pos];
+        if (BINSON_DEF_ARRAY_END == token) {
+            end = true;
+            break;
+        }
+
+        if (count == max) {
+            break;
+        }
+
+        binson_type token_type = _token_type(token);
+        if (token_type != type) {
+            parser->error_flags = (BINSON_TYPE_NONE == token_type) ?
+                                   BINSON_ERROR_FORMAT : BINSON_ERROR_WRONG_TYPE;
+            break;
+        }
+
+        if (NULL != parser->cb) {
+            parser->buffer_used = pos;
+            if (!binson_parser_next(parser)) {
+                if (BINSON_ERROR_NONE == parser->error_flags) {
+                    parser->error_flags = BINSON_ERROR_STATE;
+                }
+                return false;
+            }
+            pos = parser->buffer_used;
+            state = parser->current_state;
+            switch (type) {
+                case BINSON_TYPE_INTEGER:
+                    ((int64_t *) out)[count++] = state->current_value.integer_value;
+                    break;
+                case BINSON_TYPE_DOUBLE:
+                    ((double *) out)[count++] = state->current_value.double_value;
+                    break;
+                default:
+                    ((bool *) out)[count++] = state->current_value.bool_value;
+                    break;
+            }
+            continue;
+        }
+
+        switch (type) {
+            case BINSON_TYPE_INTEGER:
+#ifdef BINSON_PARSER_SSE2
+                if (BINSON_DEF_INT8 == token) {
+                    size_t run = _read_int8_run(&buffer[pos],
+                                                parser->buffer_size - pos,
+                                                &((int64_t *) out)[count],
+                                                max - count);
+                    if (run > 0) {
+                        count += run;
+                        pos += 2 * run;
+                        continue;
+                    }
+                }
+#endif
+                consumed.bsize = 1U << (token & 0x03U);
+                if (!_check_boundary(pos + 1, consumed.bsize, parser->buffer_size)) {
+                    parser->error_flags = BINSON_ERROR_RANGE;
+                    break;
+                }
+                consumed.bptr = &buffer[pos + 1];
+                if (!_parse_integer(&consumed, &value, true)) {
+                    parser->error_flags = BINSON_ERROR_FORMAT;
+                    break;
+                }
+                ((int64_t *) out)[count++] = value;
+                pos += 1 + consumed.bsize;
+                break;
+            case BINSON_TYPE_DOUBLE:
+                consumed.bsize = 8;
+                if (!_check_boundary(pos + 1, consumed.bsize, parser->buffer_size)) {
+                    parser->error_flags = BINSON_ERROR_RANGE;
+                    break;
+                }
+                ((double *) out)[count++] = _load_double(&buffer[pos + 1]);
+                pos += 9;
+                break;
+            default:
+                ((bool *) out)[count++] = (BINSON_DEF_TRUE == token);
+                pos += 1;
+                break;
+        }
+    }
+
+    *n = count;
+    parser->buffer_used = pos;
+
+    if (BINSON_ERROR_NONE != parser->error_flags) {
+        return false;
+    }
+
+    /* The last element is the current value, as after binson_parser_next(). */
+    if ((count > 0) && (NULL == parser->cb)) {
+        state->current_type = type;
+        switch (type) {
+            case BINSON_TYPE_INTEGER:
+                state->current_value.integer_value = ((int64_t *) out)[count - 1];
+                break;
+            case BINSON_TYPE_DOUBLE:
+                state->current_value.double_value = ((double *) out)[count - 1];
+                break;
+            default:
+                state->current_value.bool_value = ((bool *) out)[count - 1];
+                break;
+        }
+    }
+
+    return end && binson_parser_leave_array(parser);
+}
+
+#ifdef BINSON_PARSER_SSE2
+/*
+ * Decodes a run of 1 byte integers 8 at a time. Each element is the token
+ * BINSON_DEF_INT8 followed by the value, i.e. one little endian 16 bit lane
+ * with the token in the low byte. Returns the number of elements decoded,
+ * 0 if the next 8 elements are not all 1 byte integers.
+ */
+static size_t _read_int8_run(const uint8_t *data,
+                             size_t available,
+                             int64_t *out,
+                             size_t max)
+{
+    const __m128i token = _mm_set1_epi16(BINSON_DEF_INT8);
+    const __m128i low = _mm_set1_epi16(0x00FF);
+    size_t count = 0;
+
+    while ((available >= 16) && (max - count >= 8)) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (const void *) data);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, low), token)) != 0xFFFF) {
+            break;
+        }
+
+        /* Sign extend the value bytes to 16, 32 and 64 bits. */
+        __m128i v16 = _mm_srai_epi16(v, 8);
+        __m128i s16 = _mm_srai_epi16(v16, 15);
+        __m128i lo32 = _mm_unpacklo_epi16(v16, s16);
+        __m128i hi32 = _mm_unpackhi_epi16(v16, s16);
+        __m128i slo = _mm_srai_epi32(lo32, 31);
+        __m128i shi = _mm_srai_epi32(hi32, 31);
+
+        _mm_storeu_si128((__m128i *) (void *) &out[count + 0], _mm_unpacklo_epi32(lo32, slo));
+        _mm_storeu_si128((__m128i *) (void *) &out[count + 2], _mm_unpackhi_epi32(lo32, slo));
+        _mm_storeu_si128((__m128i *) (void *) &out[count + 4], _mm_unpacklo_epi32(hi32, shi));
+        _mm_storeu_si128((__m128i *) (void *) &out[count + 6], _mm_unpackhi_epi32(hi32, shi));
+
+        count += 8;
+        data += 16;
+        available -= 16;
+    }
+
+    return count;
+}
+#endif
+
+static bool _utf8_valid(const uint8_t *data, size_t size)
+{
+#ifdef BINSON_CPU_X86_DISPATCH
+    if ((size >= BINSON_UTF8_SIMD_MIN) && binson_cpu_has_avx2()) {
+        return _utf8_valid_avx2(data, size);
+    }
+#endif
+    return _utf8_valid_scalar(data, size);
+}
+
+static bool _utf8_valid_scalar(const uint8_t *data, size_t size)
+{
+    size_t i = 0;
+
+    while (i < size) {
+        uint8_t c = data[i];
+        uint8_t lo = 0x80U;
+        uint8_t hi = 0xBFU;
+        size_t length;
+        size_t k;
+
+        if (c < 0x80U) {
+            i++;
+            continue;
+        }
+
+        if ((c >= 0xC2U) && (c <= 0xDFU)) {
+            length = 2;
+        }
+        else if ((c >= 0xE0U) && (c <= 0xEFU)) {
+            length = 3;
+            /* No overlong forms, no surrogates. */
+            lo = (c == 0xE0U) ? 0xA0U : lo;
+            hi = (c == 0xEDU) ? 0x9FU : hi;
+        }
+        else if ((c >= 0xF0U) && (c <= 0xF4U)) {
+            length = 4;
+            /* No overlong forms, nothing above U+10FFFF. */
+            lo = (c == 0xF0U) ? 0x90U : lo;
+            hi = (c == 0xF4U) ? 0x8FU : hi;
+        }
+        else {
+            return false;
+        }
+
+        if ((size - i) < length) {
+            return false;
+        }
+
+        if ((data[i + 1] < lo) || (data[i + 1] > hi)) {
+            return false;
+        }
+
+        for (k = 2; k < length; k++) {
+            if ((data[i + k] & 0xC0U) != 0x80U) {
+                return false;
+            }
+        }
+
+        i += length;
+    }
+
+    return true;
+}
+
+#ifdef BINSON_CPU_X86_DISPATCH
+
+/*
+ * Vectorized validation after Keiser and Lemire, "Validating UTF-8 In Less
+ * Than One Instruction Per Byte". Each byte is classified together with the
+ * byte before it by three 16 entry table lookups on the nibbles; a bit that
+ * survives the AND of the three lookups names an error. A separate check
+ * makes sure the 3rd and 4th bytes of long sequences are continuations.
+ */
+#define UTF8_TOO_SHORT      (1U << 0)
+#define UTF8_TOO_LONG       (1U << 1)
+#define UTF8_OVERLONG_3     (1U << 2)
+#define UTF8_TOO_LARGE      (1U << 3)
+#define UTF8_SURROGATE      (1U << 4)
+#define UTF8_OVERLONG_2     (1U << 5)
+#define UTF8_TOO_LARGE_1000 (1U << 6)
+#define UTF8_OVERLONG_4     (1U << 6)
+#define UTF8_TWO_CONTS      (1U << 7)
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+#define UTF8_TABLE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p) \
+    _mm256_setr_epi8((char) (a), (char) (b), (char) (c), (char) (d),  \
+                     (char) (e), (char) (f), (char) (g), (char) (h),  \
+                     (char) (i), (char) (j), (char) (k), (char) (l),  \
+                     (char) (m), (char) (n), (char) (o), (char) (p),  \
+                     (char) (a), (char) (b), (char) (c), (char) (d),  \
+                     (char) (e), (char) (f), (char) (g), (char) (h),  \
+                     (char) (i), (char) (j), (char) (k), (char) (l),  \
+                     (char) (m), (char) (n), (char) (o), (char) (p))
+
+__attribute__((target("avx2")))
+static inline __m256i _utf8_high_nibbles(__m256i v)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i _utf8_check_block(__m256i input, __m256i prev_input)
+{
+    const __m256i byte_1_high_table = UTF8_TABLE(
+        /* 0_______ ________: ASCII first */
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        /* 10______ ________: continuation first */
+        UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+        /* 1100____ ________ */
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+        /* 1101____ ________ */
+        UTF8_TOO_SHORT,
+        /* 1110____ ________ */
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        /* 1111____ ________ */
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+    const __m256i byte_1_low_table = UTF8_TABLE(
+        /* ____0000 ________ */
+        UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+        /* ____0001 ________ */
+        UTF8_CARRY | UTF8_OVERLONG_2,
+        /* ____001_ ________ */
+        UTF8_CARRY,
+        UTF8_CARRY,
+        /* ____0100 ________ */
+        UTF8_CARRY | UTF8_TOO_LARGE,
+        /* ____0101 ________ and above */
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        /* ____1101 ________ */
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000);
+    const __m256i byte_2_high_table = UTF8_TABLE(
+        /* ________ 0_______: ASCII second */
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        /* ________ 1000____ */
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+        UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+        /* ________ 1001____ */
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+        UTF8_TOO_LARGE,
+        /* ________ 101_____ */
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE |
+        UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE |
+        UTF8_TOO_LARGE,
+        /* ________ 11______ */
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+
+    /* The input shifted by one, two and three bytes, fed from prev_input. */
+    __m256i carried = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, carried, 15);
+    __m256i prev2 = _mm256_alignr_epi8(input, carried, 14);
+    __m256i prev3 = _mm256_alignr_epi8(input, carried, 13);
+
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(byte_1_high_table, _utf8_high_nibbles(prev1)),
+            _mm256_shuffle_epi8(byte_1_low_table,
+                                _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+        _mm256_shuffle_epi8(byte_2_high_table, _utf8_high_nibbles(input)));
+
+    /* Only 111_____ and 1111____ leads stay at or above 0x80. */
+    __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xF0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                             _mm256_set1_epi8((char) 0x80));
+
+    return _mm256_xor_si256(must_continue, special);
+}
+
+__attribute__((target("avx2")))
+static bool _utf8_valid_avx2(const uint8_t *data, size_t size)
+{
+    /* A sequence started in the last three bytes must continue. */
+    const __m256i max_tail = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char) (0xF0 - 1), (char) (0xE0 - 1), (char) (0xC0 - 1));
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    uint8_t tail[32];
+    size_t i = 0;
+
+    for (;;) {
+        __m256i input;
+
+        if (i + 32 <= size) {
+            input = _mm256_loadu_si256((const __m256i *) &data[i]);
+        }
+        else if (i < size) {
+            /* Zero padding is ASCII and ends the string cleanly. */
+            memset(tail, 0x00, sizeof(tail));
+            memcpy(tail, &data[i], size - i);
+            input = _mm256_loadu_si256((const __m256i *) tail);
+        }
+        else {
+            break;
+        }
+
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+        }
+        else {
+            error = _mm256_or_si256(error, _utf8_check_block(input, prev_input));
+            prev_incomplete = _mm256_subs_epu8(input, max_tail);
+        }
+
+        prev_input = input;
+        i += 32;
+    }
+
+    error = _mm256_or_si256(error, prev_incomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+#endif
@@ -20,6 +20,18 @@ extern "C" {
 
 #define BINSON_PARSER_MAX_DEPTH     (10U)
 
+/*
+ * Parser options, set in binson_parser.options after init. They are kept by
+ * binson_parser_reset() and binson_parser_verify().
+ *
+ * BINSON_PARSER_OPTION_VALIDATE_UTF8: every string and field name token the
+ * parser passes is checked to be well formed UTF-8 (RFC 3629: no overlong
+ * forms, surrogates or code points above U+10FFFF). A bad sequence stops
+ * parsing with BINSON_ERROR_FORMAT, so binson_parser_verify() rejects the
+ * object and strings returned by the accessors are known to be valid.
+ */
+#define BINSON_PARSER_OPTION_VALIDATE_UTF8  (0x01U)
+
 /*======= Type Definitions and declarations =================================*/
 
 typedef struct binson_state_s {
@@ -44,9 +56,25 @@ struct binson_parser_s {
     binson_state    *current_state;
     binson_cb       cb;
     void            *cb_context;
-
+    uint8_t         options;
 };
 
+/*
+ * Iterator over back to back objects and arrays in one buffer, such as a
+ * log file or a batched read. Initiate with binson_message_iter_init(), or
+ * with binson_array_iter_init() for the elements of one array.
+ */
+typedef struct binson_message_iter_s {
+    const uint8_t   *buffer;
+    size_t          buffer_size;
+    size_t          offset;     /* Start of the next message or element. */
+    size_t          index;      /* Number of messages returned so far. */
+    binson_err      error_flags;
+    uint8_t         options;    /* Parser options for binson_message_iter_next(). */
+    binson_cb       cb;         /* Parser callback for binson_message_iter_next(). */
+    void            *cb_context;
+} binson_message_iter;
+
 /*======= Public variable declarations ======================================*/
 /*======= Public function declarations ======================================*/
 
@@ -113,6 +141,142 @@ bool binson_parser_reset(binson_parser *parser);
  */
 bool binson_parser_verify(binson_parser *parser);
 
+/**
+ * @brief Gets the size of the object or array at the start of a buffer.
+ *
+ * Steps over the tokens once, reading only their type bytes and length
+ * fields, to find where the object or array that begins the buffer ends.
+ * The contents are not checked; initiate a parser on the result and call
+ * binson_parser_verify() for that.
+ *
+ * @param buffer        Pointer to the serialized object or array, possibly
+ *                      followed by other data.
+ * @param buffer_size   Size of buffer.
+ *
+ * @return Size of the object or array, or 0 if the buffer does not begin
+ *         with a complete one.
+ */
+size_t binson_message_size(const uint8_t *buffer, size_t buffer_size);
+
+/**
+ * @brief Gets the size of the value at the start of a buffer.
+ *
+ * As binson_message_size(), but the value may also be a single integer,
+ * double, boolean, string or bytes token, e.g. an element of an array.
+ *
+ * @return Size of the value, or 0 if the buffer does not begin with a
+ *         complete one.
+ */
+size_t binson_value_size(const uint8_t *buffer, size_t buffer_size);
+
+/**
+ * @brief Gets the size of the single token at the start of a buffer.
+ *
+ * A token is a whole integer, double, boolean, string or bytes value, or
+ * one object or array begin or end byte. For stepping through values token
+ * by token, e.g. in raw records that also hold other tokens.
+ *
+ * @return Size of the token, or 0 if the buffer does not begin with a
+ *         complete one.
+ */
+size_t binson_token_size(const uint8_t *buffer, size_t buffer_size);
+
+/**
+ * @brief Initiates an iterator over concatenated messages in a buffer.
+ *
+ * Each message is a top level object or array. The buffer is not copied and
+ * must outlive the iterator and the parsers initiated by it.
+ *
+ * @param iter          Pointer to iterator structure.
+ * @param buffer        Pointer to the messages.
+ * @param buffer_size   Size of buffer.
+ *
+ * Parser options and callback are cleared, set iter->options, iter->cb and
+ * iter->cb_context after init to have them set on each parser.
+ *
+ * @return true     The iterator was initiated.
+ * @return false    iter or buffer is NULL.
+ */
+bool binson_message_iter_init(binson_message_iter *iter,
+                              const uint8_t *buffer,
+                              size_t buffer_size);
+
+/**
+ * @brief Initiates a parser on the next message.
+ *
+ * The parser is initiated in place on the message with
+ * binson_parser_init_object() or binson_parser_init_array(), depending on
+ * its first byte, and gets its options and callback from iter. Nothing is
+ * read from the parser, it does not have to be initiated, and one parser
+ * can be reused for all messages.
+ *
+ * @param iter      Pointer to iterator structure.
+ * @param parser    Pointer to binson parser structure.
+ *
+ * @return true     The parser is initiated on message iter->index - 1.
+ * @return false    No more messages. iter->error_flags is BINSON_ERROR_NONE
+ *                  at the end of the buffer, or BINSON_ERROR_FORMAT if the
+ *                  data at iter->offset is not a complete object or array.
+ */
+bool binson_message_iter_next(binson_message_iter *iter, binson_parser *parser);
+
+/**
+ * @brief Finds the extents of the next messages without parsing them.
+ *
+ * Meant for splitting a buffer of messages between threads: the extents
+ * are found with binson_message_size() and each can then be handed to its
+ * own parser. Call repeatedly to walk the buffer in batches.
+ *
+ * @param iter      Pointer to iterator structure.
+ * @param spans     Receives the position and size of each message.
+ * @param max       Number of entries in spans.
+ *
+ * @return Number of spans written. Less than max at the end of the buffer
+ *         or on error, see iter->error_flags as for
+ *         binson_message_iter_next().
+ */
+size_t binson_message_iter_spans(binson_message_iter *iter, bbuf *spans, size_t max);
+
+/**
+ * @brief Initiates an iterator over the elements of one top level array.
+ *
+ * For documents that are a single large array. Call
+ * binson_array_iter_spans() to get the elements; iter->offset then counts
+ * from the first element, and iter->index is the number of elements
+ * returned.
+ *
+ * @param iter          Pointer to iterator structure.
+ * @param buffer        Pointer to the serialized array.
+ * @param buffer_size   Size of buffer.
+ *
+ * @return true     The iterator was initiated.
+ * @return false    iter or buffer is NULL, or the buffer does not begin
+ *                  and end like an array (iter->error_flags is
+ *                  BINSON_ERROR_FORMAT).
+ */
+bool binson_array_iter_init(binson_message_iter *iter,
+                            const uint8_t *buffer,
+                            size_t buffer_size);
+
+/**
+ * @brief Finds the extents of the next array elements without parsing them.
+ *
+ * Elements are found with binson_value_size(), so only type bytes and
+ * length fields are read, and the parts of the array can then be verified
+ * or parsed on different threads. An element may be any value; an object
+ * or array element must close with its own end token.
+ *
+ * @param iter      Iterator from binson_array_iter_init().
+ * @param spans     Receives the position and size of each element.
+ * @param max       Number of entries in spans.
+ *
+ * @return Number of spans written. Less than max after the last element,
+ *         with iter->error_flags BINSON_ERROR_NONE, or at an element that
+ *         is incomplete or runs into the end token of the array, with
+ *         iter->error_flags BINSON_ERROR_FORMAT.
+ */
+size_t binson_array_iter_spans(binson_message_iter *iter, bbuf *spans, size_t max);
+
 /**
  * @brief Gets the current (object) depth of the parser.
  * 
@@ -346,13 +510,185 @@ double binson_parser_get_double(binson_parser *parser);
  */
 bbuf *binson_parser_get_bytes_bbuf(binson_parser *parser);
 
+/**
+ * @brief Decodes an array of integers in one call.
+ *
+ * The parser must be positioned on an array value, which is then entered,
+ * or be inside an array, where decoding continues with the elements not yet
+ * visited. Up to max elements are decoded into out.
+ *
+ * When the end of the array is reached the parser leaves the array and true
+ * is returned. When max elements were decoded and more remain, false is
+ * returned with no error set; call again to continue.
+ *
+ * An element of another type stops decoding in front of that element with
+ * BINSON_ERROR_WRONG_TYPE. Setting error_flags back to BINSON_ERROR_NONE
+ * resumes normal parsing from that element.
+ *
+ * @param parser    Pointer to binson parser structure.
+ * @param out       Destination of the decoded elements.
+ * @param max       Number of elements out can hold.
+ * @param n         Number of elements decoded by this call.
+ *
+ * @return true     The whole array was decoded.
+ * @return false    More elements remain or an error occured.
+ */
+bool binson_parser_read_int64_array(binson_parser *parser,
+                                    int64_t *out,
+                                    size_t max,
+                                    size_t *n);
+
+/**
+ * @brief Decodes an array of doubles in one call.
+ *
+ * See binson_parser_read_int64_array().
+ */
+bool binson_parser_read_double_array(binson_parser *parser,
+                                     double *out,
+                                     size_t max,
+                                     size_t *n);
+
+/**
+ * @brief Decodes an array of booleans in one call.
+ *
+ * See binson_parser_read_int64_array().
+ */
+bool binson_parser_read_bool_array(binson_parser *parser,
+                                   bool *out,
+                                   size_t max,
+                                   size_t *n);
+
 bool binson_parser_string_equals(binson_parser *pp, const char *pstr);
 bool binson_parser_print(binson_parser *parser);
+
+/**
+ * @brief Formats the binson object as JSON like text.
+ *
+ * Integers are written in decimal, doubles with the fewest digits that read
+ * back as the same value, bytes as "0x" followed by lower case hex. The
+ * text is NUL terminated when there is room for the terminator.
+ *
+ * @param parser    Pointer to binson parser structure.
+ * @param pbuf      Destination buffer.
+ * @param buf_size  In: size of pbuf. Out: length of the text, or the size
+ *                  pbuf needs when false is returned because it was too
+ *                  small.
+ * @param nice      Unused.
+ *
+ * @return true     The text was written.
+ * @return false    The object is not valid or pbuf is too small.
+ */
 bool binson_parser_to_string(binson_parser *parser,
                              char *pbuf,
                              size_t *buf_size,
                              bool nice);
 
+/* Buffer sizes for binson_format_integer() and binson_format_double(). */
+#define BINSON_FORMAT_INTEGER_SIZE  (20U)
+#define BINSON_FORMAT_DOUBLE_SIZE   (32U)
+
+/**
+ * @brief Formats an integer in decimal, as used by binson_parser_to_string().
+ *
+ * @param out   Destination of at least BINSON_FORMAT_INTEGER_SIZE characters.
+ *              No NUL terminator is written.
+ * @param value Value to format.
+ *
+ * @return Number of characters written.
+ */
+size_t binson_format_integer(char *out, int64_t value);
+
+/**
+ * @brief Formats a double with digits that read back as the same value.
+ *
+ * The digits come from Grisu2 and are the shortest ones for almost all
+ * values, never more than 17. The notation is the one of printf("%g") with
+ * at least 15 significant digits, integral values keep a ".0" and NaN and
+ * infinities are written as nan, inf and -inf. The output does not depend
+ * on the locale.
+ *
+ * @param out   Destination of at least BINSON_FORMAT_DOUBLE_SIZE characters.
+ *              The text is NUL terminated.
+ * @param value Value to format.
+ *
+ * @return Number of characters written, not counting the terminator.
+ */
+size_t binson_format_double(char *out, double value);
+
+/*======= Inline accessors ==================================================*/
+
+/*
+ * Inlinable variants of the value accessors above with identical checks and
+ * results. Calls in extraction loops expand in place, so the compiler can
+ * merge the repeated NULL, error and type checks across consecutive calls.
+ */
+
+static inline binson_state *binson_parser_current_state_inline(binson_parser *parser)
+{
+    if ((NULL != parser) &&
+        (BINSON_ERROR_NONE == parser->error_flags)) {
+        return parser->current_state;
+    }
+    return NULL;
+}
+
+static inline binson_type binson_parser_get_type_inline(binson_parser *parser)
+{
+    binson_state *state = binson_parser_current_state_inline(parser);
+    return (NULL != state) ? state->current_type : BINSON_TYPE_NONE;
+}
+
+static inline bbuf *binson_parser_get_name_inline(binson_parser *parser)
+{
+    binson_state *state = binson_parser_current_state_inline(parser);
+    return (NULL != state) ? &state->current_name : NULL;
+}
+
+static inline int64_t binson_parser_get_integer_inline(binson_parser *parser)
+{
+    binson_state *state = binson_parser_current_state_inline(parser);
+    if ((NULL != state) && (BINSON_TYPE_INTEGER == state->current_type)) {
+        return state->current_value.integer_value;
+    }
+    return 0;
+}
+
+static inline bool binson_parser_get_boolean_inline(binson_parser *parser)
+{
+    binson_state *state = binson_parser_current_state_inline(parser);
+    if ((NULL != state) && (BINSON_TYPE_BOOLEAN == state->current_type)) {
+        return state->current_value.bool_value;
+    }
+    return false;
+}
+
+static inline double binson_parser_get_double_inline(binson_parser *parser)
+{
+    binson_state *state = binson_parser_current_state_inline(parser);
+    if ((NULL != state) && (BINSON_TYPE_DOUBLE == state->current_type)) {
+        return state->current_value.double_value;
+    }
+    return 0.0;
+}
+
+static inline bbuf *binson_parser_get_string_bbuf_inline(binson_parser *parser)
+{
+    binson_state *state = binson_parser_current_state_inline(parser);
+    if ((NULL != state) && (BINSON_TYPE_STRING == state->current_type)) {
+        return &state->current_value.string_value;
+    }
+    return NULL;
+}
+
+static inline bbuf *binson_parser_get_bytes_bbuf_inline(binson_parser *parser)
+{
+    binson_state *state = binson_parser_current_state_inline(parser);
+    if ((NULL != state) && (BINSON_TYPE_BYTES == state->current_type)) {
+        return &state->current_value.bytes_value;
+    }
+    return NULL;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,473 @@
+#ifndef BINSON_PARSER_ENGINE_HPP
+#define BINSON_PARSER_ENGINE_HPP
+
+/**
+ * @file binson_parser_engine.hpp
+ *
+ * Header only binson parser specialized at compile time.
+ *
+ * binson_parser.c decides at runtime on every token whether a callback is
+ * installed, which advance mode is active and whether a field scan has to
+ * be reversed. BinsonParserEngine makes those choices template policies so
+ * each use site gets one flat, fully inlined loop:
+ *
+ *   Checked    validate the input (bounds, minimal integer encoding, field
+ *              order). Unchecked engines trust already verified input.
+ *   Callbacks  report events to a BinsonVisitor (see binson_visitor.hpp).
+ *              Without callbacks the visitor calls are compiled out.
+ *   MaxDepth   maximum object nesting, BINSON_PARSER_MAX_DEPTH by default.
+ *   FieldScan  enables scanField(), a sorted lookup of a top level field.
+ *
+ * With the default policy the engine accepts and rejects exactly what
+ * binson_parser_init() + binson_parser_verify() do, with the same error
+ * code, and reports the same events as binsonVisit():
+ *
+ *   BinsonParserEngine<> engine(data, size);
+ *   binson_err err = engine.verify();
+ *
+ *   MyVisitor v;
+ *   err = engine.parse(v);
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <binson_visitor.hpp>
+
+template <bool Checked = true,
+          bool Callbacks = true,
+          size_t MaxDepth = BINSON_PARSER_MAX_DEPTH,
+          bool FieldScan = true>
+struct BinsonParserPolicy
+{
+    static const bool checked = Checked;
+    static const bool callbacks = Callbacks;
+    static const size_t maxDepth = MaxDepth;
+    static const bool fieldScan = FieldScan;
+};
+
+/* Validation only, the loop binson_parser_verify() runs. */
+typedef BinsonParserPolicy<true, false, BINSON_PARSER_MAX_DEPTH, false> BinsonVerifyPolicy;
+
+/* Events over input that has already been verified. */
+typedef BinsonParserPolicy<false, true, BINSON_PARSER_MAX_DEPTH, true> BinsonTrustedPolicy;
+
+template <typename Policy = BinsonParserPolicy<> >
+class BinsonParserEngine
+{
+    static_assert(Policy::maxDepth > 0, "MaxDepth must allow the top level object");
+
+public:
+    BinsonParserEngine(const uint8_t *data, size_t size) : m_data(data), m_size(size) { }
+
+    /* Validates the whole object, BINSON_ERROR_NONE when it is valid. */
+    binson_err verify()
+    {
+        BinsonVisitor v;
+        return run<false>(v, nullptr, nullptr);
+    }
+
+    /*
+     * Reports the object to the visitor, see binson_visitor.hpp for the
+     * meaning of Skip and Stop. Skipped blocks are still validated.
+     */
+    template <typename Visitor>
+    binson_err parse(Visitor &visitor)
+    {
+        static_assert(Policy::callbacks, "parse() requires a policy with callbacks");
+        return run<false>(visitor, nullptr, nullptr);
+    }
+
+    /*
+     * Reports only the value of the top level field name. Fields are
+     * sorted, so the scan ends at the first larger name. found tells
+     * whether the field exists.
+     */
+    template <typename Visitor>
+    binson_err scanField(const char *name, size_t length, Visitor &visitor, bool &found)
+    {
+        static_assert(Policy::fieldScan, "scanField() requires a policy with field scan");
+        bbuf target;
+        target.bptr = (uint8_t *) name;
+        target.bsize = length;
+        found = false;
+        return run<true>(visitor, &target, &found);
+    }
+
+    template <typename Visitor>
+    binson_err scanField(const char *name, Visitor &visitor, bool &found)
+    {
+        return scanField(name, strlen(name), visitor, found);
+    }
+
+    /* Bytes consumed by the last run. */
+    size_t position() const { return m_pos; }
+
+private:
+    enum : uint8_t
+    {
+        ExpectingField = 0x01,
+        ExpectingValue = 0x02,
+        InObject = 0x03,
+        InArray = 0x04
+    };
+
+    /* Per object level, arrays share the level of their object. */
+    struct Level
+    {
+        uint8_t flags;
+        uint8_t arrayDepth;
+        const uint8_t *name;
+        size_t nameSize;
+    };
+
+    /* Visitor state, events are suppressed while skipAt >= 0. */
+    struct Events
+    {
+        int nest;
+        int skipAt;
+        bool skipNext;
+        bool stop;
+    };
+
+    static int64_t readInt(const uint8_t *p, size_t size)
+    {
+#ifdef BINSON_LITTLE_ENDIAN
+        switch (size)
+        {
+        case 1: { int8_t v; memcpy(&v, p, sizeof(v)); return v; }
+        case 2: { int16_t v; memcpy(&v, p, sizeof(v)); return v; }
+        case 4: { int32_t v; memcpy(&v, p, sizeof(v)); return v; }
+        case 8: { int64_t v; memcpy(&v, p, sizeof(v)); return v; }
+        default: break;
+        }
+#endif
+        /* Sign extend from the last (most significant) byte. */
+        uint64_t v = (p[size - 1] & 0x80) ? ~0ULL : 0;
+        for (size_t i = size; i > 0; i--)
+            v = (v << 8) | p[i - 1];
+        return (int64_t) v;
+    }
+
+    static bool minimalInt(int64_t v, size_t size)
+    {
+        switch (size)
+        {
+        case 1: return true;
+        case 2: return v < INT8_MIN || v > INT8_MAX;
+        case 4: return v < INT16_MIN || v > INT16_MAX;
+        default: return v < INT32_MIN || v > INT32_MAX;
+        }
+    }
+
+    static int cmpName(const uint8_t *a, size_t asize, const uint8_t *b, size_t bsize)
+    {
+        int r = memcmp(a, b, (asize < bsize) ? asize : bsize);
+        return (r == 0) ? (int) (asize - bsize) : r;
+    }
+
+    bool available(size_t n) const
+    {
+        return !Policy::checked || (n <= m_size - m_pos);
+    }
+
+    /* Event helpers, Stop sets ev.stop. Skip marks the nesting to resume at. */
+    template <typename F>
+    void begin(Events &ev, F callback)
+    {
+        if (ev.skipAt < 0)
+        {
+            if (ev.skipNext)
+            {
+                ev.skipNext = false;
+                ev.skipAt = ev.nest;
+            }
+            else
+            {
+                BinsonVisit r = callback();
+                if (r == BinsonVisit::Stop)
+                    ev.stop = true;
+                else if (r == BinsonVisit::Skip)
+                    ev.skipAt = ev.nest;
+            }
+        }
+        ev.nest++;
+    }
+
+    template <typename F>
+    void end(Events &ev, F callback)
+    {
+        ev.nest--;
+        if (ev.skipAt >= 0)
+        {
+            if (ev.skipAt == ev.nest)
+                ev.skipAt = -1;
+        }
+        else if (callback() == BinsonVisit::Stop)
+        {
+            ev.stop = true;
+        }
+    }
+
+    template <typename F>
+    void scalar(Events &ev, F callback)
+    {
+        if (ev.skipAt >= 0)
+            return;
+        if (ev.skipNext)
+            ev.skipNext = false;
+        else if (callback() == BinsonVisit::Stop)
+            ev.stop = true;
+    }
+
+    template <bool Scan, typename Visitor>
+    binson_err run(Visitor &v, const bbuf *target, bool *found)
+    {
+        const bool report = Policy::callbacks || Scan;
+        Level levels[Policy::maxDepth];
+        size_t depth = 0;
+        Events ev = { 0, Scan ? 0 : -1, false, false };
+
+        m_pos = 0;
+
+        if (m_data == nullptr)
+            return BINSON_ERROR_NULL;
+        if (Policy::checked)
+        {
+            if (m_size < 2)
+                return BINSON_ERROR_RANGE;
+            if (m_data[0] != BINSON_DEF_OBJECT_BEGIN || m_data[m_size - 1] != BINSON_DEF_OBJECT_END)
+                return BINSON_ERROR_FORMAT;
+        }
+
+        levels[0].flags = 0;
+        levels[0].arrayDepth = 0;
+        levels[0].name = nullptr;
+        levels[0].nameSize = 0;
+
+        for (;;)
+        {
+            if (!available(1))
+                return BINSON_ERROR_RANGE;
+
+            Level &s = levels[depth > 0 ? depth - 1 : 0];
+            const uint8_t token = m_data[m_pos];
+            const uint8_t *payload = nullptr;
+            size_t payloadSize = 0;
+            int64_t integer = 0;
+
+            /* Containers are values too when in an object. */
+            if (token == BINSON_DEF_OBJECT_BEGIN || token == BINSON_DEF_ARRAY_BEGIN)
+            {
+                if (s.flags & InObject)
+                {
+                    if (!(s.flags & ExpectingValue))
+                        return BINSON_ERROR_FORMAT;
+                    s.flags = ExpectingField;
+                }
+            }
+
+            switch (token)
+            {
+            case BINSON_DEF_OBJECT_BEGIN:
+                m_pos++;
+                if (depth >= Policy::maxDepth)
+                    return BINSON_ERROR_MAX_DEPTH;
+                depth++;
+                levels[depth - 1].flags = ExpectingField;
+                levels[depth - 1].arrayDepth = 0;
+                levels[depth - 1].name = nullptr;
+                levels[depth - 1].nameSize = 0;
+                if (report)
+                    begin(ev, [&v] { return v.onObjectBegin(); });
+                break;
+
+            case BINSON_DEF_OBJECT_END:
+                if (!(s.flags & ExpectingField))
+                    return BINSON_ERROR_FORMAT;
+                m_pos++;
+                if (report)
+                    end(ev, [&v] { return v.onObjectEnd(); });
+                if (depth == 1)
+                    return (!Policy::checked || m_pos == m_size) ? BINSON_ERROR_NONE : BINSON_ERROR_FORMAT;
+                depth--;
+                break;
+
+            case BINSON_DEF_ARRAY_BEGIN:
+                if (s.arrayDepth >= UINT8_MAX)
+                    return BINSON_ERROR_MAX_DEPTH;
+                m_pos++;
+                s.flags = InArray;
+                s.arrayDepth++;
+                if (report)
+                    begin(ev, [&v] { return v.onArrayBegin(); });
+                break;
+
+            case BINSON_DEF_ARRAY_END:
+                if (!(s.flags & InArray))
+                    return BINSON_ERROR_FORMAT;
+                m_pos++;
+                if (--s.arrayDepth == 0)
+                    s.flags = ExpectingField;
+                if (report)
+                    end(ev, [&v] { return v.onArrayEnd(); });
+                break;
+
+            case BINSON_DEF_TRUE:
+            case BINSON_DEF_FALSE:
+                m_pos++;
+                break;
+
+            case BINSON_DEF_DOUBLE:
+                m_pos++;
+                if (!available(8))
+                    return BINSON_ERROR_RANGE;
+                payload = &m_data[m_pos];
+                m_pos += 8;
+                break;
+
+            case BINSON_DEF_INT8:
+            case BINSON_DEF_INT16:
+            case BINSON_DEF_INT32:
+            case BINSON_DEF_INT64:
+                m_pos++;
+                payloadSize = 1U << (token & 0x03U);
+                if (!available(payloadSize))
+                    return BINSON_ERROR_RANGE;
+                payload = &m_data[m_pos];
+                m_pos += payloadSize;
+                break;
+
+            case BINSON_DEF_STRINGLEN_INT8:
+            case BINSON_DEF_STRINGLEN_INT16:
+            case BINSON_DEF_STRINGLEN_INT32:
+            case BINSON_DEF_BYTESLEN_INT8:
+            case BINSON_DEF_BYTESLEN_INT16:
+            case BINSON_DEF_BYTESLEN_INT32:
+            {
+                m_pos++;
+                size_t lengthSize = 1U << (token & 0x03U);
+                if (!available(lengthSize))
+                    return BINSON_ERROR_RANGE;
+                integer = readInt(&m_data[m_pos], lengthSize);
+                m_pos += lengthSize;
+                if (Policy::checked && (!minimalInt(integer, lengthSize) ||
+                                        integer < 0 || integer > INT32_MAX))
+                    return BINSON_ERROR_FORMAT;
+                payloadSize = (size_t) integer;
+                if (!available(payloadSize))
+                    return BINSON_ERROR_RANGE;
+                payload = &m_data[m_pos];
+                m_pos += payloadSize;
+                break;
+            }
+
+            default:
+                return BINSON_ERROR_FORMAT;
+            }
+
+            if (token >= BINSON_DEF_OBJECT_BEGIN && token <= BINSON_DEF_ARRAY_END)
+            {
+                if (ev.stop || (Scan && *found && ev.nest == 1))
+                    return BINSON_ERROR_NONE;
+                continue;
+            }
+
+            const bool isString = (token >= BINSON_DEF_STRINGLEN_INT8 &&
+                                   token <= BINSON_DEF_STRINGLEN_INT32);
+
+            if (s.flags & InObject)
+            {
+                if ((s.flags & ExpectingField) && isString)
+                {
+                    if (Policy::checked && s.name != nullptr &&
+                        cmpName(s.name, s.nameSize, payload, payloadSize) >= 0)
+                        return BINSON_ERROR_FORMAT;
+                    s.name = payload;
+                    s.nameSize = payloadSize;
+                    s.flags = ExpectingValue;
+
+                    if (Scan && depth == 1)
+                    {
+                        int r = cmpName(payload, payloadSize, target->bptr, target->bsize);
+                        if (r > 0)
+                            return BINSON_ERROR_NONE;
+                        if (r == 0)
+                        {
+                            *found = true;
+                            ev.skipAt = -1;
+                        }
+                        continue;
+                    }
+
+                    if (report && ev.skipAt < 0)
+                    {
+                        bbuf name;
+                        name.bptr = (uint8_t *) payload;
+                        name.bsize = payloadSize;
+                        BinsonVisit r = v.onField(name);
+                        if (r == BinsonVisit::Stop)
+                            return BINSON_ERROR_NONE;
+                        if (r == BinsonVisit::Skip)
+                            ev.skipNext = true;
+                    }
+                    continue;
+                }
+
+                if (!(s.flags & ExpectingValue))
+                    return BINSON_ERROR_FORMAT;
+                s.flags = ExpectingField;
+            }
+
+            switch (token)
+            {
+            case BINSON_DEF_TRUE:
+            case BINSON_DEF_FALSE:
+                if (report)
+                    scalar(ev, [&v, token] { return v.onBool(token == BINSON_DEF_TRUE); });
+                break;
+            case BINSON_DEF_DOUBLE:
+                if (report)
+                {
+                    uint64_t bits = (uint64_t) readInt(payload, 8);
+                    double d;
+                    memcpy(&d, &bits, sizeof(d));
+                    scalar(ev, [&v, d] { return v.onDouble(d); });
+                }
+                break;
+            case BINSON_DEF_INT8:
+            case BINSON_DEF_INT16:
+            case BINSON_DEF_INT32:
+            case BINSON_DEF_INT64:
+                integer = readInt(payload, payloadSize);
+                if (Policy::checked && !minimalInt(integer, payloadSize))
+                    return BINSON_ERROR_FORMAT;
+                if (report)
+                    scalar(ev, [&v, integer] { return v.onInt(integer); });
+                break;
+            default:
+                if (report)
+                {
+                    bbuf value;
+                    value.bptr = (uint8_t *) payload;
+                    value.bsize = payloadSize;
+                    if (isString)
+                        scalar(ev, [&v, &value] { return v.onString(value); });
+                    else
+                        scalar(ev, [&v, &value] { return v.onBytes(value); });
+                }
+                break;
+            }
+
+            if (ev.stop || (Scan && *found && ev.nest == 1))
+                return BINSON_ERROR_NONE;
+        }
+    }
+
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+};
+
+#endif /* BINSON_PARSER_ENGINE_HPP */
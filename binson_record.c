@@ -0,0 +1,1393 @@
+/**
+ * @file binson_record.c
+ *
+ * Record files: binson messages stored in checksummed blocks with an index.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BINSON_RECORD_HAVE_MMAP
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binson_record.h"
+#include "binson_cpu.h"
+
+#if defined(BINSON_CPU_X86_DISPATCH) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define BINSON_RECORD_HAVE_SSE42
+#endif
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define BINSON_RECORD_MAGIC         "binsonrf"
+#define BINSON_RECORD_INDEX_MAGIC   "binsonix"
+#define BINSON_RECORD_MAGIC_SIZE    (8U)
+#define BINSON_RECORD_END_SIZE      (4U)
+
+/* Initial number of index entries the writer allocates room for. */
+#define BINSON_RECORD_INDEX_INITIAL (64U)
+
+/* Size of a dictionary reference: BINSON_RECORD_NAME_REF and the entry. */
+#define BINSON_RECORD_REF_SIZE      (2U)
+
+/* Longest name token, type and length included, put in a dictionary. */
+#define BINSON_RECORD_NAME_MAX      (64U)
+
+/* Hash table of the names in a block, and how many distinct ones it takes. */
+#define BINSON_RECORD_NAME_SLOTS    (1024U)
+#define BINSON_RECORD_NAME_LIMIT    (768U)
+
+/* Deepest nesting the dictionary encoder follows. */
+#define BINSON_RECORD_MAX_NESTING   (64U)
+
+/*======= Type Definitions ==================================================*/
+
+typedef struct _record_name_s {
+    const uint8_t       *token;
+    uint32_t            size;
+    uint32_t            count;
+    int32_t             entry;      /* Dictionary entry, -1 if none. */
+} _record_name;
+
+typedef struct _record_candidate_s {
+    uint32_t            gain;
+    uint16_t            slot;
+} _record_candidate;
+
+/* Work area of the dictionary encoder, allocated once per writer. */
+typedef struct _record_dictionary_s {
+    _record_name        names[BINSON_RECORD_NAME_SLOTS];
+    uint16_t            filled[BINSON_RECORD_NAME_LIMIT];
+    size_t              filled_count;
+    _record_candidate   candidates[BINSON_RECORD_NAME_LIMIT];
+    uint8_t             section[4 + 2 + 2 * BINSON_RECORD_DICTIONARY_SIZE +
+                                BINSON_RECORD_DICTIONARY_SIZE * BINSON_RECORD_NAME_MAX];
+    size_t              section_size;
+} _record_dictionary;
+
+/* Position in the token stream of a record, tracking where names are. */
+typedef struct _record_walk_s {
+    uint64_t            objects;    /* Bit n set when nesting level n is an object. */
+    uint32_t            depth;
+    bool                name_next;
+} _record_walk;
+
+/*======= Local function prototypes =========================================*/
+
+static bool _emit(binson_record_writer *writer, const uint8_t *data, size_t size);
+static bool _emit_block(binson_record_writer *writer,
+                        const uint8_t *dictionary,
+                        size_t dictionary_size,
+                        const uint8_t *records,
+                        size_t records_size,
+                        const uint8_t *ends,
+                        uint32_t count,
+                        uint32_t flags);
+static size_t _block_free(const binson_record_writer *writer);
+static bool _index_add(binson_record_writer *writer, uint64_t first_record);
+static bool _dictionary_build(binson_record_writer *writer);
+static bool _dictionary_collect(binson_record_writer *writer, _record_dictionary *dict);
+static bool _dictionary_select(_record_dictionary *dict);
+static void _dictionary_encode(binson_record_writer *writer, _record_dictionary *dict);
+static void _dictionary_clear(_record_dictionary *dict);
+static _record_name *_dictionary_find(_record_dictionary *dict, const uint8_t *token, size_t size);
+static int _cmp_candidate(const void *a, const void *b);
+static size_t _writer_end(const binson_record_writer *writer, size_t k);
+static size_t _walk_token(_record_walk *walk, const uint8_t *data, size_t size, bool *is_name);
+static binson_err _check_dictionary(const uint8_t *dictionary, uint64_t size);
+static bool _locate(binson_record_file *file, uint64_t n, binson_record_block *block, bbuf *record);
+static bool _check_index(binson_record_file *file);
+static uint64_t _entry_offset(const binson_record_file *file, size_t n);
+static uint64_t _entry_first(const binson_record_file *file, size_t n);
+static void _block_cursor(const binson_record_file *file, size_t n, binson_record_block *block);
+static void _block_record(const binson_record_block *block, uint32_t k, bbuf *record);
+static bool _read_file(binson_record_file *file, const char *path);
+static void _store_u16(uint8_t *data, uint32_t value);
+static void _store_u32(uint8_t *data, uint32_t value);
+static void _store_u64(uint8_t *data, uint64_t value);
+static uint32_t _load_u16(const uint8_t *data);
+static uint32_t _load_u32(const uint8_t *data);
+static uint64_t _load_u64(const uint8_t *data);
+static uint32_t _crc32c_table(uint32_t crc, const uint8_t *data, size_t size);
+
+#ifdef BINSON_RECORD_HAVE_SSE42
+static uint32_t _crc32c_sse42(uint32_t crc, const uint8_t *data, size_t size);
+#endif
+
+/*======= Local variable declarations =======================================*/
+
+/* CRC32C, reflected polynomial 0x82F63B78. */
+static const uint32_t _crc_table[256] = {
+    0x00000000U, 0xF26B8303U, 0xE13B70F7U, 0x1350F3F4U, 0xC79A971FU, 0x35F1141CU,
+    0x26A1E7E8U, 0xD4CA64EBU, 0x8AD958CFU, 0x78B2DBCCU, 0x6BE22838U, 0x9989AB3BU,
+    0x4D43CFD0U, 0xBF284CD3U, 0xAC78BF27U, 0x5E133C24U, 0x105EC76FU, 0xE235446CU,
+    0xF165B798U, 0x030E349BU, 0xD7C45070U, 0x25AFD373U, 0x36FF2087U, 0xC494A384U,
+    0x9A879FA0U, 0x68EC1CA3U, 0x7BBCEF57U, 0x89D76C54U, 0x5D1D08BFU, 0xAF768BBCU,
+    0xBC267848U, 0x4E4DFB4BU, 0x20BD8EDEU, 0xD2D60DDDU, 0xC186FE29U, 0x33ED7D2AU,
+    0xE72719C1U, 0x154C9AC2U, 0x061C6936U, 0xF477EA35U, 0xAA64D611U, 0x580F5512U,
+    0x4B5FA6E6U, 0xB93425E5U, 0x6DFE410EU, 0x9F95C20DU, 0x8CC531F9U, 0x7EAEB2FAU,
+    0x30E349B1U, 0xC288CAB2U, 0xD1D83946U, 0x23B3BA45U, 0xF779DEAEU, 0x05125DADU,
+    0x1642AE59U, 0xE4292D5AU, 0xBA3A117EU, 0x4851927DU, 0x5B016189U, 0xA96AE28AU,
+    0x7DA08661U, 0x8FCB0562U, 0x9C9BF696U, 0x6EF07595U, 0x417B1DBCU, 0xB3109EBFU,
+    0xA0406D4BU, 0x522BEE48U, 0x86E18AA3U, 0x748A09A0U, 0x67DAFA54U, 0x95B17957U,
+    0xCBA24573U, 0x39C9C670U, 0x2A993584U, 0xD8F2B687U, 0x0C38D26CU, 0xFE53516FU,
+    0xED03A29BU, 0x1F682198U, 0x5125DAD3U, 0xA34E59D0U, 0xB01EAA24U, 0x42752927U,
+    0x96BF4DCCU, 0x64D4CECFU, 0x77843D3BU, 0x85EFBE38U, 0xDBFC821CU, 0x2997011FU,
+    0x3AC7F2EBU, 0xC8AC71E8U, 0x1C661503U, 0xEE0D9600U, 0xFD5D65F4U, 0x0F36E6F7U,
+    0x61C69362U, 0x93AD1061U, 0x80FDE395U, 0x72966096U, 0xA65C047DU, 0x5437877EU,
+    0x4767748AU, 0xB50CF789U, 0xEB1FCBADU, 0x197448AEU, 0x0A24BB5AU, 0xF84F3859U,
+    0x2C855CB2U, 0xDEEEDFB1U, 0xCDBE2C45U, 0x3FD5AF46U, 0x7198540DU, 0x83F3D70EU,
+    0x90A324FAU, 0x62C8A7F9U, 0xB602C312U, 0x44694011U, 0x5739B3E5U, 0xA55230E6U,
+    0xFB410CC2U, 0x092A8FC1U, 0x1A7A7C35U, 0xE811FF36U, 0x3CDB9BDDU, 0xCEB018DEU,
+    0xDDE0EB2AU, 0x2F8B6829U, 0x82F63B78U, 0x709DB87BU, 0x63CD4B8FU, 0x91A6C88CU,
+    0x456CAC67U, 0xB7072F64U, 0xA457DC90U, 0x563C5F93U, 0x082F63B7U, 0xFA44E0B4U,
+    0xE9141340U, 0x1B7F9043U, 0xCFB5F4A8U, 0x3DDE77ABU, 0x2E8E845FU, 0xDCE5075CU,
+    0x92A8FC17U, 0x60C37F14U, 0x73938CE0U, 0x81F80FE3U, 0x55326B08U, 0xA759E80BU,
+    0xB4091BFFU, 0x466298FCU, 0x1871A4D8U, 0xEA1A27DBU, 0xF94AD42FU, 0x0B21572CU,
+    0xDFEB33C7U, 0x2D80B0C4U, 0x3ED04330U, 0xCCBBC033U, 0xA24BB5A6U, 0x502036A5U,
+    0x4370C551U, 0xB11B4652U, 0x65D122B9U, 0x97BAA1BAU, 0x84EA524EU, 0x7681D14DU,
+    0x2892ED69U, 0xDAF96E6AU, 0xC9A99D9EU, 0x3BC21E9DU, 0xEF087A76U, 0x1D63F975U,
+    0x0E330A81U, 0xFC588982U, 0xB21572C9U, 0x407EF1CAU, 0x532E023EU, 0xA145813DU,
+    0x758FE5D6U, 0x87E466D5U, 0x94B49521U, 0x66DF1622U, 0x38CC2A06U, 0xCAA7A905U,
+    0xD9F75AF1U, 0x2B9CD9F2U, 0xFF56BD19U, 0x0D3D3E1AU, 0x1E6DCDEEU, 0xEC064EEDU,
+    0xC38D26C4U, 0x31E6A5C7U, 0x22B65633U, 0xD0DDD530U, 0x0417B1DBU, 0xF67C32D8U,
+    0xE52CC12CU, 0x1747422FU, 0x49547E0BU, 0xBB3FFD08U, 0xA86F0EFCU, 0x5A048DFFU,
+    0x8ECEE914U, 0x7CA56A17U, 0x6FF599E3U, 0x9D9E1AE0U, 0xD3D3E1ABU, 0x21B862A8U,
+    0x32E8915CU, 0xC083125FU, 0x144976B4U, 0xE622F5B7U, 0xF5720643U, 0x07198540U,
+    0x590AB964U, 0xAB613A67U, 0xB831C993U, 0x4A5A4A90U, 0x9E902E7BU, 0x6CFBAD78U,
+    0x7FAB5E8CU, 0x8DC0DD8FU, 0xE330A81AU, 0x115B2B19U, 0x020BD8EDU, 0xF0605BEEU,
+    0x24AA3F05U, 0xD6C1BC06U, 0xC5914FF2U, 0x37FACCF1U, 0x69E9F0D5U, 0x9B8273D6U,
+    0x88D28022U, 0x7AB90321U, 0xAE7367CAU, 0x5C18E4C9U, 0x4F48173DU, 0xBD23943EU,
+    0xF36E6F75U, 0x0105EC76U, 0x12551F82U, 0xE03E9C81U, 0x34F4F86AU, 0xC69F7B69U,
+    0xD5CF889DU, 0x27A40B9EU, 0x79B737BAU, 0x8BDCB4B9U, 0x988C474DU, 0x6AE7C44EU,
+    0xBE2DA0A5U, 0x4C4623A6U, 0x5F16D052U, 0xAD7D5351U
+};
+
+/*======= Global function implementations ===================================*/
+
+bool binson_record_writer_init(binson_record_writer *writer,
+                               binson_record_sink sink,
+                               void *context,
+                               uint8_t *block,
+                               size_t block_size)
+{
+    uint8_t header[BINSON_RECORD_HEADER_SIZE];
+
+    if (NULL == writer) {
+        return false;
+    }
+
+    memset(writer, 0x00U, sizeof(binson_record_writer));
+
+    if ((NULL == sink) || (NULL == block)) {
+        writer->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+
+    if (block_size < BINSON_RECORD_BLOCK_MINIMUM) {
+        writer->error_flags = BINSON_ERROR_RANGE;
+        return false;
+    }
+
+    /* The payload size field is 32 bits. */
+    if (block_size > (size_t) UINT32_MAX) {
+        block_size = (size_t) UINT32_MAX;
+    }
+
+    writer->sink            = sink;
+    writer->sink_context    = context;
+    writer->block           = block;
+    writer->block_size      = block_size;
+    writer->block_used      = BINSON_RECORD_BLOCK_HEADER;
+
+    memcpy(header, BINSON_RECORD_MAGIC, BINSON_RECORD_MAGIC_SIZE);
+    _store_u32(&header[8], BINSON_RECORD_VERSION);
+    _store_u32(&header[12], 0);
+
+    return _emit(writer, header, sizeof(header));
+}
+
+bool binson_record_writer_set_dictionary(binson_record_writer *writer)
+{
+    if ((NULL == writer) || (BINSON_ERROR_NONE != writer->error_flags)) {
+        return false;
+    }
+
+    if (NULL == writer->dictionary) {
+        writer->dictionary = calloc(1, sizeof(_record_dictionary));
+    }
+
+    return (NULL != writer->dictionary);
+}
+
+bool binson_record_write(binson_record_writer *writer,
+                         const uint8_t *record,
+                         size_t size)
+{
+    size_t needed;
+
+    if ((NULL == writer) || (BINSON_ERROR_NONE != writer->error_flags)) {
+        return false;
+    }
+
+    if ((NULL == record) || (size < BINSON_OBJECT_MINIMUM_SIZE)) {
+        writer->error_flags = (NULL == record) ? BINSON_ERROR_NULL : BINSON_ERROR_RANGE;
+        return false;
+    }
+
+    if (size > (size_t) UINT32_MAX - BINSON_RECORD_END_SIZE) {
+        writer->error_flags = BINSON_ERROR_RANGE;
+        return false;
+    }
+
+    needed = size + BINSON_RECORD_END_SIZE;
+
+    if (_block_free(writer) < needed) {
+        if (!binson_record_flush(writer)) {
+            return false;
+        }
+
+        /* Too large for any block: write it as a block of its own. */
+        if (_block_free(writer) < needed) {
+            uint8_t end[BINSON_RECORD_END_SIZE];
+
+            _store_u32(end, (uint32_t) size);
+            writer->record_count++;
+
+            return _emit_block(writer, NULL, 0, record, size, end, 1, 0);
+        }
+    }
+
+    memcpy(&writer->block[writer->block_used], record, size);
+    writer->block_used += size;
+    writer->block_records++;
+    writer->record_count++;
+
+    /* The end offsets grow down from the end of the block buffer. */
+    _store_u32(&writer->block[writer->block_size - writer->block_records * BINSON_RECORD_END_SIZE],
+               (uint32_t) (writer->block_used - BINSON_RECORD_BLOCK_HEADER));
+
+    return true;
+}
+
+bool binson_record_write_writer(binson_record_writer *writer,
+                                binson_writer *source)
+{
+    if ((NULL == writer) || (BINSON_ERROR_NONE != writer->error_flags)) {
+        return false;
+    }
+
+    if ((NULL == source) || (BINSON_ERROR_NONE != source->error_flags)) {
+        writer->error_flags = (NULL == source) ? BINSON_ERROR_NULL : source->error_flags;
+        return false;
+    }
+
+    return binson_record_write(writer, source->buffer, binson_writer_get_counter(source));
+}
+
+bool binson_record_flush(binson_record_writer *writer)
+{
+    _record_dictionary *dict;
+    bool encoded = false;
+    uint8_t *ends;
+    size_t ends_size;
+    size_t i;
+    bool ret;
+
+    if ((NULL == writer) || (BINSON_ERROR_NONE != writer->error_flags)) {
+        return false;
+    }
+
+    if (0 == writer->block_records) {
+        return true;
+    }
+
+    dict = (_record_dictionary *) writer->dictionary;
+
+    if (NULL != dict) {
+        encoded = _dictionary_build(writer);
+    }
+
+    /* Move the end offsets, last record first, behind the records. */
+    ends_size = writer->block_records * BINSON_RECORD_END_SIZE;
+    ends = &writer->block[writer->block_size - ends_size];
+    for (i = 0; i < ends_size / 2; i += BINSON_RECORD_END_SIZE) {
+        uint8_t swap[BINSON_RECORD_END_SIZE];
+
+        memcpy(swap, &ends[i], BINSON_RECORD_END_SIZE);
+        memcpy(&ends[i], &ends[ends_size - BINSON_RECORD_END_SIZE - i], BINSON_RECORD_END_SIZE);
+        memcpy(&ends[ends_size - BINSON_RECORD_END_SIZE - i], swap, BINSON_RECORD_END_SIZE);
+    }
+    memmove(&writer->block[writer->block_used], ends, ends_size);
+
+    ret = _emit_block(writer,
+                      encoded ? dict->section : NULL,
+                      encoded ? dict->section_size : 0,
+                      &writer->block[BINSON_RECORD_BLOCK_HEADER],
+                      writer->block_used - BINSON_RECORD_BLOCK_HEADER,
+                      &writer->block[writer->block_used],
+                      writer->block_records,
+                      encoded ? BINSON_RECORD_BLOCK_DICTIONARY : 0);
+
+    if (NULL != dict) {
+        _dictionary_clear(dict);
+    }
+
+    writer->block_used = BINSON_RECORD_BLOCK_HEADER;
+    writer->block_records = 0;
+
+    return ret;
+}
+
+bool binson_record_writer_finish(binson_record_writer *writer)
+{
+    uint8_t trailer[BINSON_RECORD_TRAILER_SIZE];
+    bool ret;
+
+    if (NULL == writer) {
+        return false;
+    }
+
+    ret = binson_record_flush(writer);
+
+    if (ret) {
+        size_t blocks = writer->index_size / BINSON_RECORD_INDEX_ENTRY;
+
+        _store_u64(&trailer[0], writer->offset);
+        _store_u64(&trailer[8], writer->record_count);
+        _store_u32(&trailer[16], (uint32_t) blocks);
+        _store_u32(&trailer[20],
+                   binson_record_crc32c(binson_record_crc32c(0, writer->index, writer->index_size),
+                                        trailer, 20));
+        memcpy(&trailer[24], BINSON_RECORD_INDEX_MAGIC, BINSON_RECORD_MAGIC_SIZE);
+
+        ret = ((0 == writer->index_size) ||
+               _emit(writer, writer->index, writer->index_size)) &&
+              _emit(writer, trailer, sizeof(trailer));
+    }
+
+    free(writer->index);
+    free(writer->dictionary);
+    writer->index = NULL;
+    writer->index_size = 0;
+    writer->index_capacity = 0;
+    writer->dictionary = NULL;
+
+    return ret;
+}
+
+bool binson_record_file_sink(void *context, const uint8_t *data, size_t size)
+{
+    return (NULL != context) && (fwrite(data, 1, size, (FILE *) context) == size);
+}
+
+bool binson_record_open(binson_record_file *file, const char *path)
+{
+    if (NULL == file) {
+        return false;
+    }
+
+    memset(file, 0x00U, sizeof(binson_record_file));
+
+    if ((NULL == path) || !_read_file(file, path)) {
+        file->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+
+    if (!_check_index(file)) {
+        binson_err error = file->error_flags;
+        binson_record_close(file);
+        file->error_flags = error;
+        return false;
+    }
+
+    return true;
+}
+
+bool binson_record_open_buffer(binson_record_file *file,
+                               const uint8_t *data,
+                               size_t size)
+{
+    if (NULL == file) {
+        return false;
+    }
+
+    memset(file, 0x00U, sizeof(binson_record_file));
+
+    if (NULL == data) {
+        file->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+
+    file->data = data;
+    file->size = size;
+
+    return _check_index(file);
+}
+
+void binson_record_close(binson_record_file *file)
+{
+    if (NULL == file) {
+        return;
+    }
+
+#ifdef BINSON_RECORD_HAVE_MMAP
+    if (file->mapped) {
+        munmap((void *) (uintptr_t) file->data, file->size);
+    }
+#endif
+    if (file->allocated) {
+        free((void *) (uintptr_t) file->data);
+    }
+    free(file->checked);
+
+    memset(file, 0x00U, sizeof(binson_record_file));
+}
+
+binson_err binson_record_block_open(const binson_record_file *file,
+                                    size_t n,
+                                    binson_record_block *block)
+{
+    const uint8_t *header;
+    const uint8_t *payload;
+    uint64_t start;
+    uint64_t next;
+    uint64_t records;
+    uint64_t payload_size;
+    uint32_t previous = 0;
+    uint64_t i;
+
+    if ((NULL == file) || (NULL == block) || (NULL == file->data)) {
+        return BINSON_ERROR_NULL;
+    }
+
+    if (n >= file->block_count) {
+        return BINSON_ERROR_RANGE;
+    }
+
+    /* Offsets were checked to increase on open, so the block fits. */
+    start = _entry_offset(file, n);
+    next = (n + 1 < file->block_count) ? _entry_offset(file, n + 1) : file->index_offset;
+    records = ((n + 1 < file->block_count) ? _entry_first(file, n + 1) : file->record_count) -
+              _entry_first(file, n);
+    header = &file->data[start];
+    payload = &header[BINSON_RECORD_BLOCK_HEADER];
+    payload_size = next - start - BINSON_RECORD_BLOCK_HEADER;
+
+    if ((_load_u32(&header[0]) != payload_size) ||
+        (_load_u32(&header[4]) != records) ||
+        (records * BINSON_RECORD_END_SIZE > payload_size) ||
+        ((_load_u32(&header[12]) & ~BINSON_RECORD_BLOCK_DICTIONARY) != 0)) {
+        return BINSON_ERROR_FORMAT;
+    }
+
+    if (binson_record_crc32c(0, payload, (size_t) payload_size) != _load_u32(&header[8])) {
+        return BINSON_ERROR_FORMAT;
+    }
+
+    /* The records follow the dictionary. */
+    payload_size -= records * BINSON_RECORD_END_SIZE;
+    if (_load_u32(&header[12]) & BINSON_RECORD_BLOCK_DICTIONARY) {
+        binson_err error = _check_dictionary(payload, payload_size);
+
+        if (BINSON_ERROR_NONE != error) {
+            return error;
+        }
+        payload_size -= 4 + (uint64_t) _load_u32(payload);
+    }
+
+    _block_cursor(file, n, block);
+
+    /* The records must follow each other and exactly fill the payload. */
+    for (i = 0; i < records; i++) {
+        uint32_t end = _load_u32(&block->ends[i * BINSON_RECORD_END_SIZE]);
+
+        if ((end < previous) || (end - previous < BINSON_OBJECT_MINIMUM_SIZE)) {
+            return BINSON_ERROR_FORMAT;
+        }
+        previous = end;
+    }
+
+    if (previous != payload_size) {
+        return BINSON_ERROR_FORMAT;
+    }
+
+    return BINSON_ERROR_NONE;
+}
+
+bool binson_record_block_next(binson_record_block *block, bbuf *record)
+{
+    if ((NULL == block) || (NULL == record) || (block->next >= block->record_count)) {
+        return false;
+    }
+
+    _block_record(block, block->next, record);
+    block->next++;
+
+    return true;
+}
+
+size_t binson_record_find_block(const binson_record_file *file, uint64_t n)
+{
+    size_t low = 0;
+    size_t high;
+
+    if ((NULL == file) || (n >= file->record_count)) {
+        return (NULL != file) ? file->block_count : 0;
+    }
+
+    /* Last block whose first record is at most n. */
+    high = file->block_count;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+
+        if (_entry_first(file, middle) <= n) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+bool binson_record_get(binson_record_file *file, uint64_t n, bbuf *record)
+{
+    binson_record_block block;
+
+    return _locate(file, n, &block, record);
+}
+
+bool binson_record_read(binson_record_file *file,
+                        uint64_t n,
+                        uint8_t *buffer,
+                        size_t buffer_size,
+                        bbuf *record)
+{
+    binson_record_block block;
+    bbuf stored;
+    binson_err error;
+
+    if (!_locate(file, n, &block, &stored)) {
+        return false;
+    }
+
+    error = binson_record_decode(&block, &stored, buffer, buffer_size, record);
+    if (BINSON_ERROR_NONE != error) {
+        file->error_flags = error;
+        return false;
+    }
+
+    return true;
+}
+
+binson_err binson_record_decode(const binson_record_block *block,
+                                const bbuf *record,
+                                uint8_t *buffer,
+                                size_t buffer_size,
+                                bbuf *decoded)
+{
+    const uint8_t *src;
+    const uint8_t *ends;
+    const uint8_t *names;
+    size_t size;
+    size_t used = 0;
+    size_t run = 0;
+    size_t pos = 0;
+    uint32_t count;
+
+    if ((NULL == block) || (NULL == record) || (NULL == decoded)) {
+        return BINSON_ERROR_NULL;
+    }
+
+    if (NULL == block->dictionary) {
+        *decoded = *record;
+        return BINSON_ERROR_NONE;
+    }
+
+    if (NULL == buffer) {
+        return BINSON_ERROR_NULL;
+    }
+
+    src = record->bptr;
+    size = record->bsize;
+    count = _load_u16(block->dictionary);
+    ends = &block->dictionary[2];
+    names = &ends[2 * count];
+
+    /*
+     * Runs of tokens between references are copied in one go; the walk
+     * only has to find the references.
+     */
+    while (pos < size) {
+        if (BINSON_RECORD_NAME_REF == src[pos]) {
+            uint32_t entry;
+            uint32_t start;
+            uint32_t end;
+
+            if ((size - pos < BINSON_RECORD_REF_SIZE) || (src[pos + 1] >= count)) {
+                return BINSON_ERROR_FORMAT;
+            }
+            entry = src[pos + 1];
+            start = (entry > 0) ? _load_u16(&ends[2 * (entry - 1)]) : 0;
+            end = _load_u16(&ends[2 * entry]);
+
+            if (buffer_size - used < (pos - run) + (end - start)) {
+                return BINSON_ERROR_RANGE;
+            }
+            memcpy(&buffer[used], &src[run], pos - run);
+            used += pos - run;
+            memcpy(&buffer[used], &names[start], end - start);
+            used += end - start;
+
+            pos += BINSON_RECORD_REF_SIZE;
+            run = pos;
+        }
+        else {
+            size_t n = binson_token_size(&src[pos], size - pos);
+
+            if (0 == n) {
+                return BINSON_ERROR_FORMAT;
+            }
+            pos += n;
+        }
+    }
+
+    if (buffer_size - used < pos - run) {
+        return BINSON_ERROR_RANGE;
+    }
+    memcpy(&buffer[used], &src[run], pos - run);
+    used += pos - run;
+
+    decoded->bptr = buffer;
+    decoded->bsize = used;
+
+    return BINSON_ERROR_NONE;
+}
+
+uint32_t binson_record_crc32c(uint32_t crc, const uint8_t *data, size_t size)
+{
+    if ((NULL == data) || (0 == size)) {
+        return crc;
+    }
+
+#ifdef BINSON_RECORD_HAVE_SSE42
+    if (binson_cpu_has_sse42()) {
+        return ~_crc32c_sse42(~crc, data, size);
+    }
+#endif
+
+    return ~_crc32c_table(~crc, data, size);
+}
+
+/*======= Local function implementations ====================================*/
+
+static bool _emit(binson_record_writer *writer, const uint8_t *data, size_t size)
+{
+    if (BINSON_ERROR_NONE != writer->error_flags) {
+        return false;
+    }
+
+    if (!writer->sink(writer->sink_context, data, size)) {
+        writer->error_flags = BINSON_ERROR_EOF;
+        return false;
+    }
+
+    writer->offset += size;
+
+    return true;
+}
+
+/*
+ * Fills in the block header, adds the block to the index and writes the
+ * block. The records are already counted in writer->record_count.
+ */
+static bool _emit_block(binson_record_writer *writer,
+                        const uint8_t *dictionary,
+                        size_t dictionary_size,
+                        const uint8_t *records,
+                        size_t records_size,
+                        const uint8_t *ends,
+                        uint32_t count,
+                        uint32_t flags)
+{
+    uint8_t header_space[BINSON_RECORD_BLOCK_HEADER];
+    size_t ends_size = (size_t) count * BINSON_RECORD_END_SIZE;
+    uint8_t *header = header_space;
+    uint32_t crc;
+
+    /* A buffered block has room for its header in front. */
+    if (records == &writer->block[BINSON_RECORD_BLOCK_HEADER]) {
+        header = writer->block;
+    }
+
+    crc = binson_record_crc32c(0, dictionary, dictionary_size);
+    crc = binson_record_crc32c(crc, records, records_size);
+    crc = binson_record_crc32c(crc, ends, ends_size);
+
+    _store_u32(&header[0], (uint32_t) (dictionary_size + records_size + ends_size));
+    _store_u32(&header[4], count);
+    _store_u32(&header[8], crc);
+    _store_u32(&header[12], flags);
+
+    if (!_index_add(writer, writer->record_count - count)) {
+        return false;
+    }
+
+    if ((header == writer->block) && (0 == dictionary_size)) {
+        return _emit(writer, header, BINSON_RECORD_BLOCK_HEADER + records_size + ends_size);
+    }
+
+    return _emit(writer, header, BINSON_RECORD_BLOCK_HEADER) &&
+           ((0 == dictionary_size) || _emit(writer, dictionary, dictionary_size)) &&
+           _emit(writer, records, records_size) &&
+           _emit(writer, ends, ends_size);
+}
+
+/* Room left in the block buffer for records and their end offsets. */
+static size_t _block_free(const binson_record_writer *writer)
+{
+    return writer->block_size - writer->block_used -
+           (size_t) writer->block_records * BINSON_RECORD_END_SIZE;
+}
+
+/* Adds an index entry for a block about to be written at writer->offset. */
+static bool _index_add(binson_record_writer *writer, uint64_t first_record)
+{
+    uint8_t *entry;
+
+    if (writer->index_size == writer->index_capacity) {
+        size_t capacity = (writer->index_capacity > 0) ?
+                          writer->index_capacity * 2 :
+                          BINSON_RECORD_INDEX_INITIAL * BINSON_RECORD_INDEX_ENTRY;
+        uint8_t *grown = realloc(writer->index, capacity);
+
+        if (NULL == grown) {
+            writer->error_flags = BINSON_ERROR_RANGE;
+            return false;
+        }
+        writer->index = grown;
+        writer->index_capacity = capacity;
+    }
+
+    entry = &writer->index[writer->index_size];
+    _store_u64(&entry[0], writer->offset);
+    _store_u64(&entry[8], first_record);
+    writer->index_size += BINSON_RECORD_INDEX_ENTRY;
+
+    return true;
+}
+
+/*
+ * Replaces the field names of the buffered block by dictionary references
+ * when that makes the block smaller. false leaves the block unchanged.
+ */
+static bool _dictionary_build(binson_record_writer *writer)
+{
+    _record_dictionary *dict = (_record_dictionary *) writer->dictionary;
+
+    if (!_dictionary_collect(writer, dict) || !_dictionary_select(dict)) {
+        return false;
+    }
+
+    _dictionary_encode(writer, dict);
+
+    return true;
+}
+
+/*
+ * Counts the name tokens of all records in the block. false if a record
+ * is not a well formed token stream, which the encoder could not follow.
+ */
+static bool _dictionary_collect(binson_record_writer *writer, _record_dictionary *dict)
+{
+    const uint8_t *records = &writer->block[BINSON_RECORD_BLOCK_HEADER];
+    size_t start = 0;
+    size_t k;
+
+    for (k = 0; k < writer->block_records; k++) {
+        size_t end = _writer_end(writer, k);
+        _record_walk walk = { 0, 0, false };
+        size_t pos = start;
+
+        while (pos < end) {
+            bool is_name;
+            size_t n = _walk_token(&walk, &records[pos], end - pos, &is_name);
+
+            if (0 == n) {
+                return false;
+            }
+
+            if (is_name && (n <= BINSON_RECORD_NAME_MAX)) {
+                _record_name *name = _dictionary_find(dict, &records[pos], n);
+
+                if (NULL != name) {
+                    name->count++;
+                }
+            }
+            pos += n;
+        }
+        start = end;
+    }
+
+    return true;
+}
+
+/*
+ * Picks the names that save the most and builds the dictionary section.
+ * A name of size bytes used count times saves count * (size - 2) bytes in
+ * the records and costs size bytes in the dictionary.
+ */
+static bool _dictionary_select(_record_dictionary *dict)
+{
+    size_t candidates = 0;
+    size_t entries;
+    size_t gain = 0;
+    size_t used;
+    size_t i;
+
+    for (i = 0; i < dict->filled_count; i++) {
+        _record_name *name = &dict->names[dict->filled[i]];
+        size_t saved = (size_t) name->count * (name->size - BINSON_RECORD_REF_SIZE);
+
+        if (saved > name->size) {
+            dict->candidates[candidates].gain = (uint32_t) (saved - name->size);
+            dict->candidates[candidates].slot = dict->filled[i];
+            candidates++;
+        }
+    }
+
+    qsort(dict->candidates, candidates, sizeof(_record_candidate), _cmp_candidate);
+
+    entries = (candidates < BINSON_RECORD_DICTIONARY_SIZE) ?
+              candidates : BINSON_RECORD_DICTIONARY_SIZE;
+    for (i = 0; i < entries; i++) {
+        gain += dict->candidates[i].gain;
+    }
+
+    /* The section header and the end offsets must be paid for as well. */
+    if (gain <= 4 + 2 + 2 * entries) {
+        return false;
+    }
+
+    _store_u16(&dict->section[4], (uint32_t) entries);
+    used = 4 + 2 + 2 * entries;
+    for (i = 0; i < entries; i++) {
+        _record_name *name = &dict->names[dict->candidates[i].slot];
+
+        memcpy(&dict->section[used], name->token, name->size);
+        name->token = &dict->section[used];
+        name->entry = (int32_t) i;
+        used += name->size;
+        _store_u16(&dict->section[4 + 2 + 2 * i], (uint32_t) (used - (4 + 2 + 2 * entries)));
+    }
+    _store_u32(&dict->section[0], (uint32_t) (used - 4));
+    dict->section_size = used;
+
+    return true;
+}
+
+/*
+ * Rewrites the records in place. References are shorter than the names
+ * they replace, so the output never overtakes the input.
+ */
+static void _dictionary_encode(binson_record_writer *writer, _record_dictionary *dict)
+{
+    uint8_t *records = &writer->block[BINSON_RECORD_BLOCK_HEADER];
+    size_t start = 0;
+    size_t out = 0;
+    size_t k;
+
+    for (k = 0; k < writer->block_records; k++) {
+        size_t end = _writer_end(writer, k);
+        _record_walk walk = { 0, 0, false };
+        size_t run = start;
+        size_t pos = start;
+
+        while (pos < end) {
+            bool is_name;
+            size_t n = _walk_token(&walk, &records[pos], end - pos, &is_name);
+            _record_name *name = NULL;
+
+            if (is_name && (n <= BINSON_RECORD_NAME_MAX)) {
+                name = _dictionary_find(dict, &records[pos], n);
+            }
+
+            if ((NULL != name) && (name->entry >= 0)) {
+                memmove(&records[out], &records[run], pos - run);
+                out += pos - run;
+                records[out++] = BINSON_RECORD_NAME_REF;
+                records[out++] = (uint8_t) name->entry;
+                run = pos + n;
+            }
+            pos += n;
+        }
+
+        memmove(&records[out], &records[run], end - run);
+        out += end - run;
+        _store_u32(&writer->block[writer->block_size - (k + 1) * BINSON_RECORD_END_SIZE],
+                   (uint32_t) out);
+        start = end;
+    }
+
+    writer->block_used = BINSON_RECORD_BLOCK_HEADER + out;
+}
+
+static void _dictionary_clear(_record_dictionary *dict)
+{
+    size_t i;
+
+    for (i = 0; i < dict->filled_count; i++) {
+        dict->names[dict->filled[i]].token = NULL;
+    }
+    dict->filled_count = 0;
+}
+
+/*
+ * Finds a name in the hash table, adding it if there is room. NULL if it
+ * is not there and the table is full.
+ */
+static _record_name *_dictionary_find(_record_dictionary *dict, const uint8_t *token, size_t size)
+{
+    uint32_t hash = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ token[i]) * 16777619U;
+    }
+
+    for (;;) {
+        _record_name *name = &dict->names[hash & (BINSON_RECORD_NAME_SLOTS - 1)];
+
+        if (NULL == name->token) {
+            if (dict->filled_count == BINSON_RECORD_NAME_LIMIT) {
+                return NULL;
+            }
+            dict->filled[dict->filled_count++] = (uint16_t) (hash & (BINSON_RECORD_NAME_SLOTS - 1));
+            name->token = token;
+            name->size = (uint32_t) size;
+            name->count = 0;
+            name->entry = -1;
+            return name;
+        }
+
+        if ((name->size == size) && (memcmp(name->token, token, size) == 0)) {
+            return name;
+        }
+        hash++;
+    }
+}
+
+/* Largest gain first, ties in slot order so the output is reproducible. */
+static int _cmp_candidate(const void *a, const void *b)
+{
+    const _record_candidate *x = (const _record_candidate *) a;
+    const _record_candidate *y = (const _record_candidate *) b;
+
+    if (x->gain != y->gain) {
+        return (x->gain > y->gain) ? -1 : 1;
+    }
+
+    return (int) x->slot - (int) y->slot;
+}
+
+/* End of buffered record k, relative to the first record. */
+static size_t _writer_end(const binson_record_writer *writer, size_t k)
+{
+    return _load_u32(&writer->block[writer->block_size - (k + 1) * BINSON_RECORD_END_SIZE]);
+}
+
+/*
+ * Steps over one token of a record and tells if it is a field name, i.e.
+ * a string in an object where a name is due. Returns the token size, 0 for
+ * an unknown or truncated token or unbalanced nesting.
+ */
+static size_t _walk_token(_record_walk *walk, const uint8_t *data, size_t size, bool *is_name)
+{
+    size_t n = binson_token_size(data, size);
+    uint8_t token = data[0];
+
+    *is_name = false;
+
+    if (0 == n) {
+        return 0;
+    }
+
+    if (walk->name_next &&
+        (token >= BINSON_DEF_STRINGLEN_INT8) && (token <= BINSON_DEF_STRINGLEN_INT32)) {
+        *is_name = true;
+        walk->name_next = false;
+        return n;
+    }
+
+    switch (token) {
+        case BINSON_DEF_OBJECT_BEGIN:
+        case BINSON_DEF_ARRAY_BEGIN:
+            if (walk->depth == BINSON_RECORD_MAX_NESTING) {
+                return 0;
+            }
+            if (BINSON_DEF_OBJECT_BEGIN == token) {
+                walk->objects |= (uint64_t) 1 << walk->depth;
+            }
+            else {
+                walk->objects &= ~((uint64_t) 1 << walk->depth);
+            }
+            walk->depth++;
+            walk->name_next = (BINSON_DEF_OBJECT_BEGIN == token);
+            return n;
+        case BINSON_DEF_OBJECT_END:
+        case BINSON_DEF_ARRAY_END:
+            if (0 == walk->depth) {
+                return 0;
+            }
+            walk->depth--;
+            break;
+        default:
+            break;
+    }
+
+    /* After a value, a name is due if the enclosing block is an object. */
+    walk->name_next = (walk->depth > 0) && ((walk->objects >> (walk->depth - 1)) & 1U);
+
+    return n;
+}
+
+/*
+ * Checks a block dictionary: the entry count, increasing end offsets that
+ * fill the names area exactly, and that every entry is one string token.
+ * size is what the payload holds before the record end offsets.
+ */
+static binson_err _check_dictionary(const uint8_t *payload, uint64_t size)
+{
+    const uint8_t *ends = &payload[4 + 2];
+    const uint8_t *names;
+    uint64_t dictionary_size;
+    uint32_t count;
+    uint32_t previous = 0;
+    uint32_t i;
+
+    if (size < 4 + 2) {
+        return BINSON_ERROR_FORMAT;
+    }
+
+    dictionary_size = _load_u32(payload);
+    count = _load_u16(&payload[4]);
+
+    if ((dictionary_size > size - 4) ||
+        (count > BINSON_RECORD_DICTIONARY_SIZE) ||
+        (2 + 2 * (uint64_t) count > dictionary_size)) {
+        return BINSON_ERROR_FORMAT;
+    }
+
+    names = &ends[2 * count];
+    for (i = 0; i < count; i++) {
+        uint32_t end = _load_u16(&ends[2 * i]);
+
+        if ((end <= previous) || (end > dictionary_size - 2 - 2 * count) ||
+            (names[previous] < BINSON_DEF_STRINGLEN_INT8) ||
+            (names[previous] > BINSON_DEF_STRINGLEN_INT32) ||
+            (binson_token_size(&names[previous], end - previous) != end - previous)) {
+            return BINSON_ERROR_FORMAT;
+        }
+        previous = end;
+    }
+
+    return (previous == dictionary_size - 2 - 2 * count) ? BINSON_ERROR_NONE : BINSON_ERROR_FORMAT;
+}
+
+/*
+ * Finds record n, validating its block the first time, and leaves block
+ * as a cursor over that block.
+ */
+static bool _locate(binson_record_file *file, uint64_t n, binson_record_block *block, bbuf *record)
+{
+    size_t b;
+
+    if ((NULL == file) || (NULL == record)) {
+        return false;
+    }
+
+    b = binson_record_find_block(file, n);
+    if (b >= file->block_count) {
+        file->error_flags = BINSON_ERROR_RANGE;
+        return false;
+    }
+
+    if (!file->checked[b]) {
+        binson_err error = binson_record_block_open(file, b, block);
+
+        if (BINSON_ERROR_NONE != error) {
+            file->error_flags = error;
+            return false;
+        }
+        file->checked[b] = 1;
+    }
+    else {
+        _block_cursor(file, b, block);
+    }
+
+    _block_record(block, (uint32_t) (n - block->first_record), record);
+
+    return true;
+}
+
+/*
+ * Checks the header, the trailer and the index. The block offsets must
+ * start right after the header and increase by more than a block header,
+ * and the first record numbers must increase, so that every block holds
+ * at least one record and the binary search in binson_record_find_block()
+ * is well defined. The blocks themselves are checked when opened.
+ */
+static bool _check_index(binson_record_file *file)
+{
+    const uint8_t *trailer;
+    uint64_t index_offset;
+    uint64_t index_size;
+    uint64_t previous_offset = 0;
+    uint64_t previous_first = 0;
+    size_t i;
+
+    file->error_flags = BINSON_ERROR_FORMAT;
+
+    if ((file->size < BINSON_RECORD_HEADER_SIZE + BINSON_RECORD_TRAILER_SIZE) ||
+        (memcmp(file->data, BINSON_RECORD_MAGIC, BINSON_RECORD_MAGIC_SIZE) != 0) ||
+        (_load_u32(&file->data[8]) != BINSON_RECORD_VERSION)) {
+        return false;
+    }
+
+    trailer = &file->data[file->size - BINSON_RECORD_TRAILER_SIZE];
+    if (memcmp(&trailer[24], BINSON_RECORD_INDEX_MAGIC, BINSON_RECORD_MAGIC_SIZE) != 0) {
+        return false;
+    }
+
+    index_offset = _load_u64(&trailer[0]);
+    if ((index_offset < BINSON_RECORD_HEADER_SIZE) ||
+        (index_offset > file->size - BINSON_RECORD_TRAILER_SIZE)) {
+        return false;
+    }
+
+    index_size = file->size - BINSON_RECORD_TRAILER_SIZE - index_offset;
+    if (index_size != (uint64_t) _load_u32(&trailer[16]) * BINSON_RECORD_INDEX_ENTRY) {
+        return false;
+    }
+
+    file->index_offset = (size_t) index_offset;
+    file->index = &file->data[index_offset];
+    file->block_count = (size_t) (index_size / BINSON_RECORD_INDEX_ENTRY);
+    file->record_count = _load_u64(&trailer[8]);
+
+    if (binson_record_crc32c(binson_record_crc32c(0, file->index, (size_t) index_size),
+                             trailer, 20) != _load_u32(&trailer[20])) {
+        return false;
+    }
+
+    for (i = 0; i < file->block_count; i++) {
+        uint64_t offset = _entry_offset(file, i);
+        uint64_t first = _entry_first(file, i);
+
+        if ((0 == i) ?
+                ((BINSON_RECORD_HEADER_SIZE != offset) || (0 != first)) :
+                ((offset <= previous_offset + BINSON_RECORD_BLOCK_HEADER) ||
+                 (first <= previous_first))) {
+            return false;
+        }
+
+        previous_offset = offset;
+        previous_first = first;
+    }
+
+    if ((0 == file->block_count) ?
+            ((0 != file->record_count) || (BINSON_RECORD_HEADER_SIZE != index_offset)) :
+            ((index_offset <= previous_offset + BINSON_RECORD_BLOCK_HEADER) ||
+             (file->record_count <= previous_first))) {
+        return false;
+    }
+
+    file->checked = calloc((file->block_count > 0) ? file->block_count : 1, 1);
+    if (NULL == file->checked) {
+        file->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+
+    file->error_flags = BINSON_ERROR_NONE;
+
+    return true;
+}
+
+static uint64_t _entry_offset(const binson_record_file *file, size_t n)
+{
+    return _load_u64(&file->index[n * BINSON_RECORD_INDEX_ENTRY]);
+}
+
+static uint64_t _entry_first(const binson_record_file *file, size_t n)
+{
+    return _load_u64(&file->index[n * BINSON_RECORD_INDEX_ENTRY + 8]);
+}
+
+/* Cursor over block n without any checks. */
+static void _block_cursor(const binson_record_file *file, size_t n, binson_record_block *block)
+{
+    uint64_t start = _entry_offset(file, n);
+    uint64_t next = (n + 1 < file->block_count) ? _entry_offset(file, n + 1) : file->index_offset;
+    const uint8_t *header = &file->data[start];
+    const uint8_t *payload = &header[BINSON_RECORD_BLOCK_HEADER];
+
+    block->record_count = _load_u32(&header[4]);
+    block->flags        = _load_u32(&header[12]);
+    block->first_record = _entry_first(file, n);
+    block->dictionary   = NULL;
+    block->records      = payload;
+    block->ends         = &file->data[next - (size_t) block->record_count * BINSON_RECORD_END_SIZE];
+    block->next         = 0;
+
+    if (block->flags & BINSON_RECORD_BLOCK_DICTIONARY) {
+        block->dictionary = &payload[4];
+        block->records = &payload[4 + (size_t) _load_u32(payload)];
+    }
+}
+
+/* Record k of a block, found through its end offset and the one before. */
+static void _block_record(const binson_record_block *block, uint32_t k, bbuf *record)
+{
+    uint32_t start = (k > 0) ? _load_u32(&block->ends[(size_t) (k - 1) * BINSON_RECORD_END_SIZE]) : 0;
+    uint32_t end = _load_u32(&block->ends[(size_t) k * BINSON_RECORD_END_SIZE]);
+
+    record->bptr = &block->records[start];
+    record->bsize = end - start;
+}
+
+/* Maps the file, or reads it into memory where it cannot be mapped. */
+static bool _read_file(binson_record_file *file, const char *path)
+{
+    uint8_t *data;
+    FILE *f;
+    long size = 0;
+    bool ok;
+
+#ifdef BINSON_RECORD_HAVE_MMAP
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd >= 0) {
+        if ((0 == fstat(fd, &st)) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+            void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (MAP_FAILED != map) {
+                file->data = map;
+                file->size = (size_t) st.st_size;
+                file->mapped = true;
+            }
+        }
+        close(fd);
+
+        if (file->mapped) {
+            return true;
+        }
+    }
+#endif
+
+    f = fopen(path, "rb");
+    if (NULL == f) {
+        return false;
+    }
+
+    ok = (0 == fseek(f, 0, SEEK_END)) && ((size = ftell(f)) >= 0) && (0 == fseek(f, 0, SEEK_SET));
+    data = ok ? malloc((size > 0) ? (size_t) size : 1) : NULL;
+    ok = (NULL != data) && (fread(data, 1, (size_t) size, f) == (size_t) size);
+    fclose(f);
+
+    if (!ok) {
+        free(data);
+        return false;
+    }
+
+    file->data = data;
+    file->size = (size_t) size;
+    file->allocated = true;
+
+    return true;
+}
+
+static void _store_u16(uint8_t *data, uint32_t value)
+{
+    data[0] = (uint8_t) value;
+    data[1] = (uint8_t) (value >> 8);
+}
+
+static void _store_u32(uint8_t *data, uint32_t value)
+{
+    data[0] = (uint8_t) value;
+    data[1] = (uint8_t) (value >> 8);
+    data[2] = (uint8_t) (value >> 16);
+    data[3] = (uint8_t) (value >> 24);
+}
+
+static void _store_u64(uint8_t *data, uint64_t value)
+{
+    _store_u32(&data[0], (uint32_t) value);
+    _store_u32(&data[4], (uint32_t) (value >> 32));
+}
+
+static uint32_t _load_u16(const uint8_t *data)
+{
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8);
+}
+
+static uint32_t _load_u32(const uint8_t *data)
+{
+    return (uint32_t) data[0] |
+           ((uint32_t) data[1] << 8) |
+           ((uint32_t) data[2] << 16) |
+           ((uint32_t) data[3] << 24);
+}
+
+static uint64_t _load_u64(const uint8_t *data)
+{
+    return (uint64_t) _load_u32(&data[0]) | ((uint64_t) _load_u32(&data[4]) << 32);
+}
+
+static uint32_t _crc32c_table(uint32_t crc, const uint8_t *data, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        crc = _crc_table[(crc ^ data[i]) & 0xFFU] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#ifdef BINSON_RECORD_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t _crc32c_sse42(uint32_t crc, const uint8_t *data, size_t size)
+{
+    uint64_t crc64 = crc;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+
+        memcpy(&word, &data[i], sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    crc = (uint32_t) crc64;
+    for (; i < size; i++) {
+        crc = _mm_crc32_u8(crc, data[i]);
+    }
+
+    return crc;
+}
+#endif
@@ -0,0 +1,344 @@
+#ifndef _BINSON_RECORD_H_
+#define _BINSON_RECORD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file binson_record.h
+ *
+ * Record files: binson messages stored in checksummed blocks with an index.
+ *
+ * A record file is a header, a sequence of blocks and an index followed by
+ * a trailer. All integers are little endian.
+ *
+ *   header   "binsonrf", u32 version, u32 flags
+ *   block    u32 payload size, u32 record count, u32 CRC32C of the
+ *            payload, u32 flags, then the payload: the records back to
+ *            back followed by the u32 end offset of each record within
+ *            the payload
+ *   index    per block a u64 file offset and the u64 number of the first
+ *            record in the block
+ *   trailer  u64 index offset, u64 record count, u32 block count,
+ *            u32 CRC32C of the index and the trailer fields before it,
+ *            "binsonix"
+ *
+ * A block with BINSON_RECORD_BLOCK_DICTIONARY in its flags starts its
+ * payload with a field name dictionary: u32 size of the rest of the
+ * dictionary, u16 entry count, per entry the u16 end offset of its name
+ * token, then the name tokens back to back. In the records of such a block
+ * a field name may be replaced by BINSON_RECORD_NAME_REF followed by a u8
+ * entry number; binson_record_decode() puts the name tokens back.
+ *
+ * The writer collects records in a caller supplied block buffer and writes
+ * each full block through a sink callback; only the index grows on the
+ * heap. The reader maps the file, checks the header, trailer and index on
+ * open and each block's checksum only when the block is first read. Record
+ * N is found by binary search over the index and then directly through the
+ * end offsets of its block. Blocks can be read independently of each
+ * other, e.g. one thread per range of blocks.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+
+#include "binson_defines.h"
+#include "binson_writer.h"
+
+/*======= Public macro definitions ==========================================*/
+
+#define BINSON_RECORD_VERSION       (1U)
+#define BINSON_RECORD_HEADER_SIZE   (16U)
+#define BINSON_RECORD_BLOCK_HEADER  (16U)
+#define BINSON_RECORD_INDEX_ENTRY   (16U)
+#define BINSON_RECORD_TRAILER_SIZE  (32U)
+
+/* Smallest block buffer binson_record_writer_init() accepts. */
+#define BINSON_RECORD_BLOCK_MINIMUM (64U)
+
+/* Block buffer size that keeps per block overhead well below 1 %. */
+#define BINSON_RECORD_BLOCK_DEFAULT (64U * 1024U)
+
+/* Block flag: the payload starts with a field name dictionary. */
+#define BINSON_RECORD_BLOCK_DICTIONARY  (0x01U)
+
+/* Token referring to a dictionary entry. Not a valid binson token. */
+#define BINSON_RECORD_NAME_REF      (0x1CU)
+
+/* Most entries in one block dictionary. */
+#define BINSON_RECORD_DICTIONARY_SIZE   (256U)
+
+/*======= Type Definitions and declarations =================================*/
+
+/**
+ * Sink callback. Receives size bytes of file data and returns false to
+ * abort the writer.
+ */
+typedef bool (*binson_record_sink)(void *context, const uint8_t *data, size_t size);
+
+typedef struct binson_record_writer_s {
+    binson_record_sink  sink;
+    void                *sink_context;
+    uint8_t             *block;
+    size_t              block_size;
+    size_t              block_used;
+    uint32_t            block_records;
+    uint64_t            offset;         /* Bytes passed to the sink. */
+    uint64_t            record_count;
+    uint8_t             *index;
+    size_t              index_size;
+    size_t              index_capacity;
+    void                *dictionary;    /* See binson_record_writer_set_dictionary(). */
+    binson_err          error_flags;
+} binson_record_writer;
+
+typedef struct binson_record_file_s {
+    const uint8_t       *data;
+    size_t              size;
+    const uint8_t       *index;
+    size_t              index_offset;
+    size_t              block_count;
+    uint64_t            record_count;
+    uint8_t             *checked;       /* Blocks validated by binson_record_get(). */
+    bool                mapped;         /* data is a mapping of the file. */
+    bool                allocated;      /* data is a heap copy of the file. */
+    binson_err          error_flags;
+} binson_record_file;
+
+/* Cursor over the records of one validated block. */
+typedef struct binson_record_block_s {
+    const uint8_t       *dictionary;    /* Entry count, NULL without dictionary. */
+    const uint8_t       *records;
+    const uint8_t       *ends;
+    uint64_t            first_record;
+    uint32_t            record_count;
+    uint32_t            next;
+    uint32_t            flags;
+} binson_record_block;
+
+/*======= Public function declarations ======================================*/
+
+/**
+ * @brief Initiates a record writer and writes the file header.
+ *
+ * @param writer        Pointer to record writer structure.
+ * @param sink          Output callback, e.g. binson_record_file_sink().
+ * @param context       Passed to sink.
+ * @param block         Block buffer. Records are collected here and the
+ *                      block is written when the next record does not fit.
+ * @param block_size    Size of block, at least BINSON_RECORD_BLOCK_MINIMUM.
+ *
+ * @return true     The writer was initiated.
+ * @return false    Invalid arguments, or the sink failed
+ *                  (BINSON_ERROR_EOF), see writer->error_flags.
+ */
+bool binson_record_writer_init(binson_record_writer *writer,
+                               binson_record_sink sink,
+                               void *context,
+                               uint8_t *block,
+                               size_t block_size);
+
+/**
+ * @brief Enables field name dictionaries for the following blocks.
+ *
+ * When a block is written, the field names that occur in it often enough
+ * to pay for their dictionary entry are put in a dictionary and replaced
+ * in the records by two byte references. Blocks where that does not save
+ * anything, or whose records are not well formed token streams, are
+ * written as they are. Needs a work area of about 50 kB on the heap,
+ * released by binson_record_writer_finish().
+ *
+ * @param writer    Pointer to record writer structure.
+ *
+ * @return true     Dictionaries are enabled.
+ * @return false    Out of memory or see writer->error_flags.
+ */
+bool binson_record_writer_set_dictionary(binson_record_writer *writer);
+
+/**
+ * @brief Appends one record.
+ *
+ * Records larger than the block buffer are written as a block of their
+ * own straight from record.
+ *
+ * @param writer    Pointer to record writer structure.
+ * @param record    Serialized binson object or array.
+ * @param size      Size of record, at most UINT32_MAX.
+ *
+ * @return true     The record was appended.
+ * @return false    See writer->error_flags.
+ */
+bool binson_record_write(binson_record_writer *writer,
+                         const uint8_t *record,
+                         size_t size);
+
+/**
+ * @brief Appends the output of a binson writer as one record.
+ *
+ * @return false    The binson writer has an error or see
+ *                  binson_record_write().
+ */
+bool binson_record_write_writer(binson_record_writer *writer,
+                                binson_writer *source);
+
+/**
+ * @brief Writes the current block, if it holds any records.
+ */
+bool binson_record_flush(binson_record_writer *writer);
+
+/**
+ * @brief Writes the last block, the index and the trailer.
+ *
+ * Must be called once for every initiated writer, also after an error, to
+ * release the index and dictionary memory.
+ *
+ * @return true     The file is complete.
+ * @return false    See writer->error_flags.
+ */
+bool binson_record_writer_finish(binson_record_writer *writer);
+
+/**
+ * @brief Sink writing to a FILE stream. context is the FILE pointer.
+ */
+bool binson_record_file_sink(void *context, const uint8_t *data, size_t size);
+
+/**
+ * @brief Opens a record file, mapping it into memory where possible.
+ *
+ * Checks the header, the trailer and the index. Blocks are checked when
+ * they are read.
+ *
+ * @return true     The file is open, release it with binson_record_close().
+ * @return false    The file could not be read (BINSON_ERROR_NULL) or is not
+ *                  a valid record file (BINSON_ERROR_FORMAT), see
+ *                  file->error_flags.
+ */
+bool binson_record_open(binson_record_file *file, const char *path);
+
+/**
+ * @brief Opens a record file held in memory. data must outlive file.
+ *
+ * See binson_record_open().
+ */
+bool binson_record_open_buffer(binson_record_file *file,
+                               const uint8_t *data,
+                               size_t size);
+
+/**
+ * @brief Releases a record file opened with binson_record_open() or
+ *        binson_record_open_buffer().
+ */
+void binson_record_close(binson_record_file *file);
+
+/**
+ * @brief Validates a block and initiates a cursor over its records.
+ *
+ * Checks the block header, the CRC32C of its payload and that the record
+ * end offsets exactly fill it. The file is not modified, so several threads
+ * may read different blocks of one file at the same time.
+ *
+ * @param file      Open record file.
+ * @param n         Block number, less than file->block_count.
+ * @param block     Cursor to initiate.
+ *
+ * @return BINSON_ERROR_NONE when block holds the records of block n,
+ *         BINSON_ERROR_RANGE for n out of range or BINSON_ERROR_FORMAT for
+ *         a damaged block.
+ */
+binson_err binson_record_block_open(const binson_record_file *file,
+                                    size_t n,
+                                    binson_record_block *block);
+
+/**
+ * @brief Gets the next record of a block.
+ *
+ * The record is returned as stored. For blocks with a dictionary pass it
+ * to binson_record_decode() before parsing.
+ *
+ * @return true     record points into the file.
+ * @return false    No more records in the block.
+ */
+bool binson_record_block_next(binson_record_block *block, bbuf *record);
+
+/**
+ * @brief Finds the block holding record n by binary search over the index.
+ *
+ * @return Block number, or file->block_count if n is out of range.
+ */
+size_t binson_record_find_block(const binson_record_file *file, uint64_t n);
+
+/**
+ * @brief Gets record n.
+ *
+ * Finds the block with binson_record_find_block() and validates it the
+ * first time one of its records is read. Records the validation in file,
+ * so unlike binson_record_block_open() it must not be called by several
+ * threads on the same file.
+ *
+ * The record is returned as stored, see binson_record_read() for records
+ * in blocks with a dictionary.
+ *
+ * @return true     record points into the file.
+ * @return false    See file->error_flags.
+ */
+bool binson_record_get(binson_record_file *file, uint64_t n, bbuf *record);
+
+/**
+ * @brief Gets record n as binson, decoded if its block has a dictionary.
+ *
+ * @param file          Open record file.
+ * @param n             Record number.
+ * @param buffer        Destination for decoded records.
+ * @param buffer_size   Size of buffer.
+ * @param record        Points into the file, or into buffer for a decoded
+ *                      record.
+ *
+ * @return true     record holds the binson bytes of record n.
+ * @return false    See file->error_flags, BINSON_ERROR_RANGE also when
+ *                  buffer is too small.
+ */
+bool binson_record_read(binson_record_file *file,
+                        uint64_t n,
+                        uint8_t *buffer,
+                        size_t buffer_size,
+                        bbuf *record);
+
+/**
+ * @brief Restores the field names of a record from its block dictionary.
+ *
+ * Records of blocks without dictionary are returned as they are, without
+ * copying. Otherwise the record is expanded into buffer, which then holds
+ * exactly the bytes that were passed to binson_record_write().
+ *
+ * @param block         Block the record was read from.
+ * @param record        Record as returned by binson_record_block_next().
+ * @param buffer        Destination for the decoded record.
+ * @param buffer_size   Size of buffer.
+ * @param decoded       Points to the binson bytes of the record.
+ *
+ * @return BINSON_ERROR_NONE on success, BINSON_ERROR_RANGE if buffer is
+ *         too small or BINSON_ERROR_FORMAT for a bad token or reference.
+ */
+binson_err binson_record_decode(const binson_record_block *block,
+                                const bbuf *record,
+                                uint8_t *buffer,
+                                size_t buffer_size,
+                                bbuf *decoded);
+
+/**
+ * @brief Computes or continues a CRC32C (Castagnoli) checksum.
+ *
+ * @param crc   0 for a new checksum or the result of the previous call.
+ *
+ * @return Checksum of all data passed so far.
+ */
+uint32_t binson_record_crc32c(uint32_t crc, const uint8_t *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BINSON_RECORD_H_ */
@@ -0,0 +1,528 @@
+#ifndef BINSON_STRUCT_HPP
+#define BINSON_STRUCT_HPP
+
+/**
+ * @file binson_struct.hpp
+ *
+ * Direct (de)serialization of plain C++ structs without a Binson DOM.
+ *
+ *   struct Point { int64_t x; double y; std::string name; };
+ *   BINSON_FIELDS(Point, x, y, name)
+ *
+ *   binsonSerialize(point, &writer);
+ *   binson_err err = binsonDeserialize(point, data, size);
+ *
+ * BINSON_FIELDS must be used at global scope and lists up to 32 members.
+ * Supported member types are bool, integers, float/double, std::string,
+ * std::vector<uint8_t> (bytes), std::vector<T> (arrays), other reflected
+ * structs and BinsonOptional<T>. Field names are encoded at compile time
+ * and sorted into binson order once, on first use. Deserialization is a
+ * single forward parser pass merging the sorted input fields with the
+ * sorted field table. Unknown fields are skipped, a missing field that is
+ * not optional is a format error.
+ */
+
+#include <algorithm>
+#include <initializer_list>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include <binson_builder.hpp>
+#include <binson_light.h>
+
+/* Optional struct member, left out of the message when empty. */
+template <typename T>
+class BinsonOptional
+{
+public:
+    BinsonOptional() : m_present(false), m_value() { }
+    BinsonOptional(const T &value) : m_present(true), m_value(value) { }
+
+    BinsonOptional & operator=(const T &value)
+    {
+        m_present = true;
+        m_value = value;
+        return *this;
+    }
+
+    bool hasValue() const { return m_present; }
+    explicit operator bool() const { return m_present; }
+    const T & value() const { return m_value; }
+    T & value() { return m_value; }
+
+    T & emplace()
+    {
+        m_present = true;
+        m_value = T();
+        return m_value;
+    }
+    void reset()
+    {
+        m_present = false;
+        m_value = T();
+    }
+
+private:
+    bool m_present;
+    T m_value;
+};
+
+/* Specialized for each reflected struct by BINSON_FIELDS. */
+template <typename T>
+struct BinsonStructTraits;
+
+template <typename M, typename Enable = void>
+struct BinsonCodec;
+
+template <typename T>
+struct BinsonStructField
+{
+    BinsonFieldName name;
+    bool (*present)(const T &object);
+    void (*write)(BinsonBuilder::Object &out, const BinsonFieldName &name, const T &object);
+    binson_err (*read)(binson_parser *p, T &object);
+    /* Called for fields missing in the input, false if the field is required. */
+    bool (*missing)(T &object);
+
+    template <typename M, M T::*Member>
+    static BinsonStructField make(const BinsonFieldName &name)
+    {
+        return BinsonStructField{ name, &presentMember<M, Member>, &writeMember<M, Member>,
+                                  &readMember<M, Member>, &missingMember<M, Member> };
+    }
+
+private:
+    template <typename M, M T::*Member>
+    static bool presentMember(const T &object)
+    {
+        return BinsonCodec<M>::present(object.*Member);
+    }
+    template <typename M, M T::*Member>
+    static void writeMember(BinsonBuilder::Object &out, const BinsonFieldName &name, const T &object)
+    {
+        BinsonCodec<M>::writeField(out, name, object.*Member);
+    }
+    template <typename M, M T::*Member>
+    static binson_err readMember(binson_parser *p, T &object)
+    {
+        return BinsonCodec<M>::read(p, object.*Member);
+    }
+    template <typename M, M T::*Member>
+    static bool missingMember(T &object)
+    {
+        return BinsonCodec<M>::missing(object.*Member);
+    }
+};
+
+/* Field table of a reflected struct in binson name order. */
+template <typename T>
+class BinsonStructTable
+{
+public:
+    BinsonStructTable(std::initializer_list<BinsonStructField<T>> fields)
+        : m_fields(fields)
+    {
+        std::sort(m_fields.begin(), m_fields.end(),
+                  [](const BinsonStructField<T> &a, const BinsonStructField<T> &b)
+                  { return compare(a.name, b.name.data(), b.name.size()) < 0; });
+    }
+
+    const std::vector<BinsonStructField<T>> & fields() const { return m_fields; }
+
+    /* Same order as the parser enforces: bytewise, shorter name first. */
+    static int compare(const BinsonFieldName &a, const char *b, size_t size)
+    {
+        int r = memcmp(a.data(), b, std::min(a.size(), size));
+        if (r != 0)
+            return r;
+        return (a.size() < size) ? -1 : (a.size() > size) ? 1 : 0;
+    }
+
+private:
+    std::vector<BinsonStructField<T>> m_fields;
+};
+
+template <typename T>
+void binsonWriteFields(BinsonBuilder::Object &out, const T &object)
+{
+    for (const BinsonStructField<T> &field : BinsonStructTraits<T>::table().fields())
+    {
+        if (field.present(object))
+            field.write(out, field.name, object);
+    }
+}
+
+/* Reads the fields of an object the parser has entered. */
+template <typename T>
+binson_err binsonReadFields(binson_parser *p, T &object)
+{
+    const std::vector<BinsonStructField<T>> &fields = BinsonStructTraits<T>::table().fields();
+    size_t i = 0;
+
+    while (binson_parser_next(p))
+    {
+        bbuf *name = binson_parser_get_name(p);
+        const char *data = reinterpret_cast<const char*>(name->bptr);
+        int r = 1;
+
+        for (; i < fields.size(); i++)
+        {
+            r = BinsonStructTable<T>::compare(fields[i].name, data, name->bsize);
+            if (r >= 0)
+                break;
+            if (!fields[i].missing(object))
+                return BINSON_ERROR_FORMAT;
+        }
+
+        if (r == 0)
+        {
+            binson_err err = fields[i++].read(p, object);
+            if (err != BINSON_ERROR_NONE)
+                return err;
+        }
+    }
+
+    if (p->error_flags != BINSON_ERROR_NONE)
+        return p->error_flags;
+
+    for (; i < fields.size(); i++)
+    {
+        if (!fields[i].missing(object))
+            return BINSON_ERROR_FORMAT;
+    }
+
+    return BINSON_ERROR_NONE;
+}
+
+/*
+ * Codecs. present() and missing() only matter for BinsonOptional, read()
+ * is called with the parser positioned at the value.
+ */
+template <typename M>
+struct BinsonCodecBase
+{
+    static bool present(const M &) { return true; }
+    static bool missing(M &) { return false; }
+    static void writeField(BinsonBuilder::Object &out, const BinsonFieldName &name, const M &value)
+    {
+        out.field(name, value);
+    }
+    static void writeElement(BinsonBuilder::Array &out, const M &value)
+    {
+        out.value(value);
+    }
+
+protected:
+    static binson_err expect(binson_parser *p, binson_type type)
+    {
+        return (binson_parser_get_type(p) == type) ? BINSON_ERROR_NONE : BINSON_ERROR_WRONG_TYPE;
+    }
+};
+
+template <>
+struct BinsonCodec<bool> : BinsonCodecBase<bool>
+{
+    static binson_err read(binson_parser *p, bool &value)
+    {
+        binson_err err = expect(p, BINSON_TYPE_BOOLEAN);
+        if (err == BINSON_ERROR_NONE)
+            value = binson_parser_get_boolean(p);
+        return err;
+    }
+};
+
+template <typename M>
+struct BinsonCodec<M, typename std::enable_if<std::is_integral<M>::value &&
+                                              !std::is_same<M, bool>::value>::type>
+    : BinsonCodecBase<M>
+{
+    static binson_err read(binson_parser *p, M &value)
+    {
+        binson_err err = BinsonCodecBase<M>::expect(p, BINSON_TYPE_INTEGER);
+        if (err != BINSON_ERROR_NONE)
+            return err;
+
+        int64_t i = binson_parser_get_integer(p);
+        bool fits = std::is_signed<M>::value ?
+            ((i >= static_cast<int64_t>(std::numeric_limits<M>::min())) &&
+             (i <= static_cast<int64_t>(std::numeric_limits<M>::max()))) :
+            ((i >= 0) &&
+             (static_cast<uint64_t>(i) <= static_cast<uint64_t>(std::numeric_limits<M>::max())));
+        if (!fits)
+            return BINSON_ERROR_RANGE;
+
+        value = static_cast<M>(i);
+        return BINSON_ERROR_NONE;
+    }
+};
+
+template <typename M>
+struct BinsonCodec<M, typename std::enable_if<std::is_floating_point<M>::value>::type>
+    : BinsonCodecBase<M>
+{
+    static binson_err read(binson_parser *p, M &value)
+    {
+        binson_err err = BinsonCodecBase<M>::expect(p, BINSON_TYPE_DOUBLE);
+        if (err == BINSON_ERROR_NONE)
+            value = static_cast<M>(binson_parser_get_double(p));
+        return err;
+    }
+};
+
+template <>
+struct BinsonCodec<std::string> : BinsonCodecBase<std::string>
+{
+    static binson_err read(binson_parser *p, std::string &value)
+    {
+        binson_err err = expect(p, BINSON_TYPE_STRING);
+        if (err == BINSON_ERROR_NONE)
+        {
+            bbuf *buf = binson_parser_get_string_bbuf(p);
+            value.assign(reinterpret_cast<const char*>(buf->bptr), buf->bsize);
+        }
+        return err;
+    }
+};
+
+template <>
+struct BinsonCodec<std::vector<uint8_t>> : BinsonCodecBase<std::vector<uint8_t>>
+{
+    static binson_err read(binson_parser *p, std::vector<uint8_t> &value)
+    {
+        binson_err err = expect(p, BINSON_TYPE_BYTES);
+        if (err == BINSON_ERROR_NONE)
+        {
+            bbuf *buf = binson_parser_get_bytes_bbuf(p);
+            value.assign(buf->bptr, buf->bptr + buf->bsize);
+        }
+        return err;
+    }
+};
+
+template <typename E>
+struct BinsonCodec<std::vector<E>> : BinsonCodecBase<std::vector<E>>
+{
+    static void writeField(BinsonBuilder::Object &out, const BinsonFieldName &name,
+                           const std::vector<E> &value)
+    {
+        BinsonBuilder::Array array = out.array(name);
+        writeElements(array, value);
+    }
+    static void writeElement(BinsonBuilder::Array &out, const std::vector<E> &value)
+    {
+        BinsonBuilder::Array array = out.array();
+        writeElements(array, value);
+    }
+    static binson_err read(binson_parser *p, std::vector<E> &value)
+    {
+        binson_err err = BinsonCodecBase<std::vector<E>>::expect(p, BINSON_TYPE_ARRAY);
+        if (err != BINSON_ERROR_NONE)
+            return err;
+        if (!binson_parser_go_into_array(p))
+            return p->error_flags;
+
+        value.clear();
+        while (binson_parser_next(p))
+        {
+            value.emplace_back();
+            err = BinsonCodec<E>::read(p, value.back());
+            if (err != BINSON_ERROR_NONE)
+                return err;
+        }
+
+        if (!binson_parser_leave_array(p))
+            return (p->error_flags != BINSON_ERROR_NONE) ? p->error_flags : BINSON_ERROR_STATE;
+        return BINSON_ERROR_NONE;
+    }
+
+private:
+    static void writeElements(BinsonBuilder::Array &out, const std::vector<E> &value)
+    {
+        for (const E &element : value)
+            BinsonCodec<E>::writeElement(out, element);
+    }
+};
+
+template <typename E>
+struct BinsonCodec<BinsonOptional<E>>
+{
+    static bool present(const BinsonOptional<E> &value) { return value.hasValue(); }
+    static bool missing(BinsonOptional<E> &value)
+    {
+        value.reset();
+        return true;
+    }
+    static void writeField(BinsonBuilder::Object &out, const BinsonFieldName &name,
+                           const BinsonOptional<E> &value)
+    {
+        BinsonCodec<E>::writeField(out, name, value.value());
+    }
+    static binson_err read(binson_parser *p, BinsonOptional<E> &value)
+    {
+        return BinsonCodec<E>::read(p, value.emplace());
+    }
+};
+
+/* Reflected structs, see BINSON_FIELDS. */
+template <typename M, typename Enable>
+struct BinsonCodec : BinsonCodecBase<M>
+{
+    static void writeField(BinsonBuilder::Object &out, const BinsonFieldName &name, const M &value)
+    {
+        BinsonBuilder::Object object = out.object(name);
+        binsonWriteFields(object, value);
+    }
+    static void writeElement(BinsonBuilder::Array &out, const M &value)
+    {
+        BinsonBuilder::Object object = out.object();
+        binsonWriteFields(object, value);
+    }
+    static binson_err read(binson_parser *p, M &value)
+    {
+        binson_err err = BinsonCodecBase<M>::expect(p, BINSON_TYPE_OBJECT);
+        if (err != BINSON_ERROR_NONE)
+            return err;
+        if (!binson_parser_go_into_object(p))
+            return p->error_flags;
+
+        err = binsonReadFields(p, value);
+        if (err != BINSON_ERROR_NONE)
+            return err;
+
+        if (!binson_parser_leave_object(p))
+            return (p->error_flags != BINSON_ERROR_NONE) ? p->error_flags : BINSON_ERROR_STATE;
+        return BINSON_ERROR_NONE;
+    }
+};
+
+/*
+ * Writes object as a top level binson object. Returns false on writer
+ * errors, binson_writer_get_counter() then holds the required size.
+ */
+template <typename T>
+bool binsonSerialize(const T &object, binson_writer *writer)
+{
+    BinsonBuilder builder(writer);
+    {
+        BinsonBuilder::Object root = builder.object();
+        binsonWriteFields(root, object);
+    }
+    return builder.ok();
+}
+
+template <typename T>
+std::vector<uint8_t> binsonSerialize(const T &object)
+{
+    uint8_t empty;
+    binson_writer w;
+    binson_writer_init(&w, &empty, 0);
+    binsonSerialize(object, &w);
+
+    std::vector<uint8_t> data(binson_writer_get_counter(&w));
+    binson_writer_init(&w, data.data(), data.size());
+    binsonSerialize(object, &w);
+    return data;
+}
+
+/*
+ * Reads object from a parser positioned before a top level object, see
+ * Binson::tryDeserialize(binson_parser*).
+ */
+template <typename T>
+binson_err binsonDeserialize(T &object, binson_parser *p)
+{
+    if (p == nullptr)
+        return BINSON_ERROR_NULL;
+    if (!binson_parser_go_into_object(p))
+        return (p->error_flags != BINSON_ERROR_NONE) ? p->error_flags : BINSON_ERROR_STATE;
+
+    binson_err err = binsonReadFields(p, object);
+    if (err != BINSON_ERROR_NONE)
+        return err;
+
+    if (!binson_parser_leave_object(p))
+        return (p->error_flags != BINSON_ERROR_NONE) ? p->error_flags : BINSON_ERROR_STATE;
+    return BINSON_ERROR_NONE;
+}
+
+template <typename T>
+binson_err binsonDeserialize(T &object, const uint8_t *data, size_t size)
+{
+    binson_parser p;
+
+    if (data == nullptr)
+        return BINSON_ERROR_NULL;
+    if (!binson_parser_init(&p, data, size))
+        return (p.error_flags != BINSON_ERROR_NONE) ? p.error_flags : BINSON_ERROR_FORMAT;
+
+    return binsonDeserialize(object, &p);
+}
+
+template <typename T>
+binson_err binsonDeserialize(T &object, const std::vector<uint8_t> &data)
+{
+    return binsonDeserialize(object, data.data(), data.size());
+}
+
+/*======= Field list macros =================================================*/
+
+#define BINSON_STRUCT_CAT_(a, b) a ## b
+#define BINSON_STRUCT_CAT(a, b) BINSON_STRUCT_CAT_(a, b)
+#define BINSON_STRUCT_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, N, ...) N
+#define BINSON_STRUCT_NARGS(...) BINSON_STRUCT_NARGS_(__VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define BINSON_STRUCT_FOR_EACH(m, T, ...) \
+    BINSON_STRUCT_CAT(BINSON_STRUCT_FE_, BINSON_STRUCT_NARGS(__VA_ARGS__))(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_1(m, T, x) m(T, x)
+#define BINSON_STRUCT_FE_2(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_1(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_3(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_2(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_4(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_3(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_5(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_4(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_6(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_5(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_7(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_6(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_8(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_7(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_9(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_8(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_10(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_9(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_11(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_10(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_12(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_11(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_13(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_12(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_14(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_13(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_15(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_14(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_16(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_15(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_17(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_16(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_18(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_17(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_19(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_18(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_20(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_19(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_21(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_20(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_22(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_21(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_23(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_22(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_24(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_23(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_25(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_24(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_26(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_25(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_27(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_26(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_28(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_27(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_29(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_28(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_30(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_29(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_31(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_30(m, T, __VA_ARGS__)
+#define BINSON_STRUCT_FE_32(m, T, x, ...) m(T, x), BINSON_STRUCT_FE_31(m, T, __VA_ARGS__)
+
+#define BINSON_STRUCT_FIELD(T, member) \
+    BinsonStructField<T>::make<decltype(T::member), &T::member>(#member)
+
+#define BINSON_FIELDS(T, ...)                                                   \
+    template <>                                                                 \
+    struct BinsonStructTraits<T>                                                \
+    {                                                                           \
+        static const BinsonStructTable<T> & table()                             \
+        {                                                                       \
+            static const BinsonStructTable<T> fields({                          \
+                BINSON_STRUCT_FOR_EACH(BINSON_STRUCT_FIELD, T, __VA_ARGS__)     \
+            });                                                                 \
+            return fields;                                                      \
+        }                                                                       \
+    };
+
+#endif /* BINSON_STRUCT_HPP */
@@ -0,0 +1,185 @@
+#ifndef BINSON_VISITOR_HPP
+#define BINSON_VISITOR_HPP
+
+/**
+ * @file binson_visitor.hpp
+ *
+ * Event (SAX style) traversal of a binson object with a statically
+ * dispatched visitor.
+ *
+ * The visitor is a template parameter, so each callback is a direct,
+ * inlinable call instead of the indirect parser->cb hook. Derive from
+ * BinsonVisitor and override (hide) the callbacks of interest:
+ *
+ *   struct Counter : BinsonVisitor {
+ *       int64_t sum = 0;
+ *       BinsonVisit onField(const bbuf &name) { ... return BinsonVisit::Skip; }
+ *       BinsonVisit onInt(int64_t v) { sum += v; return BinsonVisit::Continue; }
+ *   };
+ *
+ *   Counter c;
+ *   binson_err err = binsonVisit(data, size, c);
+ *
+ * Every callback returns a BinsonVisit:
+ *   Continue  go on with the traversal.
+ *   Skip      from onField: the field's value is not reported.
+ *             from onObjectBegin/onArrayBegin: the block is not entered and
+ *             its end callback is not called. The parser steps over the
+ *             skipped subtree without reporting it.
+ *   Stop      end the traversal, binsonVisit() returns BINSON_ERROR_NONE.
+ *             From other callbacks Skip is the same as Continue.
+ */
+
+#include <stdint.h>
+
+#include <binson_light.h>
+
+enum class BinsonVisit
+{
+    Continue,
+    Skip,
+    Stop
+};
+
+/* Default callbacks, all continue. */
+struct BinsonVisitor
+{
+    BinsonVisit onObjectBegin() { return BinsonVisit::Continue; }
+    BinsonVisit onObjectEnd() { return BinsonVisit::Continue; }
+    BinsonVisit onArrayBegin() { return BinsonVisit::Continue; }
+    BinsonVisit onArrayEnd() { return BinsonVisit::Continue; }
+    BinsonVisit onField(const bbuf &) { return BinsonVisit::Continue; }
+    BinsonVisit onBool(bool) { return BinsonVisit::Continue; }
+    BinsonVisit onInt(int64_t) { return BinsonVisit::Continue; }
+    BinsonVisit onDouble(double) { return BinsonVisit::Continue; }
+    BinsonVisit onString(const bbuf &) { return BinsonVisit::Continue; }
+    BinsonVisit onBytes(const bbuf &) { return BinsonVisit::Continue; }
+};
+
+template <typename Visitor>
+class BinsonVisitEngine
+{
+public:
+    BinsonVisitEngine(binson_parser *p, Visitor &visitor) : m_p(p), m_v(visitor) { }
+
+    /* Visits the object the parser is positioned before. */
+    binson_err run()
+    {
+        BinsonVisit r = m_v.onObjectBegin();
+        if (r != BinsonVisit::Continue)
+            return BINSON_ERROR_NONE;
+
+        if (!binson_parser_go_into_object(m_p))
+            return error();
+        r = block(true);
+        return (r == BinsonVisit::Stop) ? result() : BINSON_ERROR_NONE;
+    }
+
+private:
+    binson_err error() const
+    {
+        return (m_p->error_flags != BINSON_ERROR_NONE) ? m_p->error_flags : BINSON_ERROR_STATE;
+    }
+
+    /* Stop is also used to unwind on parser errors, m_error tells them apart. */
+    binson_err result() const { return m_error; }
+
+    BinsonVisit fail()
+    {
+        m_error = error();
+        return BinsonVisit::Stop;
+    }
+
+    /* Items of an entered object or array, then its end callback. */
+    BinsonVisit block(bool object)
+    {
+        while (binson_parser_next(m_p))
+        {
+            if (object)
+            {
+                BinsonVisit r = m_v.onField(*binson_parser_get_name(m_p));
+                if (r == BinsonVisit::Stop)
+                    return r;
+                if (r == BinsonVisit::Skip)
+                    continue;
+            }
+            if (value() == BinsonVisit::Stop)
+                return BinsonVisit::Stop;
+        }
+
+        if (m_p->error_flags != BINSON_ERROR_NONE)
+            return fail();
+        if (!(object ? binson_parser_leave_object(m_p) : binson_parser_leave_array(m_p)))
+            return fail();
+
+        return (object ? m_v.onObjectEnd() : m_v.onArrayEnd()) == BinsonVisit::Stop ?
+               BinsonVisit::Stop : BinsonVisit::Continue;
+    }
+
+    BinsonVisit value()
+    {
+        BinsonVisit r;
+
+        switch (binson_parser_get_type(m_p))
+        {
+        case BINSON_TYPE_OBJECT:
+            r = m_v.onObjectBegin();
+            if (r != BinsonVisit::Continue)
+                return r;
+            if (!binson_parser_go_into_object(m_p))
+                return fail();
+            return block(true);
+        case BINSON_TYPE_ARRAY:
+            r = m_v.onArrayBegin();
+            if (r != BinsonVisit::Continue)
+                return r;
+            if (!binson_parser_go_into_array(m_p))
+                return fail();
+            return block(false);
+        case BINSON_TYPE_BOOLEAN:
+            return m_v.onBool(binson_parser_get_boolean(m_p));
+        case BINSON_TYPE_INTEGER:
+            return m_v.onInt(binson_parser_get_integer(m_p));
+        case BINSON_TYPE_DOUBLE:
+            return m_v.onDouble(binson_parser_get_double(m_p));
+        case BINSON_TYPE_STRING:
+            return m_v.onString(*binson_parser_get_string_bbuf(m_p));
+        case BINSON_TYPE_BYTES:
+            return m_v.onBytes(*binson_parser_get_bytes_bbuf(m_p));
+        default:
+            return fail();
+        }
+    }
+
+    binson_parser *m_p;
+    Visitor &m_v;
+    binson_err m_error = BINSON_ERROR_NONE;
+};
+
+/*
+ * Visits the top level object of a parser positioned before it (fresh or
+ * reset). Returns BINSON_ERROR_NONE when the traversal completed or was
+ * stopped by the visitor, otherwise the parser error.
+ */
+template <typename Visitor>
+binson_err binsonVisit(binson_parser *p, Visitor &visitor)
+{
+    if (p == nullptr)
+        return BINSON_ERROR_NULL;
+    return BinsonVisitEngine<Visitor>(p, visitor).run();
+}
+
+template <typename Visitor>
+binson_err binsonVisit(const uint8_t *data, size_t size, Visitor &visitor)
+{
+    binson_parser p;
+
+    if (data == nullptr)
+        return BINSON_ERROR_NULL;
+    if (!binson_parser_init(&p, data, size))
+        return (p.error_flags != BINSON_ERROR_NONE) ? p.error_flags : BINSON_ERROR_FORMAT;
+
+    return binsonVisit(&p, visitor);
+}
+
+#endif /* BINSON_VISITOR_HPP */
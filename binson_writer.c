@@ -9,9 +9,27 @@
 
 #include <string.h>
 #include "binson_writer.h"
+#include "binson_cpu.h"
+
+#ifdef BINSON_CPU_X86_DISPATCH
+#include <immintrin.h>
+#endif
 
 /*======= Local Macro Definitions ===========================================*/
+
+/* Number of integers classified per pass of the bulk array writer. */
+#define BINSON_WIDTH_BLOCK  (256U)
+
 /*======= Type Definitions ==================================================*/
+
+/*
+ * Classifies count integers, stores the width code (0..3 for 1, 2, 4 and 8
+ * bytes) of each in codes and returns the encoded size of all of them.
+ */
+typedef size_t (*binson_width_fn)(const int64_t *values,
+                                  size_t count,
+                                  uint8_t *codes);
+
 /*======= Local function prototypes =========================================*/
 /*======= Local variable declarations =======================================*/
 
@@ -20,6 +38,15 @@ static bool _write_token(binson_writer *writer,
                          binson_type type);
 
 static bool _write(binson_writer *writer, bbuf *data);
+static bool _reserve(binson_writer *writer, size_t size, uint8_t **out);
+static uint8_t *_put_le(uint8_t *out, uint64_t value, size_t size);
+static size_t _int_widths(const int64_t *values, size_t count, uint8_t *codes);
+
+#ifdef BINSON_CPU_X86_DISPATCH
+static size_t _int_widths_avx2(const int64_t *values,
+                               size_t count,
+                               uint8_t *codes);
+#endif
 
 /*======= Global function implementations ===================================*/
 
@@ -264,6 +291,100 @@ bool binson_writer_verify(binson_writer *writer)
     return binson_parser_verify(&p);
 }
 
+bool binson_write_int64_array(binson_writer *writer,
+                              const int64_t *values,
+                              size_t count)
+{
+    uint8_t codes[BINSON_WIDTH_BLOCK];
+    binson_width_fn widths = _int_widths;
+    uint8_t *out;
+    size_t size = 2;
+    size_t i;
+    size_t j;
+
+    if (NULL == writer) {
+        return false;
+    }
+
+    if ((NULL == values) && (count > 0)) {
+        writer->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+
+    if (count > (SIZE_MAX - 2) / (1 + sizeof(int64_t))) {
+        writer->error_flags = BINSON_ERROR_RANGE;
+        return false;
+    }
+
+#ifdef BINSON_CPU_X86_DISPATCH
+    if (binson_cpu_has_avx2()) {
+        widths = _int_widths_avx2;
+    }
+#endif
+
+    /* First pass sizes the array, the second emits it. */
+    for (i = 0; i < count; i += BINSON_WIDTH_BLOCK) {
+        size_t n = count - i;
+        n = (n < BINSON_WIDTH_BLOCK) ? n : BINSON_WIDTH_BLOCK;
+        size += widths(&values[i], n, codes);
+    }
+
+    if (!_reserve(writer, size, &out)) {
+        return false;
+    }
+
+    *out++ = BINSON_DEF_ARRAY_BEGIN;
+    for (i = 0; i < count; i += BINSON_WIDTH_BLOCK) {
+        size_t n = count - i;
+        n = (n < BINSON_WIDTH_BLOCK) ? n : BINSON_WIDTH_BLOCK;
+        widths(&values[i], n, codes);
+        for (j = 0; j < n; j++) {
+            *out++ = (uint8_t) (BINSON_DEF_INT8 + codes[j]);
+            out = _put_le(out, (uint64_t) values[i + j], (size_t) 1U << codes[j]);
+        }
+    }
+    *out = BINSON_DEF_ARRAY_END;
+
+    return true;
+}
+
+bool binson_write_double_array(binson_writer *writer,
+                               const double *values,
+                               size_t count)
+{
+    binson_value bval;
+    uint8_t *out;
+    size_t i;
+
+    if (NULL == writer) {
+        return false;
+    }
+
+    if ((NULL == values) && (count > 0)) {
+        writer->error_flags = BINSON_ERROR_NULL;
+        return false;
+    }
+
+    if (count > (SIZE_MAX - 2) / (1 + sizeof(double))) {
+        writer->error_flags = BINSON_ERROR_RANGE;
+        return false;
+    }
+
+    if (!_reserve(writer, 2 + count * (1 + sizeof(double)), &out)) {
+        return false;
+    }
+
+    *out++ = BINSON_DEF_ARRAY_BEGIN;
+    for (i = 0; i < count; i++) {
+        bval.double_value = values[i];
+        *out++ = BINSON_DEF_DOUBLE;
+        out = _put_le(out, (uint64_t) bval.integer_value, sizeof(double));
+    }
+    *out = BINSON_DEF_ARRAY_END;
+
+    return true;
+}
+
 /*======= Local function implementations ====================================*/
 
 static uint8_t _int_pack_size(int64_t length, uint8_t *buffer, bool is_double)
@@ -291,13 +412,7 @@ static uint8_t _int_pack_size(int64_t length, uint8_t *buffer, bool is_double)
         }
     }
 
-    uint64_t uval = (uint64_t) length;
-
-    uint8_t i;
-    for (i = 0; i < size; i++) {
-        buffer[1 + i] = (uint8_t) (uval & 0xFFU);
-        uval >>= 8U;
-    }
+    _put_le(&buffer[1], (uint64_t) length, size);
 
     return 1 + size;
 
@@ -393,3 +508,122 @@ static bool _write(binson_writer *writer, bbuf *data)
     writer->buffer_used += data->bsize;
     return (writer->error_flags == BINSON_ERROR_NONE);
 }
+
+/*
+ * Same accounting as _write(): on failure the counter still advances so
+ * binson_writer_get_counter() reports the size the output needs.
+ */
+static bool _reserve(binson_writer *writer, size_t size, uint8_t **out)
+{
+    size_t c = writer->buffer_used + size;
+
+    if ((c > writer->buffer_size) || (c < writer->buffer_used)) {
+        writer->error_flags = BINSON_ERROR_RANGE;
+    }
+
+    if (NULL == writer->buffer) {
+        writer->error_flags = BINSON_ERROR_NULL;
+    }
+
+    *out = (writer->error_flags == BINSON_ERROR_NONE) ?
+        &writer->buffer[writer->buffer_used] : NULL;
+
+    writer->buffer_used += size;
+    return (writer->error_flags == BINSON_ERROR_NONE);
+}
+
+static uint8_t *_put_le(uint8_t *out, uint64_t value, size_t size)
+{
+#ifdef BINSON_LITTLE_ENDIAN
+    uint8_t u8;
+    uint16_t u16;
+    uint32_t u32;
+
+    switch (size) {
+        case 1:
+            u8 = (uint8_t) value;
+            memcpy(out, &u8, sizeof(u8));
+            return &out[size];
+        case 2:
+            u16 = (uint16_t) value;
+            memcpy(out, &u16, sizeof(u16));
+            return &out[size];
+        case 4:
+            u32 = (uint32_t) value;
+            memcpy(out, &u32, sizeof(u32));
+            return &out[size];
+        case 8:
+            memcpy(out, &value, sizeof(value));
+            return &out[size];
+        default:
+            break;
+    }
+#endif
+
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        out[i] = (uint8_t) (value & 0xFFU);
+        value >>= 8U;
+    }
+
+    return &out[size];
+}
+
+static size_t _int_widths(const int64_t *values, size_t count, uint8_t *codes)
+{
+    size_t size = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        /* ~v needs the same number of bytes as a negative v. */
+        uint64_t x = (values[i] < 0) ? ~(uint64_t) values[i] : (uint64_t) values[i];
+        uint8_t code = (uint8_t) ((x > (uint64_t) INT8_MAX) +
+                                  (x > (uint64_t) INT16_MAX) +
+                                  (x > (uint64_t) INT32_MAX));
+        codes[i] = code;
+        size += 1 + ((size_t) 1U << code);
+    }
+
+    return size;
+}
+
+#ifdef BINSON_CPU_X86_DISPATCH
+__attribute__((target("avx2")))
+static size_t _int_widths_avx2(const int64_t *values,
+                               size_t count,
+                               uint8_t *codes)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max8 = _mm256_set1_epi64x(INT8_MAX);
+    const __m256i max16 = _mm256_set1_epi64x(INT16_MAX);
+    const __m256i max32 = _mm256_set1_epi64x(INT32_MAX);
+    size_t size = 0;
+    size_t i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) &values[i]);
+        __m256i x = _mm256_xor_si256(v, _mm256_cmpgt_epi64(zero, v));
+        unsigned m8 = (unsigned) _mm256_movemask_pd(
+            _mm256_castsi256_pd(_mm256_cmpgt_epi64(x, max8)));
+        unsigned m16 = (unsigned) _mm256_movemask_pd(
+            _mm256_castsi256_pd(_mm256_cmpgt_epi64(x, max16)));
+        unsigned m32 = (unsigned) _mm256_movemask_pd(
+            _mm256_castsi256_pd(_mm256_cmpgt_epi64(x, max32)));
+        unsigned k;
+
+        for (k = 0; k < 4; k++) {
+            codes[i + k] = (uint8_t) (((m8 >> k) & 1U) +
+                                      ((m16 >> k) & 1U) +
+                                      ((m32 >> k) & 1U));
+        }
+
+        /* Tag and one byte each, plus 1, 2 and 4 bytes per wider step. */
+        size += 8 + (size_t) __builtin_popcount(m8) +
+                2 * (size_t) __builtin_popcount(m16) +
+                4 * (size_t) __builtin_popcount(m32);
+    }
+
+    return size + _int_widths(&values[i], count - i, &codes[i]);
+}
+#endif
@@ -56,6 +56,36 @@ bool binson_parser_to_writer(binson_parser *parser, binson_writer *writer);
 bool binson_write_raw(binson_writer *writer, const uint8_t *psrc, size_t length);
 bool binson_writer_verify(binson_writer *writer);
 
+/**
+ * @brief Writes a complete array of integers in one call.
+ *
+ * Produces the same bytes as binson_write_array_begin(), one
+ * binson_write_integer() per value and binson_write_array_end(), with each
+ * integer in its smallest encoding. The exact size of the array is computed
+ * up front, so the buffer is checked once and nothing is written when the
+ * array does not fit. As with the other write functions the counter is
+ * advanced by the full size in that case, and BINSON_ERROR_RANGE is set.
+ *
+ * @param writer    Pointer to binson writer structure.
+ * @param values    Integers to write.
+ * @param count     Number of values.
+ *
+ * @return true     The array was written.
+ * @return false    An error occured.
+ */
+bool binson_write_int64_array(binson_writer *writer,
+                              const int64_t *values,
+                              size_t count);
+
+/**
+ * @brief Writes a complete array of doubles in one call.
+ *
+ * See binson_write_int64_array().
+ */
+bool binson_write_double_array(binson_writer *writer,
+                               const double *values,
+                               size_t count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,67 @@
+# Generates the single header binson_light_amalgamated.h from the split
+# parser and writer sources. Run in script mode at build time:
+#
+#   cmake -DSOURCE_DIR=<source dir> -DOUTPUT=<header> -P amalgamate.cmake
+#
+# The public headers come first, followed by the implementation guarded by
+# BINSON_LIGHT_IMPLEMENTATION. Includes between the amalgamated files are
+# dropped, system includes are kept.
+
+if(NOT SOURCE_DIR OR NOT OUTPUT)
+  message(FATAL_ERROR "amalgamate.cmake needs SOURCE_DIR and OUTPUT")
+endif()
+
+set(AMALGAMATED_HEADERS binson_defines.h binson_cpu.h binson_parser.h binson_writer.h)
+set(AMALGAMATED_SOURCES binson_parser.c binson_writer.c)
+
+function(amalgamate_append file)
+  file(READ "${SOURCE_DIR}/${file}" content)
+  string(REGEX REPLACE "#include \"binson_[a-z_]+\\.h\"[^\n]*\n" "" content "${content}")
+  file(APPEND "${OUTPUT}.tmp" "/*======= ${file} */\n\n${content}\n")
+endfunction()
+
+file(WRITE "${OUTPUT}.tmp"
+"/**
+ * @file binson_light_amalgamated.h
+ *
+ * Single header build of binson-c-light, generated from the split sources
+ * by cmake/amalgamate.cmake. Do not edit.
+ *
+ * Include it wherever the parser or writer API is used. In exactly one C
+ * file define BINSON_LIGHT_IMPLEMENTATION before including it to compile
+ * the parser and the writer into that translation unit:
+ *
+ *   #define BINSON_LIGHT_IMPLEMENTATION
+ *   #include \"binson_light_amalgamated.h\"
+ *
+ * When the application code lives in the same translation unit, or the
+ * build uses link time optimization, the compiler can inline across the
+ * parser, the writer and the application.
+ */
+
+#ifndef BINSON_LIGHT_AMALGAMATED_H
+#define BINSON_LIGHT_AMALGAMATED_H
+
+")
+
+foreach(file ${AMALGAMATED_HEADERS})
+  amalgamate_append(${file})
+endforeach()
+
+file(APPEND "${OUTPUT}.tmp"
+"#endif /* BINSON_LIGHT_AMALGAMATED_H */
+
+#if defined(BINSON_LIGHT_IMPLEMENTATION) && !defined(BINSON_LIGHT_AMALGAMATED_IMPLEMENTED)
+#define BINSON_LIGHT_AMALGAMATED_IMPLEMENTED
+
+")
+
+foreach(file ${AMALGAMATED_SOURCES})
+  amalgamate_append(${file})
+endforeach()
+
+file(APPEND "${OUTPUT}.tmp" "#endif /* BINSON_LIGHT_IMPLEMENTATION */\n")
+
+# Only touch the header when it changed, so dependents are not rebuilt.
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different "${OUTPUT}.tmp" "${OUTPUT}")
+file(REMOVE "${OUTPUT}.tmp")
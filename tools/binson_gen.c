@@ -0,0 +1,813 @@
+/**
+ * @file binson_gen.c
+ *
+ * Generates C structs and encode/decode functions from a message schema.
+ *
+ * Usage: binson_gen <schema file> <output base>
+ *
+ * Writes <output base>.h and <output base>.c. Schema syntax:
+ *
+ *   # comment
+ *   message Inner {
+ *       int id;
+ *       string<16> label;
+ *   }
+ *
+ *   message Outer {
+ *       bool flag;
+ *       double ratio;
+ *       bytes<32> key;
+ *       int values[8];
+ *       optional Inner inner;
+ *       Inner items[4];
+ *   }
+ *
+ * Types are bool, int (int64_t), double, string<N>, bytes<N> and earlier
+ * messages. A field followed by [N] is an array of at most N elements and
+ * "optional" fields may be left out. Fields are sorted into binson order
+ * and their encoded names are precomputed, decoding is a single pass
+ * merging the parsed fields with the sorted field list. <MESSAGE>_MAX_SIZE
+ * holds the largest possible encoded size of each message.
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define GEN_MAX_IDENT       64
+#define GEN_MAX_FIELDS      64
+#define GEN_MAX_MESSAGES    64
+#define GEN_MAX_CAPACITY    (1024U * 1024U)
+
+/*======= Type Definitions ==================================================*/
+
+typedef enum gen_kind_e {
+    GEN_BOOL,
+    GEN_INT,
+    GEN_DOUBLE,
+    GEN_STRING,
+    GEN_BYTES,
+    GEN_MESSAGE
+} gen_kind;
+
+typedef struct gen_field_s {
+    char        name[GEN_MAX_IDENT];
+    gen_kind    kind;
+    size_t      capacity;   /* string and bytes */
+    size_t      message;    /* index of nested message */
+    size_t      count;      /* array size, 0 if not an array */
+    bool        optional;
+} gen_field;
+
+typedef struct gen_message_s {
+    char        name[GEN_MAX_IDENT];
+    gen_field   fields[GEN_MAX_FIELDS];
+    size_t      field_count;
+    size_t      order[GEN_MAX_FIELDS];  /* fields in binson order */
+    size_t      max_size;
+} gen_message;
+
+typedef struct gen_lexer_s {
+    const char  *pos;
+    int         line;
+    char        token[GEN_MAX_IDENT];
+} gen_lexer;
+
+/*======= Local function prototypes =========================================*/
+
+static void _fail(gen_lexer *lex, const char *fmt, ...);
+static bool _next_token(gen_lexer *lex);
+static void _expect(gen_lexer *lex, const char *token);
+static size_t _expect_number(gen_lexer *lex);
+static void _parse_schema(gen_lexer *lex);
+static void _parse_message(gen_lexer *lex);
+static size_t _width(size_t length);
+static size_t _value_max_size(const gen_field *field);
+static void _sort_fields(gen_message *msg);
+static void _write_header(FILE *f, const char *guard);
+static void _write_source(FILE *f, const char *header);
+
+/*======= Local variable declarations =======================================*/
+
+static gen_message messages[GEN_MAX_MESSAGES];
+static size_t message_count;
+
+/*======= Global function implementations ===================================*/
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <schema file> <output base>\n", argv[0]);
+        return 2;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (NULL == in) {
+        fprintf(stderr, "%s: cannot open\n", argv[1]);
+        return 1;
+    }
+
+    size_t size = 0;
+    size_t alloc = 4096;
+    char *text = malloc(alloc);
+    size_t n;
+    while ((text != NULL) && ((n = fread(&text[size], 1, alloc - size - 1, in)) > 0)) {
+        size += n;
+        if (size + 1 == alloc) {
+            alloc *= 2;
+            text = realloc(text, alloc);
+        }
+    }
+    fclose(in);
+    if (NULL == text) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    text[size] = '\0';
+
+    gen_lexer lex;
+    lex.pos = text;
+    lex.line = 1;
+    _parse_schema(&lex);
+    free(text);
+
+    size_t base_len = strlen(argv[2]);
+    char *path = malloc(base_len + 3);
+    if (NULL == path) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    /* Header guard and include name from the base name. */
+    const char *base = strrchr(argv[2], '/');
+    base = (NULL == base) ? argv[2] : base + 1;
+    char guard[256];
+    char header[256];
+    size_t i;
+    for (i = 0; (base[i] != '\0') && (i < sizeof(guard) - 4); i++) {
+        guard[i] = isalnum((unsigned char) base[i]) ? (char) toupper((unsigned char) base[i]) : '_';
+    }
+    memcpy(&guard[i], "_H_", 4);
+    snprintf(header, sizeof(header), "%s.h", base);
+
+    int ret = 0;
+    const char *suffixes[2] = { ".h", ".c" };
+    for (i = 0; i < 2; i++) {
+        snprintf(path, base_len + 3, "%s%s", argv[2], suffixes[i]);
+        FILE *out = fopen(path, "w");
+        if (NULL == out) {
+            fprintf(stderr, "%s: cannot create\n", path);
+            ret = 1;
+            break;
+        }
+        if (i == 0) {
+            _write_header(out, guard);
+        }
+        else {
+            _write_source(out, header);
+        }
+        if (fclose(out) != 0) {
+            fprintf(stderr, "%s: write failed\n", path);
+            ret = 1;
+        }
+    }
+
+    free(path);
+    return ret;
+}
+
+/*======= Local function implementations ====================================*/
+
+static void _fail(gen_lexer *lex, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "schema:%d: ", lex->line);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+static bool _next_token(gen_lexer *lex)
+{
+    for (;;) {
+        while (isspace((unsigned char) *lex->pos)) {
+            if (*lex->pos == '\n') {
+                lex->line++;
+            }
+            lex->pos++;
+        }
+        if ((*lex->pos == '#') || ((lex->pos[0] == '/') && (lex->pos[1] == '/'))) {
+            while ((*lex->pos != '\0') && (*lex->pos != '\n')) {
+                lex->pos++;
+            }
+            continue;
+        }
+        break;
+    }
+
+    if (*lex->pos == '\0') {
+        lex->token[0] = '\0';
+        return false;
+    }
+
+    size_t n = 0;
+    if (isalnum((unsigned char) *lex->pos) || (*lex->pos == '_')) {
+        while (isalnum((unsigned char) *lex->pos) || (*lex->pos == '_')) {
+            if (n + 1 >= sizeof(lex->token)) {
+                _fail(lex, "identifier too long");
+            }
+            lex->token[n++] = *lex->pos++;
+        }
+    }
+    else {
+        lex->token[n++] = *lex->pos++;
+    }
+    lex->token[n] = '\0';
+    return true;
+}
+
+static void _expect(gen_lexer *lex, const char *token)
+{
+    if (!_next_token(lex) || (strcmp(lex->token, token) != 0)) {
+        _fail(lex, "expected '%s', got '%s'", token, lex->token);
+    }
+}
+
+static size_t _expect_number(gen_lexer *lex)
+{
+    char *end;
+
+    if (!_next_token(lex) || !isdigit((unsigned char) lex->token[0])) {
+        _fail(lex, "expected number, got '%s'", lex->token);
+    }
+    unsigned long value = strtoul(lex->token, &end, 10);
+    if ((*end != '\0') || (value == 0) || (value > GEN_MAX_CAPACITY)) {
+        _fail(lex, "bad size '%s'", lex->token);
+    }
+    return (size_t) value;
+}
+
+static bool _is_ident(const char *token)
+{
+    return isalpha((unsigned char) token[0]) || (token[0] == '_');
+}
+
+static void _parse_schema(gen_lexer *lex)
+{
+    while (_next_token(lex)) {
+        if (strcmp(lex->token, "message") != 0) {
+            _fail(lex, "expected 'message', got '%s'", lex->token);
+        }
+        _parse_message(lex);
+    }
+
+    if (message_count == 0) {
+        _fail(lex, "no messages");
+    }
+}
+
+static void _parse_message(gen_lexer *lex)
+{
+    if (message_count == GEN_MAX_MESSAGES) {
+        _fail(lex, "too many messages");
+    }
+
+    gen_message *msg = &messages[message_count];
+    memset(msg, 0, sizeof(*msg));
+
+    if (!_next_token(lex) || !_is_ident(lex->token)) {
+        _fail(lex, "expected message name");
+    }
+    size_t i;
+    for (i = 0; i < message_count; i++) {
+        if (strcmp(messages[i].name, lex->token) == 0) {
+            _fail(lex, "message '%s' defined twice", lex->token);
+        }
+    }
+    strcpy(msg->name, lex->token);
+    _expect(lex, "{");
+
+    for (;;) {
+        if (!_next_token(lex)) {
+            _fail(lex, "unterminated message '%s'", msg->name);
+        }
+        if (strcmp(lex->token, "}") == 0) {
+            break;
+        }
+        if (msg->field_count == GEN_MAX_FIELDS) {
+            _fail(lex, "too many fields");
+        }
+
+        gen_field *field = &msg->fields[msg->field_count];
+        if (strcmp(lex->token, "optional") == 0) {
+            field->optional = true;
+            _next_token(lex);
+        }
+
+        if (strcmp(lex->token, "bool") == 0) {
+            field->kind = GEN_BOOL;
+        }
+        else if (strcmp(lex->token, "int") == 0) {
+            field->kind = GEN_INT;
+        }
+        else if (strcmp(lex->token, "double") == 0) {
+            field->kind = GEN_DOUBLE;
+        }
+        else if ((strcmp(lex->token, "string") == 0) || (strcmp(lex->token, "bytes") == 0)) {
+            field->kind = (lex->token[0] == 's') ? GEN_STRING : GEN_BYTES;
+            _expect(lex, "<");
+            field->capacity = _expect_number(lex);
+            _expect(lex, ">");
+        }
+        else if (_is_ident(lex->token)) {
+            for (i = 0; i < message_count; i++) {
+                if (strcmp(messages[i].name, lex->token) == 0) {
+                    break;
+                }
+            }
+            if (i == message_count) {
+                _fail(lex, "unknown type '%s' (messages must be defined before use)", lex->token);
+            }
+            field->kind = GEN_MESSAGE;
+            field->message = i;
+        }
+        else {
+            _fail(lex, "expected type, got '%s'", lex->token);
+        }
+
+        if (!_next_token(lex) || !_is_ident(lex->token)) {
+            _fail(lex, "expected field name");
+        }
+        for (i = 0; i < msg->field_count; i++) {
+            if (strcmp(msg->fields[i].name, lex->token) == 0) {
+                _fail(lex, "field '%s' defined twice", lex->token);
+            }
+        }
+        strcpy(field->name, lex->token);
+
+        _next_token(lex);
+        if (strcmp(lex->token, "[") == 0) {
+            field->count = _expect_number(lex);
+            _expect(lex, "]");
+            _next_token(lex);
+        }
+        if (strcmp(lex->token, ";") != 0) {
+            _fail(lex, "expected ';', got '%s'", lex->token);
+        }
+
+        msg->field_count++;
+    }
+
+    _sort_fields(msg);
+
+    /* Worst case: every optional field present, every array full. */
+    msg->max_size = 2;
+    for (i = 0; i < msg->field_count; i++) {
+        const gen_field *field = &msg->fields[i];
+        size_t name_len = strlen(field->name);
+        msg->max_size += 1 + _width(name_len) + name_len;
+        if (field->count > 0) {
+            msg->max_size += 2 + field->count * _value_max_size(field);
+        }
+        else {
+            msg->max_size += _value_max_size(field);
+        }
+    }
+
+    message_count++;
+}
+
+static size_t _width(size_t length)
+{
+    return (length <= INT8_MAX) ? 1 : (length <= INT16_MAX) ? 2 : 4;
+}
+
+static size_t _value_max_size(const gen_field *field)
+{
+    switch (field->kind) {
+        case GEN_BOOL:
+            return 1;
+        case GEN_INT:
+        case GEN_DOUBLE:
+            return 9;
+        case GEN_STRING:
+        case GEN_BYTES:
+            return 1 + _width(field->capacity) + field->capacity;
+        case GEN_MESSAGE:
+        default:
+            return messages[field->message].max_size;
+    }
+}
+
+static gen_message *sort_msg;
+
+static int _cmp_fields(const void *a, const void *b)
+{
+    const char *na = sort_msg->fields[*(const size_t *) a].name;
+    const char *nb = sort_msg->fields[*(const size_t *) b].name;
+    size_t la = strlen(na);
+    size_t lb = strlen(nb);
+    int r = memcmp(na, nb, (la < lb) ? la : lb);
+
+    return (r != 0) ? r : (la < lb) ? -1 : (la > lb) ? 1 : 0;
+}
+
+static void _sort_fields(gen_message *msg)
+{
+    size_t i;
+    for (i = 0; i < msg->field_count; i++) {
+        msg->order[i] = i;
+    }
+    sort_msg = msg;
+    qsort(msg->order, msg->field_count, sizeof(msg->order[0]), _cmp_fields);
+}
+
+static void _upper(FILE *f, const char *name)
+{
+    for (; *name != '\0'; name++) {
+        fputc(toupper((unsigned char) *name), f);
+    }
+}
+
+static const char *_c_type(const gen_field *field)
+{
+    switch (field->kind) {
+        case GEN_BOOL:
+            return "bool";
+        case GEN_INT:
+            return "int64_t";
+        case GEN_DOUBLE:
+            return "double";
+        case GEN_STRING:
+            return "char";
+        case GEN_BYTES:
+            return "uint8_t";
+        case GEN_MESSAGE:
+        default:
+            return messages[field->message].name;
+    }
+}
+
+static void _write_header(FILE *f, const char *guard)
+{
+    size_t m, i;
+
+    fprintf(f, "/* Generated by binson_gen, do not edit. */\n\n");
+    fprintf(f, "#ifndef %s\n#define %s\n\n", guard, guard);
+    fprintf(f, "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n");
+    fprintf(f, "#include <stdbool.h>\n#include <stddef.h>\n#include <stdint.h>\n\n");
+    fprintf(f, "#include \"binson_light.h\"\n\n");
+
+    for (m = 0; m < message_count; m++) {
+        const gen_message *msg = &messages[m];
+
+        fprintf(f, "#define ");
+        _upper(f, msg->name);
+        fprintf(f, "_MAX_SIZE %zu\n\n", msg->max_size);
+
+        fprintf(f, "typedef struct %s_s {\n", msg->name);
+        for (i = 0; i < msg->field_count; i++) {
+            const gen_field *field = &msg->fields[i];
+            bool buffer = (field->kind == GEN_STRING) || (field->kind == GEN_BYTES);
+
+            if (field->optional) {
+                fprintf(f, "    bool has_%s;\n", field->name);
+            }
+            fprintf(f, "    %s %s", _c_type(field), field->name);
+            if (field->count > 0) {
+                fprintf(f, "[%zu]", field->count);
+            }
+            if (buffer) {
+                fprintf(f, "[%zu]", field->capacity);
+            }
+            fprintf(f, ";\n");
+            if (buffer) {
+                fprintf(f, "    size_t %s_len", field->name);
+                if (field->count > 0) {
+                    fprintf(f, "[%zu]", field->count);
+                }
+                fprintf(f, ";\n");
+            }
+            if (field->count > 0) {
+                fprintf(f, "    size_t %s_count;\n", field->name);
+            }
+        }
+        if (msg->field_count == 0) {
+            fprintf(f, "    uint8_t unused;\n");
+        }
+        fprintf(f, "} %s;\n\n", msg->name);
+
+        fprintf(f, "/* Writes msg as a binson object, false on writer errors. */\n");
+        fprintf(f, "bool %s_encode(const %s *msg, binson_writer *writer);\n", msg->name, msg->name);
+        fprintf(f, "/* Reads msg from a parser positioned before an object. */\n");
+        fprintf(f, "bool %s_decode(%s *msg, binson_parser *parser);\n\n", msg->name, msg->name);
+    }
+
+    fprintf(f, "#ifdef __cplusplus\n}\n#endif\n\n#endif /* %s */\n", guard);
+}
+
+static void _write_helpers(FILE *f)
+{
+    fprintf(f,
+        "static inline int _cmp_name(const bbuf *a, const bbuf *b)\n"
+        "{\n"
+        "    int r = memcmp(a->bptr, b->bptr, (a->bsize < b->bsize) ? a->bsize : b->bsize);\n"
+        "    return (r != 0) ? r : (a->bsize < b->bsize) ? -1 : (a->bsize > b->bsize) ? 1 : 0;\n"
+        "}\n\n"
+        "static inline bool _fail(binson_parser *p, binson_err err)\n"
+        "{\n"
+        "    p->error_flags = err;\n"
+        "    return false;\n"
+        "}\n\n"
+        "static inline bool _read_boolean(binson_parser *p, bool *value)\n"
+        "{\n"
+        "    if (binson_parser_get_type(p) != BINSON_TYPE_BOOLEAN) {\n"
+        "        return _fail(p, BINSON_ERROR_WRONG_TYPE);\n"
+        "    }\n"
+        "    *value = binson_parser_get_boolean(p);\n"
+        "    return true;\n"
+        "}\n\n"
+        "static inline bool _read_integer(binson_parser *p, int64_t *value)\n"
+        "{\n"
+        "    if (binson_parser_get_type(p) != BINSON_TYPE_INTEGER) {\n"
+        "        return _fail(p, BINSON_ERROR_WRONG_TYPE);\n"
+        "    }\n"
+        "    *value = binson_parser_get_integer(p);\n"
+        "    return true;\n"
+        "}\n\n"
+        "static inline bool _read_double(binson_parser *p, double *value)\n"
+        "{\n"
+        "    if (binson_parser_get_type(p) != BINSON_TYPE_DOUBLE) {\n"
+        "        return _fail(p, BINSON_ERROR_WRONG_TYPE);\n"
+        "    }\n"
+        "    *value = binson_parser_get_double(p);\n"
+        "    return true;\n"
+        "}\n\n"
+        "static inline bool _read_buffer(binson_parser *p, binson_type type,\n"
+        "                                void *value, size_t capacity, size_t *length)\n"
+        "{\n"
+        "    if (binson_parser_get_type(p) != type) {\n"
+        "        return _fail(p, BINSON_ERROR_WRONG_TYPE);\n"
+        "    }\n"
+        "    bbuf *buf = (type == BINSON_TYPE_STRING) ? binson_parser_get_string_bbuf(p)\n"
+        "                                             : binson_parser_get_bytes_bbuf(p);\n"
+        "    if (buf->bsize > capacity) {\n"
+        "        return _fail(p, BINSON_ERROR_RANGE);\n"
+        "    }\n"
+        "    if (buf->bsize > 0) {\n"
+        "        memcpy(value, buf->bptr, buf->bsize);\n"
+        "    }\n"
+        "    *length = buf->bsize;\n"
+        "    return true;\n"
+        "}\n\n"
+        "static inline bool _expect(binson_parser *p, binson_type type)\n"
+        "{\n"
+        "    return (binson_parser_get_type(p) == type) ? true : _fail(p, BINSON_ERROR_WRONG_TYPE);\n"
+        "}\n\n"
+        "static inline bool _encode_invalid(binson_writer *w)\n"
+        "{\n"
+        "    w->error_flags = BINSON_ERROR_FORMAT;\n"
+        "    return false;\n"
+        "}\n\n");
+}
+
+/* Emits the write call for one value; ref is the C expression of the value. */
+static void _write_value(FILE *f, const gen_field *field, const char *ref,
+                         const char *len_ref, const char *indent)
+{
+    switch (field->kind) {
+        case GEN_BOOL:
+            fprintf(f, "%sbinson_write_boolean(w, %s);\n", indent, ref);
+            break;
+        case GEN_INT:
+            fprintf(f, "%sbinson_write_integer(w, %s);\n", indent, ref);
+            break;
+        case GEN_DOUBLE:
+            fprintf(f, "%sbinson_write_double(w, %s);\n", indent, ref);
+            break;
+        case GEN_STRING:
+        case GEN_BYTES:
+            fprintf(f, "%sif (%s > %zu) {\n%s    return _encode_invalid(w);\n%s}\n",
+                    indent, len_ref, field->capacity, indent, indent);
+            if (field->kind == GEN_STRING) {
+                fprintf(f, "%sbinson_write_string_with_len(w, %s, %s);\n", indent, ref, len_ref);
+            }
+            else {
+                fprintf(f, "%sbinson_write_bytes(w, %s, %s);\n", indent, ref, len_ref);
+            }
+            break;
+        case GEN_MESSAGE:
+        default:
+            fprintf(f, "%s_%s_write(&%s, w);\n", indent, messages[field->message].name, ref);
+            break;
+    }
+}
+
+/* Emits the read call for one value, returning false from the caller on errors. */
+static void _read_value(FILE *f, const gen_field *field, const char *ref,
+                        const char *len_ref, const char *indent)
+{
+    switch (field->kind) {
+        case GEN_BOOL:
+            fprintf(f, "%sif (!_read_boolean(p, &%s)) {\n", indent, ref);
+            break;
+        case GEN_INT:
+            fprintf(f, "%sif (!_read_integer(p, &%s)) {\n", indent, ref);
+            break;
+        case GEN_DOUBLE:
+            fprintf(f, "%sif (!_read_double(p, &%s)) {\n", indent, ref);
+            break;
+        case GEN_STRING:
+        case GEN_BYTES:
+            fprintf(f, "%sif (!_read_buffer(p, %s, %s, %zu, &%s)) {\n", indent,
+                    (field->kind == GEN_STRING) ? "BINSON_TYPE_STRING" : "BINSON_TYPE_BYTES",
+                    ref, field->capacity, len_ref);
+            break;
+        case GEN_MESSAGE:
+        default:
+            fprintf(f, "%sif (!_expect(p, BINSON_TYPE_OBJECT) || !_%s_read(&%s, p)) {\n",
+                    indent, messages[field->message].name, ref);
+            break;
+    }
+    fprintf(f, "%s    return false;\n%s}\n", indent, indent);
+}
+
+static void _write_encoder(FILE *f, const gen_message *msg)
+{
+    char ref[3 * GEN_MAX_IDENT];
+    char len_ref[3 * GEN_MAX_IDENT];
+    size_t i;
+
+    fprintf(f, "static bool _%s_write(const %s *msg, binson_writer *w)\n{\n", msg->name, msg->name);
+    if (msg->field_count == 0) {
+        fprintf(f, "    (void) msg;\n");
+    }
+    fprintf(f, "    binson_write_object_begin(w);\n");
+
+    for (i = 0; i < msg->field_count; i++) {
+        const gen_field *field = &msg->fields[msg->order[i]];
+        const char *indent = field->optional ? "        " : "    ";
+        size_t name_len = strlen(field->name);
+        size_t width = _width(name_len);
+        size_t b;
+
+        fprintf(f, "\n    /* %s */\n", field->name);
+        if (field->optional) {
+            fprintf(f, "    if (msg->has_%s) {\n", field->name);
+        }
+
+        /* Precomputed name: STRINGLEN token, length and name bytes. */
+        fprintf(f, "%sbinson_write_raw(w, (const uint8_t *) \"\\x%02x", indent,
+                (unsigned) ((width == 1) ? 0x14 : (width == 2) ? 0x15 : 0x16));
+        for (b = 0; b < width; b++) {
+            fprintf(f, "\\x%02x", (unsigned) ((name_len >> (8 * b)) & 0xFFU));
+        }
+        fprintf(f, "\" \"%s\", %zu);\n", field->name, 1 + width + name_len);
+
+        if (field->count > 0) {
+            fprintf(f, "%sif (msg->%s_count > %zu) {\n%s    return _encode_invalid(w);\n%s}\n",
+                    indent, field->name, field->count, indent, indent);
+            fprintf(f, "%sbinson_write_array_begin(w);\n", indent);
+            fprintf(f, "%sfor (size_t i = 0; i < msg->%s_count; i++) {\n", indent, field->name);
+            snprintf(ref, sizeof(ref), "msg->%s[i]", field->name);
+            snprintf(len_ref, sizeof(len_ref), "msg->%s_len[i]", field->name);
+            char inner[16];
+            snprintf(inner, sizeof(inner), "%s    ", indent);
+            _write_value(f, field, ref, len_ref, inner);
+            fprintf(f, "%s}\n", indent);
+            fprintf(f, "%sbinson_write_array_end(w);\n", indent);
+        }
+        else {
+            snprintf(ref, sizeof(ref), "msg->%s", field->name);
+            snprintf(len_ref, sizeof(len_ref), "msg->%s_len", field->name);
+            _write_value(f, field, ref, len_ref, indent);
+        }
+
+        if (field->optional) {
+            fprintf(f, "    }\n");
+        }
+    }
+
+    fprintf(f, "\n    binson_write_object_end(w);\n");
+    fprintf(f, "    return (w->error_flags == BINSON_ERROR_NONE);\n}\n\n");
+}
+
+static void _write_decoder(FILE *f, const gen_message *msg)
+{
+    char ref[3 * GEN_MAX_IDENT];
+    char len_ref[3 * GEN_MAX_IDENT];
+    size_t i;
+
+    fprintf(f, "static bool _%s_read(%s *msg, binson_parser *p)\n{\n", msg->name, msg->name);
+
+    if (msg->field_count == 0) {
+        fprintf(f, "    memset(msg, 0, sizeof(*msg));\n");
+        fprintf(f, "    if (!binson_parser_go_into_object(p)) {\n        return false;\n    }\n");
+        fprintf(f, "    while (binson_parser_next(p)) {\n    }\n");
+        fprintf(f, "    return (p->error_flags == BINSON_ERROR_NONE) && binson_parser_leave_object(p);\n");
+        fprintf(f, "}\n\n");
+        return;
+    }
+
+    fprintf(f, "    static const bbuf names[%zu] = {\n", msg->field_count);
+    for (i = 0; i < msg->field_count; i++) {
+        const gen_field *field = &msg->fields[msg->order[i]];
+        fprintf(f, "        { %zu, (const uint8_t *) \"%s\" },\n", strlen(field->name), field->name);
+    }
+    fprintf(f, "    };\n");
+    fprintf(f, "    static const bool required[%zu] = {", msg->field_count);
+    for (i = 0; i < msg->field_count; i++) {
+        fprintf(f, "%s%s", (i == 0) ? " " : ", ",
+                msg->fields[msg->order[i]].optional ? "false" : "true");
+    }
+    fprintf(f, " };\n");
+    fprintf(f, "    size_t field = 0;\n\n");
+
+    fprintf(f, "    memset(msg, 0, sizeof(*msg));\n");
+    fprintf(f, "    if (!binson_parser_go_into_object(p)) {\n        return false;\n    }\n\n");
+    fprintf(f, "    while (binson_parser_next(p)) {\n");
+    fprintf(f, "        bbuf *name = binson_parser_get_name(p);\n");
+    fprintf(f, "        int r = 1;\n\n");
+    fprintf(f, "        /* Both sides are sorted, skip fields missing in the input. */\n");
+    fprintf(f, "        while ((field < %zu) && ((r = _cmp_name(&names[field], name)) < 0)) {\n",
+            msg->field_count);
+    fprintf(f, "            if (required[field]) {\n");
+    fprintf(f, "                return _fail(p, BINSON_ERROR_FORMAT);\n            }\n");
+    fprintf(f, "            field++;\n        }\n");
+    fprintf(f, "        if (r != 0) {\n            continue;    /* Unknown field */\n        }\n\n");
+    fprintf(f, "        switch (field++) {\n");
+
+    for (i = 0; i < msg->field_count; i++) {
+        const gen_field *field = &msg->fields[msg->order[i]];
+
+        fprintf(f, "        case %zu:\n", i);
+        if (field->count > 0) {
+            fprintf(f, "            if (!_expect(p, BINSON_TYPE_ARRAY) || !binson_parser_go_into_array(p)) {\n"
+                       "                return false;\n            }\n");
+            fprintf(f, "            while (binson_parser_next(p)) {\n");
+            fprintf(f, "                if (msg->%s_count == %zu) {\n"
+                       "                    return _fail(p, BINSON_ERROR_RANGE);\n                }\n",
+                    field->name, field->count);
+            snprintf(ref, sizeof(ref), "msg->%s[msg->%s_count]", field->name, field->name);
+            snprintf(len_ref, sizeof(len_ref), "msg->%s_len[msg->%s_count]", field->name, field->name);
+            _read_value(f, field, ref, len_ref, "                ");
+            fprintf(f, "                msg->%s_count++;\n", field->name);
+            fprintf(f, "            }\n");
+            fprintf(f, "            if (!binson_parser_leave_array(p)) {\n"
+                       "                return false;\n            }\n");
+        }
+        else {
+            snprintf(ref, sizeof(ref), "msg->%s", field->name);
+            snprintf(len_ref, sizeof(len_ref), "msg->%s_len", field->name);
+            _read_value(f, field, ref, len_ref, "            ");
+        }
+        if (field->optional) {
+            fprintf(f, "            msg->has_%s = true;\n", field->name);
+        }
+        fprintf(f, "            break;\n");
+    }
+    fprintf(f, "        default:\n            break;\n        }\n    }\n\n");
+
+    fprintf(f, "    if (p->error_flags != BINSON_ERROR_NONE) {\n        return false;\n    }\n");
+    fprintf(f, "    for (; field < %zu; field++) {\n", msg->field_count);
+    fprintf(f, "        if (required[field]) {\n");
+    fprintf(f, "            return _fail(p, BINSON_ERROR_FORMAT);\n        }\n    }\n\n");
+    fprintf(f, "    return binson_parser_leave_object(p);\n}\n\n");
+}
+
+static void _write_source(FILE *f, const char *header)
+{
+    size_t m;
+
+    fprintf(f, "/* Generated by binson_gen, do not edit. */\n\n");
+    fprintf(f, "#include <string.h>\n\n#include \"%s\"\n\n", header);
+    _write_helpers(f);
+
+    for (m = 0; m < message_count; m++) {
+        const gen_message *msg = &messages[m];
+
+        _write_encoder(f, msg);
+        _write_decoder(f, msg);
+
+        fprintf(f, "bool %s_encode(const %s *msg, binson_writer *writer)\n{\n", msg->name, msg->name);
+        fprintf(f, "    if (NULL == writer) {\n        return false;\n    }\n");
+        fprintf(f, "    if (NULL == msg) {\n        writer->error_flags = BINSON_ERROR_NULL;\n"
+                   "        return false;\n    }\n");
+        fprintf(f, "    return _%s_write(msg, writer);\n}\n\n", msg->name);
+
+        fprintf(f, "bool %s_decode(%s *msg, binson_parser *parser)\n{\n", msg->name, msg->name);
+        fprintf(f, "    if (NULL == parser) {\n        return false;\n    }\n");
+        fprintf(f, "    if (NULL == msg) {\n        return _fail(parser, BINSON_ERROR_NULL);\n    }\n");
+        fprintf(f, "    return _%s_read(msg, parser);\n}\n\n", msg->name);
+    }
+}
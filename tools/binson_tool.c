@@ -0,0 +1,828 @@
+/**
+ * @file binson_tool.c
+ *
+ * Command line tool for files of concatenated binson messages.
+ *
+ * Usage: binson <command> [options] [file]
+ *
+ *   verify [-u]        Verify every message, -u also validates UTF-8.
+ *   dump [-p] [-b]     Write every message as JSON, one per line. -p
+ *                      indents, -b writes bytes as base64 instead of hex.
+ *   stats              Message count, sizes and number of values by type.
+ *   get [-b] <path>    Write the value at path of every message as JSON,
+ *                      null where it is missing. Path elements are
+ *                      separated by '.', numbers index arrays: "a.list.0".
+ *   bench [-n count]   Time verify, JSON output and message scanning over
+ *                      the whole file.
+ *
+ * A message is a top level object or array, messages follow each other
+ * without separators. The file is memory mapped, without a file or with
+ * "-" standard input is read instead. One parser is reused for all
+ * messages and output goes through one large buffer straight to the
+ * file descriptor.
+ *
+ * Exit status is 0 on success, 1 for invalid input and 2 for usage errors.
+ */
+
+/*======= Includes ==========================================================*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "binson_parser.h"
+#include "binson_json.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define TOOL_OUTPUT_SIZE    (64U * 1024U)
+#define TOOL_MAX_PATH       (BINSON_PARSER_MAX_DEPTH)
+
+/*======= Type Definitions ==================================================*/
+
+typedef struct tool_input_s {
+    const uint8_t   *data;
+    size_t          size;
+    bool            mapped;
+} tool_input;
+
+typedef struct tool_output_s {
+    int             fd;
+    size_t          used;
+    bool            failed;
+    char            buffer[TOOL_OUTPUT_SIZE];
+} tool_output;
+
+typedef struct tool_message_s {
+    const uint8_t   *data;
+    size_t          size;
+    size_t          index;
+    size_t          offset;
+} tool_message;
+
+typedef struct tool_stats_s {
+    size_t          values[BINSON_TYPE_BYTES + 1];
+    size_t          payload;
+    size_t          max_depth;
+    size_t          min_size;
+    size_t          max_size;
+} tool_stats;
+
+typedef struct tool_path_s {
+    const char      *element[TOOL_MAX_PATH];
+    size_t          length[TOOL_MAX_PATH];
+    size_t          count;
+} tool_path;
+
+/* Context of the dump and get callbacks. */
+typedef struct tool_emit_s {
+    uint8_t             flags;
+    binson_json_sink    sink;
+    void                *sink_context;
+    const tool_path     *path;
+} tool_emit;
+
+/* Called for each message with a parser initiated on it. */
+typedef bool (*tool_message_fn)(binson_parser *parser,
+                                const tool_message *message,
+                                void *context);
+
+/*======= Local function prototypes =========================================*/
+
+static int _verify(int argc, char **argv);
+static int _dump(int argc, char **argv);
+static int _stats(int argc, char **argv);
+static int _get(int argc, char **argv);
+static int _bench(int argc, char **argv);
+static bool _verify_message(binson_parser *parser, const tool_message *message, void *context);
+static bool _dump_message(binson_parser *parser, const tool_message *message, void *context);
+static bool _stats_message(binson_parser *parser, const tool_message *message, void *context);
+static bool _get_message(binson_parser *parser, const tool_message *message, void *context);
+static bool _count_message(binson_parser *parser, const tool_message *message, void *context);
+static bool _walk(binson_parser *parser, tool_stats *stats, size_t depth);
+static bool _find(binson_parser *parser, const tool_path *path);
+static bool _for_each_message(const tool_input *input,
+                              tool_message_fn fn,
+                              void *context,
+                              size_t *count);
+static bool _open_input(const char *name, tool_input *input);
+static void _close_input(tool_input *input);
+static bool _output_sink(void *context, const char *data, size_t size);
+static bool _count_sink(void *context, const char *data, size_t size);
+static bool _output_flush(tool_output *output);
+static bool _write_all(int fd, const char *data, size_t size);
+static double _now(void);
+static const char *_error_name(binson_err error);
+static int _usage(void);
+
+/*======= Local variable declarations =======================================*/
+
+static tool_output stdout_output;
+
+/* Set by the per message callbacks for _for_each_message() to report. */
+static binson_err message_error;
+
+/*======= Main function =====================================================*/
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char  *name;
+        int         (*run)(int argc, char **argv);
+    } commands[] = {
+        { "verify", _verify },
+        { "dump", _dump },
+        { "stats", _stats },
+        { "get", _get },
+        { "bench", _bench }
+    };
+    size_t i;
+
+    if (argc < 2) {
+        return _usage();
+    }
+
+    stdout_output.fd = STDOUT_FILENO;
+
+    for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (0 == strcmp(argv[1], commands[i].name)) {
+            int ret = commands[i].run(argc - 1, &argv[1]);
+            if (!_output_flush(&stdout_output) && (0 == ret)) {
+                fprintf(stderr, "binson: write failed: %s\n", strerror(errno));
+                ret = 1;
+            }
+            return ret;
+        }
+    }
+
+    return _usage();
+}
+
+/*======= Local function implementations ====================================*/
+
+static int _verify(int argc, char **argv)
+{
+    tool_input input;
+    uint8_t options = 0;
+    size_t count = 0;
+    bool ok;
+    int c;
+
+    while ((c = getopt(argc, argv, "u")) != -1) {
+        if ('u' == c) {
+            options |= BINSON_PARSER_OPTION_VALIDATE_UTF8;
+        }
+        else {
+            return _usage();
+        }
+    }
+
+    if (argc - optind > 1) {
+        return _usage();
+    }
+
+    if (!_open_input(argv[optind], &input)) {
+        return 1;
+    }
+
+    ok = _for_each_message(&input, _verify_message, &options, &count);
+    if (ok) {
+        printf("%zu messages, %zu bytes OK\n", count, input.size);
+    }
+
+    _close_input(&input);
+    return ok ? 0 : 1;
+}
+
+static int _dump(int argc, char **argv)
+{
+    tool_emit emit = { 0, _output_sink, &stdout_output, NULL };
+    tool_input input;
+    bool ok;
+    int c;
+
+    while ((c = getopt(argc, argv, "pb")) != -1) {
+        if ('p' == c) {
+            emit.flags |= BINSON_JSON_PRETTY;
+        }
+        else if ('b' == c) {
+            emit.flags |= BINSON_JSON_BYTES_BASE64;
+        }
+        else {
+            return _usage();
+        }
+    }
+
+    if (argc - optind > 1) {
+        return _usage();
+    }
+
+    if (!_open_input(argv[optind], &input)) {
+        return 1;
+    }
+
+    ok = _for_each_message(&input, _dump_message, &emit, NULL);
+
+    _close_input(&input);
+    return ok ? 0 : 1;
+}
+
+static int _stats(int argc, char **argv)
+{
+    static const char *names[BINSON_TYPE_BYTES + 1] = {
+        [BINSON_TYPE_OBJECT] = "objects",
+        [BINSON_TYPE_ARRAY] = "arrays",
+        [BINSON_TYPE_BOOLEAN] = "booleans",
+        [BINSON_TYPE_INTEGER] = "integers",
+        [BINSON_TYPE_DOUBLE] = "doubles",
+        [BINSON_TYPE_STRING] = "strings",
+        [BINSON_TYPE_BYTES] = "bytes"
+    };
+    tool_input input;
+    tool_stats stats;
+    size_t count = 0;
+    size_t i;
+    bool ok;
+
+    if ((getopt(argc, argv, "") != -1) || (argc - optind > 1)) {
+        return _usage();
+    }
+
+    if (!_open_input(argv[optind], &input)) {
+        return 1;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    stats.min_size = SIZE_MAX;
+
+    ok = _for_each_message(&input, _stats_message, &stats, &count);
+    if (ok) {
+        printf("messages      %zu\n", count);
+        printf("bytes         %zu\n", input.size);
+        if (count > 0) {
+            printf("message size  min %zu, avg %zu, max %zu\n",
+                   stats.min_size, input.size / count, stats.max_size);
+        }
+        printf("max depth     %zu\n", stats.max_depth);
+        for (i = BINSON_TYPE_OBJECT; i <= BINSON_TYPE_BYTES; i++) {
+            if (NULL != names[i]) {
+                printf("%-13s %zu\n", names[i], stats.values[i]);
+            }
+        }
+        printf("payload       %zu bytes of strings and bytes\n", stats.payload);
+    }
+
+    _close_input(&input);
+    return ok ? 0 : 1;
+}
+
+static int _get(int argc, char **argv)
+{
+    tool_emit emit = { 0, _output_sink, &stdout_output, NULL };
+    tool_input input;
+    tool_path path;
+    const char *p;
+    bool ok;
+    int c;
+
+    while ((c = getopt(argc, argv, "b")) != -1) {
+        if ('b' == c) {
+            emit.flags |= BINSON_JSON_BYTES_BASE64;
+        }
+        else {
+            return _usage();
+        }
+    }
+
+    if ((argc - optind < 1) || (argc - optind > 2)) {
+        return _usage();
+    }
+
+    /* "a.b.0" to { "a", "b", "0" }, the empty path is the whole message. */
+    path.count = 0;
+    p = argv[optind];
+    while ('\0' != *p) {
+        const char *end = strchr(p, '.');
+        size_t length = (NULL == end) ? strlen(p) : (size_t) (end - p);
+
+        if (path.count == TOOL_MAX_PATH) {
+            fprintf(stderr, "binson: path deeper than %u\n", TOOL_MAX_PATH);
+            return 2;
+        }
+        path.element[path.count] = p;
+        path.length[path.count] = length;
+        path.count++;
+        p += length + ((NULL == end) ? 0 : 1);
+    }
+
+    if (!_open_input(argv[optind + 1], &input)) {
+        return 1;
+    }
+
+    emit.path = &path;
+    ok = _for_each_message(&input, _get_message, &emit, NULL);
+
+    _close_input(&input);
+    return ok ? 0 : 1;
+}
+
+static int _bench(int argc, char **argv)
+{
+    size_t json_size = 0;
+    tool_emit emit = { 0, _count_sink, &json_size, NULL };
+    tool_input input;
+    size_t iterations = 5;
+    size_t count = 0;
+    uint8_t options = 0;
+    double start;
+    double elapsed;
+    size_t i;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        if ('n' == c) {
+            iterations = strtoul(optarg, NULL, 10);
+        }
+        else {
+            return _usage();
+        }
+    }
+
+    if ((argc - optind > 1) || (0 == iterations)) {
+        return _usage();
+    }
+
+    if (!_open_input(argv[optind], &input)) {
+        return 1;
+    }
+
+    start = _now();
+    for (i = 0; i < iterations; i++) {
+        if (!_for_each_message(&input, _count_message, NULL, &count)) {
+            _close_input(&input);
+            return 1;
+        }
+    }
+    elapsed = _now() - start;
+    printf("%zu messages, %zu bytes, %zu iterations\n", count, input.size, iterations);
+    printf("%-8s %10.1f MB/s %12.0f messages/s\n", "scan",
+           (double) (iterations * input.size) / elapsed / 1e6,
+           (double) (iterations * count) / elapsed);
+
+    start = _now();
+    for (i = 0; i < iterations; i++) {
+        if (!_for_each_message(&input, _verify_message, &options, NULL)) {
+            _close_input(&input);
+            return 1;
+        }
+    }
+    elapsed = _now() - start;
+    printf("%-8s %10.1f MB/s %12.0f messages/s\n", "verify",
+           (double) (iterations * input.size) / elapsed / 1e6,
+           (double) (iterations * count) / elapsed);
+
+    /* JSON into a counting sink, so only the conversion is timed. */
+    start = _now();
+    for (i = 0; i < iterations; i++) {
+        if (!_for_each_message(&input, _dump_message, &emit, NULL)) {
+            _close_input(&input);
+            return 1;
+        }
+    }
+    elapsed = _now() - start;
+    printf("%-8s %10.1f MB/s %12.0f messages/s, %zu bytes JSON\n", "json",
+           (double) (iterations * input.size) / elapsed / 1e6,
+           (double) (iterations * count) / elapsed,
+           json_size / iterations);
+
+    _close_input(&input);
+    return 0;
+}
+
+static bool _verify_message(binson_parser *parser, const tool_message *message, void *context)
+{
+    (void) message;
+
+    if (NULL != context) {
+        parser->options = *(const uint8_t *) context;
+    }
+
+    /* verify() resets the parser, so the error code itself is lost. */
+    if (!binson_parser_verify(parser)) {
+        message_error = BINSON_ERROR_FORMAT;
+        return false;
+    }
+
+    return true;
+}
+
+static bool _dump_message(binson_parser *parser, const tool_message *message, void *context)
+{
+    const tool_emit *emit = (const tool_emit *) context;
+
+    (void) message;
+
+    if (!binson_json_emit(parser, emit->flags, emit->sink, emit->sink_context)) {
+        message_error = parser->error_flags;
+        return false;
+    }
+
+    /* Pretty output already ends with a newline. */
+    if (!(emit->flags & BINSON_JSON_PRETTY)) {
+        return emit->sink(emit->sink_context, "\n", 1);
+    }
+
+    return true;
+}
+
+static bool _stats_message(binson_parser *parser, const tool_message *message, void *context)
+{
+    tool_stats *stats = (tool_stats *) context;
+    bool is_object = (BINSON_DEF_OBJECT_BEGIN == message->data[0]);
+
+    stats->min_size = (message->size < stats->min_size) ? message->size : stats->min_size;
+    stats->max_size = (message->size > stats->max_size) ? message->size : stats->max_size;
+    stats->values[is_object ? BINSON_TYPE_OBJECT : BINSON_TYPE_ARRAY]++;
+
+    if (!(is_object ? binson_parser_go_into_object(parser) :
+                      binson_parser_go_into_array(parser)) ||
+        !_walk(parser, stats, 1)) {
+        message_error = parser->error_flags;
+        return false;
+    }
+
+    return true;
+}
+
+static bool _get_message(binson_parser *parser, const tool_message *message, void *context)
+{
+    const tool_emit *emit = (const tool_emit *) context;
+
+    (void) message;
+
+    if (0 == emit->path->count) {
+        if (!binson_json_emit(parser, emit->flags, emit->sink, emit->sink_context)) {
+            message_error = parser->error_flags;
+            return false;
+        }
+    }
+    else if (_find(parser, emit->path)) {
+        if (!binson_json_emit_value(parser, emit->flags, emit->sink, emit->sink_context)) {
+            message_error = parser->error_flags;
+            return false;
+        }
+    }
+    else if (BINSON_ERROR_NONE != parser->error_flags) {
+        message_error = parser->error_flags;
+        return false;
+    }
+    /* A sorted lookup can stop early, before the damage. */
+    else if (!binson_parser_verify(parser)) {
+        message_error = BINSON_ERROR_FORMAT;
+        return false;
+    }
+    else if (!emit->sink(emit->sink_context, "null", 4)) {
+        return false;
+    }
+
+    return emit->sink(emit->sink_context, "\n", 1);
+}
+
+static bool _count_message(binson_parser *parser, const tool_message *message, void *context)
+{
+    (void) parser;
+    (void) message;
+    (void) context;
+
+    return true;
+}
+
+static bool _walk(binson_parser *parser, tool_stats *stats, size_t depth)
+{
+    stats->max_depth = (depth > stats->max_depth) ? depth : stats->max_depth;
+
+    while (binson_parser_next(parser)) {
+        binson_type type = binson_parser_get_type(parser);
+
+        stats->values[type]++;
+
+        switch (type) {
+            case BINSON_TYPE_OBJECT:
+                if (!binson_parser_go_into_object(parser) ||
+                    !_walk(parser, stats, depth + 1) ||
+                    !binson_parser_leave_object(parser)) {
+                    return false;
+                }
+                break;
+            case BINSON_TYPE_ARRAY:
+                if (!binson_parser_go_into_array(parser) ||
+                    !_walk(parser, stats, depth + 1) ||
+                    !binson_parser_leave_array(parser)) {
+                    return false;
+                }
+                break;
+            case BINSON_TYPE_STRING:
+                stats->payload += binson_parser_get_string_bbuf(parser)->bsize;
+                break;
+            case BINSON_TYPE_BYTES:
+                stats->payload += binson_parser_get_bytes_bbuf(parser)->bsize;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return BINSON_ERROR_NONE == parser->error_flags;
+}
+
+/* Positions the parser on the value at path, false if there is none. */
+static bool _find(binson_parser *parser, const tool_path *path)
+{
+    bool in_object = (BINSON_DEF_OBJECT_BEGIN == parser->buffer[0]);
+    size_t i;
+
+    if (!(in_object ? binson_parser_go_into_object(parser) :
+                      binson_parser_go_into_array(parser))) {
+        return false;
+    }
+
+    for (i = 0; i < path->count; i++) {
+        if (in_object) {
+            if (!binson_parser_field_with_length(parser,
+                                                 path->element[i],
+                                                 path->length[i])) {
+                return false;
+            }
+        }
+        else {
+            size_t index = 0;
+            size_t k;
+
+            if (0 == path->length[i]) {
+                return false;
+            }
+            for (k = 0; k < path->length[i]; k++) {
+                char c = path->element[i][k];
+                if ((c < '0') || (c > '9') || (index > SIZE_MAX / 10 - 1)) {
+                    return false;
+                }
+                index = index * 10 + (size_t) (c - '0');
+            }
+            for (k = 0; k <= index; k++) {
+                if (!binson_parser_next(parser)) {
+                    return false;
+                }
+            }
+        }
+
+        if (i + 1 < path->count) {
+            binson_type type = binson_parser_get_type(parser);
+
+            if (BINSON_TYPE_OBJECT == type) {
+                in_object = binson_parser_go_into_object(parser);
+            }
+            else if (BINSON_TYPE_ARRAY == type) {
+                in_object = !binson_parser_go_into_array(parser);
+            }
+            else {
+                return false;
+            }
+
+            if (BINSON_ERROR_NONE != parser->error_flags) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Splits the input into messages and calls fn for each with the same
+ * parser. Reports the first invalid message on stderr.
+ */
+static bool _for_each_message(const tool_input *input,
+                              tool_message_fn fn,
+                              void *context,
+                              size_t *count)
+{
+    binson_message_iter iter;
+    binson_parser parser;
+    tool_message message;
+
+    binson_message_iter_init(&iter, input->data, input->size);
+
+    for (;;) {
+        message.offset = iter.offset;
+        message.index = iter.index;
+        if (!binson_message_iter_next(&iter, &parser)) {
+            break;
+        }
+        message.data = parser.buffer;
+        message.size = parser.buffer_size;
+        message_error = BINSON_ERROR_NONE;
+
+        if (!fn(&parser, &message, context)) {
+            if (BINSON_ERROR_NONE != message_error) {
+                fprintf(stderr, "binson: message %zu at offset %zu: %s\n",
+                        message.index, message.offset, _error_name(message_error));
+            }
+            return false;
+        }
+    }
+
+    if (BINSON_ERROR_NONE != iter.error_flags) {
+        fprintf(stderr, "binson: message %zu at offset %zu: "
+                "not a complete binson object or array\n",
+                iter.index, iter.offset);
+        return false;
+    }
+
+    if (NULL != count) {
+        *count = iter.index;
+    }
+
+    return true;
+}
+
+static bool _open_input(const char *name, tool_input *input)
+{
+    struct stat st;
+    int fd;
+
+    input->data = NULL;
+    input->size = 0;
+    input->mapped = false;
+
+    if ((NULL == name) || (0 == strcmp(name, "-"))) {
+        fd = STDIN_FILENO;
+        name = "<stdin>";
+    }
+    else {
+        fd = open(name, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "binson: %s: %s\n", name, strerror(errno));
+            return false;
+        }
+    }
+
+    if ((0 == fstat(fd, &st)) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+        void *data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (MAP_FAILED != data) {
+            posix_madvise(data, (size_t) st.st_size, POSIX_MADV_SEQUENTIAL);
+            input->data = data;
+            input->size = (size_t) st.st_size;
+            input->mapped = true;
+        }
+    }
+
+    /* Pipes and anything else that cannot be mapped are read. */
+    if (!input->mapped) {
+        size_t capacity = 0;
+        uint8_t *buffer = NULL;
+
+        for (;;) {
+            ssize_t n;
+
+            if (input->size == capacity) {
+                uint8_t *grown;
+                capacity = (capacity > 0) ? capacity * 2 : TOOL_OUTPUT_SIZE;
+                grown = realloc(buffer, capacity);
+                if (NULL == grown) {
+                    fprintf(stderr, "binson: %s: out of memory\n", name);
+                    free(buffer);
+                    return false;
+                }
+                buffer = grown;
+            }
+
+            n = read(fd, &buffer[input->size], capacity - input->size);
+            if (n < 0) {
+                if (EINTR == errno) {
+                    continue;
+                }
+                fprintf(stderr, "binson: %s: %s\n", name, strerror(errno));
+                free(buffer);
+                return false;
+            }
+            if (0 == n) {
+                break;
+            }
+            input->size += (size_t) n;
+        }
+
+        input->data = buffer;
+    }
+
+    if (STDIN_FILENO != fd) {
+        close(fd);
+    }
+
+    return true;
+}
+
+static void _close_input(tool_input *input)
+{
+    if (input->mapped) {
+        munmap((void *) (uintptr_t) input->data, input->size);
+    }
+    else {
+        free((void *) (uintptr_t) input->data);
+    }
+
+    input->data = NULL;
+}
+
+static bool _output_sink(void *context, const char *data, size_t size)
+{
+    tool_output *output = (tool_output *) context;
+
+    if (size > sizeof(output->buffer) - output->used) {
+        if (!_output_flush(output)) {
+            return false;
+        }
+    }
+
+    if (size > sizeof(output->buffer)) {
+        output->failed = !_write_all(output->fd, data, size);
+        return !output->failed;
+    }
+
+    memcpy(&output->buffer[output->used], data, size);
+    output->used += size;
+
+    return true;
+}
+
+static bool _count_sink(void *context, const char *data, size_t size)
+{
+    (void) data;
+    *(size_t *) context += size;
+    return true;
+}
+
+static bool _output_flush(tool_output *output)
+{
+    if (!output->failed && (output->used > 0)) {
+        output->failed = !_write_all(output->fd, output->buffer, output->used);
+    }
+    output->used = 0;
+
+    return !output->failed;
+}
+
+static bool _write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= (size_t) n;
+    }
+
+    return true;
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static const char *_error_name(binson_err error)
+{
+    static const char *names[] = {
+        "no error", "out of range", "format error", "unexpected end",
+        "end of block", "null pointer", "invalid state", "wrong type",
+        "too deeply nested"
+    };
+
+    return ((size_t) error < sizeof(names) / sizeof(names[0])) ? names[error] : "unknown error";
+}
+
+static int _usage(void)
+{
+    fprintf(stderr,
+            "usage: binson verify [-u] [file]\n"
+            "       binson dump [-p] [-b] [file]\n"
+            "       binson stats [file]\n"
+            "       binson get [-b] <path> [file]\n"
+            "       binson bench [-n iterations] [file]\n");
+    return 2;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file binson_amalgamated_test.c
+ *
+ * Description
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <string.h>
+
+#define BINSON_LIGHT_IMPLEMENTATION
+#include "binson_light_amalgamated.h"
+#include "utest.h"
+
+/*======= Local Macro Definitions ===========================================*/
+/*======= Local function prototypes =========================================*/
+
+static size_t build_message(uint8_t *buffer, size_t size);
+
+/*======= Local variable declarations =======================================*/
+/*======= Test cases ========================================================*/
+
+TEST(amalgamated_roundtrip)
+{
+    uint8_t buffer[128];
+    size_t size = build_message(buffer, sizeof(buffer));
+    binson_parser p;
+
+    ASSERT_TRUE(size > 0);
+    ASSERT_TRUE(binson_parser_init(&p, buffer, size));
+    ASSERT_TRUE(binson_parser_verify(&p));
+    ASSERT_TRUE(binson_parser_go_into_object(&p));
+    ASSERT_TRUE(binson_parser_field(&p, "c"));
+    ASSERT_TRUE(binson_parser_get_integer(&p) == -1000);
+}
+
+TEST(inline_accessors_match)
+{
+    uint8_t buffer[128];
+    size_t size = build_message(buffer, sizeof(buffer));
+    binson_parser p;
+    size_t values = 0;
+
+    ASSERT_TRUE(binson_parser_init(&p, buffer, size));
+    ASSERT_TRUE(binson_parser_go_into_object(&p));
+    while (binson_parser_next(&p)) {
+        ASSERT_TRUE(binson_parser_get_type_inline(&p) == binson_parser_get_type(&p));
+        ASSERT_TRUE(binson_parser_get_name_inline(&p) == binson_parser_get_name(&p));
+        ASSERT_TRUE(binson_parser_get_integer_inline(&p) == binson_parser_get_integer(&p));
+        ASSERT_TRUE(binson_parser_get_boolean_inline(&p) == binson_parser_get_boolean(&p));
+        ASSERT_TRUE(binson_parser_get_double_inline(&p) == binson_parser_get_double(&p));
+        ASSERT_TRUE(binson_parser_get_string_bbuf_inline(&p) == binson_parser_get_string_bbuf(&p));
+        ASSERT_TRUE(binson_parser_get_bytes_bbuf_inline(&p) == binson_parser_get_bytes_bbuf(&p));
+        values++;
+    }
+    ASSERT_TRUE(values == 6);
+
+    /* NULL parser and parser in error state. */
+    ASSERT_TRUE(binson_parser_get_type_inline(NULL) == BINSON_TYPE_NONE);
+    ASSERT_TRUE(binson_parser_get_name_inline(NULL) == NULL);
+    ASSERT_TRUE(binson_parser_get_integer_inline(NULL) == 0);
+    p.error_flags = BINSON_ERROR_FORMAT;
+    ASSERT_TRUE(binson_parser_get_type_inline(&p) == BINSON_TYPE_NONE);
+    ASSERT_TRUE(binson_parser_get_double_inline(&p) == 0.0);
+    ASSERT_TRUE(binson_parser_get_string_bbuf_inline(&p) == NULL);
+}
+
+int main(void) {
+    RUN_TEST(amalgamated_roundtrip);
+    RUN_TEST(inline_accessors_match);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
+
+static size_t build_message(uint8_t *buffer, size_t size)
+{
+    binson_writer w;
+    const uint8_t bytes[3] = { 1, 2, 3 };
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "a");
+    binson_write_boolean(&w, true);
+    binson_write_name(&w, "b");
+    binson_write_bytes(&w, bytes, sizeof(bytes));
+    binson_write_name(&w, "c");
+    binson_write_integer(&w, -1000);
+    binson_write_name(&w, "d");
+    binson_write_double(&w, 2.5);
+    binson_write_name(&w, "e");
+    binson_write_string(&w, "text");
+    binson_write_name(&w, "f");
+    binson_write_object_begin(&w);
+    binson_write_object_end(&w);
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
@@ -0,0 +1,173 @@
+/**
+ * @file binson_batch_array_test.cpp
+ *
+ * Deserialization of the elements of one array on several threads.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <binson_batch.hpp>
+#include "utest.h"
+#include <string>
+#include <vector>
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define ELEMENTS    (2500U)
+
+/*======= Type Definitions ==================================================*/
+
+struct Reading
+{
+    int64_t id;
+    double value;
+    std::string sensor;
+    BinsonOptional<std::vector<int64_t>> history;
+};
+BINSON_FIELDS(Reading, id, value, sensor, history)
+
+/*======= Local variable declarations =======================================*/
+
+using namespace std;
+
+/*======= Local function implementations ====================================*/
+
+static Reading make_reading(size_t i)
+{
+    Reading r;
+    r.id = static_cast<int64_t>(i);
+    r.value = static_cast<double>(i) / 4.0;
+    r.sensor = string("sensor-") + to_string(i % 17);
+    if (i % 3 == 0)
+        r.history = vector<int64_t>(i % 10, static_cast<int64_t>(i));
+    return r;
+}
+
+/* [ reading 0, reading 1, ... ] */
+static vector<uint8_t> make_array(size_t count)
+{
+    uint8_t empty;
+    vector<uint8_t> data;
+
+    /* The first pass only counts the size. */
+    for (int pass = 0; pass < 2; pass++)
+    {
+        binson_writer w;
+        binson_writer_init(&w, pass ? data.data() : &empty, data.size());
+        binson_write_array_begin(&w);
+        for (size_t i = 0; i < count; i++)
+            binsonSerialize(make_reading(i), &w);
+        binson_write_array_end(&w);
+        data.resize(binson_writer_get_counter(&w));
+    }
+
+    return data;
+}
+
+/*======= Test cases ========================================================*/
+
+TEST(structs_in_array_order)
+{
+    vector<uint8_t> data = make_array(ELEMENTS);
+
+    for (size_t threads : { 1, 2, 5, 0 })
+    {
+        vector<Reading> out;
+        vector<binson_err> results;
+
+        ASSERT_TRUE(binsonDeserializeArray(out, data.data(), data.size(),
+                                           threads, &results, 7) == BINSON_ERROR_NONE);
+        ASSERT_TRUE(out.size() == ELEMENTS);
+        ASSERT_TRUE(results.size() == ELEMENTS);
+        for (size_t i = 0; i < ELEMENTS; i++)
+        {
+            Reading expected = make_reading(i);
+
+            ASSERT_TRUE(out[i].id == expected.id);
+            ASSERT_TRUE(out[i].value == expected.value);
+            ASSERT_TRUE(out[i].sensor == expected.sensor);
+            ASSERT_TRUE(out[i].history.hasValue() == expected.history.hasValue());
+            ASSERT_TRUE(!expected.history || (out[i].history.value() == expected.history.value()));
+            ASSERT_TRUE(results[i] == BINSON_ERROR_NONE);
+        }
+    }
+}
+
+TEST(binson_elements)
+{
+    vector<uint8_t> data = make_array(300);
+    vector<Binson> out;
+
+    ASSERT_TRUE(binsonDeserializeArray(out, data.data(), data.size(), 3) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(out.size() == 300);
+    for (size_t i = 0; i < out.size(); i++)
+    {
+        ASSERT_TRUE(out[i].get("id").getInt() == static_cast<int64_t>(i));
+        ASSERT_TRUE(out[i].get("sensor").getString() == make_reading(i).sensor);
+        ASSERT_TRUE(out[i].hasKey("history") == (i % 3 == 0));
+    }
+
+    /* Empty array. */
+    const uint8_t empty[] = { 0x42, 0x43 };
+    ASSERT_TRUE(binsonDeserializeArray(out, empty, sizeof(empty)) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(out.empty());
+}
+
+TEST(first_error_in_array_order)
+{
+    vector<uint8_t> element = binsonSerialize(make_reading(1));
+    vector<uint8_t> bad(element);
+    vector<uint8_t> data;
+    vector<Reading> out;
+    vector<binson_err> results;
+
+    /* Element 4 has no "id" (renamed "ie"), element 9 is a scalar. */
+    for (size_t i = 0; i + 3 < bad.size(); i++)
+    {
+        if ((bad[i] == 0x14) && (bad[i + 1] == 2) && (bad[i + 2] == 'i') && (bad[i + 3] == 'd'))
+        {
+            bad[i + 3] = 'e';
+            break;
+        }
+    }
+
+    data.push_back(0x42);
+    for (size_t i = 0; i < 12; i++)
+    {
+        if (i == 4)
+            data.insert(data.end(), bad.begin(), bad.end());
+        else if (i == 9)
+            data.insert(data.end(), { 0x10, 0x05 });
+        else
+            data.insert(data.end(), element.begin(), element.end());
+    }
+    data.push_back(0x43);
+
+    binson_err err = binsonDeserializeArray(out, data.data(), data.size(), 4, &results, 1);
+    ASSERT_TRUE(err != BINSON_ERROR_NONE);
+    ASSERT_TRUE(err == results[4]);
+    ASSERT_TRUE(results[9] == BINSON_ERROR_FORMAT);
+    ASSERT_TRUE(out.size() == 12);
+    ASSERT_TRUE(out[3].id == 1);
+    ASSERT_TRUE(out[11].sensor == "sensor-1");
+
+    /* Not an array, or elements running into the end. */
+    ASSERT_TRUE(binsonDeserializeArray(out, element.data(), element.size()) == BINSON_ERROR_FORMAT);
+    ASSERT_TRUE(out.empty());
+    data[data.size() - 2] = 0x14;
+    ASSERT_TRUE(binsonDeserializeArray(out, data.data(), data.size()) == BINSON_ERROR_FORMAT);
+    ASSERT_TRUE(binsonDeserializeArray(out, nullptr, 2) == BINSON_ERROR_NULL);
+}
+
+/*======= Main function =====================================================*/
+
+int main(void) {
+    RUN_TEST(structs_in_array_order);
+    RUN_TEST(binson_elements);
+    RUN_TEST(first_error_in_array_order);
+    PRINT_RESULT();
+}
@@ -0,0 +1,317 @@
+/**
+ * @file binson_batch_test.c
+ *
+ * Multi threaded batch verification.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "binson_batch.h"
+#include "binson_writer.h"
+#include "utest.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define MESSAGES    (3000U)
+
+/*======= Local function prototypes =========================================*/
+
+static void build_messages(void);
+static binson_err expected_result(const bbuf *message, uint8_t options);
+static binson_err check_field(void *context, size_t n, binson_parser *parser);
+
+/*======= Local variable declarations =======================================*/
+
+static uint8_t buffer[MESSAGES * 64];
+static bbuf messages[MESSAGES];
+static binson_err expected[MESSAGES];
+static binson_err results[MESSAGES];
+static unsigned int seen[MESSAGES];
+
+/*======= Test cases ========================================================*/
+
+TEST(results_do_not_depend_on_threads)
+{
+    const size_t threads[] = { 1, 2, 3, 8, 64, 0 };
+    const size_t chunks[] = { 1, 7, 0, MESSAGES };
+    size_t passed = 0;
+    size_t i;
+    size_t t;
+    size_t c;
+
+    build_messages();
+    for (i = 0; i < MESSAGES; i++) {
+        expected[i] = expected_result(&messages[i], 0);
+        passed += (BINSON_ERROR_NONE == expected[i]) ? 1 : 0;
+    }
+    ASSERT_TRUE(passed > MESSAGES / 2);
+    ASSERT_TRUE(passed < MESSAGES);
+
+    for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+            binson_batch batch;
+
+            ASSERT_TRUE(binson_batch_init(&batch));
+            batch.threads = threads[t];
+            batch.chunk = chunks[c];
+            memset(results, 0xFF, sizeof(results));
+
+            ASSERT_TRUE(binson_batch_verify(&batch, messages, MESSAGES, results));
+            ASSERT_TRUE(memcmp(results, expected, sizeof(results)) == 0);
+            ASSERT_TRUE(batch.passed == passed);
+            ASSERT_TRUE(batch.failed == MESSAGES - passed);
+            ASSERT_TRUE(batch.threads_used >= 1);
+            ASSERT_TRUE((0 == threads[t]) || (batch.threads_used <= threads[t]));
+            ASSERT_TRUE(batch.error_flags == BINSON_ERROR_NONE);
+        }
+    }
+
+    /* Totals only. */
+    {
+        binson_batch batch;
+
+        ASSERT_TRUE(binson_batch_init(&batch));
+        batch.threads = 4;
+        ASSERT_TRUE(binson_batch_verify(&batch, messages, MESSAGES, NULL));
+        ASSERT_TRUE(batch.passed == passed);
+    }
+}
+
+TEST(callback_runs_once_per_verified_message)
+{
+    binson_batch batch;
+    size_t i;
+
+    build_messages();
+    memset(seen, 0, sizeof(seen));
+
+    ASSERT_TRUE(binson_batch_init(&batch));
+    batch.threads = 4;
+    batch.chunk = 5;
+    batch.callback = check_field;
+    batch.callback_context = seen;
+    ASSERT_TRUE(binson_batch_verify(&batch, messages, MESSAGES, results));
+
+    for (i = 0; i < MESSAGES; i++) {
+        binson_err verified = expected_result(&messages[i], 0);
+
+        if (BINSON_ERROR_NONE == verified) {
+            ASSERT_TRUE(1 == seen[i]);
+            ASSERT_TRUE(results[i] == ((i % 5 == 0) ? BINSON_ERROR_STATE : BINSON_ERROR_NONE));
+        }
+        else {
+            ASSERT_TRUE(0 == seen[i]);
+            ASSERT_TRUE(results[i] == verified);
+        }
+    }
+}
+
+TEST(parser_options_are_applied)
+{
+    const uint8_t bad_utf8[] = { 0x40, 0x14, 0x01, 'a', 0x14, 0x02, 0xC3, 0x28, 0x41 };
+    bbuf message;
+    binson_batch batch;
+
+    message.bptr = bad_utf8;
+    message.bsize = sizeof(bad_utf8);
+
+    ASSERT_TRUE(binson_batch_init(&batch));
+    ASSERT_TRUE(binson_batch_verify(&batch, &message, 1, results));
+    ASSERT_TRUE(results[0] == BINSON_ERROR_NONE);
+
+    batch.parser_options = BINSON_PARSER_OPTION_VALIDATE_UTF8;
+    ASSERT_TRUE(binson_batch_verify(&batch, &message, 1, results));
+    ASSERT_TRUE(results[0] == BINSON_ERROR_FORMAT);
+    ASSERT_TRUE(batch.failed == 1);
+}
+
+TEST(invalid_arguments)
+{
+    binson_batch batch;
+
+    ASSERT_FALSE(binson_batch_init(NULL));
+    ASSERT_FALSE(binson_batch_verify(NULL, messages, MESSAGES, results));
+
+    ASSERT_TRUE(binson_batch_init(&batch));
+    ASSERT_FALSE(binson_batch_verify(&batch, NULL, 1, results));
+    ASSERT_TRUE(batch.error_flags == BINSON_ERROR_NULL);
+
+    ASSERT_TRUE(binson_batch_verify(&batch, NULL, 0, NULL));
+    ASSERT_TRUE(batch.passed == 0);
+    ASSERT_TRUE(batch.failed == 0);
+    ASSERT_TRUE(batch.threads_used == 1);
+    ASSERT_TRUE(batch.error_flags == BINSON_ERROR_NONE);
+}
+
+TEST(array_elements)
+{
+    static uint8_t array[sizeof(buffer)];
+    binson_batch batch;
+    binson_writer w;
+    size_t size;
+    size_t i;
+
+    /* Elements with "i" equal to their index, and one scalar. */
+    binson_writer_init(&w, array, sizeof(array));
+    binson_write_array_begin(&w);
+    for (i = 0; i < MESSAGES; i++) {
+        if (i == 101) {
+            binson_write_integer(&w, 127);
+        }
+        else if (i % 11 == 3) {
+            binson_write_array_begin(&w);
+            binson_write_string(&w, "element");
+            binson_write_array_end(&w);
+        }
+        else {
+            binson_write_object_begin(&w);
+            binson_write_name(&w, "i");
+            binson_write_integer(&w, (int64_t) i);
+            binson_write_object_end(&w);
+        }
+    }
+    binson_write_array_end(&w);
+    size = binson_writer_get_counter(&w);
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_NONE);
+
+    memset(seen, 0, sizeof(seen));
+    ASSERT_TRUE(binson_batch_init(&batch));
+    batch.threads = 3;
+    batch.chunk = 10;
+    batch.callback = check_field;
+    batch.callback_context = seen;
+    ASSERT_TRUE(binson_batch_verify_array(&batch, array, size, results, MESSAGES));
+    ASSERT_TRUE(batch.count == MESSAGES);
+    ASSERT_TRUE(batch.failed == 1 + MESSAGES / 5);
+
+    for (i = 0; i < MESSAGES; i++) {
+        if (i == 101) {
+            ASSERT_TRUE(0 == seen[i]);
+            ASSERT_TRUE(results[i] == BINSON_ERROR_FORMAT);
+        }
+        else {
+            ASSERT_TRUE(1 == seen[i]);
+            ASSERT_TRUE(results[i] == ((i % 5 == 0) ? BINSON_ERROR_STATE : BINSON_ERROR_NONE));
+        }
+    }
+
+    /* Too few results: nothing is verified. */
+    memset(seen, 0, sizeof(seen));
+    ASSERT_FALSE(binson_batch_verify_array(&batch, array, size, results, MESSAGES - 1));
+    ASSERT_TRUE(batch.error_flags == BINSON_ERROR_RANGE);
+    ASSERT_TRUE(batch.count == MESSAGES);
+    ASSERT_TRUE(batch.passed + batch.failed == 0);
+    ASSERT_TRUE(seen[0] == 0);
+
+    /* Totals only. */
+    batch.callback = NULL;
+    ASSERT_TRUE(binson_batch_verify_array(&batch, array, size, NULL, 0));
+    ASSERT_TRUE(batch.failed == 1);
+
+    /* The last element runs into the end token. */
+    array[size - 2] = 0x14;
+    ASSERT_FALSE(binson_batch_verify_array(&batch, array, size, results, MESSAGES));
+    ASSERT_TRUE(batch.error_flags == BINSON_ERROR_FORMAT);
+    ASSERT_FALSE(binson_batch_verify_array(&batch, array, 1, results, MESSAGES));
+    ASSERT_TRUE(batch.error_flags == BINSON_ERROR_FORMAT);
+    ASSERT_FALSE(binson_batch_verify_array(&batch, NULL, size, results, MESSAGES));
+    ASSERT_TRUE(batch.error_flags == BINSON_ERROR_NULL);
+}
+
+/*======= Main function =====================================================*/
+
+int main(void) {
+    RUN_TEST(results_do_not_depend_on_threads);
+    RUN_TEST(callback_runs_once_per_verified_message);
+    RUN_TEST(parser_options_are_applied);
+    RUN_TEST(array_elements);
+    RUN_TEST(invalid_arguments);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
+
+/*
+ * Objects with field "i" and arrays, of varying size. Some are damaged:
+ * an unknown token, a missing end, an empty or a NULL message.
+ */
+static void build_messages(void)
+{
+    size_t offset = 0;
+    size_t i;
+
+    for (i = 0; i < MESSAGES; i++) {
+        binson_writer w;
+        uint8_t *out = &buffer[offset];
+        size_t size;
+
+        binson_writer_init(&w, out, sizeof(buffer) - offset);
+        if (i % 11 == 3) {
+            binson_write_array_begin(&w);
+            binson_write_integer(&w, (int64_t) i);
+            binson_write_array_end(&w);
+        }
+        else {
+            binson_write_object_begin(&w);
+            binson_write_name(&w, "i");
+            binson_write_integer(&w, (int64_t) i);
+            binson_write_name(&w, "s");
+            binson_write_string_with_len(&w, "abcdefghijklmnopqrstuvwxyz", i % 27);
+            binson_write_object_end(&w);
+        }
+        size = binson_writer_get_counter(&w);
+
+        if (i % 97 == 5) {
+            out[1] = 0x33;
+        }
+        else if (i % 89 == 7) {
+            size--;
+        }
+
+        messages[i].bptr = (i % 503 == 9) ? NULL : out;
+        messages[i].bsize = (i % 401 == 11) ? 0 : size;
+        offset += size + 1;
+    }
+}
+
+static binson_err expected_result(const bbuf *message, uint8_t options)
+{
+    binson_parser p;
+    bool ok;
+
+    if ((NULL == message->bptr) || (0 == message->bsize)) {
+        return (NULL == message->bptr) ? BINSON_ERROR_NULL : BINSON_ERROR_RANGE;
+    }
+
+    ok = (BINSON_DEF_ARRAY_BEGIN == message->bptr[0])
+        ? binson_parser_init_array(&p, message->bptr, message->bsize)
+        : binson_parser_init_object(&p, message->bptr, message->bsize);
+    if (!ok) {
+        return p.error_flags;
+    }
+    p.options = options;
+
+    return binson_parser_verify(&p) ? BINSON_ERROR_NONE : BINSON_ERROR_FORMAT;
+}
+
+/* Each call writes only seen[n], so calls on different threads do not race. */
+static binson_err check_field(void *context, size_t n, binson_parser *parser)
+{
+    unsigned int *counts = (unsigned int *) context;
+
+    counts[n]++;
+
+    if (BINSON_DEF_OBJECT_BEGIN == parser->buffer[0]) {
+        if (!binson_parser_go_into_object(parser) ||
+            !binson_parser_field(parser, "i") ||
+            (binson_parser_get_integer(parser) != (int64_t) n)) {
+            return BINSON_ERROR_WRONG_TYPE;
+        }
+    }
+
+    return (n % 5 == 0) ? BINSON_ERROR_STATE : BINSON_ERROR_NONE;
+}
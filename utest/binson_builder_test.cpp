@@ -0,0 +1,164 @@
+/**
+ * @file binson_builder_test.cpp
+ *
+ * Description
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <binson_builder.hpp>
+#include <binson.hpp>
+#include "utest.h"
+#include <string>
+#include <vector>
+
+/*======= Local Macro Definitions ===========================================*/
+/*======= Local function prototypes =========================================*/
+/*======= Local variable declarations =======================================*/
+
+using namespace std;
+
+/* {"a":1, "b":"text", "c":[-200, 2.5, true, {"x":70000}, []], "d":{}, "e":0x0102} */
+static size_t write_reference(uint8_t *buf, size_t size)
+{
+    binson_writer w;
+    const uint8_t bytes[] = { 0x01, 0x02 };
+    binson_writer_init(&w, buf, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "a");
+    binson_write_integer(&w, 1);
+    binson_write_name(&w, "b");
+    binson_write_string(&w, "text");
+    binson_write_name(&w, "c");
+    binson_write_array_begin(&w);
+    binson_write_integer(&w, -200);
+    binson_write_double(&w, 2.5);
+    binson_write_boolean(&w, true);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "x");
+    binson_write_integer(&w, 70000);
+    binson_write_object_end(&w);
+    binson_write_array_begin(&w);
+    binson_write_array_end(&w);
+    binson_write_array_end(&w);
+    binson_write_name(&w, "d");
+    binson_write_object_begin(&w);
+    binson_write_object_end(&w);
+    binson_write_name(&w, "e");
+    binson_write_bytes(&w, bytes, sizeof(bytes));
+    binson_write_object_end(&w);
+    return binson_writer_get_counter(&w);
+}
+
+static void build(binson_writer *w)
+{
+    const uint8_t bytes[] = { 0x01, 0x02 };
+    BinsonBuilder b(w);
+    BinsonBuilder::Object root = b.object();
+    root.field("a", 1).field("b", "text");
+    {
+        BinsonBuilder::Array c = root.array("c");
+        c.value(-200).value(2.5).value(true);
+        c.object().field(string("x"), 70000L);
+        c.array();
+    }
+    root.object("d");
+    root.field(BinsonFieldName("e", 1), bytes, sizeof(bytes));
+}
+
+/*======= Test cases ========================================================*/
+
+TEST(builder_matches_writer)
+{
+    uint8_t expected[128];
+    uint8_t result[128];
+    size_t expected_size = write_reference(expected, sizeof(expected));
+
+    binson_writer w;
+    ASSERT_TRUE(binson_writer_init(&w, result, sizeof(result)));
+    build(&w);
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_NONE);
+    ASSERT_TRUE(binson_writer_get_counter(&w) == expected_size);
+    ASSERT_TRUE(memcmp(expected, result, expected_size) == 0);
+    ASSERT_TRUE(binson_writer_verify(&w));
+}
+
+TEST(builder_compile_time_names)
+{
+    constexpr BinsonFieldName name("abc");
+    static_assert(name.size() == 3, "name length");
+    static_assert(name.headerSize() == 2, "name header size");
+    static_assert(name.header()[0] == BINSON_DEF_STRINGLEN_INT8, "name token");
+    static_assert(name.header()[1] == 3, "name length byte");
+
+    /* Long names get a wider length header, same as the writer. */
+    string long_name(300, 'n');
+    uint8_t expected[700];
+    uint8_t result[700];
+    binson_writer w;
+    binson_writer_init(&w, expected, sizeof(expected));
+    binson_write_object_begin(&w);
+    binson_write_name(&w, long_name.c_str());
+    binson_write_string(&w, long_name.c_str());
+    binson_write_object_end(&w);
+    size_t expected_size = binson_writer_get_counter(&w);
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_NONE);
+
+    binson_writer_init(&w, result, sizeof(result));
+    {
+        BinsonBuilder b(&w);
+        b.object().field(long_name, long_name);
+    }
+    ASSERT_TRUE(binson_writer_get_counter(&w) == expected_size);
+    ASSERT_TRUE(memcmp(expected, result, expected_size) == 0);
+}
+
+TEST(builder_too_small_buffer)
+{
+    uint8_t expected[128];
+    size_t expected_size = write_reference(expected, sizeof(expected));
+
+    /* Reports the required size without writing past the buffer. */
+    for (size_t size = 0; size < expected_size; size++)
+    {
+        uint8_t result[128];
+        memset(result, 0xAA, sizeof(result));
+        binson_writer w;
+        ASSERT_TRUE(binson_writer_init(&w, result, size));
+        build(&w);
+        ASSERT_TRUE(w.error_flags == BINSON_ERROR_RANGE);
+        ASSERT_TRUE(binson_writer_get_counter(&w) == expected_size);
+        for (size_t i = size; i < sizeof(result); i++)
+            ASSERT_TRUE(result[i] == 0xAA);
+    }
+}
+
+TEST(builder_binson_roundtrip)
+{
+    uint8_t result[128];
+    binson_writer w;
+    ASSERT_TRUE(binson_writer_init(&w, result, sizeof(result)));
+    build(&w);
+
+    Binson b;
+    b.deserialize(result, binson_writer_get_counter(&w));
+    ASSERT_TRUE(b.get("a").getInt() == 1);
+    ASSERT_TRUE(b.get("b").getString() == "text");
+    ASSERT_TRUE(b.get("c").getArray().size() == 5);
+    ASSERT_TRUE(b.get("c").getArray()[3].getObject().get("x").getInt() == 70000);
+    ASSERT_TRUE(b.get("e").getBin().size() == 2);
+}
+
+int main(void) {
+    RUN_TEST(builder_matches_writer);
+    RUN_TEST(builder_compile_time_names);
+    RUN_TEST(builder_too_small_buffer);
+    RUN_TEST(builder_binson_roundtrip);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
@@ -16,6 +16,7 @@
 #include <binson.hpp>
 #include "utest.h"
 #include <vector>
+#include <iterator>
 
 /*======= Local Macro Definitions ===========================================*/
 /*======= Local function prototypes =========================================*/
@@ -238,12 +239,356 @@ TEST(serialize_vector)
     }
 }
 
+TEST(buffer_backed_deserialize)
+{
+    size_t binson_expected_size = sizeof(binson_bytes) - 1;
+    auto data = make_shared<vector<uint8_t>>(binson_bytes, binson_bytes + binson_expected_size);
+    const uint8_t *first = data->data();
+    const uint8_t *last = data->data() + data->size();
+
+    Binson b;
+    b.deserialize(data);
+
+    bbuf ref = b.get("A").getStringRef();
+    ASSERT_TRUE(ref.bptr >= first && ref.bptr + ref.bsize <= last);
+    ASSERT_TRUE(ref.bsize == 1 && ref.bptr[0] == 'B');
+    ref = b.get("G").getBinRef();
+    ASSERT_TRUE(ref.bptr >= first && ref.bptr + ref.bsize <= last);
+    ref = b.get("C").getArray()[2].getObject().get("A").getStringRef();
+    ASSERT_TRUE(ref.bptr >= first && ref.bptr + ref.bsize <= last);
+
+    /* The DOM keeps the buffer alive. */
+    data.reset();
+    ASSERT_TRUE(b.get("A").getString() == string("B"));
+    ASSERT_TRUE(b.get("G").getBin() == vector<uint8_t>({0x02, 0x02}));
+
+    auto out = b.serialize();
+    ASSERT_TRUE(out.size() == binson_expected_size);
+    ASSERT_TRUE(memcmp(binson_bytes, out.data(), binson_expected_size) == 0);
+
+    /* Mutation replaces the reference with an owned value. */
+    Binson copy = b;
+    copy.put("A", "C");
+    ASSERT_TRUE(copy.get("A").getString() == string("C"));
+    ASSERT_TRUE(b.get("A").getString() == string("B"));
+}
+
+TEST(serialize_cached_subtrees)
+{
+    size_t binson_expected_size = sizeof(binson_bytes) - 1;
+    Binson b;
+    b.deserialize(binson_bytes, binson_expected_size);
+
+    auto first = b.serializeCached();
+    auto second = b.serialize();
+    ASSERT_TRUE(first->size() == binson_expected_size);
+    ASSERT_TRUE(*first == second);
+
+    /* Nested objects refer to the cached buffer. */
+    b.put("D", 1.5);
+    auto third = b.serialize();
+    ASSERT_TRUE(third.size() == binson_expected_size);
+    ASSERT_TRUE(memcmp(third.data(), first->data(), 78) == 0);
+    b.put("D", 3.141592653589793);
+    ASSERT_TRUE(b.serializeCached()->size() == binson_expected_size);
+    first.reset();
+    ASSERT_TRUE(b.serialize() == second);
+
+    /* Change a leaf deep down and put the subtree back. */
+    Binson inner = b.get("C").getArray()[2].getObject();
+    inner.put("A", "X");
+    vector<BinsonValue> array = b.get("C").getArray();
+    array[2] = BinsonValue(inner);
+    b.put("C", array);
+
+    auto changed = b.serialize();
+    ASSERT_TRUE(*b.serializeCached() == changed);
+    ASSERT_TRUE(b.serialize() == changed);
+    Binson fresh;
+    fresh.deserialize(changed);
+    ASSERT_TRUE(fresh.get("C").getArray()[2].getObject().get("A").getString() == string("X"));
+    ASSERT_TRUE(fresh.get("B").getObject().get("A").getString() == string("B"));
+    ASSERT_TRUE(changed.size() == binson_expected_size);
+
+    /* Uncached re-encoding gives the same bytes. */
+    Binson uncached;
+    uncached.deserialize(changed);
+    uncached.put("E", false);
+    ASSERT_TRUE(uncached.serialize() == changed);
+
+    /* Cached bytes from a shared input buffer. */
+    auto data = make_shared<vector<uint8_t>>(changed);
+    Binson shared;
+    shared.deserialize(data);
+    ASSERT_TRUE(shared.serialize() == changed);
+    shared.put("F", 1);
+    ASSERT_FALSE(shared.serialize() == changed);
+    shared.put("F", 127);
+    ASSERT_TRUE(shared.serialize() == changed);
+}
+
+TEST(serialize_exact_size)
+{
+    uint8_t expected[70000];
+    binson_writer w;
+    string long_string(40000, 'x');
+    vector<uint8_t> bytes(200, 0xAA);
+
+    binson_writer_init(&w, expected, sizeof(expected));
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "a");
+    binson_write_integer(&w, -129);
+    binson_write_name(&w, "b");
+    binson_write_integer(&w, 70000);
+    binson_write_name(&w, "c");
+    binson_write_integer(&w, INT64_MIN);
+    binson_write_name(&w, "d");
+    binson_write_double(&w, -2.5);
+    binson_write_name(&w, "e");
+    binson_write_string_with_len(&w, long_string.data(), long_string.size());
+    binson_write_name(&w, "f");
+    binson_write_bytes(&w, bytes.data(), bytes.size());
+    binson_write_name(&w, "g");
+    binson_write_array_begin(&w);
+    binson_write_boolean(&w, true);
+    binson_write_object_begin(&w);
+    binson_write_object_end(&w);
+    binson_write_array_end(&w);
+    binson_write_object_end(&w);
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_NONE);
+    size_t expected_size = binson_writer_get_counter(&w);
+
+    Binson b;
+    b.put("a", -129);
+    b.put("b", 70000);
+    b.put("c", static_cast<int64_t>(INT64_MIN));
+    b.put("d", -2.5);
+    b.put("e", long_string);
+    b.put("f", bytes);
+    b.put("g", vector<BinsonValue>({true, Binson()}));
+
+    ASSERT_TRUE(b.serializedSize() == expected_size);
+
+    auto data = b.serialize();
+    ASSERT_TRUE(data.size() == expected_size);
+    ASSERT_TRUE(memcmp(data.data(), expected, expected_size) == 0);
+
+    string str;
+    b.serialize(str);
+    ASSERT_TRUE(str.size() == expected_size);
+    ASSERT_TRUE(memcmp(str.data(), expected, expected_size) == 0);
+
+    vector<uint8_t> out;
+    b.serializeTo(back_inserter(out));
+    ASSERT_TRUE(out == data);
+
+    uint8_t small[16];
+    ASSERT_TRUE(b.serialize(small, sizeof(small)) == expected_size);
+    vector<uint8_t> buffer(expected_size);
+    ASSERT_TRUE(b.serialize(buffer.data(), buffer.size()) == expected_size);
+    ASSERT_TRUE(buffer == data);
+
+    /* Writer accounting is kept: the counter tells the required size. */
+    binson_writer_init(&w, small, sizeof(small));
+    b.serialize(&w);
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_RANGE);
+    ASSERT_TRUE(binson_writer_get_counter(&w) == expected_size);
+
+    /* Uncached path gives the same bytes after a change. */
+    b.put("h", false);
+    ASSERT_TRUE(b.serializedSize() == expected_size + 4);
+    data = b.serialize();
+    ASSERT_TRUE(data.size() == expected_size + 4);
+    ASSERT_TRUE(memcmp(data.data(), expected, expected_size - 1) == 0);
+}
+
+TEST(try_deserialize)
+{
+    size_t binson_expected_size = sizeof(binson_bytes) - 1;
+    Binson b;
+
+    ASSERT_TRUE(b.tryDeserialize(binson_bytes, binson_expected_size) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(b.hasKey("A"));
+
+    /* Truncated, flipped and empty input never throws. */
+    for (size_t i = 0; i < binson_expected_size; i++)
+    {
+        vector<uint8_t> bad(binson_bytes, binson_bytes + binson_expected_size);
+        bad[i] ^= 0x55;
+        binson_err err = b.tryDeserialize(bad);
+        if (err != BINSON_ERROR_NONE)
+            ASSERT_TRUE(!b.hasKey("A"));
+
+        bool thrown = false;
+        try {
+            Binson b2;
+            b2.deserialize(bad);
+        } catch (const std::runtime_error &e) {
+            thrown = true;
+        }
+        ASSERT_TRUE(thrown == (err != BINSON_ERROR_NONE));
+    }
+    ASSERT_TRUE(b.tryDeserialize(binson_bytes, binson_expected_size - 1) != BINSON_ERROR_NONE);
+    ASSERT_TRUE(b.tryDeserialize(vector<uint8_t>()) != BINSON_ERROR_NONE);
+    ASSERT_TRUE(b.tryDeserialize(nullptr, 0) == BINSON_ERROR_NULL);
+
+    ASSERT_TRUE(b.tryDeserialize(binson_bytes, binson_expected_size) == BINSON_ERROR_NONE);
+    int64_t i = 0;
+    bool flag = true;
+    double d = 0.0;
+    bbuf ref;
+    ASSERT_TRUE(b.tryGet("F")->tryGetInt(i) && i == 127);
+    ASSERT_FALSE(b.tryGet("F")->tryGetDouble(d));
+    ASSERT_TRUE(b.tryGet("E")->tryGetBool(flag) && !flag);
+    ASSERT_TRUE(b.tryGet("D")->tryGetDouble(d) && d == 3.141592653589793);
+    ASSERT_TRUE(b.tryGet("A")->tryGetStringRef(ref) && ref.bsize == 1);
+    ASSERT_TRUE(*b.tryGet("A")->tryGetString() == "B");
+    ASSERT_TRUE(b.tryGet("A")->tryGetBin() == nullptr);
+    ASSERT_TRUE(b.tryGet("G")->tryGetBinRef(ref) && ref.bsize == 2);
+    ASSERT_TRUE(b.tryGet("B")->tryGetObject() != nullptr);
+    ASSERT_TRUE(b.tryGet("C")->tryGetArray()->size() == 4);
+    ASSERT_TRUE(b.tryGet("C")->tryGetObject() == nullptr);
+    ASSERT_TRUE(b.tryGet("X") == nullptr);
+}
+
+TEST(interned_names)
+{
+    size_t binson_expected_size = sizeof(binson_bytes) - 1;
+    vector<uint8_t> reference;
+    {
+        Binson b;
+        b.deserialize(binson_bytes, binson_expected_size);
+        reference = b.serialize();
+    }
+
+    Binson::setNameInterning(true);
+
+    Binson b1, b2;
+    b1.deserialize(binson_bytes, binson_expected_size);
+    b2.deserialize(binson_bytes, binson_expected_size);
+    ASSERT_TRUE(b1.serialize() == reference);
+
+    /* Equal names share one symbol. */
+    auto it1 = b1.begin();
+    auto it2 = b2.begin();
+    for (; it1 != b1.end(); ++it1, ++it2)
+    {
+        ASSERT_TRUE(it1.name().isSameSymbol(it2.name()));
+        ASSERT_TRUE(it1->first == it2->first);
+    }
+
+    BinsonName a = BinsonName::intern("A");
+    ASSERT_TRUE(a.isSameSymbol(b1.begin().name()));
+    ASSERT_TRUE(b1.get(a).getString() == b1.get("A").getString());
+
+    /* put() interns keys and replaces existing values. */
+    Binson b3;
+    b3.put("A", "x");
+    b3.put("A", "y");
+    ASSERT_TRUE(b3.begin().name().isSameSymbol(a));
+    ASSERT_TRUE(b3.get("A").getString() == "y");
+    ASSERT_TRUE(b3.tryGet("B") == nullptr);
+
+    /* Once the table is full names are copied. */
+    Binson::setNameInterning(true, 0);
+    Binson b4;
+    b4.put("not interned", 1);
+    ASSERT_FALSE(b4.begin().name().isSameSymbol(BinsonName::intern("not interned")));
+    ASSERT_TRUE(b4.get("not interned").getInt() == 1);
+
+    Binson::setNameInterning(false);
+    Binson b5;
+    b5.deserialize(binson_bytes, binson_expected_size);
+    ASSERT_FALSE(b5.begin().name().isSameSymbol(a));
+    ASSERT_TRUE(b5.serialize() == reference);
+}
+
+TEST(string_keyed_iteration)
+{
+    Binson b;
+    b.put("b", 2);
+    b.put("a", 1);
+    b.put("ccc", "x");
+
+    /* Names are std::string, as with the former std::map<std::string> keys. */
+    std::string names;
+    int64_t sum = 0;
+    for (const auto &item : b)
+    {
+        names += item.first + "/" + std::to_string(item.first.size()) + " ";
+        if (item.second.myType() == BinsonValue::Types::intType)
+            sum += item.second.getInt();
+    }
+    ASSERT_TRUE(names == "a/1 b/1 ccc/3 ");
+    ASSERT_TRUE(sum == 3);
+
+    Binson::const_iterator it = b.end();
+    --it;
+    ASSERT_TRUE(it->first.compare("ccc") == 0);
+    ASSERT_TRUE(it->second.getString() == "x");
+    ASSERT_TRUE(it.name() == "ccc");
+    ASSERT_TRUE(std::distance(b.begin(), b.end()) == 3);
+}
+
+TEST(scalar_arrays)
+{
+    vector<BinsonValue> ints, doubles, bools, mixed, nested;
+    for (int64_t i = -40; i < 40; i++)
+        ints.push_back(i * i * i);
+    for (int i = 0; i < 70; i++)
+        doubles.push_back(i * 0.25);
+    for (int i = 0; i < 70; i++)
+        bools.push_back(i % 3 == 0);
+    mixed = { 1, 2, "three", 4.0, vector<BinsonValue>{ 5 }, 6 };
+    nested = { ints, mixed };
+
+    Binson b;
+    b.put("bools", bools)
+     .put("doubles", doubles)
+     .put("empty", vector<BinsonValue>())
+     .put("ints", ints)
+     .put("mixed", mixed)
+     .put("nested", nested);
+    vector<uint8_t> data = b.serialize();
+
+    Binson r;
+    ASSERT_TRUE(r.tryDeserialize(data) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(r.serialize() == data);
+    ASSERT_TRUE(r.get("ints").getArray().size() == 80);
+    ASSERT_TRUE(r.get("ints").getArray()[0].getInt() == -64000);
+    ASSERT_TRUE(r.get("doubles").getArray()[69].getDouble() == 17.25);
+    ASSERT_TRUE(r.get("bools").getArray()[3].getBool());
+    ASSERT_TRUE(r.get("mixed").getArray()[2].getString() == "three");
+    ASSERT_TRUE(r.get("mixed").getArray()[5].getInt() == 6);
+    ASSERT_TRUE(r.get("empty").getArray().empty());
+}
+
+TEST(to_str_large)
+{
+    /* More text than the first 10000 byte attempt holds. */
+    Binson b;
+    b.put("b", vector<uint8_t>(6000, 0xab));
+    b.put("d", 0.1);
+    string s = b.toStr();
+    ASSERT_TRUE(s.size() == 12000 + 18);
+    ASSERT_TRUE(s.compare(0, 12, "{\"b\":\"0xabab") == 0);
+    ASSERT_TRUE(s.compare(s.size() - 10, 10, "\",\"d\":0.1}") == 0);
+}
+
 /*======= Main function =====================================================*/
 
 int main(void) {
     RUN_TEST(binson_class_test1);
     RUN_TEST(unsorted_writing);
     RUN_TEST(serialize_vector);
+    RUN_TEST(buffer_backed_deserialize);
+    RUN_TEST(serialize_cached_subtrees);
+    RUN_TEST(serialize_exact_size);
+    RUN_TEST(try_deserialize);
+    RUN_TEST(interned_names);
+    RUN_TEST(string_keyed_iteration);
+    RUN_TEST(scalar_arrays);
+    RUN_TEST(to_str_large);
     PRINT_RESULT();
 }
 
@@ -0,0 +1,441 @@
+/**
+ * @file binson_filter_test.c
+ *
+ * Predicates on raw binson objects and filtering record files.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "binson_filter.h"
+#include "binson_writer.h"
+#include "utest.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define RECORDS     (2000U)
+#define BLOCK_SIZE  (4096U)
+
+/*======= Type Definitions ==================================================*/
+
+typedef struct memory_sink_s {
+    uint8_t     data[512 * 1024];
+    size_t      size;
+} memory_sink;
+
+/*======= Local function prototypes =========================================*/
+
+static bool memory_write(void *context, const uint8_t *data, size_t size);
+static size_t build_event(uint8_t *buffer, size_t size, uint64_t n);
+static size_t write_events(bool dictionary);
+static bool expected_match(size_t query, uint64_t n);
+static void build_query(binson_filter *filter, size_t query);
+static void mark_match(void *context, uint64_t n, const binson_record_block *b, const bbuf *record);
+
+/*======= Local variable declarations =======================================*/
+
+static memory_sink file;
+static uint8_t block[BLOCK_SIZE];
+static unsigned int hits[RECORDS];
+
+/*======= Test cases ========================================================*/
+
+TEST(predicates_on_objects)
+{
+    static const uint8_t raw[] = { 0x01, 0x02, 0x03 };
+    uint8_t object[256];
+    binson_filter f;
+    binson_writer w;
+    size_t size;
+
+    /* {"a":-300, "b":{"c":"hello", "d":true}, "e":1.5, "f":0x010203, "z":INT64_MIN} */
+    binson_writer_init(&w, object, sizeof(object));
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "a");
+    binson_write_integer(&w, -300);
+    binson_write_name(&w, "b");
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "c");
+    binson_write_string(&w, "hello");
+    binson_write_name(&w, "d");
+    binson_write_boolean(&w, true);
+    binson_write_object_end(&w);
+    binson_write_name(&w, "e");
+    binson_write_double(&w, 1.5);
+    binson_write_name(&w, "f");
+    binson_write_bytes(&w, raw, sizeof(raw));
+    binson_write_name(&w, "z");
+    binson_write_integer(&w, INT64_MIN);
+    binson_write_object_end(&w);
+    size = binson_writer_get_counter(&w);
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_NONE);
+
+    /* The empty filter matches any object. */
+    ASSERT_TRUE(binson_filter_init(&f));
+    ASSERT_TRUE(binson_filter_match(&f, object, size));
+
+    ASSERT_TRUE(binson_filter_equal_integer(&f, "a", -300));
+    ASSERT_TRUE(binson_filter_exists(&f, "b.d"));
+    ASSERT_TRUE(binson_filter_equal_string(&f, "b.c", "hello"));
+    ASSERT_TRUE(binson_filter_prefix_string(&f, "b.c", "hel"));
+    ASSERT_TRUE(binson_filter_prefix_string(&f, "b.c", ""));
+    ASSERT_TRUE(binson_filter_equal_boolean(&f, "b.d", true));
+    ASSERT_TRUE(binson_filter_range_double(&f, "e", 1.0, 2.0));
+    ASSERT_TRUE(binson_filter_equal_bytes(&f, "f", raw, sizeof(raw)));
+    ASSERT_TRUE(binson_filter_prefix_bytes(&f, "f", raw, 2));
+    ASSERT_TRUE(binson_filter_range_integer(&f, "z", INT64_MIN, -1));
+    ASSERT_TRUE(binson_filter_exists(&f, "b"));
+    ASSERT_TRUE(f.count == 11);
+    ASSERT_TRUE(binson_filter_match(&f, object, size));
+
+    /* Each failing predicate on its own. */
+#define ASSERT_NO_MATCH(add) \
+    do { \
+        ASSERT_TRUE(binson_filter_init(&f)); \
+        ASSERT_TRUE(add); \
+        ASSERT_FALSE(binson_filter_match(&f, object, size)); \
+    } while (0)
+
+    ASSERT_NO_MATCH(binson_filter_equal_integer(&f, "a", 300));
+    ASSERT_NO_MATCH(binson_filter_range_integer(&f, "a", -299, 0));
+    ASSERT_NO_MATCH(binson_filter_range_double(&f, "a", -400.0, 0.0));
+    ASSERT_NO_MATCH(binson_filter_equal_string(&f, "b.c", "hell"));
+    ASSERT_NO_MATCH(binson_filter_equal_string(&f, "b.c", "hello!"));
+    ASSERT_NO_MATCH(binson_filter_prefix_string(&f, "b.c", "help"));
+    ASSERT_NO_MATCH(binson_filter_prefix_string(&f, "b.c", "hello world"));
+    ASSERT_NO_MATCH(binson_filter_prefix_bytes(&f, "b.c", (const uint8_t *) "he", 2));
+    ASSERT_NO_MATCH(binson_filter_equal_boolean(&f, "b.d", false));
+    ASSERT_NO_MATCH(binson_filter_equal_integer(&f, "b.d", 1));
+    ASSERT_NO_MATCH(binson_filter_range_double(&f, "e", 1.6, 2.0));
+    ASSERT_NO_MATCH(binson_filter_equal_string(&f, "f", "\x01\x02\x03"));
+    ASSERT_NO_MATCH(binson_filter_equal_integer(&f, "z", INT64_MAX));
+    /* Missing fields: before, between and after the names present. */
+    ASSERT_NO_MATCH(binson_filter_exists(&f, "A"));
+    ASSERT_NO_MATCH(binson_filter_exists(&f, "bb"));
+    ASSERT_NO_MATCH(binson_filter_exists(&f, "zz"));
+    ASSERT_NO_MATCH(binson_filter_exists(&f, "b.c.x"));
+    ASSERT_NO_MATCH(binson_filter_exists(&f, "a.x"));
+    ASSERT_NO_MATCH(binson_filter_exists(&f, "b.e"));
+
+    /* Not an object, or cut off before the value. */
+    ASSERT_TRUE(binson_filter_init(&f));
+    ASSERT_TRUE(binson_filter_exists(&f, "z"));
+    ASSERT_FALSE(binson_filter_match(&f, object, size - 3));
+    ASSERT_FALSE(binson_filter_match(&f, object, 1));
+    ASSERT_FALSE(binson_filter_match(&f, NULL, size));
+    ASSERT_FALSE(binson_filter_match(NULL, object, size));
+    object[0] = BINSON_DEF_ARRAY_BEGIN;
+    ASSERT_FALSE(binson_filter_match(&f, object, size));
+}
+
+TEST(fields_are_searched_in_name_order)
+{
+    /* {"b":1, "a":2} is out of order, so "a" is not found after "b". */
+    static const uint8_t unsorted[] = {
+        0x40, 0x14, 0x01, 'b', 0x10, 0x01, 0x14, 0x01, 'a', 0x10, 0x02, 0x41
+    };
+    /* {"a":<bad token>, "b":1}: neither field is found past the bad token. */
+    static const uint8_t bad_value[] = {
+        0x40, 0x14, 0x01, 'a', 0x33, 0x14, 0x01, 'b', 0x10, 0x01, 0x41
+    };
+    /* {"ab":1, "b":2}: "a" sorts before "ab", "abc" after it. */
+    static const uint8_t prefix_names[] = {
+        0x40, 0x14, 0x02, 'a', 'b', 0x10, 0x01, 0x14, 0x01, 'b', 0x10, 0x02, 0x41
+    };
+    binson_filter f;
+
+    ASSERT_TRUE(binson_filter_init(&f));
+    ASSERT_TRUE(binson_filter_exists(&f, "a"));
+    ASSERT_FALSE(binson_filter_match(&f, unsorted, sizeof(unsorted)));
+    ASSERT_FALSE(binson_filter_match(&f, bad_value, sizeof(bad_value)));
+    ASSERT_FALSE(binson_filter_match(&f, prefix_names, sizeof(prefix_names)));
+
+    ASSERT_TRUE(binson_filter_init(&f));
+    ASSERT_TRUE(binson_filter_equal_integer(&f, "b", 1));
+    ASSERT_TRUE(binson_filter_match(&f, unsorted, sizeof(unsorted)));
+    ASSERT_FALSE(binson_filter_match(&f, bad_value, sizeof(bad_value)));
+
+    ASSERT_TRUE(binson_filter_init(&f));
+    ASSERT_TRUE(binson_filter_equal_integer(&f, "b", 2));
+    ASSERT_TRUE(binson_filter_match(&f, prefix_names, sizeof(prefix_names)));
+}
+
+TEST(invalid_predicates)
+{
+    char long_path[BINSON_FILTER_POOL_SIZE + 2];
+    binson_filter f;
+    size_t i;
+
+    ASSERT_FALSE(binson_filter_init(NULL));
+    ASSERT_FALSE(binson_filter_exists(NULL, "a"));
+    ASSERT_TRUE(binson_filter_init(&f));
+
+    ASSERT_FALSE(binson_filter_exists(&f, NULL));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_NULL);
+    ASSERT_FALSE(binson_filter_equal_string(&f, "a", NULL));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_NULL);
+    ASSERT_FALSE(binson_filter_equal_bytes(&f, "a", NULL, 1));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_NULL);
+
+    ASSERT_FALSE(binson_filter_exists(&f, ""));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_FORMAT);
+    ASSERT_FALSE(binson_filter_exists(&f, "a..b"));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_FORMAT);
+    ASSERT_FALSE(binson_filter_exists(&f, "a."));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_FORMAT);
+    ASSERT_FALSE(binson_filter_exists(&f, "a.b.c.d.e.f.g.h.i"));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_MAX_DEPTH);
+    ASSERT_TRUE(binson_filter_exists(&f, "a.b.c.d.e.f.g.h"));
+
+    memset(long_path, 'x', sizeof(long_path) - 1);
+    long_path[sizeof(long_path) - 1] = '\0';
+    ASSERT_FALSE(binson_filter_exists(&f, long_path));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_RANGE);
+    long_path[10] = '\0';
+    ASSERT_FALSE(binson_filter_equal_string(&f, "abc", &long_path[11]));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_RANGE);
+
+    /* Failed predicates left nothing behind. */
+    ASSERT_TRUE(f.count == 1);
+    ASSERT_TRUE(f.pool_used == 8);
+
+    for (i = 1; i < BINSON_FILTER_MAX_PREDICATES; i++) {
+        ASSERT_TRUE(binson_filter_equal_integer(&f, "n", (int64_t) i));
+    }
+    ASSERT_FALSE(binson_filter_exists(&f, "n"));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_RANGE);
+    ASSERT_TRUE(f.count == BINSON_FILTER_MAX_PREDICATES);
+}
+
+TEST(scan_record_files)
+{
+    const size_t threads[] = { 1, 3, 0 };
+    binson_record_file rf;
+    binson_filter_scan scan;
+    size_t d;
+    size_t q;
+    size_t t;
+
+    for (d = 0; d < 2; d++) {
+        size_t dictionary_blocks = 0;
+        size_t i;
+
+        ASSERT_TRUE(write_events(d == 1) > 0);
+        ASSERT_TRUE(binson_record_open_buffer(&rf, file.data, file.size));
+        ASSERT_TRUE(rf.block_count > 3);
+
+        for (i = 0; i < rf.block_count; i++) {
+            binson_record_block b;
+
+            ASSERT_TRUE(binson_record_block_open(&rf, i, &b) == BINSON_ERROR_NONE);
+            dictionary_blocks += (NULL != b.dictionary) ? 1 : 0;
+        }
+        ASSERT_TRUE((d == 1) ? (dictionary_blocks == rf.block_count) : (dictionary_blocks == 0));
+
+        for (q = 0; q < 6; q++) {
+            binson_filter f;
+            uint64_t expected = 0;
+            uint64_t n;
+
+            build_query(&f, q);
+            for (n = 0; n < RECORDS; n++) {
+                expected += expected_match(q, n) ? 1 : 0;
+            }
+            ASSERT_TRUE(expected > 0);
+
+            for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+                memset(hits, 0, sizeof(hits));
+                ASSERT_TRUE(binson_filter_scan_init(&scan));
+                scan.threads = threads[t];
+                scan.callback = mark_match;
+                scan.callback_context = hits;
+
+                ASSERT_TRUE(binson_filter_scan_file(&scan, &f, &rf));
+                ASSERT_TRUE(scan.scanned == RECORDS);
+                ASSERT_TRUE(scan.matched == expected);
+                ASSERT_TRUE(scan.damaged == 0);
+                ASSERT_TRUE(scan.threads_used >= 1);
+                for (n = 0; n < RECORDS; n++) {
+                    ASSERT_TRUE(hits[n] == (expected_match(q, n) ? 1U : 0U));
+                }
+            }
+        }
+        binson_record_close(&rf);
+    }
+}
+
+TEST(scan_skips_damaged_blocks)
+{
+    binson_record_file rf;
+    binson_record_block b;
+    binson_filter_scan scan;
+    binson_filter f;
+
+    ASSERT_TRUE(write_events(true) > 0);
+    ASSERT_TRUE(binson_record_open_buffer(&rf, file.data, file.size));
+    ASSERT_TRUE(binson_record_block_open(&rf, 1, &b) == BINSON_ERROR_NONE);
+    file.data[b.records + 3 - file.data] ^= 0x20;
+
+    ASSERT_TRUE(binson_filter_init(&f));
+    ASSERT_TRUE(binson_filter_scan_init(&scan));
+    scan.threads = 2;
+    ASSERT_FALSE(binson_filter_scan_file(&scan, &f, &rf));
+    ASSERT_TRUE(scan.error_flags == BINSON_ERROR_FORMAT);
+    ASSERT_TRUE(scan.damaged == 1);
+    ASSERT_TRUE(scan.scanned == RECORDS - b.record_count);
+    ASSERT_TRUE(scan.matched == scan.scanned);
+
+    ASSERT_FALSE(binson_filter_scan_file(&scan, NULL, &rf));
+    ASSERT_TRUE(scan.error_flags == BINSON_ERROR_NULL);
+    ASSERT_FALSE(binson_filter_scan_file(NULL, &f, &rf));
+    ASSERT_FALSE(binson_filter_scan_init(NULL));
+    binson_record_close(&rf);
+}
+
+/*======= Main function =====================================================*/
+
+int main(void) {
+    RUN_TEST(predicates_on_objects);
+    RUN_TEST(fields_are_searched_in_name_order);
+    RUN_TEST(invalid_predicates);
+    RUN_TEST(scan_record_files);
+    RUN_TEST(scan_skips_damaged_blocks);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
+
+static bool memory_write(void *context, const uint8_t *data, size_t size)
+{
+    memory_sink *sink = (memory_sink *) context;
+
+    if (size > sizeof(sink->data) - sink->size) {
+        return false;
+    }
+    memcpy(&sink->data[sink->size], data, size);
+    sink->size += size;
+
+    return true;
+}
+
+/*
+ * Event n: {"device":{"id":n % 50, "vendor":...}, "kind":..., "latency":n / 8,
+ * "ok":..., "payload":<3 bytes>, "seq":n} and "tag" for every fifth event.
+ */
+static size_t build_event(uint8_t *buffer, size_t size, uint64_t n)
+{
+    static const char *kinds[] = { "click", "view", "purchase", "error" };
+    const uint8_t payload[] = { (uint8_t) n, 0x01, 0x02 };
+    binson_writer w;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "device");
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "id");
+    binson_write_integer(&w, (int64_t) (n % 50));
+    binson_write_name(&w, "vendor");
+    binson_write_string(&w, (n % 3 == 0) ? "acme-west" : "globex");
+    binson_write_object_end(&w);
+    binson_write_name(&w, "kind");
+    binson_write_string(&w, kinds[n % 4]);
+    binson_write_name(&w, "latency");
+    binson_write_double(&w, (double) n / 8.0);
+    binson_write_name(&w, "ok");
+    binson_write_boolean(&w, n % 7 != 0);
+    binson_write_name(&w, "payload");
+    binson_write_bytes(&w, payload, sizeof(payload));
+    binson_write_name(&w, "seq");
+    binson_write_integer(&w, (int64_t) n * 1000);
+    if (n % 5 == 0) {
+        binson_write_name(&w, "tag");
+        binson_write_string(&w, "sampled");
+    }
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+static size_t write_events(bool dictionary)
+{
+    binson_record_writer w;
+    uint8_t record[256];
+    uint64_t n;
+
+    file.size = 0;
+    if (!binson_record_writer_init(&w, memory_write, &file, block, sizeof(block)) ||
+        (dictionary && !binson_record_writer_set_dictionary(&w))) {
+        return 0;
+    }
+
+    for (n = 0; n < RECORDS; n++) {
+        if (!binson_record_write(&w, record, build_event(record, sizeof(record), n))) {
+            break;
+        }
+    }
+
+    return binson_record_writer_finish(&w) ? file.size : 0;
+}
+
+static void build_query(binson_filter *filter, size_t query)
+{
+    const uint8_t payload[] = { 0x07, 0x01 };
+
+    binson_filter_init(filter);
+    switch (query) {
+        case 0:
+            binson_filter_equal_integer(filter, "device.id", 7);
+            break;
+        case 1:
+            binson_filter_prefix_string(filter, "device.vendor", "acme");
+            binson_filter_equal_boolean(filter, "ok", false);
+            break;
+        case 2:
+            binson_filter_equal_string(filter, "kind", "purchase");
+            binson_filter_range_double(filter, "latency", 10.0, 100.0);
+            break;
+        case 3:
+            binson_filter_exists(filter, "tag");
+            binson_filter_range_integer(filter, "seq", 500000, INT64_MAX);
+            break;
+        case 4:
+            binson_filter_prefix_bytes(filter, "payload", payload, sizeof(payload));
+            break;
+        default:
+            binson_filter_exists(filter, "device");
+            break;
+    }
+}
+
+static bool expected_match(size_t query, uint64_t n)
+{
+    switch (query) {
+        case 0:
+            return n % 50 == 7;
+        case 1:
+            return (n % 3 == 0) && (n % 7 == 0);
+        case 2:
+            return (n % 4 == 2) && (n >= 80) && (n <= 800);
+        case 3:
+            return (n % 5 == 0) && (n >= 500);
+        case 4:
+            return (uint8_t) n == 0x07;
+        default:
+            return true;
+    }
+}
+
+/* Each call writes only hits[n], so calls on different threads do not race. */
+static void mark_match(void *context, uint64_t n, const binson_record_block *b, const bbuf *record)
+{
+    unsigned int *counts = (unsigned int *) context;
+
+    (void) b;
+    (void) record;
+    if (n < RECORDS) {
+        counts[n]++;
+    }
+}
@@ -0,0 +1,327 @@
+/**
+ * @file binson_gen_test.c
+ *
+ * Tests code generated by binson_gen from binson_gen_test.schema.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "binson_light.h"
+#include "binson_gen_test_schema.h"
+#include "utest.h"
+
+/*======= Local Macro Definitions ===========================================*/
+/*======= Local function prototypes =========================================*/
+/*======= Local variable declarations =======================================*/
+
+static void _fill(Outer *o, bool full)
+{
+    size_t i;
+
+    memset(o, 0, sizeof(*o));
+    o->flag = true;
+    o->count = full ? INT64_MIN : 1000;
+    o->ratio = 2.5;
+    o->name_len = full ? sizeof(o->name) : 5;
+    memset(o->name, 'n', o->name_len);
+    o->key_len = 2;
+    o->key[0] = 0x01;
+    o->key[1] = 0xFF;
+    o->values_count = full ? 4 : 3;
+    for (i = 0; i < o->values_count; i++) {
+        o->values[i] = full ? INT64_MAX : (int64_t) i * 100 - 100;
+    }
+    o->tags_count = full ? 3 : 2;
+    for (i = 0; i < o->tags_count; i++) {
+        o->tags_len[i] = full ? 4 : 1;
+        memset(o->tags[i], 'a' + (int) i, o->tags_len[i]);
+    }
+    o->inner.id = 7;
+    o->inner.label_len = 3;
+    memcpy(o->inner.label, "abc", 3);
+    o->items_count = full ? 2 : 1;
+    o->items[0].id = -1;
+    if (full) {
+        o->has_extra = true;
+        o->has_note = true;
+        o->note = INT64_MAX;
+        o->inner.id = INT64_MAX;
+        o->inner.label_len = 8;
+        memcpy(o->inner.label, "12345678", 8);
+        o->extra = o->inner;
+        o->items[0] = o->inner;
+        o->items[1] = o->inner;
+        o->key_len = 4;
+    }
+}
+
+/* Reference encoding of _fill(o, false) with the writer API. */
+static size_t _write_reference(uint8_t *buf, size_t size)
+{
+    binson_writer w;
+    const uint8_t key[2] = { 0x01, 0xFF };
+
+    binson_writer_init(&w, buf, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "count");
+    binson_write_integer(&w, 1000);
+    binson_write_name(&w, "flag");
+    binson_write_boolean(&w, true);
+    binson_write_name(&w, "inner");
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "id");
+    binson_write_integer(&w, 7);
+    binson_write_name(&w, "label");
+    binson_write_string(&w, "abc");
+    binson_write_object_end(&w);
+    binson_write_name(&w, "items");
+    binson_write_array_begin(&w);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "id");
+    binson_write_integer(&w, -1);
+    binson_write_name(&w, "label");
+    binson_write_string(&w, "");
+    binson_write_object_end(&w);
+    binson_write_array_end(&w);
+    binson_write_name(&w, "key");
+    binson_write_bytes(&w, key, sizeof(key));
+    binson_write_name(&w, "name");
+    binson_write_string(&w, "nnnnn");
+    binson_write_name(&w, "nothing");
+    binson_write_object_begin(&w);
+    binson_write_object_end(&w);
+    binson_write_name(&w, "ratio");
+    binson_write_double(&w, 2.5);
+    binson_write_name(&w, "tags");
+    binson_write_array_begin(&w);
+    binson_write_string(&w, "a");
+    binson_write_string(&w, "b");
+    binson_write_array_end(&w);
+    binson_write_name(&w, "values");
+    binson_write_array_begin(&w);
+    binson_write_integer(&w, -100);
+    binson_write_integer(&w, 0);
+    binson_write_integer(&w, 100);
+    binson_write_array_end(&w);
+    binson_write_object_end(&w);
+    return binson_writer_get_counter(&w);
+}
+
+static bool _decode(Outer *o, const uint8_t *buf, size_t size, binson_err *err)
+{
+    binson_parser p;
+    bool ret = binson_parser_init(&p, buf, size) && Outer_decode(o, &p);
+    *err = p.error_flags;
+    return ret;
+}
+
+/*======= Test cases ========================================================*/
+
+TEST(gen_encode_matches_writer)
+{
+    uint8_t expected[OUTER_MAX_SIZE];
+    uint8_t result[OUTER_MAX_SIZE];
+    size_t expected_size = _write_reference(expected, sizeof(expected));
+    Outer o;
+    binson_writer w;
+
+    _fill(&o, false);
+    ASSERT_TRUE(binson_writer_init(&w, result, sizeof(result)));
+    ASSERT_TRUE(Outer_encode(&o, &w));
+    ASSERT_TRUE(binson_writer_get_counter(&w) == expected_size);
+    ASSERT_TRUE(memcmp(expected, result, expected_size) == 0);
+
+    /* Too small buffer reports the required size. */
+    ASSERT_TRUE(binson_writer_init(&w, result, 10));
+    ASSERT_FALSE(Outer_encode(&o, &w));
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_RANGE);
+    ASSERT_TRUE(binson_writer_get_counter(&w) == expected_size);
+
+    /* Lengths beyond the capacity are rejected. */
+    o.tags_len[1] = 5;
+    ASSERT_TRUE(binson_writer_init(&w, result, sizeof(result)));
+    ASSERT_FALSE(Outer_encode(&o, &w));
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_FORMAT);
+    ASSERT_FALSE(Outer_encode(NULL, &w));
+}
+
+TEST(gen_max_size)
+{
+    uint8_t result[OUTER_MAX_SIZE];
+    Outer o;
+    binson_writer w;
+
+    _fill(&o, true);
+    ASSERT_TRUE(binson_writer_init(&w, result, sizeof(result)));
+    ASSERT_TRUE(Outer_encode(&o, &w));
+    ASSERT_TRUE(binson_writer_get_counter(&w) == OUTER_MAX_SIZE);
+    ASSERT_TRUE(binson_writer_verify(&w));
+    ASSERT_TRUE(EMPTY_MAX_SIZE == 2);
+}
+
+TEST(gen_roundtrip)
+{
+    uint8_t buf[OUTER_MAX_SIZE];
+    Outer o, r;
+    binson_writer w;
+    binson_err err;
+    int full;
+
+    for (full = 0; full < 2; full++) {
+        _fill(&o, full != 0);
+        ASSERT_TRUE(binson_writer_init(&w, buf, sizeof(buf)));
+        ASSERT_TRUE(Outer_encode(&o, &w));
+        memset(&r, 0xAA, sizeof(r));
+        ASSERT_TRUE(_decode(&r, buf, binson_writer_get_counter(&w), &err));
+        ASSERT_TRUE(err == BINSON_ERROR_NONE);
+        ASSERT_TRUE(r.flag == o.flag && r.count == o.count && r.ratio == o.ratio);
+        ASSERT_TRUE(r.name_len == o.name_len && memcmp(r.name, o.name, o.name_len) == 0);
+        ASSERT_TRUE(r.key_len == o.key_len && memcmp(r.key, o.key, o.key_len) == 0);
+        ASSERT_TRUE(r.values_count == o.values_count);
+        ASSERT_TRUE(memcmp(r.values, o.values, o.values_count * sizeof(o.values[0])) == 0);
+        ASSERT_TRUE(r.tags_count == o.tags_count && r.tags_len[1] == o.tags_len[1]);
+        ASSERT_TRUE(memcmp(r.tags[1], o.tags[1], o.tags_len[1]) == 0);
+        ASSERT_TRUE(r.inner.id == o.inner.id && r.inner.label_len == o.inner.label_len);
+        ASSERT_TRUE(r.has_extra == o.has_extra && r.has_note == o.has_note);
+        ASSERT_TRUE(r.note == o.note && r.extra.id == o.extra.id);
+        ASSERT_TRUE(r.items_count == o.items_count && r.items[0].id == o.items[0].id);
+    }
+}
+
+TEST(gen_decode_errors)
+{
+    uint8_t buf[OUTER_MAX_SIZE];
+    Outer o;
+    Inner in;
+    binson_writer w;
+    binson_parser p;
+    binson_err err;
+
+    /* Unknown fields are skipped. */
+    binson_writer_init(&w, buf, sizeof(buf));
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "a");
+    binson_write_array_begin(&w);
+    binson_write_integer(&w, 1);
+    binson_write_array_end(&w);
+    binson_write_name(&w, "id");
+    binson_write_integer(&w, 5);
+    binson_write_name(&w, "label");
+    binson_write_string(&w, "x");
+    binson_write_name(&w, "zz");
+    binson_write_object_begin(&w);
+    binson_write_object_end(&w);
+    binson_write_object_end(&w);
+    ASSERT_TRUE(binson_parser_init(&p, buf, binson_writer_get_counter(&w)));
+    ASSERT_TRUE(Inner_decode(&in, &p));
+    ASSERT_TRUE(in.id == 5 && in.label_len == 1);
+
+    /* Missing required field. */
+    binson_writer_init(&w, buf, sizeof(buf));
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "label");
+    binson_write_string(&w, "x");
+    binson_write_object_end(&w);
+    ASSERT_TRUE(binson_parser_init(&p, buf, binson_writer_get_counter(&w)));
+    ASSERT_FALSE(Inner_decode(&in, &p));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_FORMAT);
+
+    /* String longer than the capacity. */
+    binson_writer_init(&w, buf, sizeof(buf));
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "id");
+    binson_write_integer(&w, 1);
+    binson_write_name(&w, "label");
+    binson_write_string(&w, "123456789");
+    binson_write_object_end(&w);
+    ASSERT_TRUE(binson_parser_init(&p, buf, binson_writer_get_counter(&w)));
+    ASSERT_FALSE(Inner_decode(&in, &p));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_RANGE);
+
+    /* Wrong type. */
+    binson_writer_init(&w, buf, sizeof(buf));
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "id");
+    binson_write_string(&w, "1");
+    binson_write_name(&w, "label");
+    binson_write_string(&w, "x");
+    binson_write_object_end(&w);
+    ASSERT_TRUE(binson_parser_init(&p, buf, binson_writer_get_counter(&w)));
+    ASSERT_FALSE(Inner_decode(&in, &p));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_WRONG_TYPE);
+
+    _fill(&o, false);
+    binson_writer_init(&w, buf, sizeof(buf));
+    ASSERT_TRUE(Outer_encode(&o, &w));
+    ASSERT_TRUE(_decode(&o, buf, binson_writer_get_counter(&w), &err));
+    ASSERT_FALSE(Outer_decode(&o, NULL));
+    ASSERT_TRUE(binson_parser_init(&p, buf, binson_writer_get_counter(&w)));
+    ASSERT_FALSE(Outer_decode(NULL, &p));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_NULL);
+}
+
+TEST(gen_array_overflow)
+{
+    uint8_t buf[OUTER_MAX_SIZE];
+    binson_writer w;
+    binson_err err;
+    Outer o;
+
+    _fill(&o, false);
+    binson_writer_init(&w, buf, sizeof(buf));
+    ASSERT_TRUE(Outer_encode(&o, &w));
+    size_t size = binson_writer_get_counter(&w);
+
+    /* Five elements in "values" which holds four. */
+    uint8_t bad[OUTER_MAX_SIZE];
+    const uint8_t *end = &buf[size - 2];
+    ASSERT_TRUE(*end == BINSON_DEF_ARRAY_END);
+    size_t head = (size_t) (end - buf);
+    memcpy(bad, buf, head);
+    memcpy(&bad[head], "\x10\x01\x10\x02\x43\x41", 6);
+    ASSERT_FALSE(_decode(&o, bad, head + 6, &err));
+    ASSERT_TRUE(err == BINSON_ERROR_RANGE);
+}
+
+TEST(gen_corrupted_input)
+{
+    uint8_t buf[OUTER_MAX_SIZE];
+    binson_writer w;
+    binson_err err;
+    Outer o;
+    size_t i;
+
+    _fill(&o, true);
+    binson_writer_init(&w, buf, sizeof(buf));
+    ASSERT_TRUE(Outer_encode(&o, &w));
+    size_t size = binson_writer_get_counter(&w);
+
+    for (i = 0; i < size; i++) {
+        uint8_t bad[OUTER_MAX_SIZE];
+        binson_parser p;
+        memcpy(bad, buf, size);
+        bad[i] ^= 0x5A;
+        bool decoded = _decode(&o, bad, size, &err);
+        bool valid = binson_parser_init(&p, bad, size) && binson_parser_verify(&p);
+        if (!valid) {
+            ASSERT_FALSE(decoded);
+        }
+    }
+    ASSERT_FALSE(_decode(&o, buf, size - 1, &err));
+}
+
+int main(void) {
+    RUN_TEST(gen_encode_matches_writer);
+    RUN_TEST(gen_max_size);
+    RUN_TEST(gen_roundtrip);
+    RUN_TEST(gen_decode_errors);
+    RUN_TEST(gen_array_overflow);
+    RUN_TEST(gen_corrupted_input);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
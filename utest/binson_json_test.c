@@ -0,0 +1,506 @@
+/**
+ * @file binson_json_test.c
+ *
+ * Description
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binson_defines.h"
+#include "binson_parser.h"
+#include "binson_writer.h"
+#include "binson_json.h"
+#include "utest.h"
+
+/*======= Local Macro Definitions ===========================================*/
+/*======= Local function prototypes =========================================*/
+
+static size_t build_message(uint8_t *buffer, size_t size);
+static bool emit_to_string(const uint8_t *data, size_t size, uint8_t flags, char *out);
+static bool failing_sink(void *context, const char *data, size_t size);
+static binson_err transcode(const char *json, size_t *size);
+
+/*======= Local variable declarations =======================================*/
+
+static uint8_t message[256];
+static uint8_t transcoded[1024];
+static char text[1024];
+
+/*======= Test cases ========================================================*/
+
+TEST(compact_output)
+{
+    size_t size = build_message(message, sizeof(message));
+
+    ASSERT_TRUE(size > 0);
+    ASSERT_TRUE(emit_to_string(message, size, 0, text));
+    ASSERT_TRUE(strcmp(text,
+        "{\"a\":[1,-200,2.5,true,{}],\"b\":\"0x00ff\",\"c\":\"q\\\"b\\\\n\\nt\\tc\\u0001\xC3\xA4\","
+        "\"d\":{\"e\":[],\"f\":null},\"g\":9223372036854775807}") == 0);
+}
+
+TEST(pretty_output)
+{
+    size_t size = build_message(message, sizeof(message));
+
+    ASSERT_TRUE(emit_to_string(message, size, BINSON_JSON_PRETTY | BINSON_JSON_BYTES_BASE64, text));
+    ASSERT_TRUE(strcmp(text,
+        "{\n"
+        "  \"a\": [\n"
+        "    1,\n"
+        "    -200,\n"
+        "    2.5,\n"
+        "    true,\n"
+        "    {}\n"
+        "  ],\n"
+        "  \"b\": \"AP8=\",\n"
+        "  \"c\": \"q\\\"b\\\\n\\nt\\tc\\u0001\xC3\xA4\",\n"
+        "  \"d\": {\n"
+        "    \"e\": [],\n"
+        "    \"f\": null\n"
+        "  },\n"
+        "  \"g\": 9223372036854775807\n"
+        "}\n") == 0);
+}
+
+TEST(base64_bytes)
+{
+    static const char *expected[] = {
+        "[\"\"]", "[\"Zg==\"]", "[\"Zm8=\"]", "[\"Zm9v\"]",
+        "[\"Zm9vYg==\"]", "[\"Zm9vYmE=\"]", "[\"Zm9vYmFy\"]"
+    };
+    binson_writer w;
+    size_t i;
+
+    for (i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        binson_writer_init(&w, message, sizeof(message));
+        binson_write_array_begin(&w);
+        binson_write_bytes(&w, (const uint8_t *) "foobar", i);
+        binson_write_array_end(&w);
+        ASSERT_TRUE(emit_to_string(message, binson_writer_get_counter(&w),
+                                   BINSON_JSON_BYTES_BASE64, text));
+        ASSERT_TRUE(strcmp(text, expected[i]) == 0);
+    }
+}
+
+TEST(large_document_matches_to_string)
+{
+    static uint8_t big[64 * 1024];
+    static char expected[256 * 1024];
+    binson_json_buffer out = { NULL, 0, 0 };
+    size_t expected_size = sizeof(expected);
+    binson_writer w;
+    binson_parser p;
+    uint32_t i;
+
+    binson_writer_init(&w, big, sizeof(big));
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "values");
+    binson_write_array_begin(&w);
+    for (i = 0; i < 2000; i++) {
+        binson_write_integer(&w, (int64_t) i * 1000003);
+        binson_write_string(&w, "some text");
+        binson_write_double(&w, i / 8.0);
+    }
+    binson_write_array_end(&w);
+    binson_write_object_end(&w);
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_NONE);
+
+    ASSERT_TRUE(binson_parser_init(&p, big, binson_writer_get_counter(&w)));
+    ASSERT_TRUE(binson_parser_to_string(&p, expected, &expected_size, false));
+    ASSERT_TRUE(binson_json_emit(&p, 0, binson_json_buffer_sink, &out));
+    ASSERT_TRUE(out.size == expected_size);
+    ASSERT_TRUE(out.size > 10 * BINSON_JSON_BUFFER_SIZE);
+    ASSERT_TRUE(memcmp(out.data, expected, out.size) == 0);
+    binson_json_buffer_free(&out);
+    ASSERT_TRUE(out.data == NULL);
+}
+
+TEST(file_and_fd_sinks)
+{
+    size_t size = build_message(message, sizeof(message));
+    char expected[512];
+    char read_back[512];
+    binson_parser p;
+    FILE *f;
+    int fd;
+    size_t n;
+
+    ASSERT_TRUE(emit_to_string(message, size, 0, expected));
+    ASSERT_TRUE(binson_parser_init(&p, message, size));
+
+    f = tmpfile();
+    ASSERT_TRUE(f != NULL);
+    ASSERT_TRUE(binson_json_emit(&p, 0, binson_json_file_sink, f));
+    fflush(f);
+    fd = fileno(f);
+    ASSERT_TRUE(binson_json_emit(&p, 0, binson_json_fd_sink, &fd));
+    rewind(f);
+    n = fread(read_back, 1, sizeof(read_back), f);
+    fclose(f);
+
+    ASSERT_TRUE(n == 2 * strlen(expected));
+    ASSERT_TRUE(memcmp(read_back, expected, n / 2) == 0);
+    ASSERT_TRUE(memcmp(&read_back[n / 2], expected, n / 2) == 0);
+}
+
+TEST(errors_should_be_reported)
+{
+    size_t size = build_message(message, sizeof(message));
+    binson_parser p;
+    size_t calls = 0;
+
+    ASSERT_TRUE(binson_parser_init(&p, message, size));
+    ASSERT_FALSE(binson_json_emit(&p, 0, failing_sink, &calls));
+    ASSERT_TRUE(calls == 1);
+    ASSERT_FALSE(binson_json_emit(NULL, 0, binson_json_file_sink, stdout));
+    ASSERT_FALSE(binson_json_emit(&p, 0, NULL, NULL));
+
+    /* Integer where the first field name should be. */
+    message[1] = BINSON_DEF_INT8;
+    ASSERT_TRUE(binson_parser_init(&p, message, size));
+    ASSERT_FALSE(emit_to_string(message, size, 0, text));
+}
+
+TEST(transcode_sorts_keys)
+{
+    const char *json = " { \"z\" : 1, \"a\": {\"y\":true,\"b\":false}, \"m\":[1,\"x\",2.5, []] ,"
+                       "\"aa\":\"s\", \"\\u0061b\": {} }\n";
+    binson_writer w;
+    size_t size;
+
+    binson_writer_init(&w, message, sizeof(message));
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "a");
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "b");
+    binson_write_boolean(&w, false);
+    binson_write_name(&w, "y");
+    binson_write_boolean(&w, true);
+    binson_write_object_end(&w);
+    binson_write_name(&w, "aa");
+    binson_write_string(&w, "s");
+    binson_write_name(&w, "ab");
+    binson_write_object_begin(&w);
+    binson_write_object_end(&w);
+    binson_write_name(&w, "m");
+    binson_write_array_begin(&w);
+    binson_write_integer(&w, 1);
+    binson_write_string(&w, "x");
+    binson_write_double(&w, 2.5);
+    binson_write_array_begin(&w);
+    binson_write_array_end(&w);
+    binson_write_array_end(&w);
+    binson_write_name(&w, "z");
+    binson_write_integer(&w, 1);
+    binson_write_object_end(&w);
+
+    ASSERT_TRUE(transcode(json, &size) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(size == binson_writer_get_counter(&w));
+    ASSERT_TRUE(memcmp(transcoded, message, size) == 0);
+}
+
+TEST(transcode_strings)
+{
+    static const char expected[] = "q\"/\b\f\n\r\t\x00\xC3\xA4\xE2\x82\xAC\xF0\x9F\x98\x80\xC3\xA4";
+    char json[512];
+    char value[128];
+    binson_parser p;
+    size_t size;
+    size_t i;
+
+    ASSERT_TRUE(transcode("[\"q\\\"\\/\\b\\f\\n\\r\\t\\u0000\\u00e4\\u20AC\\ud83d\\ude00\xC3\xA4\"]",
+                          &size) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(binson_parser_init_array(&p, transcoded, size));
+    ASSERT_TRUE(binson_parser_go_into_array(&p));
+    ASSERT_TRUE(binson_parser_next(&p));
+    ASSERT_TRUE(binson_parser_get_string_bbuf(&p)->bsize == sizeof(expected) - 1);
+    ASSERT_TRUE(memcmp(binson_parser_get_string_bbuf(&p)->bptr, expected, sizeof(expected) - 1) == 0);
+
+    /* Escapes and the closing quote at every offset of the vector scanner. */
+    for (i = 0; i < 100; i++) {
+        memset(value, 'x', i);
+        value[i] = '\0';
+        snprintf(json, sizeof(json), "{\"k\":\"%s\\n%s\"}", value, value);
+        ASSERT_TRUE(transcode(json, &size) == BINSON_ERROR_NONE);
+        ASSERT_TRUE(binson_parser_init(&p, transcoded, size));
+        ASSERT_TRUE(binson_parser_go_into_object(&p));
+        ASSERT_TRUE(binson_parser_field(&p, "k"));
+        ASSERT_TRUE(binson_parser_get_string_bbuf(&p)->bsize == 2 * i + 1);
+        ASSERT_TRUE(binson_parser_get_string_bbuf(&p)->bptr[i] == '\n');
+    }
+}
+
+TEST(transcode_numbers)
+{
+    static const char *numbers[] = {
+        "0", "-0", "42", "-42", "9223372036854775807", "-9223372036854775808",
+        "9223372036854775808", "-9223372036854775809", "12345678901234567890123",
+        "1.5", "-2.25e-3", "1e22", "1e23", "0.1", "0.000001234", "1E+2",
+        "1.7976931348623157e308", "5e-324", "2.2250738585072014e-308",
+        "3.14159265358979323846264338327950288", "-0.0", "1e400"
+    };
+    char json[512] = "[";
+    binson_parser p;
+    size_t size;
+    size_t i;
+
+    for (i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        strcat(json, numbers[i]);
+        strcat(json, (i + 1 < sizeof(numbers) / sizeof(numbers[0])) ? ", " : "]");
+    }
+
+    ASSERT_TRUE(transcode(json, &size) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(binson_parser_init_array(&p, transcoded, size));
+    ASSERT_TRUE(binson_parser_go_into_array(&p));
+
+    for (i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        ASSERT_TRUE(binson_parser_next(&p));
+        if (i < 6) {
+            ASSERT_TRUE(binson_parser_get_type(&p) == BINSON_TYPE_INTEGER);
+            ASSERT_TRUE(binson_parser_get_integer(&p) == strtoll(numbers[i], NULL, 10));
+        }
+        else {
+            double expected = strtod(numbers[i], NULL);
+            double value = binson_parser_get_double(&p);
+            ASSERT_TRUE(binson_parser_get_type(&p) == BINSON_TYPE_DOUBLE);
+            ASSERT_TRUE(memcmp(&value, &expected, sizeof(value)) == 0);
+        }
+    }
+    ASSERT_FALSE(binson_parser_next(&p));
+}
+
+TEST(transcode_numbers_ignore_locale)
+{
+    static const char *locales[] = {
+        "de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "fr_FR.utf8", "sv_SE.UTF-8"
+    };
+    static const double expected[] = { 2.5, 1.2345678901234567e300, 0.1 };
+    binson_parser p;
+    size_t size;
+    size_t i;
+
+    /* Numbers off the fast path, with a ',' decimal point where installed. */
+    for (i = 0; i < sizeof(locales) / sizeof(locales[0]); i++) {
+        if (NULL != setlocale(LC_NUMERIC, locales[i])) {
+            break;
+        }
+    }
+
+    ASSERT_TRUE(transcode("[2.50000000000000000000, 1.2345678901234567e300, "
+                          "0.10000000000000000000001]", &size) == BINSON_ERROR_NONE);
+    setlocale(LC_NUMERIC, "C");
+    ASSERT_TRUE(binson_parser_init_array(&p, transcoded, size));
+    ASSERT_TRUE(binson_parser_go_into_array(&p));
+    for (i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        ASSERT_TRUE(binson_parser_next(&p));
+        ASSERT_TRUE(binson_parser_get_double(&p) == expected[i]);
+    }
+}
+
+TEST(transcode_round_trip)
+{
+    static const uint8_t flags[2] = { 0, BINSON_JSON_PRETTY };
+    binson_json_buffer out = { NULL, 0, 0 };
+    binson_writer w;
+    binson_parser p;
+    size_t size;
+    size_t i;
+
+    binson_writer_init(&w, message, sizeof(message));
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "");
+    binson_write_double(&w, -1e-300);
+    binson_write_name(&w, "array");
+    binson_write_array_begin(&w);
+    binson_write_integer(&w, INT64_MIN);
+    binson_write_string(&w, "tab\there \"quoted\" \x7F");
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "n\xC3\xA4me");
+    binson_write_double(&w, 0.1);
+    binson_write_object_end(&w);
+    binson_write_array_end(&w);
+    binson_write_name(&w, "flag");
+    binson_write_boolean(&w, false);
+    binson_write_object_end(&w);
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_NONE);
+
+    for (i = 0; i < sizeof(flags); i++) {
+        ASSERT_TRUE(binson_parser_init(&p, message, binson_writer_get_counter(&w)));
+        ASSERT_TRUE(binson_json_emit(&p, flags[i], binson_json_buffer_sink, &out));
+        ASSERT_TRUE(binson_json_buffer_sink(&out, "", 1));
+        ASSERT_TRUE(transcode(out.data, &size) == BINSON_ERROR_NONE);
+        ASSERT_TRUE(size == binson_writer_get_counter(&w));
+        ASSERT_TRUE(memcmp(transcoded, message, size) == 0);
+        binson_json_buffer_free(&out);
+    }
+}
+
+TEST(transcode_errors)
+{
+    static const char *bad[] = {
+        "", " ", "1", "\"s\"", "{", "[", "{\"a\"}", "{\"a\":}", "{\"a\":1,}", "{,}",
+        "{a:1}", "[1,]", "[1 2]", "[01]", "[1.]", "[.5]", "[-]", "[1e]", "[+1]", "[tru]",
+        "[True]", "{\"a\":null}", "[null]", "{\"a\":1,\"a\":2}", "{\"a\":1,\"\\u0061\":2}",
+        "[\"\\ud800\"]", "[\"\\ud800\\u0041\"]", "[\"\\udc00\"]", "[\"\\u12\"]",
+        "[\"\\x\"]", "[\"a\x01\"]", "{\"a\":\"\x1f\"}", "[\"abc", "{\"a\":[1}}",
+        "{\"a\":{\"b\":1]}", "[1] x", "[1]]", "{\"a\":1}}", "{\"a\":\"\\\"}"
+    };
+    char json[64];
+    binson_parser p;
+    size_t size;
+    size_t i;
+
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        ASSERT_TRUE(transcode(bad[i], &size) == BINSON_ERROR_FORMAT);
+    }
+
+    /* As deep as the parser goes, and one more. */
+    memset(json, '[', BINSON_PARSER_MAX_DEPTH);
+    memset(&json[BINSON_PARSER_MAX_DEPTH], ']', BINSON_PARSER_MAX_DEPTH);
+    json[2 * BINSON_PARSER_MAX_DEPTH] = '\0';
+    ASSERT_TRUE(transcode(json, &size) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(binson_parser_init_array(&p, transcoded, size));
+    ASSERT_TRUE(binson_parser_verify(&p));
+
+    memset(json, '[', BINSON_PARSER_MAX_DEPTH + 1);
+    memset(&json[BINSON_PARSER_MAX_DEPTH + 1], ']', BINSON_PARSER_MAX_DEPTH + 1);
+    json[2 * BINSON_PARSER_MAX_DEPTH + 2] = '\0';
+    ASSERT_TRUE(transcode(json, &size) == BINSON_ERROR_MAX_DEPTH);
+}
+
+TEST(transcode_bounded_scratch)
+{
+    const char *json = "{\"c\":1,\"b\":{\"y\":2,\"x\":3},\"a\":\"\\n0123456789\"}";
+    uint8_t scratch[256];
+    binson_writer w;
+    size_t needed;
+    size_t i;
+
+    /* Needs three keys outside plus two inside, and the unescaped string. */
+    ASSERT_TRUE(transcode(json, &needed) == BINSON_ERROR_NONE);
+    binson_writer_init(&w, transcoded, sizeof(transcoded));
+    ASSERT_TRUE(binson_json_transcode(&w, json, strlen(json), scratch, sizeof(scratch)));
+
+    for (i = 0; i < 5 * sizeof(size_t); i++) {
+        binson_writer_init(&w, transcoded, sizeof(transcoded));
+        ASSERT_FALSE(binson_json_transcode(&w, json, strlen(json), scratch, i));
+        ASSERT_TRUE(w.error_flags == BINSON_ERROR_RANGE);
+    }
+
+    /* Writer too small: counts on to the size needed. */
+    binson_writer_init(&w, transcoded, 10);
+    ASSERT_FALSE(binson_json_transcode(&w, json, strlen(json), NULL, 0));
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_RANGE);
+    ASSERT_TRUE(binson_writer_get_counter(&w) == needed);
+
+    ASSERT_FALSE(binson_json_transcode(NULL, json, strlen(json), NULL, 0));
+    ASSERT_FALSE(binson_json_transcode(&w, NULL, 0, NULL, 0));
+}
+
+/*======= Main function =====================================================*/
+
+int main(void) {
+    RUN_TEST(compact_output);
+    RUN_TEST(pretty_output);
+    RUN_TEST(base64_bytes);
+    RUN_TEST(large_document_matches_to_string);
+    RUN_TEST(file_and_fd_sinks);
+    RUN_TEST(errors_should_be_reported);
+    RUN_TEST(transcode_sorts_keys);
+    RUN_TEST(transcode_strings);
+    RUN_TEST(transcode_numbers);
+    RUN_TEST(transcode_numbers_ignore_locale);
+    RUN_TEST(transcode_round_trip);
+    RUN_TEST(transcode_errors);
+    RUN_TEST(transcode_bounded_scratch);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
+
+static size_t build_message(uint8_t *buffer, size_t size)
+{
+    const uint8_t bytes[2] = { 0x00, 0xff };
+    const char str[] = "q\"b\\n\nt\tc\x01\xC3\xA4";
+    binson_writer w;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "a");
+    binson_write_array_begin(&w);
+    binson_write_integer(&w, 1);
+    binson_write_integer(&w, -200);
+    binson_write_double(&w, 2.5);
+    binson_write_boolean(&w, true);
+    binson_write_object_begin(&w);
+    binson_write_object_end(&w);
+    binson_write_array_end(&w);
+    binson_write_name(&w, "b");
+    binson_write_bytes(&w, bytes, sizeof(bytes));
+    binson_write_name(&w, "c");
+    binson_write_string_with_len(&w, str, sizeof(str) - 1);
+    binson_write_name(&w, "d");
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "e");
+    binson_write_array_begin(&w);
+    binson_write_array_end(&w);
+    binson_write_name(&w, "f");
+    binson_write_double(&w, 1.0 / 0.0);
+    binson_write_object_end(&w);
+    binson_write_name(&w, "g");
+    binson_write_integer(&w, INT64_MAX);
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+/* Emits into a growable buffer and copies it NUL terminated to out. */
+static bool emit_to_string(const uint8_t *data, size_t size, uint8_t flags, char *out)
+{
+    binson_json_buffer buffer = { NULL, 0, 0 };
+    binson_parser p;
+    bool ret;
+
+    ret = ((BINSON_DEF_ARRAY_BEGIN == data[0]) ?
+              binson_parser_init_array(&p, data, size) :
+              binson_parser_init(&p, data, size)) &&
+          binson_json_emit(&p, flags, binson_json_buffer_sink, &buffer);
+    if (ret) {
+        memcpy(out, buffer.data, buffer.size);
+        out[buffer.size] = '\0';
+    }
+    binson_json_buffer_free(&buffer);
+
+    return ret;
+}
+
+static bool failing_sink(void *context, const char *data, size_t size)
+{
+    (void) data;
+    (void) size;
+    (*(size_t *) context)++;
+    return false;
+}
+
+/* Transcodes a NUL terminated JSON text into transcoded. */
+static binson_err transcode(const char *json, size_t *size)
+{
+    binson_writer w;
+
+    binson_writer_init(&w, transcoded, sizeof(transcoded));
+    if (!binson_json_transcode(&w, json, strlen(json), NULL, 0)) {
+        return w.error_flags;
+    }
+    *size = binson_writer_get_counter(&w);
+
+    return BINSON_ERROR_NONE;
+}
@@ -0,0 +1,305 @@
+/**
+ * @file binson_message_iter_test.c
+ *
+ * Iteration over back to back objects and arrays in one buffer, and over
+ * the elements of one array.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "binson_defines.h"
+#include "binson_parser.h"
+#include "binson_writer.h"
+#include "utest.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define MESSAGES    (40U)
+
+/*======= Local function prototypes =========================================*/
+
+static size_t build_messages(uint8_t *buffer, size_t size, size_t *offsets);
+
+/*======= Local variable declarations =======================================*/
+
+static uint8_t buffer[8192];
+static size_t offsets[MESSAGES + 1];
+
+/*======= Test cases ========================================================*/
+
+TEST(message_size)
+{
+    const uint8_t empty[] = { 0x40, 0x41, 0x40 };
+    const uint8_t nested[] = { 0x42, 0x40, 0x41, 0x42, 0x43, 0x43, 0x00 };
+    const uint8_t string[] = { 0x40, 0x14, 0x01, 'a', 0x14, 0x02, 'b', 'c', 0x41 };
+    const uint8_t truncated[] = { 0x40, 0x14, 0x01, 'a', 0x14, 0x05, 'b', 'c', 0x41 };
+    const uint8_t negative[] = { 0x40, 0x14, 0x01, 'a', 0x18, 0xFE, 0x41 };
+    const uint8_t unknown[] = { 0x40, 0x33, 0x41 };
+
+    ASSERT_TRUE(binson_message_size(empty, sizeof(empty)) == 2);
+    ASSERT_TRUE(binson_message_size(nested, sizeof(nested)) == 6);
+    ASSERT_TRUE(binson_message_size(string, sizeof(string)) == sizeof(string));
+    ASSERT_TRUE(binson_message_size(string, sizeof(string) - 1) == 0);
+    ASSERT_TRUE(binson_message_size(truncated, sizeof(truncated)) == 0);
+    ASSERT_TRUE(binson_message_size(negative, sizeof(negative)) == 0);
+    ASSERT_TRUE(binson_message_size(unknown, sizeof(unknown)) == 0);
+    ASSERT_TRUE(binson_message_size(&string[1], sizeof(string) - 1) == 0);
+    ASSERT_TRUE(binson_message_size(empty, 1) == 0);
+    ASSERT_TRUE(binson_message_size(NULL, 2) == 0);
+}
+
+TEST(iterate_messages)
+{
+    size_t size = build_messages(buffer, sizeof(buffer), offsets);
+    binson_message_iter iter;
+    binson_parser parser;
+    size_t i = 0;
+
+    ASSERT_TRUE(size > 0);
+    ASSERT_TRUE(binson_message_iter_init(&iter, buffer, size));
+
+    /* The parser needs no initiation. */
+    memset(&parser, 0xA5, sizeof(parser));
+    iter.options = BINSON_PARSER_OPTION_VALIDATE_UTF8;
+
+    while (binson_message_iter_next(&iter, &parser)) {
+        ASSERT_TRUE(parser.cb == NULL);
+        ASSERT_TRUE(iter.index == i + 1);
+        ASSERT_TRUE(parser.buffer == &buffer[offsets[i]]);
+        ASSERT_TRUE(parser.buffer_size == offsets[i + 1] - offsets[i]);
+        ASSERT_TRUE(parser.options == BINSON_PARSER_OPTION_VALIDATE_UTF8);
+        ASSERT_TRUE(binson_parser_verify(&parser));
+
+        if (i % 3 == 2) {
+            ASSERT_TRUE(binson_parser_go_into_array(&parser));
+            ASSERT_TRUE(binson_parser_next(&parser));
+            ASSERT_TRUE(binson_parser_get_integer(&parser) == (int64_t) i);
+        }
+        else {
+            ASSERT_TRUE(binson_parser_go_into_object(&parser));
+            ASSERT_TRUE(binson_parser_field(&parser, "i"));
+            ASSERT_TRUE(binson_parser_get_integer(&parser) == (int64_t) i);
+        }
+        i++;
+    }
+
+    ASSERT_TRUE(i == MESSAGES);
+    ASSERT_TRUE(iter.error_flags == BINSON_ERROR_NONE);
+    ASSERT_TRUE(iter.offset == size);
+
+    /* Stays at the end. */
+    ASSERT_FALSE(binson_message_iter_next(&iter, &parser));
+    ASSERT_TRUE(iter.index == MESSAGES);
+
+    /* Empty buffer. */
+    ASSERT_TRUE(binson_message_iter_init(&iter, buffer, 0));
+    ASSERT_FALSE(binson_message_iter_next(&iter, &parser));
+    ASSERT_TRUE(iter.error_flags == BINSON_ERROR_NONE);
+
+    ASSERT_FALSE(binson_message_iter_init(&iter, NULL, 0));
+    ASSERT_FALSE(binson_message_iter_init(NULL, buffer, size));
+}
+
+TEST(spans_in_batches)
+{
+    size_t size = build_messages(buffer, sizeof(buffer), offsets);
+    binson_message_iter iter;
+    bbuf spans[7];
+    size_t total = 0;
+    size_t n;
+
+    ASSERT_TRUE(binson_message_iter_init(&iter, buffer, size));
+
+    do {
+        size_t i;
+
+        n = binson_message_iter_spans(&iter, spans, sizeof(spans) / sizeof(spans[0]));
+        for (i = 0; i < n; i++) {
+            ASSERT_TRUE(spans[i].bptr == &buffer[offsets[total + i]]);
+            ASSERT_TRUE(spans[i].bsize == offsets[total + i + 1] - offsets[total + i]);
+        }
+        total += n;
+    } while (n == sizeof(spans) / sizeof(spans[0]));
+
+    ASSERT_TRUE(total == MESSAGES);
+    ASSERT_TRUE(iter.index == MESSAGES);
+    ASSERT_TRUE(iter.error_flags == BINSON_ERROR_NONE);
+}
+
+TEST(bad_message_should_stop)
+{
+    size_t size = build_messages(buffer, sizeof(buffer), offsets);
+    binson_message_iter iter;
+    binson_parser parser;
+    bbuf spans[MESSAGES];
+
+    /* Truncated last message. */
+    ASSERT_TRUE(binson_message_iter_init(&iter, buffer, size - 1));
+    ASSERT_TRUE(binson_message_iter_spans(&iter, spans, MESSAGES) == MESSAGES - 1);
+    ASSERT_TRUE(iter.error_flags == BINSON_ERROR_FORMAT);
+    ASSERT_TRUE(iter.offset == offsets[MESSAGES - 1]);
+    ASSERT_FALSE(binson_message_iter_next(&iter, &parser));
+
+    /* Object closed with an array end. */
+    buffer[offsets[4] - 1] = BINSON_DEF_ARRAY_END;
+    ASSERT_TRUE(binson_message_iter_init(&iter, buffer, size));
+    while (binson_message_iter_next(&iter, &parser)) {
+    }
+    ASSERT_TRUE(iter.error_flags == BINSON_ERROR_FORMAT);
+    ASSERT_TRUE(iter.index == 3);
+    ASSERT_TRUE(iter.offset == offsets[3]);
+
+    /* Garbage between messages. */
+    size = build_messages(buffer, sizeof(buffer), offsets);
+    buffer[offsets[1]] = 0x00;
+    ASSERT_TRUE(binson_message_iter_init(&iter, buffer, size));
+    ASSERT_TRUE(binson_message_iter_spans(&iter, spans, MESSAGES) == 1);
+    ASSERT_TRUE(iter.error_flags == BINSON_ERROR_FORMAT);
+}
+
+TEST(array_element_spans)
+{
+    /* [ 1, "ab", { "a": [] }, [ true ], 2.0, 0x0102 ] */
+    const uint8_t array[] = {
+        0x42,
+        0x10, 0x01,
+        0x14, 0x02, 'a', 'b',
+        0x40, 0x14, 0x01, 'a', 0x42, 0x43, 0x41,
+        0x42, 0x44, 0x43,
+        0x46, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40,
+        0x18, 0x02, 0x01, 0x02,
+        0x43
+    };
+    const size_t sizes[] = { 2, 4, 7, 3, 9, 4 };
+    const uint8_t empty[] = { 0x42, 0x43 };
+    binson_message_iter iter;
+    bbuf spans[4];
+    size_t offset = 1;
+    size_t total = 0;
+    size_t n;
+
+    ASSERT_TRUE(binson_value_size(&array[1], sizeof(array) - 1) == 2);
+    ASSERT_TRUE(binson_value_size(&array[7], sizeof(array) - 7) == 7);
+    ASSERT_TRUE(binson_value_size(&array[sizeof(array) - 1], 1) == 0);
+    ASSERT_TRUE(binson_value_size(&array[3], 3) == 0);
+    ASSERT_TRUE(binson_token_size(&array[7], sizeof(array) - 7) == 1);
+    ASSERT_TRUE(binson_token_size(&array[8], sizeof(array) - 8) == 3);
+    ASSERT_TRUE(binson_token_size(&array[sizeof(array) - 1], 1) == 1);
+    ASSERT_TRUE(binson_token_size(&array[17], 8) == 0);
+    ASSERT_TRUE(binson_token_size(NULL, 1) == 0);
+
+    ASSERT_TRUE(binson_array_iter_init(&iter, array, sizeof(array)));
+    do {
+        size_t i;
+
+        n = binson_array_iter_spans(&iter, spans, sizeof(spans) / sizeof(spans[0]));
+        for (i = 0; i < n; i++) {
+            ASSERT_TRUE(spans[i].bptr == &array[offset]);
+            ASSERT_TRUE(spans[i].bsize == sizes[total + i]);
+            offset += spans[i].bsize;
+        }
+        total += n;
+    } while (n == sizeof(spans) / sizeof(spans[0]));
+
+    ASSERT_TRUE(total == 6);
+    ASSERT_TRUE(iter.index == 6);
+    ASSERT_TRUE(offset == sizeof(array) - 1);
+    ASSERT_TRUE(iter.error_flags == BINSON_ERROR_NONE);
+
+    ASSERT_TRUE(binson_array_iter_init(&iter, empty, sizeof(empty)));
+    ASSERT_TRUE(binson_array_iter_spans(&iter, spans, 4) == 0);
+    ASSERT_TRUE(iter.error_flags == BINSON_ERROR_NONE);
+
+    /* Concatenated messages are not one array. */
+    n = build_messages(buffer, sizeof(buffer), offsets);
+    ASSERT_FALSE(binson_array_iter_init(&iter, buffer, n));
+    ASSERT_TRUE(iter.error_flags == BINSON_ERROR_FORMAT);
+    ASSERT_FALSE(binson_array_iter_init(&iter, empty, 1));
+    ASSERT_FALSE(binson_array_iter_init(&iter, NULL, 2));
+    ASSERT_FALSE(binson_array_iter_init(NULL, empty, 2));
+}
+
+TEST(array_element_errors)
+{
+    /* [ 1, { ] ] : the object closes with an array end. */
+    const uint8_t mismatched[] = { 0x42, 0x10, 0x01, 0x40, 0x43, 0x43 };
+    /* [ 1, "a ] : the string runs into the end token. */
+    const uint8_t overrun[] = { 0x42, 0x10, 0x01, 0x14, 0x02, 'a', 0x43 };
+    /* [ 1 ] 2 ] : an end token before the last byte. */
+    const uint8_t early_end[] = { 0x42, 0x10, 0x01, 0x43, 0x10, 0x02, 0x43 };
+    /* [ 1, 0x33 ] : unknown token. */
+    const uint8_t unknown[] = { 0x42, 0x10, 0x01, 0x33, 0x43 };
+    const uint8_t *arrays[] = { mismatched, overrun, early_end, unknown };
+    const size_t sizes[] = { sizeof(mismatched), sizeof(overrun), sizeof(early_end), sizeof(unknown) };
+    size_t i;
+
+    for (i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        binson_message_iter iter;
+        bbuf spans[4];
+
+        ASSERT_TRUE(binson_array_iter_init(&iter, arrays[i], sizes[i]));
+        ASSERT_TRUE(binson_array_iter_spans(&iter, spans, 4) == 1);
+        ASSERT_TRUE(spans[0].bsize == 2);
+        ASSERT_TRUE(iter.error_flags == BINSON_ERROR_FORMAT);
+        ASSERT_TRUE(iter.offset == 2);
+        ASSERT_TRUE(binson_array_iter_spans(&iter, spans, 4) == 0);
+    }
+}
+
+/*======= Main function =====================================================*/
+
+int main(void) {
+    RUN_TEST(message_size);
+    RUN_TEST(iterate_messages);
+    RUN_TEST(spans_in_batches);
+    RUN_TEST(bad_message_should_stop);
+    RUN_TEST(array_element_spans);
+    RUN_TEST(array_element_errors);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
+
+/*
+ * MESSAGES messages of varying size, every third an array. offsets[i] is
+ * where message i starts, offsets[MESSAGES] the total size.
+ */
+static size_t build_messages(uint8_t *out, size_t size, size_t *starts)
+{
+    binson_writer w;
+    size_t i;
+
+    binson_writer_init(&w, out, size);
+
+    for (i = 0; i < MESSAGES; i++) {
+        char text[64];
+
+        starts[i] = binson_writer_get_counter(&w);
+        snprintf(text, sizeof(text), "message %zu %.*s", i, (int) (i % 20), "xxxxxxxxxxxxxxxxxxxx");
+
+        if (i % 3 == 2) {
+            binson_write_array_begin(&w);
+            binson_write_integer(&w, (int64_t) i);
+            binson_write_string(&w, text);
+            binson_write_array_end(&w);
+        }
+        else {
+            binson_write_object_begin(&w);
+            binson_write_name(&w, "i");
+            binson_write_integer(&w, (int64_t) i);
+            binson_write_name(&w, "s");
+            binson_write_object_begin(&w);
+            binson_write_name(&w, "text");
+            binson_write_string(&w, text);
+            binson_write_object_end(&w);
+            binson_write_object_end(&w);
+        }
+    }
+    starts[MESSAGES] = binson_writer_get_counter(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? starts[MESSAGES] : 0;
+}
@@ -15,10 +15,15 @@
 
 #include "binson_defines.h"
 #include "binson_parser.h"
+#include "binson_writer.h"
 #include "utest.h"
 
 /*======= Local Macro Definitions ===========================================*/
 /*======= Local function prototypes =========================================*/
+
+static size_t write_scalar_arrays(uint8_t *buffer, size_t size, int64_t *ints, size_t count);
+static void count_cb(binson_parser *parser, uint16_t next_state, void *context);
+
 /*======= Local variable declarations =======================================*/
 
 
@@ -97,6 +102,168 @@ TEST(get_raw_array_should_work)
 }
 
 
+TEST(read_int64_array_should_work)
+{
+    uint8_t buffer[1024];
+    int64_t ints[100];
+    int64_t out[100];
+    size_t i;
+    size_t n;
+    size_t total = 0;
+    size_t calls = 0;
+    binson_parser p;
+
+    /* Long int8 runs around wider integers. */
+    for (i = 0; i < 100; i++) {
+        ints[i] = (int64_t) (i % 50) - 25;
+    }
+    ints[37] = 300;
+    ints[38] = -70000;
+    ints[39] = INT64_MIN;
+    size_t size = write_scalar_arrays(buffer, sizeof(buffer), ints, 100);
+
+    binson_parser_init(&p, buffer, size);
+    ASSERT_TRUE(binson_parser_verify(&p));
+    binson_parser_go_into_object(&p);
+    ASSERT_TRUE(binson_parser_field(&p, "a"));
+
+    /* Too small destination, continued in a second call. */
+    ASSERT_FALSE(binson_parser_read_int64_array(&p, out, 60, &n));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_NONE);
+    ASSERT_TRUE(n == 60);
+    ASSERT_TRUE(binson_parser_get_integer(&p) == ints[59]);
+    ASSERT_TRUE(binson_parser_read_int64_array(&p, &out[60], 40, &n));
+    ASSERT_TRUE(n == 40);
+    ASSERT_TRUE(memcmp(out, ints, sizeof(ints)) == 0);
+
+    /* Parsing continues after the array. */
+    ASSERT_TRUE(binson_parser_field(&p, "b"));
+    ASSERT_TRUE(binson_parser_get_type(&p) == BINSON_TYPE_ARRAY);
+
+    /* Chunked reads of any size give the same result. */
+    binson_parser_reset(&p);
+    binson_parser_go_into_object(&p);
+    binson_parser_field(&p, "a");
+    while (!binson_parser_read_int64_array(&p, &out[total], 7, &n)) {
+        ASSERT_TRUE(p.error_flags == BINSON_ERROR_NONE);
+        total += n;
+        calls++;
+    }
+    total += n;
+    ASSERT_TRUE(total == 100 && calls == 14);
+    ASSERT_TRUE(memcmp(out, ints, sizeof(ints)) == 0);
+
+    /* Entered with binson_parser_go_into_array() after one element. */
+    binson_parser_reset(&p);
+    binson_parser_go_into_object(&p);
+    binson_parser_field(&p, "a");
+    ASSERT_TRUE(binson_parser_go_into_array(&p));
+    ASSERT_TRUE(binson_parser_next(&p));
+    ASSERT_TRUE(binson_parser_read_int64_array(&p, out, 100, &n));
+    ASSERT_TRUE(n == 99);
+    ASSERT_TRUE(memcmp(out, &ints[1], 99 * sizeof(int64_t)) == 0);
+}
+
+TEST(read_double_and_bool_array_should_work)
+{
+    uint8_t buffer[1024];
+    int64_t ints[4] = { 1, 2, 3, 4 };
+    double d[8];
+    bool b[8];
+    size_t n;
+    binson_parser p;
+    size_t size = write_scalar_arrays(buffer, sizeof(buffer), ints, 4);
+
+    binson_parser_init(&p, buffer, size);
+    binson_parser_go_into_object(&p);
+    ASSERT_TRUE(binson_parser_field(&p, "b"));
+    ASSERT_TRUE(binson_parser_read_double_array(&p, d, 8, &n));
+    ASSERT_TRUE(n == 3 && d[0] == 0.5 && d[1] == -2.25 && d[2] == 1e300);
+    ASSERT_TRUE(binson_parser_field(&p, "c"));
+    ASSERT_TRUE(binson_parser_read_bool_array(&p, b, 8, &n));
+    ASSERT_TRUE(n == 3 && b[0] && !b[1] && b[2]);
+    ASSERT_TRUE(binson_parser_field(&p, "d"));
+    ASSERT_TRUE(binson_parser_read_bool_array(&p, b, 8, &n));
+    ASSERT_TRUE(n == 0);
+    ASSERT_FALSE(binson_parser_next(&p));
+    ASSERT_TRUE(binson_parser_leave_object(&p));
+
+    /* Top level array. */
+    uint8_t array[] = { 0x42, 0x44, 0x45, 0x43 };
+    ASSERT_TRUE(binson_parser_init_array(&p, array, sizeof(array)));
+    ASSERT_TRUE(binson_parser_read_bool_array(&p, b, 8, &n));
+    ASSERT_TRUE(n == 2 && b[0] && !b[1]);
+}
+
+TEST(read_array_mixed_and_bad)
+{
+    /* { "a": [ 1, 2, "x", 3 ], "b": 5 } */
+    uint8_t mixed[] = {
+        0x40,
+        0x14, 0x01, 0x61,
+        0x42, 0x10, 0x01, 0x10, 0x02, 0x14, 0x01, 0x78, 0x10, 0x03, 0x43,
+        0x14, 0x01, 0x62, 0x10, 0x05,
+        0x41
+    };
+    /* { "a": [ 1 as a 2 byte integer ] } */
+    uint8_t wide[] = { 0x40, 0x14, 0x01, 0x61, 0x42, 0x11, 0x01, 0x00, 0x43, 0x41 };
+    int64_t out[8];
+    double d[8];
+    size_t n;
+    int calls = 0;
+    binson_parser p;
+
+    binson_parser_init(&p, mixed, sizeof(mixed));
+    binson_parser_go_into_object(&p);
+    ASSERT_TRUE(binson_parser_field(&p, "a"));
+    ASSERT_FALSE(binson_parser_read_int64_array(&p, out, 8, &n));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_WRONG_TYPE);
+    ASSERT_TRUE(n == 2 && out[0] == 1 && out[1] == 2);
+
+    /* Resume in front of the string. */
+    p.error_flags = BINSON_ERROR_NONE;
+    ASSERT_TRUE(binson_parser_next(&p));
+    ASSERT_TRUE(binson_parser_string_equals(&p, "x"));
+    ASSERT_TRUE(binson_parser_read_int64_array(&p, out, 8, &n));
+    ASSERT_TRUE(n == 1 && out[0] == 3);
+    ASSERT_TRUE(binson_parser_field(&p, "b"));
+    ASSERT_TRUE(binson_parser_get_integer(&p) == 5);
+
+    /* Not positioned on an array. */
+    ASSERT_FALSE(binson_parser_read_int64_array(&p, out, 8, &n));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_WRONG_TYPE);
+
+    /* Wrong element type. */
+    binson_parser_init(&p, mixed, sizeof(mixed));
+    binson_parser_go_into_object(&p);
+    binson_parser_field(&p, "a");
+    ASSERT_FALSE(binson_parser_read_double_array(&p, d, 8, &n));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_WRONG_TYPE && n == 0);
+
+    /* Integers must be minimally encoded, as for binson_parser_next(). */
+    binson_parser_init(&p, wide, sizeof(wide));
+    binson_parser_go_into_object(&p);
+    binson_parser_field(&p, "a");
+    ASSERT_FALSE(binson_parser_read_int64_array(&p, out, 8, &n));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_FORMAT);
+
+    ASSERT_FALSE(binson_parser_read_int64_array(NULL, out, 8, &n));
+    binson_parser_init(&p, mixed, sizeof(mixed));
+    ASSERT_FALSE(binson_parser_read_int64_array(&p, NULL, 8, &n));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_NULL);
+
+    /* With a callback every element is reported. */
+    binson_parser_init(&p, mixed, sizeof(mixed));
+    p.cb = count_cb;
+    p.cb_context = &calls;
+    binson_parser_go_into_object(&p);
+    binson_parser_field(&p, "a");
+    calls = 0;
+    ASSERT_FALSE(binson_parser_read_int64_array(&p, out, 8, &n));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_WRONG_TYPE);
+    ASSERT_TRUE(n == 2 && out[1] == 2 && calls == 3);
+}
+
 /*======= Main function =====================================================*/
 
 int main(void) {
@@ -104,8 +271,52 @@ int main(void) {
     RUN_TEST(bad_array);
     RUN_TEST(verify_should_work);
     RUN_TEST(get_raw_array_should_work);
+    RUN_TEST(read_int64_array_should_work);
+    RUN_TEST(read_double_and_bool_array_should_work);
+    RUN_TEST(read_array_mixed_and_bad);
     PRINT_RESULT();
 }
 
 /*======= Local function implementations ====================================*/
 
+/* { "a": [ ints ], "b": [ 0.5, -2.25, 1e300 ], "c": [ true, false, true ], "d": [ ] } */
+static size_t write_scalar_arrays(uint8_t *buffer, size_t size, int64_t *ints, size_t count)
+{
+    binson_writer w;
+    size_t i;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "a");
+    binson_write_array_begin(&w);
+    for (i = 0; i < count; i++) {
+        binson_write_integer(&w, ints[i]);
+    }
+    binson_write_array_end(&w);
+    binson_write_name(&w, "b");
+    binson_write_array_begin(&w);
+    binson_write_double(&w, 0.5);
+    binson_write_double(&w, -2.25);
+    binson_write_double(&w, 1e300);
+    binson_write_array_end(&w);
+    binson_write_name(&w, "c");
+    binson_write_array_begin(&w);
+    binson_write_boolean(&w, true);
+    binson_write_boolean(&w, false);
+    binson_write_boolean(&w, true);
+    binson_write_array_end(&w);
+    binson_write_name(&w, "d");
+    binson_write_array_begin(&w);
+    binson_write_array_end(&w);
+    binson_write_object_end(&w);
+
+    return binson_writer_get_counter(&w);
+}
+
+static void count_cb(binson_parser *parser, uint16_t next_state, void *context)
+{
+    (void) parser;
+    (void) next_state;
+    (*(int *) context)++;
+}
+
@@ -0,0 +1,243 @@
+/**
+ * @file binson_parser_engine_test.cpp
+ *
+ * Description
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+
+#include <binson_parser_engine.hpp>
+#include "utest.h"
+#include <string>
+#include <vector>
+
+/*======= Local Macro Definitions ===========================================*/
+
+#ifndef BINSON_TEST_DATA
+#define BINSON_TEST_DATA "test_data"
+#endif
+
+/*======= Local function prototypes =========================================*/
+
+static std::vector<std::vector<uint8_t> > read_corpus(const char *name);
+
+/*======= Local variable declarations =======================================*/
+
+using namespace std;
+
+/* Records a trace of events, optionally skipping arrays or stopping. */
+struct Tracer : BinsonVisitor
+{
+    string trace;
+    bool skip_arrays = false;
+    size_t stop_after = 0;
+    vector<string> names;
+    int nest = 0;
+
+    BinsonVisit add(const string &s)
+    {
+        trace += s;
+        return (stop_after > 0 && trace.size() >= stop_after) ? BinsonVisit::Stop : BinsonVisit::Continue;
+    }
+
+    BinsonVisit onObjectBegin() { nest++; return add("{"); }
+    BinsonVisit onObjectEnd() { nest--; return add("}"); }
+    BinsonVisit onArrayBegin()
+    {
+        BinsonVisit r = add("[");
+        return (r == BinsonVisit::Continue && skip_arrays) ? BinsonVisit::Skip : r;
+    }
+    BinsonVisit onArrayEnd() { return add("]"); }
+    BinsonVisit onField(const bbuf &name)
+    {
+        string n((const char *) name.bptr, name.bsize);
+        if (nest == 1)
+            names.push_back(n);
+        return add(n + ":");
+    }
+    BinsonVisit onBool(bool v) { return add(v ? "t," : "f,"); }
+    BinsonVisit onInt(int64_t v) { return add(to_string(v) + ","); }
+    BinsonVisit onDouble(double v)
+    {
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        return add("d" + to_string(bits) + ",");
+    }
+    BinsonVisit onString(const bbuf &v) { return add("s" + to_string(v.bsize) + ","); }
+    BinsonVisit onBytes(const bbuf &v) { return add("b" + to_string(v.bsize) + ","); }
+};
+
+static const vector<vector<uint8_t> > valid_objects = read_corpus("valid_objects");
+static const vector<vector<uint8_t> > bad_objects = read_corpus("bad_objects");
+
+/*======= Test cases ========================================================*/
+
+TEST(engine_corpora_loaded)
+{
+    ASSERT_TRUE(valid_objects.size() > 100);
+    ASSERT_TRUE(bad_objects.size() > 1000);
+}
+
+TEST(engine_verify_matches_parser)
+{
+    size_t mismatches = 0;
+
+    for (size_t k = 0; k < 2; k++)
+    {
+        const vector<vector<uint8_t> > &corpus = (k == 0) ? valid_objects : bad_objects;
+        for (const vector<uint8_t> &data : corpus)
+        {
+            binson_parser p;
+            p.error_flags = BINSON_ERROR_NONE;
+            bool init = binson_parser_init(&p, data.data(), data.size());
+            bool valid = init && binson_parser_verify(&p);
+
+            BinsonParserEngine<> engine(data.data(), data.size());
+            binson_err err = engine.verify();
+            BinsonParserEngine<BinsonVerifyPolicy> verifier(data.data(), data.size());
+
+            if ((err == BINSON_ERROR_NONE) != valid ||
+                verifier.verify() != err ||
+                (!init && p.error_flags != BINSON_ERROR_NONE && err != p.error_flags))
+            {
+                mismatches++;
+            }
+            if (valid && engine.position() != data.size())
+                mismatches++;
+        }
+    }
+
+    ASSERT_TRUE(mismatches == 0);
+}
+
+TEST(engine_events_match_visitor)
+{
+    for (const vector<uint8_t> &data : valid_objects)
+    {
+        for (int skip = 0; skip < 2; skip++)
+        {
+            Tracer expected, got, trusted;
+            expected.skip_arrays = got.skip_arrays = trusted.skip_arrays = (skip == 1);
+
+            ASSERT_TRUE(binsonVisit(data.data(), data.size(), expected) == BINSON_ERROR_NONE);
+
+            BinsonParserEngine<> engine(data.data(), data.size());
+            ASSERT_TRUE(engine.parse(got) == BINSON_ERROR_NONE);
+            ASSERT_TRUE(got.trace == expected.trace);
+
+            BinsonParserEngine<BinsonTrustedPolicy> fast(data.data(), data.size());
+            ASSERT_TRUE(fast.parse(trusted) == BINSON_ERROR_NONE);
+            ASSERT_TRUE(trusted.trace == expected.trace);
+        }
+    }
+}
+
+TEST(engine_stop)
+{
+    for (const vector<uint8_t> &data : valid_objects)
+    {
+        Tracer full;
+        BinsonParserEngine<> engine(data.data(), data.size());
+        ASSERT_TRUE(engine.parse(full) == BINSON_ERROR_NONE);
+
+        Tracer t;
+        t.stop_after = full.trace.size() / 2 + 1;
+        ASSERT_TRUE(engine.parse(t) == BINSON_ERROR_NONE);
+        ASSERT_TRUE(full.trace.compare(0, t.trace.size(), t.trace) == 0);
+        ASSERT_TRUE(t.trace.size() >= t.stop_after);
+        ASSERT_TRUE(t.trace.size() < full.trace.size() || full.trace.size() <= 2);
+    }
+}
+
+TEST(engine_field_scan_matches_parser)
+{
+    for (const vector<uint8_t> &data : valid_objects)
+    {
+        Tracer all;
+        BinsonParserEngine<> engine(data.data(), data.size());
+        ASSERT_TRUE(engine.parse(all) == BINSON_ERROR_NONE);
+
+        vector<string> names = all.names;
+        names.push_back("");
+        names.push_back("\x7f\x7f\x7f");
+
+        for (const string &name : names)
+        {
+            binson_parser p;
+            ASSERT_TRUE(binson_parser_init(&p, data.data(), data.size()));
+            ASSERT_TRUE(binson_parser_go_into_object(&p));
+            bool expected = binson_parser_field_with_length(&p, name.data(), name.size());
+
+            Tracer value;
+            bool found;
+            ASSERT_TRUE(engine.scanField(name.data(), name.size(), value, found) == BINSON_ERROR_NONE);
+            ASSERT_TRUE(found == expected);
+            ASSERT_TRUE(found || value.trace.empty());
+            if (found)
+                ASSERT_TRUE(all.trace.find(name + ":" + value.trace) != string::npos);
+        }
+    }
+}
+
+TEST(engine_max_depth_policy)
+{
+    /* { "a": { "a": { } } } */
+    const uint8_t nested[] = { 0x40, 0x14, 0x01, 'a', 0x40, 0x14, 0x01, 'a', 0x40, 0x41, 0x41, 0x41 };
+
+    BinsonParserEngine<BinsonParserPolicy<true, false, 3, false> > three(nested, sizeof(nested));
+    ASSERT_TRUE(three.verify() == BINSON_ERROR_NONE);
+    BinsonParserEngine<BinsonParserPolicy<true, false, 2, false> > two(nested, sizeof(nested));
+    ASSERT_TRUE(two.verify() == BINSON_ERROR_MAX_DEPTH);
+
+    BinsonParserEngine<> none(nullptr, 0);
+    ASSERT_TRUE(none.verify() == BINSON_ERROR_NULL);
+}
+
+int main(void) {
+    RUN_TEST(engine_corpora_loaded);
+    RUN_TEST(engine_verify_matches_parser);
+    RUN_TEST(engine_events_match_visitor);
+    RUN_TEST(engine_stop);
+    RUN_TEST(engine_field_scan_matches_parser);
+    RUN_TEST(engine_max_depth_policy);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
+
+static vector<vector<uint8_t> > read_corpus(const char *name)
+{
+    vector<vector<uint8_t> > corpus;
+    string dir = string(BINSON_TEST_DATA) + "/" + name;
+    DIR *d = opendir(dir.c_str());
+
+    if (d == nullptr)
+        return corpus;
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != nullptr)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        FILE *f = fopen((dir + "/" + entry->d_name).c_str(), "rb");
+        if (f == nullptr)
+            continue;
+
+        vector<uint8_t> data;
+        uint8_t buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+            data.insert(data.end(), buf, buf + n);
+        fclose(f);
+        corpus.push_back(data);
+    }
+    closedir(d);
+
+    return corpus;
+}
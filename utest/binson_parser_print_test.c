@@ -11,6 +11,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <float.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "binson_defines.h"
@@ -70,21 +71,147 @@ TEST(print_binson)
     binson_parser p;
     binson_parser_init(&p, binson_bytes, sizeof(binson_bytes));
     ASSERT_TRUE(binson_parser_print(&p));
-    /* Expected:
-     * {"A":"B","B":{"A":"B"},"C":["A","A",{"A":"B","B":["A","A",{"A":"B"},[[[[{"A":"B"}]]]]]},"A"],"D":3.141593,"E":false,"F":127,"G":"0x0202"}
-     * Actual:
-     * {"A":"B","B":{"A":"B"},"C":["A","A",{"A":"B","B":["A","A",{"A":"B"},[[[[{"A":"B"}]]]]]},"A"],"D":3.141593,"E":false,"F":127,"G":"0x0202"}
-     */
+    const char *expected =
+        "{\"A\":\"B\",\"B\":{\"A\":\"B\"},\"C\":[\"A\",\"A\",{\"A\":\"B\",\"B\":"
+        "[\"A\",\"A\",{\"A\":\"B\"},[[[[{\"A\":\"B\"}]]]]]},\"A\"],"
+        "\"D\":3.141592653589793,\"E\":false,\"F\":127,\"G\":\"0x0202\"}";
     char buffer[512];
     size_t size = sizeof(buffer);
     ASSERT_TRUE(binson_parser_to_string(&p, buffer, &size, false));
     printf("%*.*s", 0, (int) size, buffer);
+    ASSERT_TRUE(size == strlen(expected));
+    ASSERT_TRUE(memcmp(buffer, expected, size) == 0);
+    ASSERT_TRUE(buffer[size] == '\0');
+}
+
+TEST(to_string_numbers)
+{
+    static const int64_t ints[] = {
+        0, -1, 9, 10, 99, 100, -12345, 1234567890123LL, INT64_MAX, INT64_MIN
+    };
+    static const double doubles[] = {
+        0.1, 2.0, -0.0, 1e300, 1.0 / 3.0, 5e-324, DBL_MAX, -123.456
+    };
+    uint8_t bin[256];
+    char text[512];
+    char expected[64];
+    size_t size = sizeof(text);
+    binson_writer w;
+    binson_parser p;
+    char *pos;
+    size_t i;
+
+    binson_writer_init(&w, bin, sizeof(bin));
+    binson_write_array_begin(&w);
+    for (i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) {
+        binson_write_integer(&w, ints[i]);
+    }
+    for (i = 0; i < sizeof(doubles) / sizeof(doubles[0]); i++) {
+        binson_write_double(&w, doubles[i]);
+    }
+    binson_write_array_end(&w);
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_NONE);
+
+    ASSERT_TRUE(binson_parser_init_array(&p, bin, binson_writer_get_counter(&w)));
+    ASSERT_TRUE(binson_parser_to_string(&p, text, &size, false));
+    ASSERT_TRUE(text[0] == '[');
+
+    /* Integers as printed by printf, doubles read back exactly. */
+    pos = &text[1];
+    for (i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) {
+        snprintf(expected, sizeof(expected), "%" PRId64 ",", ints[i]);
+        ASSERT_TRUE(strncmp(pos, expected, strlen(expected)) == 0);
+        pos += strlen(expected);
+    }
+    for (i = 0; i < sizeof(doubles) / sizeof(doubles[0]); i++) {
+        char *end;
+        double d = strtod(pos, &end);
+        ASSERT_TRUE(memcmp(&d, &doubles[i], sizeof(d)) == 0);
+        pos = end + 1;
+    }
+    ASSERT_TRUE(strstr(text, ",0.1,2.0,-0.0,1e+300,0.3333333333333333,") != NULL);
+    ASSERT_TRUE((size_t) (pos - text) == size);
+    ASSERT_TRUE(text[size - 1] == ']');
+}
+
+TEST(to_string_should_give_required_size)
+{
+    const uint8_t bytes[40] = { 0x00, 0x7f, 0x80, 0xff };
+    uint8_t bin[128];
+    char text[128];
+    char small[16];
+    size_t size = sizeof(text);
+    size_t required = sizeof(small);
+    binson_writer w;
+    binson_parser p;
+
+    binson_writer_init(&w, bin, sizeof(bin));
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "b");
+    binson_write_bytes(&w, bytes, sizeof(bytes));
+    binson_write_object_end(&w);
+
+    ASSERT_TRUE(binson_parser_init(&p, bin, binson_writer_get_counter(&w)));
+    ASSERT_TRUE(binson_parser_to_string(&p, text, &size, false));
+    ASSERT_TRUE(size == 5 + 3 + 2 * sizeof(bytes) + 2);
+    ASSERT_TRUE(memcmp(text, "{\"b\":\"0x007f80ff0000", 20) == 0);
+
+    ASSERT_FALSE(binson_parser_to_string(&p, small, &required, false));
+    ASSERT_TRUE(required == size);
+
+    /* Exactly the text, no room for the terminator. */
+    ASSERT_TRUE(binson_parser_to_string(&p, text, &required, false));
+    ASSERT_TRUE(required == size);
+}
+
+TEST(format_double_shortest)
+{
+    static const struct {
+        double value;
+        const char *text;
+    } cases[] = {
+        { 0.3, "0.3" }, { 100.0, "100.0" }, { -1e-300, "-1e-300" },
+        { 5e-324, "5e-324" }, { 1e-05, "1e-05" }, { 0.0001, "0.0001" },
+        { 1e15, "1e+15" }, { 123456789012345.0, "123456789012345.0" },
+        { 9007199254740992.0, "9007199254740992.0" },
+        { DBL_MAX, "1.7976931348623157e+308" }, { 1.0 / 0.0, "inf" },
+        { -1.0 / 0.0, "-inf" }
+    };
+    char out[BINSON_FORMAT_DOUBLE_SIZE];
+    uint64_t state = 88172645463325252ULL;
+    size_t i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        ASSERT_TRUE(binson_format_double(out, cases[i].value) == strlen(cases[i].text));
+        ASSERT_TRUE(strcmp(out, cases[i].text) == 0);
+    }
+
+    /* Random bit patterns read back exactly. */
+    for (i = 0; i < 100000; i++) {
+        double value;
+        double back;
+        char *end;
+
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        memcpy(&value, &state, sizeof(value));
+        if ((value != value) || (value - value != 0.0)) {
+            continue;
+        }
+        ASSERT_TRUE(binson_format_double(out, value) < BINSON_FORMAT_DOUBLE_SIZE);
+        back = strtod(out, &end);
+        ASSERT_TRUE((*end == '\0') && (memcmp(&back, &value, sizeof(back)) == 0));
+    }
 }
 
 /*======= Main function =====================================================*/
 
 int main(void) {
     RUN_TEST(print_binson);
+    RUN_TEST(to_string_numbers);
+    RUN_TEST(to_string_should_give_required_size);
+    RUN_TEST(format_double_shortest);
     PRINT_RESULT();
 }
 
@@ -0,0 +1,319 @@
+/**
+ * @file binson_parser_utf8_test.c
+ *
+ * UTF-8 validation of strings and field names with
+ * BINSON_PARSER_OPTION_VALIDATE_UTF8.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "binson_defines.h"
+#include "binson_parser.h"
+#include "binson_writer.h"
+#include "utest.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define MAX_STRING  (300U)
+
+/*======= Local function prototypes =========================================*/
+
+static size_t write_string(uint8_t *buffer,
+                           size_t size,
+                           const uint8_t *name,
+                           size_t name_size,
+                           const uint8_t *str,
+                           size_t str_size);
+static int parse_string(const uint8_t *str, size_t size);
+static bool reference_utf8(const uint8_t *data, size_t size);
+static size_t random_utf8(uint8_t *out, size_t max, uint32_t *seed);
+static uint32_t next_random(uint32_t *seed);
+
+/*======= Local variable declarations =======================================*/
+
+static uint8_t message[MAX_STRING + 64];
+
+/*======= Test cases ========================================================*/
+
+TEST(valid_strings_should_pass)
+{
+    static const char *strings[] = {
+        "",
+        "plain ascii",
+        "\xC2\x80 \xDF\xBF",                    /* U+0080, U+07FF */
+        "\xE0\xA0\x80 \xED\x9F\xBF \xEE\x80\x80 \xEF\xBF\xBF",
+        "\xF0\x90\x80\x80 \xF4\x8F\xBF\xBF",    /* U+10000, U+10FFFF */
+        "r\xC3\xA4ksm\xC3\xB6rg\xC3\xA5s \xE2\x82\xAC \xF0\x9F\x98\x80 "
+        "long enough to take the vectorized path",
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+        ASSERT_TRUE(parse_string((const uint8_t *) strings[i], strlen(strings[i])) == 1);
+    }
+}
+
+TEST(invalid_strings_should_fail)
+{
+    static const char *strings[] = {
+        "\x80",                 /* Lone continuation */
+        "\xC0\xAF",             /* Overlong '/' */
+        "\xC1\xBF",
+        "\xE0\x9F\xBF",         /* Overlong 3 byte */
+        "\xED\xA0\x80",         /* Surrogate U+D800 */
+        "\xED\xBF\xBF",
+        "\xF0\x8F\xBF\xBF",     /* Overlong 4 byte */
+        "\xF4\x90\x80\x80",     /* Above U+10FFFF */
+        "\xF5\x80\x80\x80",
+        "\xFF",
+        "\xC3",                 /* Truncated */
+        "\xE2\x82",
+        "\xF0\x9F\x98",
+        "\xC3\x41",             /* Missing continuation */
+        "\xE2\x82\xAC\xAC",     /* Extra continuation */
+    };
+    uint8_t str[MAX_STRING];
+    size_t i;
+    size_t offset;
+
+    for (i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+        size_t len = strlen(strings[i]);
+
+        /* Every position relative to the 32 byte blocks, up to the end. */
+        for (offset = 0; offset + len <= 100; offset++) {
+            memset(str, 'a', sizeof(str));
+            memcpy(&str[offset], strings[i], len);
+            ASSERT_TRUE(parse_string(str, offset + len) == 0);
+            ASSERT_TRUE(parse_string(str, 100) == 0);
+        }
+    }
+}
+
+TEST(random_strings_should_match_reference)
+{
+    uint8_t str[MAX_STRING];
+    uint32_t seed = 12345;
+    size_t valid = 0;
+    size_t i;
+
+    for (i = 0; i < 20000; i++) {
+        size_t size = random_utf8(str, 1 + (next_random(&seed) % MAX_STRING), &seed);
+        bool expected = reference_utf8(str, size);
+
+        ASSERT_TRUE(parse_string(str, size) == (expected ? 1 : 0));
+        valid += expected ? 1 : 0;
+    }
+
+    /* Both outcomes are covered. */
+    ASSERT_TRUE(valid > 1000);
+    ASSERT_TRUE(valid < 19000);
+}
+
+TEST(field_names_should_be_validated)
+{
+    const uint8_t bad_name[2] = { 'a', 0xC0 };
+    const uint8_t str[1] = { 'x' };
+    size_t size = write_string(message, sizeof(message), bad_name, sizeof(bad_name), str, 1);
+    binson_parser p;
+
+    ASSERT_TRUE(size > 0);
+    ASSERT_TRUE(binson_parser_init(&p, message, size));
+    ASSERT_TRUE(binson_parser_verify(&p));
+
+    p.options = BINSON_PARSER_OPTION_VALIDATE_UTF8;
+    ASSERT_FALSE(binson_parser_verify(&p));
+    ASSERT_TRUE(p.options == BINSON_PARSER_OPTION_VALIDATE_UTF8);
+
+    ASSERT_TRUE(binson_parser_go_into_object(&p));
+    ASSERT_FALSE(binson_parser_next(&p));
+    ASSERT_TRUE(p.error_flags == BINSON_ERROR_FORMAT);
+}
+
+TEST(option_off_should_accept_anything)
+{
+    const uint8_t str[3] = { 0xED, 0xA0, 0x80 };
+    size_t size = write_string(message, sizeof(message),
+                               (const uint8_t *) "s", 1, str, sizeof(str));
+    binson_parser p;
+
+    ASSERT_TRUE(binson_parser_init(&p, message, size));
+    ASSERT_TRUE(binson_parser_verify(&p));
+    ASSERT_TRUE(binson_parser_go_into_object(&p));
+    ASSERT_TRUE(binson_parser_field(&p, "s"));
+    ASSERT_TRUE(binson_parser_get_string_bbuf(&p)->bsize == sizeof(str));
+}
+
+/*======= Main function =====================================================*/
+
+int main(void) {
+    RUN_TEST(valid_strings_should_pass);
+    RUN_TEST(invalid_strings_should_fail);
+    RUN_TEST(random_strings_should_match_reference);
+    RUN_TEST(field_names_should_be_validated);
+    RUN_TEST(option_off_should_accept_anything);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
+
+static size_t write_string(uint8_t *buffer,
+                           size_t size,
+                           const uint8_t *name,
+                           size_t name_size,
+                           const uint8_t *str,
+                           size_t str_size)
+{
+    binson_writer w;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name_with_len(&w, (const char *) name, name_size);
+    binson_write_string_with_len(&w, (const char *) str, str_size);
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+/*
+ * Verifies and then reads { "s": str } with validation on. Returns 1 when
+ * the string is accepted, 0 when it is rejected with BINSON_ERROR_FORMAT
+ * and -1 when verify and the field lookup disagree.
+ */
+static int parse_string(const uint8_t *str, size_t size)
+{
+    size_t msg_size = write_string(message, sizeof(message),
+                                   (const uint8_t *) "s", 1, str, size);
+    binson_parser p;
+    bbuf *value;
+    bool verified;
+
+    if ((msg_size == 0) || !binson_parser_init(&p, message, msg_size)) {
+        return -1;
+    }
+
+    p.options = BINSON_PARSER_OPTION_VALIDATE_UTF8;
+    verified = binson_parser_verify(&p);
+
+    if (!binson_parser_go_into_object(&p) || !binson_parser_field(&p, "s")) {
+        return (!verified && (p.error_flags == BINSON_ERROR_FORMAT)) ? 0 : -1;
+    }
+
+    value = binson_parser_get_string_bbuf(&p);
+    return (verified && (value != NULL) && (value->bsize == size)) ? 1 : -1;
+}
+
+/* Decodes every code point and checks its range. */
+static bool reference_utf8(const uint8_t *data, size_t size)
+{
+    size_t i = 0;
+
+    while (i < size) {
+        uint32_t cp;
+        uint32_t min;
+        size_t length;
+        size_t k;
+
+        if (data[i] < 0x80U) {
+            i++;
+            continue;
+        }
+        else if ((data[i] & 0xE0U) == 0xC0U) {
+            length = 2;
+            min = 0x80U;
+            cp = data[i] & 0x1FU;
+        }
+        else if ((data[i] & 0xF0U) == 0xE0U) {
+            length = 3;
+            min = 0x800U;
+            cp = data[i] & 0x0FU;
+        }
+        else if ((data[i] & 0xF8U) == 0xF0U) {
+            length = 4;
+            min = 0x10000U;
+            cp = data[i] & 0x07U;
+        }
+        else {
+            return false;
+        }
+
+        if ((size - i) < length) {
+            return false;
+        }
+
+        for (k = 1; k < length; k++) {
+            if ((data[i + k] & 0xC0U) != 0x80U) {
+                return false;
+            }
+            cp = (cp << 6) | (data[i + k] & 0x3FU);
+        }
+
+        if ((cp < min) || (cp > 0x10FFFFU) || ((cp >= 0xD800U) && (cp <= 0xDFFFU))) {
+            return false;
+        }
+
+        i += length;
+    }
+
+    return true;
+}
+
+/*
+ * Mostly well formed text: ASCII runs and encoded code points from all
+ * ranges, with an occasional random byte.
+ */
+static size_t random_utf8(uint8_t *out, size_t max, uint32_t *seed)
+{
+    size_t size = 0;
+
+    while (size + 4 <= max) {
+        uint32_t r = next_random(seed);
+        uint32_t cp;
+
+        if ((r % 128U) == 0) {
+            out[size++] = (uint8_t) (next_random(seed) & 0xFFU);
+        }
+        else if ((r % 128U) < 64U) {
+            out[size++] = (uint8_t) (0x20U + (next_random(seed) % 0x5FU));
+        }
+        else {
+            /* Spread over the 1, 2, 3 and 4 byte encodings. */
+            cp = next_random(seed) % (0x80U << (5U * (r % 4U)));
+            cp = (cp > 0x10FFFFU) ? (cp & 0xFFFFU) : cp;
+            if (cp < 0x80U) {
+                out[size++] = (uint8_t) cp;
+            }
+            else if (cp < 0x800U) {
+                out[size++] = (uint8_t) (0xC0U | (cp >> 6));
+                out[size++] = (uint8_t) (0x80U | (cp & 0x3FU));
+            }
+            else if (cp < 0x10000U) {
+                out[size++] = (uint8_t) (0xE0U | (cp >> 12));
+                out[size++] = (uint8_t) (0x80U | ((cp >> 6) & 0x3FU));
+                out[size++] = (uint8_t) (0x80U | (cp & 0x3FU));
+            }
+            else {
+                out[size++] = (uint8_t) (0xF0U | (cp >> 18));
+                out[size++] = (uint8_t) (0x80U | ((cp >> 12) & 0x3FU));
+                out[size++] = (uint8_t) (0x80U | ((cp >> 6) & 0x3FU));
+                out[size++] = (uint8_t) (0x80U | (cp & 0x3FU));
+            }
+        }
+
+        /* Strings of valid runs are long; cut some short. */
+        if ((r & 0x3FU) == 0) {
+            break;
+        }
+    }
+
+    return size;
+}
+
+static uint32_t next_random(uint32_t *seed)
+{
+    *seed = *seed * 1103515245U + 12345U;
+    return *seed >> 8;
+}
@@ -0,0 +1,477 @@
+/**
+ * @file binson_record_test.c
+ *
+ * Writing and reading record files, random access and damaged files.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binson_defines.h"
+#include "binson_parser.h"
+#include "binson_writer.h"
+#include "binson_record.h"
+#include "utest.h"
+
+/*======= Local Macro Definitions ===========================================*/
+
+#define RECORDS     (1000U)
+#define BLOCK_SIZE  (256U)
+#define FILE_NAME   "binson_record_test.tmp"
+
+/*======= Type Definitions ==================================================*/
+
+typedef struct memory_sink_s {
+    uint8_t     data[128 * 1024];
+    size_t      size;
+    size_t      limit;
+} memory_sink;
+
+/*======= Local function prototypes =========================================*/
+
+static bool memory_write(void *context, const uint8_t *data, size_t size);
+static size_t build_record(uint8_t *buffer, size_t size, uint64_t n);
+static size_t build_nested(uint8_t *buffer, size_t size, uint64_t n);
+static size_t write_records(size_t count);
+static bool record_is(const bbuf *record, uint64_t n);
+
+/*======= Local variable declarations =======================================*/
+
+static memory_sink file;
+static uint8_t block[BLOCK_SIZE];
+static uint8_t large_block[16 * BLOCK_SIZE];
+
+/*======= Test cases ========================================================*/
+
+TEST(crc32c)
+{
+    const uint8_t check[] = "123456789";
+    uint8_t data[1000];
+    uint32_t crc;
+    size_t i;
+
+    ASSERT_TRUE(binson_record_crc32c(0, check, 9) == 0xE3069283U);
+    ASSERT_TRUE(binson_record_crc32c(0, check, 0) == 0);
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (i * 7 + 3);
+    }
+    crc = binson_record_crc32c(0, data, 3);
+    crc = binson_record_crc32c(crc, &data[3], 500);
+    crc = binson_record_crc32c(crc, &data[503], sizeof(data) - 503);
+    ASSERT_TRUE(crc == binson_record_crc32c(0, data, sizeof(data)));
+}
+
+TEST(write_and_scan_blocks)
+{
+    binson_record_file f;
+    binson_record_block b;
+    bbuf record;
+    uint64_t n = 0;
+    size_t i;
+
+    ASSERT_TRUE(write_records(RECORDS) > 0);
+    ASSERT_TRUE(binson_record_open_buffer(&f, file.data, file.size));
+    ASSERT_TRUE(f.record_count == RECORDS);
+    ASSERT_TRUE(f.block_count > 10);
+
+    for (i = 0; i < f.block_count; i++) {
+        ASSERT_TRUE(binson_record_block_open(&f, i, &b) == BINSON_ERROR_NONE);
+        ASSERT_TRUE(b.first_record == n);
+        while (binson_record_block_next(&b, &record)) {
+            ASSERT_TRUE(record_is(&record, n));
+            n++;
+        }
+    }
+    ASSERT_TRUE(n == RECORDS);
+    ASSERT_TRUE(binson_record_block_open(&f, f.block_count, &b) == BINSON_ERROR_RANGE);
+
+    binson_record_close(&f);
+}
+
+TEST(random_access)
+{
+    binson_record_file f;
+    bbuf record;
+    uint64_t n;
+
+    ASSERT_TRUE(write_records(RECORDS) > 0);
+    ASSERT_TRUE(binson_record_open_buffer(&f, file.data, file.size));
+
+    for (n = 0; n < RECORDS; n++) {
+        uint64_t k = (n * 617) % RECORDS;
+
+        ASSERT_TRUE(binson_record_get(&f, k, &record));
+        ASSERT_TRUE(record_is(&record, k));
+    }
+
+    ASSERT_TRUE(binson_record_find_block(&f, 0) == 0);
+    ASSERT_TRUE(binson_record_find_block(&f, RECORDS - 1) == f.block_count - 1);
+    ASSERT_TRUE(binson_record_find_block(&f, RECORDS) == f.block_count);
+    ASSERT_FALSE(binson_record_get(&f, RECORDS, &record));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_RANGE);
+
+    binson_record_close(&f);
+}
+
+TEST(large_records_and_files)
+{
+    static uint8_t large[4 * BLOCK_SIZE];
+    static const uint8_t bytes[3 * BLOCK_SIZE];
+    binson_record_writer w;
+    binson_record_file f;
+    binson_writer bw;
+    bbuf record;
+    FILE *out;
+
+    binson_writer_init(&bw, large, sizeof(large));
+    binson_write_object_begin(&bw);
+    binson_write_name(&bw, "data");
+    binson_write_bytes(&bw, bytes, sizeof(bytes));
+    binson_write_object_end(&bw);
+
+    out = fopen(FILE_NAME, "wb");
+    ASSERT_TRUE(out != NULL);
+    ASSERT_TRUE(binson_record_writer_init(&w, binson_record_file_sink, out, block, sizeof(block)));
+    ASSERT_TRUE(binson_record_write(&w, (const uint8_t *) "\x40\x41", 2));
+    ASSERT_TRUE(binson_record_write_writer(&w, &bw));
+    ASSERT_TRUE(binson_record_write(&w, (const uint8_t *) "\x42\x43", 2));
+    ASSERT_TRUE(binson_record_writer_finish(&w));
+    ASSERT_TRUE(fclose(out) == 0);
+
+    ASSERT_TRUE(binson_record_open(&f, FILE_NAME));
+    ASSERT_TRUE(f.record_count == 3);
+    ASSERT_TRUE(f.block_count == 3);
+    ASSERT_TRUE(binson_record_get(&f, 1, &record));
+    ASSERT_TRUE(record.bsize == binson_writer_get_counter(&bw));
+    ASSERT_TRUE(memcmp(record.bptr, large, record.bsize) == 0);
+    ASSERT_TRUE(binson_record_get(&f, 2, &record));
+    ASSERT_TRUE((record.bsize == 2) && (record.bptr[0] == 0x42));
+    binson_record_close(&f);
+    remove(FILE_NAME);
+
+    ASSERT_FALSE(binson_record_open(&f, FILE_NAME));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_NULL);
+
+    /* A file without records. */
+    file.size = 0;
+    file.limit = sizeof(file.data);
+    ASSERT_TRUE(binson_record_writer_init(&w, memory_write, &file, block, sizeof(block)));
+    ASSERT_TRUE(binson_record_writer_finish(&w));
+    ASSERT_TRUE(file.size == BINSON_RECORD_HEADER_SIZE + BINSON_RECORD_TRAILER_SIZE);
+    ASSERT_TRUE(binson_record_open_buffer(&f, file.data, file.size));
+    ASSERT_TRUE((f.record_count == 0) && (f.block_count == 0));
+    ASSERT_FALSE(binson_record_get(&f, 0, &record));
+    binson_record_close(&f);
+}
+
+TEST(damaged_files_should_fail)
+{
+    binson_record_file f;
+    binson_record_block b;
+    bbuf record;
+    size_t size = write_records(RECORDS);
+    size_t first_block_end;
+    size_t i;
+
+    ASSERT_TRUE(binson_record_open_buffer(&f, file.data, size));
+    ASSERT_TRUE(binson_record_block_open(&f, 1, &b) == BINSON_ERROR_NONE);
+    first_block_end = (size_t) (b.records - file.data) - BINSON_RECORD_BLOCK_HEADER;
+    binson_record_close(&f);
+
+    /* A flipped bit in the first block is found when it is read. */
+    file.data[first_block_end - 3] ^= 0x10U;
+    ASSERT_TRUE(binson_record_open_buffer(&f, file.data, size));
+    ASSERT_TRUE(binson_record_block_open(&f, 0, &b) == BINSON_ERROR_FORMAT);
+    ASSERT_FALSE(binson_record_get(&f, 0, &record));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_FORMAT);
+    ASSERT_TRUE(binson_record_get(&f, RECORDS - 1, &record));
+    ASSERT_TRUE(record_is(&record, RECORDS - 1));
+    binson_record_close(&f);
+    file.data[first_block_end - 3] ^= 0x10U;
+
+    /* Truncated files and damage to the index or trailer fail on open. */
+    for (i = 1; i < 64; i++) {
+        ASSERT_FALSE(binson_record_open_buffer(&f, file.data, size - i));
+        ASSERT_TRUE(f.error_flags == BINSON_ERROR_FORMAT);
+    }
+    for (i = size - BINSON_RECORD_TRAILER_SIZE - 40; i < size; i++) {
+        file.data[i] ^= 0x01U;
+        ASSERT_FALSE(binson_record_open_buffer(&f, file.data, size));
+        file.data[i] ^= 0x01U;
+    }
+    ASSERT_FALSE(binson_record_open_buffer(&f, file.data, 10));
+    file.data[0] = 'B';
+    ASSERT_FALSE(binson_record_open_buffer(&f, file.data, size));
+    ASSERT_FALSE(binson_record_open_buffer(&f, NULL, size));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_NULL);
+}
+
+TEST(dictionary_round_trip)
+{
+    static const uint8_t odd[] = {
+        0x40, 0x14, 0x01, 'a', 0x18, 0x02, 0x1C, 0x00, 0x41
+    };
+    binson_record_writer w;
+    binson_record_file f;
+    binson_record_block b;
+    uint8_t record[512];
+    uint8_t decoded[512];
+    size_t dictionary_blocks = 0;
+    size_t plain_size = 0;
+    bbuf stored;
+    bbuf out;
+    uint64_t n = 0;
+    size_t i;
+
+    for (i = 0; i < RECORDS; i++) {
+        plain_size += build_nested(record, sizeof(record), i);
+    }
+
+    file.size = 0;
+    file.limit = sizeof(file.data);
+    ASSERT_TRUE(binson_record_writer_init(&w, memory_write, &file, large_block, sizeof(large_block)));
+    ASSERT_TRUE(binson_record_writer_set_dictionary(&w));
+    for (i = 0; i < RECORDS; i++) {
+        ASSERT_TRUE(binson_record_write(&w, record, build_nested(record, sizeof(record), i)));
+        if (i == RECORDS / 2) {
+            /* Reference and name like bytes inside values are left alone. */
+            ASSERT_TRUE(binson_record_write(&w, odd, sizeof(odd)));
+        }
+    }
+    ASSERT_TRUE(binson_record_writer_finish(&w));
+    ASSERT_TRUE(binson_record_open_buffer(&f, file.data, file.size));
+    ASSERT_TRUE(f.record_count == RECORDS + 1);
+
+    for (i = 0; i < f.block_count; i++) {
+        ASSERT_TRUE(binson_record_block_open(&f, i, &b) == BINSON_ERROR_NONE);
+        dictionary_blocks += (b.flags & BINSON_RECORD_BLOCK_DICTIONARY) ? 1 : 0;
+        while (binson_record_block_next(&b, &stored)) {
+            size_t size;
+
+            ASSERT_TRUE(binson_record_decode(&b, &stored, decoded, sizeof(decoded), &out) ==
+                        BINSON_ERROR_NONE);
+            if (n == RECORDS / 2 + 1) {
+                ASSERT_TRUE((out.bsize == sizeof(odd)) && (memcmp(out.bptr, odd, sizeof(odd)) == 0));
+            }
+            else {
+                size = build_nested(record, sizeof(record), (n > RECORDS / 2) ? n - 1 : n);
+                ASSERT_TRUE((out.bsize == size) && (memcmp(out.bptr, record, size) == 0));
+            }
+            n++;
+        }
+    }
+    ASSERT_TRUE(n == RECORDS + 1);
+    ASSERT_TRUE(dictionary_blocks == f.block_count);
+    ASSERT_TRUE(file.size < plain_size * 2 / 3);
+
+    ASSERT_TRUE(binson_record_read(&f, 7, decoded, sizeof(decoded), &out));
+    ASSERT_TRUE(out.bptr == decoded);
+    ASSERT_TRUE(out.bsize == build_nested(record, sizeof(record), 7));
+    ASSERT_TRUE(memcmp(out.bptr, record, out.bsize) == 0);
+    ASSERT_FALSE(binson_record_read(&f, 7, decoded, 10, &out));
+    ASSERT_TRUE(f.error_flags == BINSON_ERROR_RANGE);
+    binson_record_close(&f);
+
+    /* Records without repeated names are stored as they are. */
+    file.size = 0;
+    ASSERT_TRUE(binson_record_writer_init(&w, memory_write, &file, block, sizeof(block)));
+    ASSERT_TRUE(binson_record_writer_set_dictionary(&w));
+    ASSERT_TRUE(binson_record_write(&w, odd, sizeof(odd)));
+    ASSERT_TRUE(binson_record_writer_finish(&w));
+    ASSERT_TRUE(binson_record_open_buffer(&f, file.data, file.size));
+    ASSERT_TRUE(binson_record_block_open(&f, 0, &b) == BINSON_ERROR_NONE);
+    ASSERT_TRUE((b.flags == 0) && (b.dictionary == NULL));
+    ASSERT_TRUE(binson_record_read(&f, 0, NULL, 0, &out));
+    ASSERT_TRUE((out.bsize == sizeof(odd)) && (out.bptr != NULL) && (out.bptr[6] == 0x1C));
+    binson_record_close(&f);
+
+    /* Plain blocks are read without copying. */
+    ASSERT_TRUE(write_records(RECORDS) > 0);
+    ASSERT_TRUE(binson_record_open_buffer(&f, file.data, file.size));
+    ASSERT_TRUE(binson_record_read(&f, 3, NULL, 0, &out));
+    ASSERT_TRUE(record_is(&out, 3));
+    binson_record_close(&f);
+}
+
+TEST(dictionary_skips_bad_blocks)
+{
+    static const uint8_t bad[] = { 0x40, 0x14, 0x01, 'a', 0x1C, 0x00, 0x41 };
+    binson_record_writer w;
+    binson_record_file f;
+    binson_record_block b;
+    uint8_t record[512];
+    uint8_t decoded[512];
+    bbuf stored;
+    bbuf out;
+    size_t i;
+
+    file.size = 0;
+    file.limit = sizeof(file.data);
+    ASSERT_TRUE(binson_record_writer_init(&w, memory_write, &file, large_block, sizeof(large_block)));
+    ASSERT_TRUE(binson_record_writer_set_dictionary(&w));
+    for (i = 0; i < 3; i++) {
+        ASSERT_TRUE(binson_record_write(&w, record, build_nested(record, sizeof(record), i)));
+    }
+    /* Not a token stream: the whole block is stored without dictionary. */
+    ASSERT_TRUE(binson_record_write(&w, bad, sizeof(bad)));
+    ASSERT_TRUE(binson_record_writer_finish(&w));
+
+    ASSERT_TRUE(binson_record_open_buffer(&f, file.data, file.size));
+    ASSERT_TRUE(binson_record_block_open(&f, 0, &b) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(b.dictionary == NULL);
+    for (i = 0; binson_record_block_next(&b, &stored); i++) {
+        ASSERT_TRUE(binson_record_decode(&b, &stored, decoded, sizeof(decoded), &out) ==
+                    BINSON_ERROR_NONE);
+        ASSERT_TRUE(out.bptr == stored.bptr);
+    }
+    ASSERT_TRUE(i == 4);
+    binson_record_close(&f);
+}
+
+TEST(writer_errors)
+{
+    binson_record_writer w;
+    binson_writer bw;
+    uint8_t small[8];
+
+    ASSERT_FALSE(binson_record_writer_init(&w, memory_write, &file, block, BINSON_RECORD_BLOCK_MINIMUM - 1));
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_RANGE);
+    ASSERT_FALSE(binson_record_writer_init(&w, NULL, &file, block, sizeof(block)));
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_NULL);
+
+    /* The sink fails after the header. */
+    file.size = 0;
+    file.limit = BINSON_RECORD_HEADER_SIZE;
+    ASSERT_TRUE(binson_record_writer_init(&w, memory_write, &file, block, sizeof(block)));
+    ASSERT_TRUE(binson_record_write(&w, (const uint8_t *) "\x40\x41", 2));
+    ASSERT_FALSE(binson_record_writer_finish(&w));
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_EOF);
+
+    /* A binson writer that ran out of room is not written. */
+    file.size = 0;
+    file.limit = sizeof(file.data);
+    binson_writer_init(&bw, small, sizeof(small));
+    binson_write_object_begin(&bw);
+    binson_write_name(&bw, "too long for the buffer");
+    binson_write_object_end(&bw);
+    ASSERT_TRUE(binson_record_writer_init(&w, memory_write, &file, block, sizeof(block)));
+    ASSERT_FALSE(binson_record_write_writer(&w, &bw));
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_RANGE);
+    ASSERT_FALSE(binson_record_write(&w, (const uint8_t *) "\x40\x41", 2));
+    ASSERT_FALSE(binson_record_writer_finish(&w));
+}
+
+/*======= Main function =====================================================*/
+
+int main(void) {
+    RUN_TEST(crc32c);
+    RUN_TEST(write_and_scan_blocks);
+    RUN_TEST(random_access);
+    RUN_TEST(large_records_and_files);
+    RUN_TEST(damaged_files_should_fail);
+    RUN_TEST(dictionary_round_trip);
+    RUN_TEST(dictionary_skips_bad_blocks);
+    RUN_TEST(writer_errors);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
+
+static bool memory_write(void *context, const uint8_t *data, size_t size)
+{
+    memory_sink *sink = (memory_sink *) context;
+
+    if (size > sink->limit - sink->size) {
+        return false;
+    }
+    memcpy(&sink->data[sink->size], data, size);
+    sink->size += size;
+
+    return true;
+}
+
+/* Record n: {"n": n, "pad": "xx..."} with a length varying with n. */
+static size_t build_record(uint8_t *buffer, size_t size, uint64_t n)
+{
+    char pad[64];
+    binson_writer w;
+
+    memset(pad, 'x', sizeof(pad));
+    pad[n % sizeof(pad)] = '\0';
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "n");
+    binson_write_integer(&w, (int64_t) n);
+    binson_write_name(&w, "pad");
+    binson_write_string(&w, pad);
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+/* Record n with nested objects and an array of objects, ~100 bytes of names. */
+static size_t build_nested(uint8_t *buffer, size_t size, uint64_t n)
+{
+    binson_writer w;
+    uint64_t i;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "device");
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "identifier");
+    binson_write_integer(&w, (int64_t) n);
+    binson_write_name(&w, "manufacturer");
+    binson_write_string(&w, (n & 1) ? "acme" : "device");
+    binson_write_object_end(&w);
+    binson_write_name(&w, "measurements");
+    binson_write_array_begin(&w);
+    for (i = 0; i < n % 4; i++) {
+        binson_write_object_begin(&w);
+        binson_write_name(&w, "temperature");
+        binson_write_double(&w, (double) i / 3.0);
+        binson_write_object_end(&w);
+    }
+    binson_write_array_end(&w);
+    binson_write_name(&w, "x");
+    binson_write_string(&w, "identifier");
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+static size_t write_records(size_t count)
+{
+    binson_record_writer w;
+    uint8_t record[128];
+    size_t i;
+
+    file.size = 0;
+    file.limit = sizeof(file.data);
+
+    if (!binson_record_writer_init(&w, memory_write, &file, block, sizeof(block))) {
+        return 0;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (!binson_record_write(&w, record, build_record(record, sizeof(record), i))) {
+            break;
+        }
+    }
+
+    return binson_record_writer_finish(&w) ? file.size : 0;
+}
+
+static bool record_is(const bbuf *record, uint64_t n)
+{
+    uint8_t expected[128];
+    size_t size = build_record(expected, sizeof(expected), n);
+
+    return (record->bsize == size) && (memcmp(record->bptr, expected, size) == 0);
+}
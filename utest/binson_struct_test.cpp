@@ -0,0 +1,203 @@
+/**
+ * @file binson_struct_test.cpp
+ *
+ * Description
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <binson_struct.hpp>
+#include <binson.hpp>
+#include "utest.h"
+#include <string>
+#include <vector>
+
+/*======= Local Macro Definitions ===========================================*/
+/*======= Type Definitions ==================================================*/
+
+struct Inner
+{
+    int32_t id;
+    std::string label;
+};
+BINSON_FIELDS(Inner, label, id)
+
+struct Outer
+{
+    bool flag;
+    int64_t count;
+    double ratio;
+    std::string name;
+    std::vector<uint8_t> blob;
+    std::vector<int64_t> values;
+    std::vector<Inner> items;
+    Inner inner;
+    BinsonOptional<std::string> note;
+    BinsonOptional<Inner> extra;
+    uint8_t small;
+    std::vector<std::vector<std::string>> matrix;
+};
+BINSON_FIELDS(Outer, flag, count, ratio, name, blob, values, items, inner,
+              note, extra, small, matrix)
+
+/*======= Local function prototypes =========================================*/
+/*======= Local variable declarations =======================================*/
+
+using namespace std;
+
+static Outer make_outer()
+{
+    Outer o;
+    o.flag = true;
+    o.count = -5000000000LL;
+    o.ratio = 0.25;
+    o.name = "outer";
+    o.blob = { 0x00, 0xFF };
+    o.values = { 1, -300, 70000 };
+    o.items = { Inner{ 1, "one" }, Inner{ 2, "two" } };
+    o.inner = Inner{ 3, "three" };
+    o.note = string("hello");
+    o.small = 200;
+    o.matrix = { { "a", "b" }, { } };
+    return o;
+}
+
+static Binson inner_binson(const Inner &i)
+{
+    Binson b;
+    b.put("id", i.id).put("label", i.label);
+    return b;
+}
+
+/* Same content built with the DOM, which sorts its fields. */
+static Binson make_binson(const Outer &o)
+{
+    vector<BinsonValue> values, items, row;
+    for (int64_t v : o.values)
+        values.push_back(v);
+    for (const Inner &i : o.items)
+        items.push_back(inner_binson(i));
+    vector<BinsonValue> matrix = { vector<BinsonValue>{ "a", "b" }, vector<BinsonValue>() };
+
+    Binson b;
+    b.put("flag", o.flag)
+     .put("count", o.count)
+     .put("ratio", o.ratio)
+     .put("name", o.name)
+     .put("blob", o.blob)
+     .put("values", values)
+     .put("items", items)
+     .put("inner", inner_binson(o.inner))
+     .put("note", o.note.value())
+     .put("small", static_cast<int64_t>(o.small))
+     .put("matrix", matrix);
+    return b;
+}
+
+/*======= Test cases ========================================================*/
+
+TEST(struct_serialize_matches_dom)
+{
+    Outer o = make_outer();
+    vector<uint8_t> data = binsonSerialize(o);
+    ASSERT_TRUE(data == make_binson(o).serialize());
+
+    /* Too small buffers report the required size. */
+    uint8_t small[16];
+    binson_writer w;
+    binson_writer_init(&w, small, sizeof(small));
+    ASSERT_FALSE(binsonSerialize(o, &w));
+    ASSERT_TRUE(binson_writer_get_counter(&w) == data.size());
+}
+
+TEST(struct_roundtrip)
+{
+    Outer o = make_outer();
+    vector<uint8_t> data = binsonSerialize(o);
+
+    Outer r;
+    r.extra = Inner{ 9, "stale" };
+    ASSERT_TRUE(binsonDeserialize(r, data) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(r.flag && r.count == o.count && r.ratio == o.ratio);
+    ASSERT_TRUE(r.name == o.name && r.blob == o.blob && r.values == o.values);
+    ASSERT_TRUE(r.items.size() == 2 && r.items[1].id == 2 && r.items[1].label == "two");
+    ASSERT_TRUE(r.inner.id == 3 && r.inner.label == "three");
+    ASSERT_TRUE(r.note.hasValue() && r.note.value() == "hello");
+    ASSERT_FALSE(r.extra.hasValue());
+    ASSERT_TRUE(r.small == 200);
+    ASSERT_TRUE(r.matrix == o.matrix);
+}
+
+TEST(struct_unknown_and_missing_fields)
+{
+    Inner i;
+
+    /* Unknown fields, including nested blocks, are skipped. */
+    Binson b = inner_binson(Inner{ 7, "seven" });
+    b.put("a", Binson().put("x", 1)).put("m", vector<BinsonValue>{ 1, 2 }).put("z", "zz");
+    ASSERT_TRUE(binsonDeserialize(i, b.serialize()) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(i.id == 7 && i.label == "seven");
+
+    /* Required fields must be present. */
+    Binson missing;
+    missing.put("label", "x");
+    ASSERT_TRUE(binsonDeserialize(i, missing.serialize()) == BINSON_ERROR_FORMAT);
+    missing.clear();
+    missing.put("id", 1);
+    ASSERT_TRUE(binsonDeserialize(i, missing.serialize()) == BINSON_ERROR_FORMAT);
+}
+
+TEST(struct_type_and_range_errors)
+{
+    Inner i;
+    Binson b;
+    b.put("id", "1").put("label", "x");
+    ASSERT_TRUE(binsonDeserialize(i, b.serialize()) == BINSON_ERROR_WRONG_TYPE);
+
+    b.put("id", static_cast<int64_t>(INT32_MAX) + 1);
+    ASSERT_TRUE(binsonDeserialize(i, b.serialize()) == BINSON_ERROR_RANGE);
+
+    Outer o = make_outer();
+    Binson ob = make_binson(o);
+    ob.put("small", 256);
+    ASSERT_TRUE(binsonDeserialize(o, ob.serialize()) == BINSON_ERROR_RANGE);
+    ob.put("small", -1);
+    ASSERT_TRUE(binsonDeserialize(o, ob.serialize()) == BINSON_ERROR_RANGE);
+}
+
+TEST(struct_bad_input)
+{
+    Outer o = make_outer();
+    vector<uint8_t> data = binsonSerialize(o);
+
+    ASSERT_TRUE(binsonDeserialize(o, nullptr, 0) == BINSON_ERROR_NULL);
+    ASSERT_TRUE(binsonDeserialize(o, data.data(), data.size() - 1) != BINSON_ERROR_NONE);
+
+    /* Corrupted input fails cleanly or decodes to something valid. */
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        vector<uint8_t> bad(data);
+        bad[i] ^= 0x5A;
+        Outer r;
+        binson_err err = binsonDeserialize(r, bad);
+        binson_parser p;
+        bool valid = binson_parser_init(&p, bad.data(), bad.size()) && binson_parser_verify(&p);
+        if (!valid)
+            ASSERT_TRUE(err != BINSON_ERROR_NONE);
+    }
+}
+
+int main(void) {
+    RUN_TEST(struct_serialize_matches_dom);
+    RUN_TEST(struct_roundtrip);
+    RUN_TEST(struct_unknown_and_missing_fields);
+    RUN_TEST(struct_type_and_range_errors);
+    RUN_TEST(struct_bad_input);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
@@ -0,0 +1,270 @@
+/**
+ * @file binson_tool_test.c
+ *
+ * Runs the binson command line tool on a file of concatenated messages.
+ * BINSON_TOOL is the path of the tool executable.
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "binson_defines.h"
+#include "binson_writer.h"
+#include "utest.h"
+
+/*======= Local Macro Definitions ===========================================*/
+/*======= Local function prototypes =========================================*/
+
+static size_t build_file(uint8_t *buffer, size_t size);
+static bool write_file(const uint8_t *data, size_t size);
+static int run(const char *arguments, char *out, size_t out_size);
+static int run_errors(const char *arguments, char *out, size_t out_size);
+static int run_redirected(const char *arguments, const char *redirect,
+                          char *out, size_t out_size);
+
+/*======= Local variable declarations =======================================*/
+
+static char path[] = "/tmp/binson_tool_test_XXXXXX";
+static uint8_t data[512];
+static size_t data_size;
+static char out[4096];
+
+/*======= Test cases ========================================================*/
+
+TEST(verify)
+{
+    char expected[64];
+
+    ASSERT_TRUE(write_file(data, data_size));
+    ASSERT_TRUE(run("verify", out, sizeof(out)) == 0);
+    snprintf(expected, sizeof(expected), "3 messages, %zu bytes OK\n", data_size);
+    ASSERT_TRUE(strcmp(out, expected) == 0);
+    ASSERT_TRUE(run("verify -u", out, sizeof(out)) == 0);
+
+    /* Truncated last message. */
+    ASSERT_TRUE(write_file(data, data_size - 1));
+    ASSERT_TRUE(run("verify", out, sizeof(out)) == 1);
+
+    ASSERT_TRUE(run("frobnicate", out, sizeof(out)) == 2);
+}
+
+TEST(verify_reports_bad_message)
+{
+    uint8_t bad[sizeof(data)];
+    size_t i;
+
+    /* Swap the names "a" and "b" of the first message. */
+    memcpy(bad, data, data_size);
+    for (i = 0; i + 2 < data_size; i++) {
+        if ((bad[i] == BINSON_DEF_STRINGLEN_INT8) && (bad[i + 1] == 1) && (bad[i + 2] == 'a')) {
+            bad[i + 2] = 'c';
+            break;
+        }
+    }
+
+    ASSERT_TRUE(write_file(bad, data_size));
+    ASSERT_TRUE(run_errors("verify", out, sizeof(out)) == 1);
+    ASSERT_TRUE(strcmp(out, "binson: message 0 at offset 0: format error\n") == 0);
+    ASSERT_TRUE(run("dump", out, sizeof(out)) == 1);
+}
+
+TEST(get_reports_bad_message)
+{
+    /* The integer 1 stored as INT16, which is not the shortest encoding. */
+    const uint8_t wide[] = { 0x40, 0x14, 0x01, 'a', 0x11, 0x01, 0x00, 0x41 };
+    uint8_t bad[sizeof(data)];
+
+    ASSERT_TRUE(write_file(wide, sizeof(wide)));
+    ASSERT_TRUE(run_errors("get a", out, sizeof(out)) == 1);
+    ASSERT_TRUE(strcmp(out, "binson: message 0 at offset 0: format error\n") == 0);
+    ASSERT_TRUE(run("get b", out, sizeof(out)) == 1);
+    ASSERT_TRUE(strcmp(out, "") == 0);
+
+    /* A missing name is only null when the rest of the message is valid. */
+    memcpy(bad, data, data_size);
+    bad[data_size - 1] = BINSON_DEF_OBJECT_BEGIN;
+    ASSERT_TRUE(write_file(bad, data_size));
+    ASSERT_TRUE(run_errors("get x", out, sizeof(out)) == 1);
+    ASSERT_TRUE(strncmp(out, "binson: message 2 at offset ", 28) == 0);
+}
+
+TEST(dump)
+{
+    ASSERT_TRUE(write_file(data, data_size));
+    ASSERT_TRUE(run("dump", out, sizeof(out)) == 0);
+    ASSERT_TRUE(strcmp(out,
+        "{\"a\":1,\"b\":{\"c\":\"x\\\"y\"}}\n"
+        "[1,2.5,true,\"0x0102\"]\n"
+        "{\"list\":[{\"k\":\"v\"},{\"k\":\"w\"}],\"n\":-5}\n") == 0);
+
+    ASSERT_TRUE(run("dump -b", out, sizeof(out)) == 0);
+    ASSERT_TRUE(strstr(out, "[1,2.5,true,\"AQI=\"]\n") != NULL);
+
+    ASSERT_TRUE(run("dump -p", out, sizeof(out)) == 0);
+    ASSERT_TRUE(strncmp(out, "{\n  \"a\": 1,\n", 12) == 0);
+}
+
+TEST(get)
+{
+    ASSERT_TRUE(write_file(data, data_size));
+
+    ASSERT_TRUE(run("get list.1.k", out, sizeof(out)) == 0);
+    ASSERT_TRUE(strcmp(out, "null\nnull\n\"w\"\n") == 0);
+
+    ASSERT_TRUE(run("get b", out, sizeof(out)) == 0);
+    ASSERT_TRUE(strcmp(out, "{\"c\":\"x\\\"y\"}\nnull\nnull\n") == 0);
+
+    ASSERT_TRUE(run("get 3", out, sizeof(out)) == 0);
+    ASSERT_TRUE(strcmp(out, "null\n\"0x0102\"\nnull\n") == 0);
+
+    ASSERT_TRUE(run("get ''", out, sizeof(out)) == 0);
+    ASSERT_TRUE(strncmp(out, "{\"a\":1,", 7) == 0);
+
+    ASSERT_TRUE(run("get a b", out, sizeof(out)) == 2);
+}
+
+TEST(stats_and_stdin)
+{
+    char command[128];
+
+    ASSERT_TRUE(write_file(data, data_size));
+    ASSERT_TRUE(run("stats", out, sizeof(out)) == 0);
+    ASSERT_TRUE(strstr(out, "messages      3\n") != NULL);
+    ASSERT_TRUE(strstr(out, "max depth     3\n") != NULL);
+    ASSERT_TRUE(strstr(out, "objects       5\n") != NULL);
+    ASSERT_TRUE(strstr(out, "integers      3\n") != NULL);
+
+    /* The same through a pipe, which cannot be mapped. */
+    snprintf(command, sizeof(command), "cat %s | %s verify -", path, BINSON_TOOL);
+    {
+        FILE *p = popen(command, "r");
+        size_t n;
+
+        ASSERT_TRUE(p != NULL);
+        n = fread(out, 1, sizeof(out) - 1, p);
+        out[n] = '\0';
+        ASSERT_TRUE(WEXITSTATUS(pclose(p)) == 0);
+        ASSERT_TRUE(strncmp(out, "3 messages", 10) == 0);
+    }
+
+    ASSERT_TRUE(run("bench -n 2", out, sizeof(out)) == 0);
+}
+
+/*======= Main function =====================================================*/
+
+int main(void) {
+    int fd = mkstemp(path);
+
+    if (fd < 0) {
+        return 1;
+    }
+    close(fd);
+
+    data_size = build_file(data, sizeof(data));
+
+    RUN_TEST(verify);
+    RUN_TEST(verify_reports_bad_message);
+    RUN_TEST(dump);
+    RUN_TEST(get);
+    RUN_TEST(get_reports_bad_message);
+    RUN_TEST(stats_and_stdin);
+
+    unlink(path);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
+
+/* Three messages: an object, an array and an object with nested arrays. */
+static size_t build_file(uint8_t *buffer, size_t size)
+{
+    const uint8_t bytes[2] = { 0x01, 0x02 };
+    binson_writer w;
+
+    binson_writer_init(&w, buffer, size);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "a");
+    binson_write_integer(&w, 1);
+    binson_write_name(&w, "b");
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "c");
+    binson_write_string(&w, "x\"y");
+    binson_write_object_end(&w);
+    binson_write_object_end(&w);
+
+    binson_write_array_begin(&w);
+    binson_write_integer(&w, 1);
+    binson_write_double(&w, 2.5);
+    binson_write_boolean(&w, true);
+    binson_write_bytes(&w, bytes, sizeof(bytes));
+    binson_write_array_end(&w);
+
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "list");
+    binson_write_array_begin(&w);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "k");
+    binson_write_string(&w, "v");
+    binson_write_object_end(&w);
+    binson_write_object_begin(&w);
+    binson_write_name(&w, "k");
+    binson_write_string(&w, "w");
+    binson_write_object_end(&w);
+    binson_write_array_end(&w);
+    binson_write_name(&w, "n");
+    binson_write_integer(&w, -5);
+    binson_write_object_end(&w);
+
+    return (w.error_flags == BINSON_ERROR_NONE) ? binson_writer_get_counter(&w) : 0;
+}
+
+static bool write_file(const uint8_t *buffer, size_t size)
+{
+    FILE *f = fopen(path, "wb");
+    bool ok;
+
+    if (NULL == f) {
+        return false;
+    }
+    ok = (fwrite(buffer, 1, size, f) == size);
+
+    return (fclose(f) == 0) && ok;
+}
+
+/* Runs the tool on the test file and returns its exit status. */
+static int run(const char *arguments, char *output, size_t output_size)
+{
+    return run_redirected(arguments, "2>/dev/null", output, output_size);
+}
+
+/* As run(), but captures the diagnostics instead of the output. */
+static int run_errors(const char *arguments, char *output, size_t output_size)
+{
+    return run_redirected(arguments, "2>&1 >/dev/null", output, output_size);
+}
+
+static int run_redirected(const char *arguments, const char *redirect,
+                          char *output, size_t output_size)
+{
+    char command[256];
+    FILE *p;
+    size_t n;
+
+    snprintf(command, sizeof(command), "%s %s %s %s", BINSON_TOOL, arguments, path, redirect);
+    p = popen(command, "r");
+    if (NULL == p) {
+        return -1;
+    }
+    n = fread(output, 1, output_size - 1, p);
+    output[n] = '\0';
+
+    return WEXITSTATUS(pclose(p));
+}
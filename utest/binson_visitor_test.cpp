@@ -0,0 +1,157 @@
+/**
+ * @file binson_visitor_test.cpp
+ *
+ * Description
+ *
+ */
+
+/*======= Includes ==========================================================*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <binson_visitor.hpp>
+#include "utest.h"
+#include <string>
+#include <vector>
+
+/*======= Local Macro Definitions ===========================================*/
+/*======= Local function prototypes =========================================*/
+/*======= Local variable declarations =======================================*/
+
+using namespace std;
+
+/* Same document as in binson_class_test.cpp */
+static const uint8_t binson_bytes[105] = "\x40\x14\x01\x41\x14\x01\x42\x14\x01\x42\x40\x14\x01\x41\x14\x01\x42\x41\x14\x01\x43\x42\x14\x01\x41\x14\x01\x41\x40\x14\x01\x41\x14\x01\x42\x14\x01\x42\x42\x14\x01\x41\x14\x01\x41\x40\x14\x01\x41\x14\x01\x42\x41\x42\x42\x42\x42\x40\x14\x01\x41\x14\x01\x42\x41\x43\x43\x43\x43\x43\x41\x14\x01\x41\x43\x14\x01\x44\x46\x18\x2d\x44\x54\xfb\x21\x09\x40\x14\x01\x45\x45\x14\x01\x46\x10\x7f\x14\x01\x47\x18\x02\x02\x02\x41";
+static const size_t binson_bytes_size = sizeof(binson_bytes) - 1;
+
+/* Re-encodes every event with the writer. */
+struct Copier : BinsonVisitor
+{
+    binson_writer w;
+    uint8_t buf[256];
+
+    Copier() { binson_writer_init(&w, buf, sizeof(buf)); }
+
+    BinsonVisit onObjectBegin() { binson_write_object_begin(&w); return BinsonVisit::Continue; }
+    BinsonVisit onObjectEnd() { binson_write_object_end(&w); return BinsonVisit::Continue; }
+    BinsonVisit onArrayBegin() { binson_write_array_begin(&w); return BinsonVisit::Continue; }
+    BinsonVisit onArrayEnd() { binson_write_array_end(&w); return BinsonVisit::Continue; }
+    BinsonVisit onField(const bbuf &name)
+    {
+        binson_write_name_with_len(&w, (const char *) name.bptr, name.bsize);
+        return BinsonVisit::Continue;
+    }
+    BinsonVisit onBool(bool v) { binson_write_boolean(&w, v); return BinsonVisit::Continue; }
+    BinsonVisit onInt(int64_t v) { binson_write_integer(&w, v); return BinsonVisit::Continue; }
+    BinsonVisit onDouble(double v) { binson_write_double(&w, v); return BinsonVisit::Continue; }
+    BinsonVisit onString(const bbuf &v)
+    {
+        binson_write_string_with_len(&w, (const char *) v.bptr, v.bsize);
+        return BinsonVisit::Continue;
+    }
+    BinsonVisit onBytes(const bbuf &v)
+    {
+        binson_write_bytes(&w, v.bptr, v.bsize);
+        return BinsonVisit::Continue;
+    }
+};
+
+/* Records a trace of events, skipping fields named in skip. */
+struct Tracer : BinsonVisitor
+{
+    string trace;
+    string skip;
+    string stop_at;
+    bool skip_arrays = false;
+
+    BinsonVisit onObjectBegin() { trace += "{"; return BinsonVisit::Continue; }
+    BinsonVisit onObjectEnd() { trace += "}"; return BinsonVisit::Continue; }
+    BinsonVisit onArrayBegin()
+    {
+        trace += "[";
+        return skip_arrays ? BinsonVisit::Skip : BinsonVisit::Continue;
+    }
+    BinsonVisit onArrayEnd() { trace += "]"; return BinsonVisit::Continue; }
+    BinsonVisit onField(const bbuf &name)
+    {
+        string n((const char *) name.bptr, name.bsize);
+        trace += n + ":";
+        if (n == stop_at)
+            return BinsonVisit::Stop;
+        return (n == skip) ? BinsonVisit::Skip : BinsonVisit::Continue;
+    }
+    BinsonVisit onBool(bool v) { trace += v ? "t," : "f,"; return BinsonVisit::Continue; }
+    BinsonVisit onInt(int64_t v) { trace += to_string(v) + ","; return BinsonVisit::Continue; }
+    BinsonVisit onDouble(double) { trace += "d,"; return BinsonVisit::Continue; }
+    BinsonVisit onString(const bbuf &v)
+    {
+        trace += string((const char *) v.bptr, v.bsize) + ",";
+        return BinsonVisit::Continue;
+    }
+    BinsonVisit onBytes(const bbuf &) { trace += "b,"; return BinsonVisit::Continue; }
+};
+
+/*======= Test cases ========================================================*/
+
+TEST(visitor_copy)
+{
+    Copier c;
+    ASSERT_TRUE(binsonVisit(binson_bytes, binson_bytes_size, c) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(binson_writer_get_counter(&c.w) == binson_bytes_size);
+    ASSERT_TRUE(memcmp(c.buf, binson_bytes, binson_bytes_size) == 0);
+
+    /* The default visitor walks the whole object. */
+    BinsonVisitor v;
+    ASSERT_TRUE(binsonVisit(binson_bytes, binson_bytes_size, v) == BINSON_ERROR_NONE);
+}
+
+TEST(visitor_skip)
+{
+    Tracer t;
+    t.skip = "C";
+    ASSERT_TRUE(binsonVisit(binson_bytes, binson_bytes_size, t) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(t.trace == "{A:B,B:{A:B,}C:D:d,E:f,F:127,G:b,}");
+
+    Tracer a;
+    a.skip_arrays = true;
+    ASSERT_TRUE(binsonVisit(binson_bytes, binson_bytes_size, a) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(a.trace == "{A:B,B:{A:B,}C:[D:d,E:f,F:127,G:b,}");
+}
+
+TEST(visitor_stop)
+{
+    Tracer t;
+    t.stop_at = "D";
+    ASSERT_TRUE(binsonVisit(binson_bytes, binson_bytes_size, t) == BINSON_ERROR_NONE);
+    ASSERT_TRUE(t.trace.substr(t.trace.size() - 2) == "D:");
+    ASSERT_TRUE(t.trace.find("E:") == string::npos);
+}
+
+TEST(visitor_errors)
+{
+    BinsonVisitor v;
+    ASSERT_TRUE(binsonVisit(nullptr, 0, v) == BINSON_ERROR_NULL);
+    ASSERT_TRUE(binsonVisit((binson_parser *) nullptr, v) == BINSON_ERROR_NULL);
+    ASSERT_TRUE(binsonVisit(binson_bytes, binson_bytes_size - 1, v) != BINSON_ERROR_NONE);
+
+    /* Errors match a full verify for corrupted input. */
+    for (size_t i = 0; i < binson_bytes_size; i++)
+    {
+        vector<uint8_t> bad(binson_bytes, binson_bytes + binson_bytes_size);
+        bad[i] ^= 0x21;
+        binson_parser p;
+        bool valid = binson_parser_init(&p, bad.data(), bad.size()) && binson_parser_verify(&p);
+        ASSERT_TRUE((binsonVisit(bad.data(), bad.size(), v) == BINSON_ERROR_NONE) == valid);
+    }
+}
+
+int main(void) {
+    RUN_TEST(visitor_copy);
+    RUN_TEST(visitor_skip);
+    RUN_TEST(visitor_stop);
+    RUN_TEST(visitor_errors);
+    PRINT_RESULT();
+}
+
+/*======= Local function implementations ====================================*/
@@ -18,8 +18,18 @@
 #include "utest.h"
 
 /*======= Local Macro Definitions ===========================================*/
+
+#define ARRAY_VALUES    (601U)
+
 /*======= Local function prototypes =========================================*/
+
+static void fill_int64(int64_t *values, size_t count);
+
 /*======= Local variable declarations =======================================*/
+
+static uint8_t bulk[ARRAY_VALUES * 9 + 2];
+static uint8_t single[ARRAY_VALUES * 9 + 2];
+
 /*======= Test cases ========================================================*/
 
 TEST(valid_init)
@@ -148,6 +158,96 @@ TEST(write_string)
     ASSERT_TRUE(binson_parser_leave_object(&p));
 }
 
+TEST(write_int64_array)
+{
+    int64_t values[ARRAY_VALUES];
+    binson_writer wb;
+    binson_writer ws;
+    size_t count;
+    size_t i;
+
+    fill_int64(values, ARRAY_VALUES);
+
+    /* Counts around the vector width and the classification block. */
+    for (count = 0; count <= ARRAY_VALUES; count += (count < 9) ? 1 : 37) {
+        ASSERT_TRUE(binson_writer_init(&wb, bulk, sizeof(bulk)));
+        ASSERT_TRUE(binson_write_int64_array(&wb, values, count));
+
+        ASSERT_TRUE(binson_writer_init(&ws, single, sizeof(single)));
+        ASSERT_TRUE(binson_write_array_begin(&ws));
+        for (i = 0; i < count; i++) {
+            ASSERT_TRUE(binson_write_integer(&ws, values[i]));
+        }
+        ASSERT_TRUE(binson_write_array_end(&ws));
+
+        ASSERT_TRUE(binson_writer_get_counter(&wb) == binson_writer_get_counter(&ws));
+        ASSERT_TRUE(memcmp(bulk, single, binson_writer_get_counter(&ws)) == 0);
+    }
+}
+
+TEST(write_double_array)
+{
+    const double values[5] = { 0.0, -1.5, DBL_MAX, DBL_MIN, 1e-300 };
+    binson_writer wb;
+    binson_writer ws;
+    size_t i;
+
+    ASSERT_TRUE(binson_writer_init(&wb, bulk, sizeof(bulk)));
+    ASSERT_TRUE(binson_write_object_begin(&wb));
+    ASSERT_TRUE(binson_write_name(&wb, "d"));
+    ASSERT_TRUE(binson_write_double_array(&wb, values, 5));
+    ASSERT_TRUE(binson_write_object_end(&wb));
+
+    ASSERT_TRUE(binson_writer_init(&ws, single, sizeof(single)));
+    ASSERT_TRUE(binson_write_object_begin(&ws));
+    ASSERT_TRUE(binson_write_name(&ws, "d"));
+    ASSERT_TRUE(binson_write_array_begin(&ws));
+    for (i = 0; i < 5; i++) {
+        ASSERT_TRUE(binson_write_double(&ws, values[i]));
+    }
+    ASSERT_TRUE(binson_write_array_end(&ws));
+    ASSERT_TRUE(binson_write_object_end(&ws));
+
+    ASSERT_TRUE(binson_writer_get_counter(&wb) == binson_writer_get_counter(&ws));
+    ASSERT_TRUE(memcmp(bulk, single, binson_writer_get_counter(&ws)) == 0);
+    ASSERT_TRUE(binson_writer_verify(&wb));
+}
+
+TEST(write_array_should_give_required_size)
+{
+    int64_t values[64];
+    uint8_t buffer[16];
+    binson_writer w;
+
+    fill_int64(values, 64);
+    memset(buffer, 0xAA, sizeof(buffer));
+
+    /* Nothing is written when the array does not fit. */
+    ASSERT_TRUE(binson_writer_init(&w, buffer, sizeof(buffer)));
+    ASSERT_TRUE(binson_write_object_begin(&w));
+    ASSERT_FALSE(binson_write_int64_array(&w, values, 64));
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_RANGE);
+    ASSERT_TRUE(buffer[1] == 0xAA);
+
+    ASSERT_TRUE(binson_writer_init(&w, bulk, sizeof(bulk)));
+    ASSERT_TRUE(binson_write_object_begin(&w));
+    ASSERT_TRUE(binson_write_int64_array(&w, values, 64));
+    size_t required = binson_writer_get_counter(&w);
+
+    ASSERT_TRUE(binson_writer_init(&w, buffer, sizeof(buffer)));
+    ASSERT_TRUE(binson_write_object_begin(&w));
+    ASSERT_FALSE(binson_write_int64_array(&w, values, 64));
+    ASSERT_TRUE(binson_writer_get_counter(&w) == required);
+
+    ASSERT_TRUE(binson_writer_init(&w, buffer, sizeof(buffer)));
+    ASSERT_FALSE(binson_write_double_array(&w, NULL, 2));
+    ASSERT_TRUE(w.error_flags == BINSON_ERROR_NULL);
+    ASSERT_TRUE(binson_writer_init(&w, buffer, sizeof(buffer)));
+    ASSERT_FALSE(binson_write_double_array(&w, (const double *) values, 2));
+    ASSERT_TRUE(binson_writer_get_counter(&w) == 2 + 2 * 9);
+    ASSERT_FALSE(binson_write_int64_array(NULL, values, 1));
+}
+
 /*======= Main function =====================================================*/
 
 int main(void) {
@@ -157,8 +257,31 @@ int main(void) {
     RUN_TEST(error_should_be_reported);
     RUN_TEST(writer_should_give_required_size);
     RUN_TEST(write_string);
+    RUN_TEST(write_int64_array);
+    RUN_TEST(write_double_array);
+    RUN_TEST(write_array_should_give_required_size);
     PRINT_RESULT();
 }
 
 /*======= Local function implementations ====================================*/
 
+/* Values on both sides of every width boundary, mixed with small ones. */
+static void fill_int64(int64_t *values, size_t count)
+{
+    static const int64_t edges[] = {
+        0, 1, -1, INT8_MAX, INT8_MIN, INT8_MAX + 1, INT8_MIN - 1,
+        INT16_MAX, INT16_MIN, INT16_MAX + 1, INT16_MIN - 1,
+        INT32_MAX, INT32_MIN, (int64_t) INT32_MAX + 1, (int64_t) INT32_MIN - 1,
+        INT64_MAX, INT64_MIN
+    };
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if ((i % 3) == 0) {
+            values[i] = (int64_t) i - 40;
+        }
+        else {
+            values[i] = edges[(i * 7) % (sizeof(edges) / sizeof(edges[0]))];
+        }
+    }
+}